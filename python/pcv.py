@@ -0,0 +1,295 @@
+"""Python bindings to the point cloud viewer core.
+
+Wraps the C API in src/pcv.h through ctypes, so nothing has to be compiled
+for Python itself; only the shared library (libpcv.so) built with the rest of
+the project is needed. Point arrays are NumPy views of the core's memory and
+arrays handed to the core are used in place, nothing is copied either way.
+Views keep that memory alive: a cloud removed or a context closed while views
+of its arrays exist is only released in the core once the last view is gone.
+The library is looked up in $PCV_LIBRARY first, then next to this file and in
+the usual build directories.
+
+    import pcv
+    ctx = pcv.Context()
+    cloud = ctx.load("res/dragon_high_res.obj")[0]
+    cloud.positions            # (n, 3) float32 view of the loaded points
+    cloud.cluster(0.002)       # labels the points in place
+    cloud.labels               # (n,) uint32 view of the labels
+"""
+
+import ctypes
+import itertools
+import os
+
+import numpy as np
+
+__all__ = ["Context", "Cloud", "PcvError", "NO_POINT"]
+
+NO_POINT = 0xFFFFFFFF
+
+_STATUS_OK = 0
+_MAX_SHAPES = 4096
+
+_RELEASE_FN = ctypes.CFUNCTYPE(None, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p)
+_FLOAT_P = ctypes.POINTER(ctypes.c_float)
+_UINT32_P = ctypes.POINTER(ctypes.c_uint32)
+_SIZE_P = ctypes.POINTER(ctypes.c_size_t)
+
+
+class PcvError(RuntimeError):
+    pass
+
+
+def _find_library():
+    names = ["libpcv.so", "libpcv.dylib", "pcv.dll"]
+    if os.environ.get("PCV_LIBRARY"):
+        return os.environ["PCV_LIBRARY"]
+    here = os.path.dirname(os.path.abspath(__file__))
+    for directory in [here, os.path.join(here, "..", "build"), os.path.join(here, "..", "_build")]:
+        for name in names:
+            path = os.path.join(directory, name)
+            if os.path.exists(path):
+                return path
+    return names[0]
+
+
+def _load_library():
+    lib = ctypes.CDLL(_find_library())
+    context_p = ctypes.c_void_p
+    signatures = {
+        "pcv_create": (context_p, []),
+        "pcv_destroy": (None, [context_p]),
+        "pcv_status_string": (ctypes.c_char_p, [ctypes.c_int]),
+        "pcv_set_threads": (None, [ctypes.c_uint]),
+        "pcv_add_cloud": (ctypes.c_int, [context_p, _FLOAT_P, _FLOAT_P, ctypes.c_size_t, _RELEASE_FN,
+                                         ctypes.c_void_p, _UINT32_P]),
+        "pcv_load_obj": (ctypes.c_int, [context_p, ctypes.c_char_p, _UINT32_P, ctypes.c_size_t, _SIZE_P]),
+        "pcv_set_dataset_cache": (ctypes.c_int, [context_p, ctypes.c_char_p, ctypes.c_uint64]),
+        "pcv_remove_cloud": (ctypes.c_int, [context_p, ctypes.c_uint32]),
+        "pcv_cloud_size": (ctypes.c_size_t, [context_p, ctypes.c_uint32]),
+        "pcv_cloud_positions": (ctypes.c_void_p, [context_p, ctypes.c_uint32]),
+        "pcv_cloud_normals": (ctypes.c_void_p, [context_p, ctypes.c_uint32]),
+        "pcv_cloud_labels": (ctypes.c_void_p, [context_p, ctypes.c_uint32]),
+        "pcv_cluster": (ctypes.c_int, [context_p, ctypes.c_uint32, ctypes.c_float, ctypes.c_size_t, ctypes.c_size_t,
+                                       _UINT32_P, _SIZE_P]),
+        "pcv_classify_ground": (ctypes.c_int, [context_p, ctypes.c_uint32, ctypes.c_int, ctypes.c_float,
+                                               _UINT32_P, _SIZE_P]),
+        "pcv_register": (ctypes.c_int, [context_p, ctypes.c_uint32, ctypes.c_uint32, _FLOAT_P, _FLOAT_P]),
+        "pcv_nearest_k": (ctypes.c_int, [context_p, ctypes.c_uint32, _FLOAT_P, ctypes.c_size_t, ctypes.c_size_t,
+                                         _UINT32_P, _FLOAT_P]),
+    }
+    for name, (restype, argtypes) in signatures.items():
+        function = getattr(lib, name)
+        function.restype = restype
+        function.argtypes = argtypes
+    return lib
+
+
+_lib = _load_library()
+
+# Host arrays stay referenced here until the core releases them
+_held = {}
+_keys = itertools.count(1)
+
+
+@_RELEASE_FN
+def _release(user, positions, normals):
+    _held.pop(user, None)
+
+
+def _check(status):
+    if status != _STATUS_OK:
+        raise PcvError(_lib.pcv_status_string(status).decode())
+
+
+class _ContextLifetime(object):
+    """Owns a core context, destroyed once the Context and every cloud lifetime let go of it."""
+
+    def __init__(self):
+        self.handle = _lib.pcv_create()
+        self.closed = False
+
+    def __del__(self):
+        if self.handle and _lib is not None:
+            _lib.pcv_destroy(self.handle)
+            self.handle = None
+
+
+class _CloudLifetime(object):
+    """Referenced by a Cloud and by every view of its arrays.
+
+    A removed cloud is only removed from the core when the last of them is
+    gone, and it keeps the context alive until then.
+    """
+
+    def __init__(self, context, cloud):
+        self.context = context
+        self.id = cloud
+        self.removed = False
+
+    def __del__(self):
+        if self.removed and self.context.handle and _lib is not None:
+            _lib.pcv_remove_cloud(self.context.handle, self.id)
+
+
+def _view(address, ctype, shape, owner, writeable=False):
+    """NumPy view of core memory that keeps "owner" alive while it exists."""
+    count = int(np.prod(shape))
+    if not address or count == 0:
+        return np.zeros(shape, dtype=ctype)
+    buffer = (ctypes.c_byte * (count * np.dtype(ctype).itemsize)).from_address(address)
+    buffer._pcv_owner = owner
+    view = np.frombuffer(buffer, dtype=ctype).reshape(shape)
+    view.flags.writeable = writeable
+    return view
+
+
+def set_threads(threads):
+    """Max worker threads of the processing stages, 0 for all."""
+    _lib.pcv_set_threads(threads)
+
+
+class Context(object):
+    """Set of clouds, removed and released together when it is closed."""
+
+    def __init__(self):
+        self._lifetime = _ContextLifetime()
+
+    @property
+    def _handle(self):
+        if self._lifetime is None:
+            raise PcvError("context is closed")
+        return self._lifetime.handle
+
+    def close(self):
+        """Releases every cloud once no view of its arrays is left, the clouds can't be used after."""
+        if self._lifetime is not None:
+            self._lifetime.closed = True
+            self._lifetime = None
+
+    def __del__(self):
+        self.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def use_cache(self, directory="", max_bytes=0):
+        """Loads through the decoded dataset cache shared between processes.
+
+        Clouds loaded afterwards are views of a read-only mapping shared with
+        every other process that loaded the same file. None turns it off, ""
+        uses the default directory.
+        """
+        path = os.fsencode(directory) if directory is not None else None
+        _check(_lib.pcv_set_dataset_cache(self._handle, path, max_bytes))
+
+    def load(self, filename):
+        """Loads every shape of an OBJ file with the viewer's loader."""
+        ids = (ctypes.c_uint32 * _MAX_SHAPES)()
+        loaded = ctypes.c_size_t()
+        _check(_lib.pcv_load_obj(self._handle, os.fsencode(filename), ids, _MAX_SHAPES, ctypes.byref(loaded)))
+        return [Cloud(self._lifetime, ids[i]) for i in range(min(loaded.value, _MAX_SHAPES))]
+
+    def add(self, positions, normals=None):
+        """Registers (n, 3) float32 arrays with the core without copying them.
+
+        Arrays of another type or layout are converted first, the converted
+        array is then the one shared.
+        """
+        positions = np.ascontiguousarray(positions, dtype=np.float32).reshape(-1, 3)
+        if normals is not None:
+            normals = np.ascontiguousarray(normals, dtype=np.float32).reshape(-1, 3)
+            if normals.shape != positions.shape:
+                raise ValueError("normals must match positions")
+
+        key = next(_keys)
+        _held[key] = (positions, normals)
+        cloud = ctypes.c_uint32()
+        status = _lib.pcv_add_cloud(self._handle, positions.ctypes.data_as(_FLOAT_P),
+                                    normals.ctypes.data_as(_FLOAT_P) if normals is not None else None,
+                                    positions.shape[0], _release, key, ctypes.byref(cloud))
+        if status != _STATUS_OK:
+            _held.pop(key, None)
+            _check(status)
+        return Cloud(self._lifetime, cloud.value)
+
+
+class Cloud(object):
+    """One cloud of a context, its arrays are views of the core's memory."""
+
+    def __init__(self, context, cloud):
+        self._lifetime = _CloudLifetime(context, cloud)
+        self._id = cloud
+
+    @property
+    def _handle(self):
+        if self._lifetime is None:
+            raise PcvError("cloud was removed")
+        if self._lifetime.context.closed:
+            raise PcvError("context is closed")
+        return self._lifetime.context.handle
+
+    def __len__(self):
+        return _lib.pcv_cloud_size(self._handle, self._id)
+
+    @property
+    def positions(self):
+        return _view(_lib.pcv_cloud_positions(self._handle, self._id), np.float32, (len(self), 3), self._lifetime)
+
+    @property
+    def normals(self):
+        """None if the cloud has no normals."""
+        address = _lib.pcv_cloud_normals(self._handle, self._id)
+        return _view(address, np.float32, (len(self), 3), self._lifetime) if address else None
+
+    @property
+    def labels(self):
+        """Writable per point labels, written by cluster() and classify_ground()."""
+        return _view(_lib.pcv_cloud_labels(self._handle, self._id), np.uint32, (len(self),), self._lifetime, True)
+
+    def remove(self):
+        """Releases the cloud once no view of its arrays is left, the cloud can't be used after."""
+        if self._lifetime is None:
+            raise PcvError("cloud was removed")
+        self._lifetime.removed = True
+        self._lifetime = None
+
+    def cluster(self, epsilon, min_points=4, min_cluster_size=10):
+        """DBSCAN clustering into labels, returns the amount of clusters."""
+        clusters = ctypes.c_size_t()
+        labels = self.labels
+        _check(_lib.pcv_cluster(self._handle, self._id, epsilon, min_points, min_cluster_size,
+                                labels.ctypes.data_as(_UINT32_P), ctypes.byref(clusters)))
+        return clusters.value
+
+    def classify_ground(self, up_axis=1, cell_size=0.0):
+        """Ground filter into labels (2 ground, 1 other), returns the ground point count."""
+        ground = ctypes.c_size_t()
+        labels = self.labels
+        _check(_lib.pcv_classify_ground(self._handle, self._id, up_axis, cell_size,
+                                        labels.ctypes.data_as(_UINT32_P), ctypes.byref(ground)))
+        return ground.value
+
+    def register(self, target, transform=None):
+        """Point to plane ICP onto "target", returns the 4x4 transform and residual."""
+        matrix = np.eye(4, dtype=np.float32) if transform is None else np.array(transform, dtype=np.float32)
+        # The core takes column major matrices
+        column_major = np.ascontiguousarray(matrix.T)
+        residual = ctypes.c_float()
+        if target._handle != self._handle:
+            raise ValueError("target must belong to the same context")
+        _check(_lib.pcv_register(self._handle, self._id, target._id, column_major.ctypes.data_as(_FLOAT_P),
+                                 ctypes.byref(residual)))
+        return column_major.T.copy(), residual.value
+
+    def nearest_k(self, queries, k):
+        """Indices and squared distances of the k nearest points of every query."""
+        queries = np.ascontiguousarray(queries, dtype=np.float32).reshape(-1, 3)
+        indices = np.empty((queries.shape[0], k), dtype=np.uint32)
+        dist_sq = np.empty((queries.shape[0], k), dtype=np.float32)
+        _check(_lib.pcv_nearest_k(self._handle, self._id, queries.ctypes.data_as(_FLOAT_P), queries.shape[0],
+                                  k, indices.ctypes.data_as(_UINT32_P), dist_sq.ctypes.data_as(_FLOAT_P)))
+        return indices, dist_sq
@@ -0,0 +1,446 @@
+#include "async_file.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+
+#ifdef __linux__
+// Kernel headers before 5.1 have no io_uring, reads then go through threads
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define ASYNC_FILE_URING_HEADER 1
+#endif
+#endif
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define fseeko _fseeki64
+#define ftello _ftelli64
+#endif
+
+#define ASYNC_FILE_THREADS 4
+
+#if defined(ASYNC_FILE_URING_HEADER) && defined(__NR_io_uring_setup)
+#define ASYNC_FILE_URING 1
+#endif
+
+#ifdef ASYNC_FILE_URING
+
+/**
+* The mapped submission and completion queues, driven with the raw system
+* calls so there is no liburing dependency.
+*/
+struct AsyncFile::Ring {
+	int fd = -1;
+	unsigned entries = 0;
+	void *sqMap = MAP_FAILED;
+	size_t sqMapBytes = 0;
+	void *cqMap = MAP_FAILED;
+	size_t cqMapBytes = 0;
+	struct io_uring_sqe *sqes = (struct io_uring_sqe *)MAP_FAILED;
+	size_t sqeBytes = 0;
+	unsigned *sqTail = NULL;
+	unsigned *sqMask = NULL;
+	unsigned *sqArray = NULL;
+	unsigned *cqHead = NULL;
+	unsigned *cqTail = NULL;
+	unsigned *cqMask = NULL;
+	struct io_uring_cqe *cqes = NULL;
+	std::vector<struct iovec> iovecs; // One per slot, READV works on every io_uring kernel
+	unsigned unsubmitted = 0;
+};
+
+bool AsyncFile::openRing(unsigned depth)
+{
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	const int ringFd = (int)syscall(__NR_io_uring_setup, depth, &params);
+	if (ringFd < 0)
+		return false; // ENOSYS on old kernels, EPERM where seccomp or sysctl disallow it
+
+	ring = new Ring();
+	ring->fd = ringFd;
+	ring->entries = params.sq_entries;
+	ring->sqMapBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	ring->cqMapBytes = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	ring->sqeBytes = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqMap = mmap(NULL, ring->sqMapBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+	ring->cqMap = mmap(NULL, ring->cqMapBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+	ring->sqes = (struct io_uring_sqe *)mmap(NULL, ring->sqeBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+	if (ring->sqMap == MAP_FAILED || ring->cqMap == MAP_FAILED || ring->sqes == MAP_FAILED) {
+		closeRing();
+		return false;
+	}
+
+	char *sq = (char *)ring->sqMap;
+	char *cq = (char *)ring->cqMap;
+	ring->sqTail = (unsigned *)(sq + params.sq_off.tail);
+	ring->sqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+	ring->sqArray = (unsigned *)(sq + params.sq_off.array);
+	ring->cqHead = (unsigned *)(cq + params.cq_off.head);
+	ring->cqTail = (unsigned *)(cq + params.cq_off.tail);
+	ring->cqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+	ring->iovecs.resize(slots.size());
+	return true;
+}
+
+void AsyncFile::closeRing()
+{
+	if (ring == NULL)
+		return;
+	if (ring->sqes != MAP_FAILED)
+		munmap(ring->sqes, ring->sqeBytes);
+	if (ring->cqMap != MAP_FAILED)
+		munmap(ring->cqMap, ring->cqMapBytes);
+	if (ring->sqMap != MAP_FAILED)
+		munmap(ring->sqMap, ring->sqMapBytes);
+	::close(ring->fd);
+	delete ring;
+	ring = NULL;
+}
+
+#else
+
+struct AsyncFile::Ring {};
+
+bool AsyncFile::openRing(unsigned)
+{
+	return false;
+}
+
+void AsyncFile::closeRing() {}
+
+#endif
+
+AsyncFile::~AsyncFile()
+{
+	close();
+}
+
+bool AsyncFile::open(const std::string &path, unsigned depth, bool allowUring)
+{
+	close();
+#ifndef _WIN32
+	fd = ::open(path.c_str(), O_RDONLY);
+	struct stat info;
+	if (fd < 0 || fstat(fd, &info) != 0) {
+		close();
+		return false;
+	}
+	fileSize = (uint64_t)info.st_size;
+#else
+	stream = fopen(path.c_str(), "rb");
+	if (stream == NULL)
+		return false;
+	fseeko(stream, 0, SEEK_END);
+	fileSize = (uint64_t)ftello(stream);
+#endif
+
+	depth = std::max(depth, 1u);
+	slots.resize(depth);
+	for (size_t i = depth; i > 0; i--)
+		freeSlots.push_back(i - 1);
+	if (allowUring && getenv("PCV_NO_IO_URING") == NULL && openRing(depth))
+		return true;
+
+	stopping = false;
+	for (unsigned i = 0; i < std::min<unsigned>(depth, ASYNC_FILE_THREADS); i++)
+		workers.emplace_back(&AsyncFile::runWorker, this);
+	return true;
+}
+
+void AsyncFile::close()
+{
+	// Reads still in flight write into the callers' buffers, let them land
+	queued.clear();
+	for (auto &slot : slots)
+		slot.read.done = nullptr;
+	while (active > 0 && reap(true) > 0) {}
+	closeRing();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (auto &worker : workers)
+		worker.join();
+	workers.clear();
+	work.clear();
+	results.clear();
+
+#ifndef _WIN32
+	if (fd >= 0)
+		::close(fd);
+#endif
+	if (stream != NULL)
+		fclose(stream);
+	fd = -1;
+	stream = NULL;
+	fileSize = 0;
+	slots.clear();
+	freeSlots.clear();
+	active = 0;
+}
+
+void AsyncFile::submit(const std::vector<AsyncRead> &reads)
+{
+	queued.insert(queued.end(), reads.begin(), reads.end());
+	issueQueued();
+}
+
+void AsyncFile::issueQueued()
+{
+	while (!queued.empty() && !freeSlots.empty()) {
+		const size_t slot = freeSlots.back();
+		freeSlots.pop_back();
+		slots[slot].read = std::move(queued.front());
+		slots[slot].done = 0;
+		slots[slot].failed = false;
+		slots[slot].used = true;
+		queued.pop_front();
+		active++;
+		issue(slot);
+	}
+
+#ifdef ASYNC_FILE_URING
+	// One system call for the whole batch
+	if (ring != NULL && ring->unsubmitted > 0) {
+		const int submitted = (int)syscall(__NR_io_uring_enter, ring->fd, ring->unsubmitted, 0, 0, NULL, 0);
+		if (submitted > 0)
+			ring->unsubmitted -= std::min<unsigned>(ring->unsubmitted, (unsigned)submitted);
+	}
+#endif
+}
+
+void AsyncFile::issue(size_t slot)
+{
+	const Slot &s = slots[slot];
+#ifdef ASYNC_FILE_URING
+	if (ring != NULL) {
+		struct iovec &iov = ring->iovecs[slot];
+		iov.iov_base = s.read.data + s.done;
+		iov.iov_len = s.read.length - s.done;
+
+		const unsigned tail = *ring->sqTail;
+		const unsigned index = tail & *ring->sqMask;
+		struct io_uring_sqe &sqe = ring->sqes[index];
+		memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode = IORING_OP_READV;
+		sqe.fd = fd;
+		sqe.addr = (uint64_t)(uintptr_t)&iov;
+		sqe.len = 1;
+		sqe.off = s.read.offset + s.done;
+		sqe.user_data = slot;
+		ring->sqArray[index] = index;
+
+		// The kernel must see the entry before the new tail
+		std::atomic_thread_fence(std::memory_order_release);
+		*(volatile unsigned *)ring->sqTail = tail + 1;
+		ring->unsubmitted++;
+		return;
+	}
+#endif
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		work.push_back(slot);
+	}
+	wake.notify_one();
+}
+
+long AsyncFile::readAt(size_t slot)
+{
+	const Slot &s = slots[slot];
+#ifndef _WIN32
+	for (;;) {
+		const ssize_t read = pread(fd, s.read.data + s.done, s.read.length - s.done, (off_t)(s.read.offset + s.done));
+		if (read >= 0 || errno != EINTR)
+			return (long)read;
+	}
+#else
+	std::lock_guard<std::mutex> lock(mutex);
+	if (fseeko(stream, (__int64)(s.read.offset + s.done), SEEK_SET) != 0)
+		return -1;
+	const size_t read = fread(s.read.data + s.done, 1, s.read.length - s.done, stream);
+	return ferror(stream) ? -1 : (long)read;
+#endif
+}
+
+void AsyncFile::runWorker()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		wake.wait(lock, [this]() {
+			return stopping || !work.empty();
+		});
+		if (stopping)
+			return;
+		const size_t slot = work.front();
+		work.pop_front();
+		lock.unlock();
+		const long result = readAt(slot);
+		lock.lock();
+		results.push_back(std::make_pair(slot, result));
+		finished.notify_all();
+	}
+}
+
+void AsyncFile::complete(size_t slot, long result, std::vector<size_t> &done)
+{
+	Slot &s = slots[slot];
+	if (result > 0)
+		s.done += (size_t)result;
+
+	// Short reads before the end of the file continue where they stopped
+	if (result > 0 && s.done < s.read.length && s.read.offset + s.done < fileSize) {
+		issue(slot);
+		return;
+	}
+	s.failed = result < 0;
+	done.push_back(slot);
+}
+
+size_t AsyncFile::reap(bool block)
+{
+	std::vector<size_t> done;
+	while (done.empty()) {
+#ifdef ASYNC_FILE_URING
+		if (ring != NULL) {
+			if (block || ring->unsubmitted > 0) {
+				const unsigned flags = block ? IORING_ENTER_GETEVENTS : 0;
+				const int submitted = (int)syscall(__NR_io_uring_enter, ring->fd, ring->unsubmitted, block ? 1 : 0, flags, NULL, 0);
+				if (submitted > 0)
+					ring->unsubmitted -= std::min<unsigned>(ring->unsubmitted, (unsigned)submitted);
+			}
+			unsigned head = *ring->cqHead;
+			const unsigned tail = *(volatile unsigned *)ring->cqTail;
+			std::atomic_thread_fence(std::memory_order_acquire);
+			for (; head != tail; head++) {
+				const struct io_uring_cqe &cqe = ring->cqes[head & *ring->cqMask];
+				complete((size_t)cqe.user_data, (long)cqe.res, done);
+			}
+			std::atomic_thread_fence(std::memory_order_release);
+			*(volatile unsigned *)ring->cqHead = head;
+		}
+		else
+#endif
+		{
+			std::deque<std::pair<size_t, long>> ready;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				if (block)
+					finished.wait(lock, [this]() { return !results.empty(); });
+				ready.swap(results);
+			}
+			for (const auto &result : ready)
+				complete(result.first, result.second, done);
+		}
+		if (!block || active == 0)
+			break;
+	}
+
+	// Free the slots first, a callback may submit the next read
+	std::vector<Slot> reads;
+	for (size_t slot : done) {
+		reads.push_back(std::move(slots[slot]));
+		slots[slot].used = false;
+		freeSlots.push_back(slot);
+		active--;
+	}
+	issueQueued();
+	for (auto &s : reads) {
+		if (s.read.done)
+			s.read.done(s.read.offset, s.read.data, s.failed ? 0 : s.done, !s.failed);
+	}
+	return reads.size();
+}
+
+size_t AsyncFile::poll()
+{
+	return active > 0 ? reap(false) : 0;
+}
+
+size_t AsyncFile::wait()
+{
+	if (active == 0)
+		issueQueued();
+	return active > 0 ? reap(true) : 0;
+}
+
+bool ReadAheadFile::open(const std::string &path, uint64_t first, uint64_t lastByte, size_t blockBytes, unsigned depth)
+{
+	close();
+	if (!file.open(path, depth))
+		return false;
+	offset = std::min(first, file.size());
+	last = std::min(lastByte, file.size());
+	blocks.resize(std::max(depth, 1u));
+	for (auto &block : blocks)
+		block.data.resize(std::max<size_t>(blockBytes, 1));
+	for (size_t i = 0; i < blocks.size(); i++)
+		request(i);
+	return true;
+}
+
+void ReadAheadFile::close()
+{
+	file.close();
+	blocks.clear();
+	head = 0;
+	holding = false;
+	offset = last = 0;
+	error = false;
+}
+
+void ReadAheadFile::request(size_t index)
+{
+	Block &block = blocks[index];
+	block.requested = offset < last;
+	block.ready = false;
+	block.bytes = 0;
+	if (!block.requested)
+		return;
+	const size_t length = (size_t)std::min<uint64_t>(block.data.size(), last - offset);
+	file.submit({ { offset, length, block.data.data(), [this, index](uint64_t, char *, size_t bytes, bool ok) {
+		blocks[index].bytes = bytes;
+		blocks[index].ready = true;
+		error = error || !ok;
+	} } });
+	offset += length;
+}
+
+bool ReadAheadFile::next(const char *&data, size_t &bytes)
+{
+	if (blocks.empty())
+		return false;
+
+	// The block handed out last time is free again, it reads the range's
+	// next block now
+	if (holding)
+		request((head + blocks.size() - 1) % blocks.size());
+	holding = false;
+
+	Block &block = blocks[head];
+	while (block.requested && !block.ready && !error) {
+		if (file.wait() == 0)
+			error = !block.ready;
+	}
+	if (!block.requested || error || block.bytes == 0)
+		return false;
+	data = block.data.data();
+	bytes = block.bytes;
+	head = (head + 1) % blocks.size();
+	holding = true;
+	return true;
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#define ASYNC_FILE_DEPTH 32
+#define READ_AHEAD_BLOCK (4 << 20)
+#define READ_AHEAD_DEPTH 4
+
+/**
+* Called once a read finished with the bytes read, fewer than asked only at
+* the end of the file. "ok" is false on an I/O error.
+*/
+typedef std::function<void(uint64_t offset, char *data, size_t bytes, bool ok)> AsyncReadCallback;
+
+struct AsyncRead {
+	uint64_t offset;
+	size_t length;
+	char *data; // Owned by the caller, must stay valid until the callback ran
+	AsyncReadCallback done;
+};
+
+/**
+* Reads of one file kept in flight together: through io_uring on Linux when
+* the kernel allows it, else through a few threads doing pread. Callbacks
+* run on the thread calling poll or wait, so they need no locking and may
+* submit further reads.
+*/
+class AsyncFile {
+public:
+	AsyncFile() {}
+	~AsyncFile();
+
+	/**
+	* "depth" reads are in flight at most, more are queued until one
+	* finishes. "allowUring" false, or PCV_NO_IO_URING in the environment,
+	* forces the thread fallback.
+	*/
+	bool open(const std::string &path, unsigned depth = ASYNC_FILE_DEPTH, bool allowUring = true);
+
+	/**
+	* Waits for the reads in flight, their callbacks do not run anymore.
+	*/
+	void close();
+
+	void submit(const std::vector<AsyncRead> &reads);
+
+	/**
+	* Runs the callbacks of finished reads, returns how many.
+	*/
+	size_t poll();
+
+	/**
+	* Like poll but first waits for a read to finish, 0 if none is pending.
+	*/
+	size_t wait();
+
+	size_t pending() const { return active + queued.size(); }
+	uint64_t size() const { return fileSize; }
+	bool usesUring() const { return ring != NULL; }
+	const char *backend() const { return ring != NULL ? "io_uring" : "pread threads"; }
+
+private:
+	AsyncFile(const AsyncFile &);
+	AsyncFile &operator=(const AsyncFile &);
+
+	struct Ring;
+
+	struct Slot {
+		AsyncRead read;
+		size_t done = 0; // Bytes read so far, short reads are continued
+		bool failed = false;
+		bool used = false;
+	};
+
+	bool openRing(unsigned depth);
+	void closeRing();
+	void issue(size_t slot);
+	void issueQueued();
+	size_t reap(bool block);
+	void complete(size_t slot, long result, std::vector<size_t> &finished);
+	void runWorker();
+	long readAt(size_t slot);
+
+	int fd = -1;
+	FILE *stream = NULL; // Win32 fallback, read under "mutex"
+	uint64_t fileSize = 0;
+	std::vector<Slot> slots;
+	std::vector<size_t> freeSlots;
+	std::deque<AsyncRead> queued; // Waiting for a free slot
+	size_t active = 0;
+
+	Ring *ring = NULL;
+
+	// pread fallback
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable finished;
+	std::deque<size_t> work;
+	std::deque<std::pair<size_t, long>> results;
+	bool stopping = false;
+};
+
+/**
+* Reads a byte range front to back in blocks with the next few blocks in
+* flight, so the caller parses one block while the following ones load.
+*/
+class ReadAheadFile {
+public:
+	ReadAheadFile() {}
+
+	bool open(const std::string &path, uint64_t first = 0, uint64_t last = UINT64_MAX,
+		size_t blockBytes = READ_AHEAD_BLOCK, unsigned depth = READ_AHEAD_DEPTH);
+	void close();
+
+	/**
+	* Next block in file order, valid until the following call. Every block
+	* is full but the last. False at the end or on an error.
+	*/
+	bool next(const char *&data, size_t &bytes);
+
+	bool failed() const { return error; }
+	uint64_t size() const { return file.size(); }
+	const char *backend() const { return file.backend(); }
+
+private:
+	ReadAheadFile(const ReadAheadFile &);
+	ReadAheadFile &operator=(const ReadAheadFile &);
+
+	struct Block {
+		std::vector<char> data;
+		size_t bytes = 0;
+		bool requested = false;
+		bool ready = false;
+	};
+
+	void request(size_t block);
+
+	AsyncFile file;
+	std::vector<Block> blocks; // Ring in file order starting at "head"
+	size_t head = 0;
+	bool holding = false; // The block before "head" is still with the caller
+	uint64_t offset = 0; // Next offset to request
+	uint64_t last = 0;
+	bool error = false;
+};
@@ -0,0 +1,57 @@
+#include "axis_index.h"
+
+#include <string.h>
+#include <algorithm>
+
+#include "parallel.h"
+#include "radix_sort.h"
+
+/**
+* Maps a float to an unsigned key with the same ordering.
+*/
+static inline uint32_t sortableKey(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+}
+
+void AxisIndex::build(const float *positions, size_t count, int sortAxis)
+{
+	float unit[4] = { 0, 0, 0, 0 };
+	unit[sortAxis] = 1;
+	build(positions, count, sortAxis, unit);
+}
+
+void AxisIndex::build(const float *positions, size_t count, int sortAxis, const float *sortPlane)
+{
+	axis = sortAxis;
+	memcpy(plane, sortPlane, sizeof(plane));
+	order.resize(count);
+	coords.resize(count);
+
+	// The coordinate is computed once per point, the keys and "coords" must agree
+	std::vector<float> values(count);
+	std::vector<uint32_t> keys(count);
+	parallelFor(count, [&](size_t, size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			const float *p = positions + i * 3;
+			values[i] = plane[0] * p[0] + plane[1] * p[1] + plane[2] * p[2] + plane[3];
+			keys[i] = sortableKey(values[i]);
+			order[i] = (uint32_t)i;
+		}
+	});
+
+	radixSort(keys, order);
+
+	parallelFor(count, [&](size_t, size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+			coords[i] = values[order[i]];
+	});
+}
+
+void AxisIndex::range(float lo, float hi, size_t &first, size_t &last) const
+{
+	first = std::lower_bound(coords.begin(), coords.end(), lo) - coords.begin();
+	last = std::upper_bound(coords.begin() + first, coords.end(), hi) - coords.begin();
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+* Point indices sorted along one axis, so every slab perpendicular to that
+* axis is a contiguous range of the index found with two binary searches.
+*/
+struct AxisIndex {
+	int axis = -1;
+	float plane[4] = { 0, 0, 0, 0 }; // Coordinate of point p is plane . (p, 1)
+	std::vector<uint32_t> order; // Point indices by ascending coordinate
+	std::vector<float> coords; // Coordinate of each entry in "order"
+
+	/**
+	* Sorts the points along "axis" with the parallel radix sort.
+	*/
+	void build(const float *positions, size_t count, int axis);
+
+	/**
+	* Sorts the points along "axis" after a transform, "plane" being the row
+	* of the transform giving that coordinate.
+	*/
+	void build(const float *positions, size_t count, int axis, const float *plane);
+
+	/**
+	* Range [first, last) of "order" with coordinates inside [lo, hi].
+	*/
+	void range(float lo, float hi, size_t &first, size_t &last) const;
+};
@@ -0,0 +1,131 @@
+#include "cluster.h"
+
+#include <algorithm>
+#include <atomic>
+
+#include "parallel.h"
+#include "point_grid.h"
+
+#define CLUSTER_NOISE 0xffffffffu
+
+namespace {
+
+typedef std::vector<std::atomic<uint32_t>> ParentArray;
+
+/**
+* Root of "x", halving the path on the way. Racing updates only ever point
+* an entry further up its own tree, so they are harmless.
+*/
+uint32_t findRoot(ParentArray &parent, uint32_t x)
+{
+	for (;;) {
+		uint32_t p = parent[x].load(std::memory_order_relaxed);
+		if (p == x)
+			return x;
+		const uint32_t gp = parent[p].load(std::memory_order_relaxed);
+		if (gp != p)
+			parent[x].compare_exchange_weak(p, gp, std::memory_order_relaxed);
+		x = gp;
+	}
+}
+
+/**
+* Links the higher root below the lower one, so the root of every set ends up
+* being its smallest entry regardless of the order of the unions.
+*/
+void unite(ParentArray &parent, uint32_t a, uint32_t b)
+{
+	for (;;) {
+		a = findRoot(parent, a);
+		b = findRoot(parent, b);
+		if (a == b)
+			return;
+		if (a < b)
+			std::swap(a, b);
+		uint32_t expected = a;
+		if (parent[a].compare_exchange_strong(expected, b, std::memory_order_acq_rel))
+			return;
+	}
+}
+
+}
+
+size_t clusterPoints(const float *positions, size_t count, const ClusterOptions &options, std::vector<uint32_t> &labels)
+{
+	labels.assign(count, 0);
+	if (count == 0 || options.epsilon <= 0)
+		return 0;
+
+	PointGrid grid;
+	grid.build(positions, count, options.epsilon);
+	const float eps = options.epsilon;
+
+	// Core points have at least minPoints neighbours, counting stops there
+	std::vector<uint8_t> core(count, 1);
+	if (options.minPoints > 1) {
+		parallelFor(count, [&](size_t, size_t begin, size_t end) {
+			for (size_t e = begin; e < end; e++) {
+				size_t found = 0;
+				grid.forEachInRadius(grid.point(e), eps, [&](uint32_t, float) {
+					return ++found < options.minPoints;
+				});
+				core[e] = found >= options.minPoints ? 1 : 0;
+			}
+		}, 1024);
+	}
+
+	ParentArray parent(count);
+	parallelFor(count, [&](size_t, size_t begin, size_t end) {
+		for (size_t e = begin; e < end; e++)
+			parent[e].store((uint32_t)e, std::memory_order_relaxed);
+	});
+
+	// Merge every pair of core neighbours once, from the lower entry
+	parallelFor(count, [&](size_t, size_t begin, size_t end) {
+		for (size_t e = begin; e < end; e++) {
+			if (!core[e])
+				continue;
+			grid.forEachInRadius(grid.point(e), eps, [&](uint32_t n, float) {
+				if (n > e && core[n])
+					unite(parent, (uint32_t)e, n);
+				return true;
+			});
+		}
+	}, 1024);
+
+	// Border points take the set of a core neighbour, the rest is noise
+	std::vector<uint32_t> roots(count);
+	parallelFor(count, [&](size_t, size_t begin, size_t end) {
+		for (size_t e = begin; e < end; e++) {
+			if (core[e]) {
+				roots[e] = findRoot(parent, (uint32_t)e);
+				continue;
+			}
+			uint32_t root = CLUSTER_NOISE;
+			grid.forEachInRadius(grid.point(e), eps, [&](uint32_t n, float) {
+				if (!core[n])
+					return true;
+				root = findRoot(parent, n);
+				return false;
+			});
+			roots[e] = root;
+		}
+	}, 1024);
+
+	// Number the sets big enough to keep
+	std::vector<uint32_t> sizes(count, 0);
+	for (size_t e = 0; e < count; e++) {
+		if (roots[e] != CLUSTER_NOISE)
+			sizes[roots[e]]++;
+	}
+	std::vector<uint32_t> &ids = sizes;
+	uint32_t clusters = 0;
+	for (size_t e = 0; e < count; e++)
+		ids[e] = sizes[e] >= options.minClusterSize && sizes[e] > 0 ? ++clusters : 0;
+
+	parallelFor(count, [&](size_t, size_t begin, size_t end) {
+		for (size_t e = begin; e < end; e++)
+			labels[grid.order[e]] = roots[e] != CLUSTER_NOISE ? ids[roots[e]] : 0;
+	});
+	return clusters;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+struct ClusterOptions {
+	float epsilon = 0.05f; // Neighbourhood radius
+	size_t minPoints = 1; // Neighbours (self included) of a core point, 1 is plain Euclidean clustering
+	size_t minClusterSize = 100; // Smaller clusters become noise
+};
+
+/**
+* DBSCAN clustering. Neighbourhoods come from a hashed uniform grid with
+* cells the size of epsilon, and core points are merged with a lock free
+* union-find in parallel. Border points join the cluster of their first core
+* neighbour. labels[i] is set to the 1 based cluster of point i, or 0 for
+* noise. Clusters are numbered in grid order, which does not depend on the
+* thread count.
+* Returns the number of clusters.
+*/
+size_t clusterPoints(const float *positions, size_t count, const ClusterOptions &options, std::vector<uint32_t> &labels);
@@ -0,0 +1,858 @@
+//////////////////////////////////////////////////////////////////
+// pcv-convert: Spatially chunked point files for range loading //
+//////////////////////////////////////////////////////////////////
+
+#include <iostream>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define mkdir(path, mode) _mkdir(path)
+#define getpid _getpid
+#define fseeko _fseeki64
+#define ftello _ftelli64
+#define off_t __int64
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "external_sort.h"
+#include "morton.h"
+#include "obj_stream.h"
+#include "parallel.h"
+#include "point_file.h"
+#include "radix_sort.h"
+
+#define CONVERT_BATCH_POINTS (1 << 22)
+#define CONVERT_EXTERNAL_BATCH_POINTS (1 << 16) // Parsed at once with --memory, on top of the budget
+#define CONVERT_CHUNK_BYTES (256ull << 20) // Input per parse task when --chunks is not given
+#define CONVERT_POLL_MS 200
+#define CONVERT_COPY_BYTES (4 << 20)
+#define RUN_MAGIC 0x4e555250u // "PRUN"
+
+/**
+* Command line options.
+*/
+struct ConvertOptions {
+	std::string input;
+	std::string output;
+	size_t nodePoints = 1 << 18;
+	unsigned threads = 0;
+	size_t memoryMB = 0; // Sort out of core within this budget when set
+	std::string workDir; // Distributed mode when set
+	size_t chunks = 0; // 0 picks one per CONVERT_CHUNK_BYTES of input
+	int tileLevel = 1;
+	bool reclaim = false;
+};
+
+/**
+* Intermediate points of the distributed mode: this header, "tiles + 1"
+* point indices where each tile starts and then the positions.
+*/
+struct RunHeader {
+	uint32_t magic;
+	uint32_t tiles; // 0 until the points are grouped by tile
+	uint64_t count;
+	float min[3];
+	float max[3];
+};
+
+/**
+* Job layout shared by every worker of a work directory, decided by the
+* first one.
+*/
+struct ConvertPlan {
+	size_t chunks = 0;
+	int tileLevel = 0;
+	size_t nodePoints = 0;
+	uint64_t inputBytes = 0;
+};
+
+enum ConvertPhase {
+	PHASE_PARSE,
+	PHASE_BUCKET,
+	PHASE_TILE,
+	PHASE_MERGE,
+	PHASE_COUNT
+};
+
+static const char *phaseNames[PHASE_COUNT] = { "parse", "bucket", "tile", "merge" };
+
+struct ConvertTask {
+	ConvertPhase phase;
+	size_t index;
+};
+
+static void usage()
+{
+	std::cerr << "Usage: pcv-convert <input.obj> <output.pcvc> [options]\n"
+		"  --node-points <count>  Max points per node (default: 262144)\n"
+		"  --threads <count>   Worker threads (default: all)\n"
+		"  --memory <MB>       Sort within this much memory, spilling sorted runs next\n"
+		"                      to the output and merging them (default: all in memory)\n"
+		"  --work-dir <dir>    Convert together with every other pcv-convert given the\n"
+		"                      same directory, e.g. on a shared filesystem\n"
+		"  --chunks <count>    Parse tasks the input is split into (default: one per 256 MB)\n"
+		"  --tile-level <n>    Sort tasks are 8^n Morton tiles (default: 1)\n"
+		"  --reclaim           Release the tasks of workers which died, only while no\n"
+		"                      other worker is running\n"
+		"Sorts the points along a Morton curve and splits them into nodes of nearby\n"
+		"points, which pcv-tile-server and File > Open URL load one range at a time.\n";
+}
+
+static bool parseArgs(int argc, char **args, ConvertOptions &options)
+{
+	int positional = 0;
+	for (int i = 1; i < argc; i++) {
+		const char *arg = args[i];
+		const bool hasValue = i + 1 < argc;
+		if (strcmp(arg, "--node-points") == 0 && hasValue) {
+			options.nodePoints = (size_t)std::max(1, atoi(args[++i]));
+		}
+		else if (strcmp(arg, "--threads") == 0 && hasValue) {
+			options.threads = (unsigned)std::max(0, atoi(args[++i]));
+		}
+		else if (strcmp(arg, "--memory") == 0 && hasValue) {
+			options.memoryMB = (size_t)std::max(1, atoi(args[++i]));
+		}
+		else if (strcmp(arg, "--work-dir") == 0 && hasValue) {
+			options.workDir = args[++i];
+		}
+		else if (strcmp(arg, "--chunks") == 0 && hasValue) {
+			options.chunks = (size_t)std::max(1, atoi(args[++i]));
+		}
+		else if (strcmp(arg, "--tile-level") == 0 && hasValue) {
+			options.tileLevel = std::min(std::max(0, atoi(args[++i])), 5);
+		}
+		else if (strcmp(arg, "--reclaim") == 0) {
+			options.reclaim = true;
+		}
+		else if (arg[0] == '-') {
+			return false;
+		}
+		else if (positional == 0) {
+			options.input = arg;
+			positional++;
+		}
+		else if (positional == 1) {
+			options.output = arg;
+			positional++;
+		}
+		else {
+			return false;
+		}
+	}
+	return positional == 2;
+}
+
+static double elapsedMs(std::chrono::high_resolution_clock::time_point since)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - since).count();
+}
+
+/**
+* Sorts point indices along the Morton curve of the given bounds.
+*/
+static void mortonOrder(const std::vector<float> &positions, const glm::vec3 &min, const glm::vec3 &max, std::vector<uint32_t> &keys, std::vector<uint32_t> &order)
+{
+	const size_t count = positions.size() / 3;
+	const glm::vec3 extent = glm::max(max - min, glm::vec3(FLT_MIN));
+	const glm::vec3 invExtent = 1.f / extent;
+	keys.resize(count);
+	order.resize(count);
+	parallelFor(count, [&](size_t, size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			keys[i] = mortonCode(&positions[i * 3], &min[0], &invExtent[0]);
+			order[i] = (uint32_t)i;
+		}
+	});
+	radixSort(keys, order, 30);
+}
+
+/**
+* Cuts the ordered points into nodes of at most "nodePoints".
+*/
+static void buildNodes(const std::vector<float> &positions, const std::vector<uint32_t> &order, size_t nodePoints, std::vector<PointCloud> &nodes)
+{
+	const size_t pointCount = order.size();
+	nodes.clear();
+	nodes.resize((pointCount + nodePoints - 1) / nodePoints);
+	parallelFor(nodes.size(), [&](size_t, size_t begin, size_t end) {
+		for (size_t n = begin; n < end; n++) {
+			const size_t first = n * nodePoints;
+			const size_t last = std::min(pointCount, first + nodePoints);
+			PointCloud &node = nodes[n];
+			node.positions.resize((last - first) * 3);
+			for (size_t i = first; i < last; i++)
+				memcpy(&node.positions[(i - first) * 3], &positions[(size_t)order[i] * 3], 3 * sizeof(float));
+			node.updateBounds();
+		}
+	}, 1);
+}
+
+static int convertLocal(const ConvertOptions &options)
+{
+	ObjPointStream stream;
+	if (!stream.open(options.input)) {
+		std::cerr << stream.error() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	auto stage = start;
+
+	// Only positions are kept, they are all the viewer needs to draw
+	std::vector<float> positions, batch;
+	glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+	while (stream.read(batch, CONVERT_BATCH_POINTS)) {
+		for (size_t i = 0; i < batch.size(); i += 3) {
+			const glm::vec3 p(batch[i], batch[i + 1], batch[i + 2]);
+			min = glm::min(min, p);
+			max = glm::max(max, p);
+		}
+		positions.insert(positions.end(), batch.begin(), batch.end());
+	}
+	if (stream.failed()) {
+		std::cerr << stream.error() << std::endl;
+		return EXIT_FAILURE;
+	}
+	const size_t pointCount = positions.size() / 3;
+	if (pointCount == 0) {
+		std::cerr << "No points in " << options.input << std::endl;
+		return EXIT_FAILURE;
+	}
+	const uint64_t sourceSize = stream.offset();
+	std::cout << pointCount << " points read in " << elapsedMs(stage) << " ms" << std::endl;
+
+	// Morton order keeps every node a compact region of space
+	stage = std::chrono::high_resolution_clock::now();
+	std::vector<uint32_t> keys, order;
+	mortonOrder(positions, min, max, keys, order);
+	std::cout << "Sorted in " << elapsedMs(stage) << " ms" << std::endl;
+
+	stage = std::chrono::high_resolution_clock::now();
+	std::vector<PointCloud> nodes;
+	buildNodes(positions, order, options.nodePoints, nodes);
+	if (!writePointFile(options.output, nodes, 0, sourceSize)) {
+		std::cerr << "Cannot write " << options.output << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::cout << nodes.size() << " nodes written in " << elapsedMs(stage) << " ms" << std::endl;
+
+	const double seconds = elapsedMs(start) / 1000.0;
+	std::cout << "Done in " << seconds << " s (" << (pointCount / 1000000.0) / seconds << " M points/s)" << std::endl;
+	return EXIT_SUCCESS;
+}
+
+/**
+* Same output as convertLocal in bounded memory: the points go through an
+* external sort and every node is written as soon as it is full.
+*/
+static int convertExternal(const ConvertOptions &options)
+{
+	ObjPointStream stream;
+	if (!stream.open(options.input)) {
+		std::cerr << stream.error() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	auto stage = start;
+	ExternalMortonSort sorter(options.output + ".sort", options.memoryMB << 20);
+	std::vector<float> batch;
+	while (stream.read(batch, CONVERT_EXTERNAL_BATCH_POINTS)) {
+		if (!sorter.add(batch.data(), batch.size() / 3)) {
+			std::cerr << "Cannot write temporary files next to " << options.output << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	if (stream.failed()) {
+		std::cerr << stream.error() << std::endl;
+		return EXIT_FAILURE;
+	}
+	const uint64_t pointCount = sorter.count();
+	if (pointCount == 0) {
+		std::cerr << "No points in " << options.input << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::cout << pointCount << " points read in " << elapsedMs(stage) << " ms" << std::endl;
+
+	stage = std::chrono::high_resolution_clock::now();
+	PointFileWriter writer;
+	if (!writer.open(options.output, (pointCount + options.nodePoints - 1) / options.nodePoints, 0, stream.offset())) {
+		std::cerr << "Cannot write " << options.output << std::endl;
+		return EXIT_FAILURE;
+	}
+	PointCloud node;
+	node.positions.reserve(options.nodePoints * 3);
+	const bool sorted = sorter.finish([&](const float *positions, size_t count) {
+		while (count > 0) {
+			const size_t take = std::min(count, options.nodePoints - node.size());
+			node.positions.insert(node.positions.end(), positions, positions + take * 3);
+			positions += take * 3;
+			count -= take;
+			if (node.size() == options.nodePoints) {
+				node.updateBounds();
+				if (!writer.add(node))
+					return false;
+				node.positions.clear();
+			}
+		}
+		return true;
+	});
+	bool ok = sorted;
+	if (ok && node.size() > 0) {
+		node.updateBounds();
+		ok = writer.add(node);
+	}
+	if (!ok || !writer.close()) {
+		std::cerr << (sorted ? "Cannot write " + options.output : "Sorting failed, out of disk space for the runs?") << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// Bytes through the sort per second of each stage, parsing excluded
+	const ExternalSortStats &stats = sorter.stats();
+	const double pointMB = pointCount * 3 * sizeof(float) / 1048576.0;
+	if (stats.runs == 0)
+		std::cout << "Sorted " << pointMB << " MB in memory in " << stats.runMs << " ms" << std::endl;
+	else
+		std::cout << "Sorted " << pointMB << " MB in " << options.memoryMB << " MB: " << stats.runs << " runs in " << stats.runMs << " ms ("
+		<< pointMB / (stats.runMs / 1000.0) << " MB/s), " << stats.mergePasses << " intermediate merge passes, merged in "
+		<< stats.mergeMs << " ms (" << pointMB / (stats.mergeMs / 1000.0) << " MB/s)" << std::endl;
+	std::cout << "Temporary I/O: " << stats.bytesWritten / 1048576.0 << " MB written (" << stats.spillMs << " ms while reading), "
+		<< stats.bytesRead / 1048576.0 << " MB read" << std::endl;
+	std::cout << "Sorted and written in " << elapsedMs(stage) << " ms" << std::endl;
+
+	const double seconds = elapsedMs(start) / 1000.0;
+	std::cout << "Done in " << seconds << " s (" << (pointCount / 1000000.0) / seconds << " M points/s)" << std::endl;
+	return EXIT_SUCCESS;
+}
+
+//
+// Distributed mode
+//
+// Every worker given the same work directory claims tasks by creating their
+// lock file with O_EXCL and marks them done with a second file once their
+// output is renamed into place. Tasks of one phase only start once the
+// previous phase is done:
+//   parse-N   points of input byte range N with their bounds
+//   bucket-N  the same points grouped by Morton tile of the global bounds
+//   tile-N    the points of tile N from every bucket, sorted into nodes
+//   merge     the tiles' nodes in tile order, which is the global Morton order
+//
+
+static bool fileExists(const std::string &path)
+{
+	FILE *file = fopen(path.c_str(), "rb");
+	if (file != NULL)
+		fclose(file);
+	return file != NULL;
+}
+
+static std::string workerName()
+{
+	char host[256] = "localhost";
+#ifndef _WIN32
+	gethostname(host, sizeof(host) - 1);
+#endif
+	return std::string(host) + ":" + std::to_string((int)getpid());
+}
+
+static std::string taskName(const ConvertTask &task)
+{
+	char name[32];
+	if (task.phase == PHASE_MERGE)
+		snprintf(name, sizeof(name), "%s", phaseNames[task.phase]);
+	else
+		snprintf(name, sizeof(name), "%s-%04d", phaseNames[task.phase], (int)task.index);
+	return name;
+}
+
+/**
+* Creates "path" only if it does not exist yet, which holds across hosts on
+* NFSv3 and later.
+*/
+static bool claimFile(const std::string &path, const std::string &owner)
+{
+	FILE *file = fopen(path.c_str(), "wx");
+	if (file == NULL)
+		return false;
+	fprintf(file, "%s\n", owner.c_str());
+	fclose(file);
+	return true;
+}
+
+static bool writeRun(const std::string &path, const RunHeader &header, const std::vector<uint64_t> &tileStarts, const std::vector<float> &positions)
+{
+	const std::string temp = path + ".tmp";
+	FILE *file = fopen(temp.c_str(), "wb");
+	if (file == NULL)
+		return false;
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(tileStarts.data(), sizeof(uint64_t), tileStarts.size(), file) == tileStarts.size() &&
+		fwrite(positions.data(), sizeof(float), positions.size(), file) == positions.size();
+	ok = fclose(file) == 0 && ok;
+	if (!ok || rename(temp.c_str(), path.c_str()) != 0) {
+		remove(temp.c_str());
+		return false;
+	}
+	return true;
+}
+
+/**
+* Reads a run's header and tile starts, leaves "file" at its positions.
+*/
+static FILE *openRun(const std::string &path, RunHeader &header, std::vector<uint64_t> &tileStarts)
+{
+	FILE *file = fopen(path.c_str(), "rb");
+	if (file == NULL)
+		return NULL;
+	if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != RUN_MAGIC) {
+		fclose(file);
+		return NULL;
+	}
+	tileStarts.resize(header.tiles > 0 ? header.tiles + 1 : 0);
+	if (fread(tileStarts.data(), sizeof(uint64_t), tileStarts.size(), file) != tileStarts.size()) {
+		fclose(file);
+		return NULL;
+	}
+	return file;
+}
+
+class DistributedConvert {
+public:
+	DistributedConvert(const ConvertOptions &options) : options(options), owner(workerName()) {}
+
+	int run();
+
+private:
+	std::string path(const std::string &name) const { return options.workDir + "/" + name; }
+	std::string runPath(ConvertPhase phase, size_t index) const { return path(taskName({ phase, index }) + ".pts"); }
+	std::string tilePath(size_t index) const { return path(taskName({ PHASE_TILE, index }) + ".pcvc"); }
+	size_t tileCount() const { return (size_t)1 << (3 * plan.tileLevel); }
+
+	bool joinPlan();
+	bool writePlan(const std::string &planPath);
+	void reclaim();
+	bool runTask(const ConvertTask &task);
+	bool parse(size_t chunk);
+	bool bucket(size_t chunk);
+	bool tile(size_t index);
+	bool merge();
+	void removeIntermediates();
+
+	const ConvertOptions &options;
+	const std::string owner;
+	ConvertPlan plan;
+	std::vector<ConvertTask> tasks;
+	size_t tasksRun[PHASE_COUNT] = {};
+	double taskMs[PHASE_COUNT] = {};
+	uint64_t pointsRun = 0;
+};
+
+/**
+* The first worker writes the plan, the others wait for it and take its
+* values so every worker splits the job the same way. A worker that fails to
+* write the plan drops its lock, so a waiting worker takes over instead of
+* waiting forever.
+*/
+bool DistributedConvert::joinPlan()
+{
+	const std::string planPath = path("plan");
+	for (;;) {
+		FILE *file = fopen(planPath.c_str(), "r");
+		if (file != NULL) {
+			unsigned long long inputBytes = 0;
+			const bool ok = fscanf(file, "%zu %d %zu %llu", &plan.chunks, &plan.tileLevel, &plan.nodePoints, &inputBytes) == 4;
+			fclose(file);
+			plan.inputBytes = inputBytes;
+			if (!ok || plan.chunks == 0 || plan.nodePoints == 0) {
+				std::cerr << "Invalid plan in " << planPath << std::endl;
+				return false;
+			}
+			return true;
+		}
+		if (claimFile(planPath + ".lock", owner)) {
+			if (writePlan(planPath))
+				return true;
+			remove((planPath + ".lock").c_str());
+			return false;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(CONVERT_POLL_MS));
+	}
+}
+
+bool DistributedConvert::writePlan(const std::string &planPath)
+{
+	FILE *input = fopen(options.input.c_str(), "rb");
+	if (input == NULL) {
+		std::cerr << "Cannot open " << options.input << std::endl;
+		return false;
+	}
+	fseeko(input, 0, SEEK_END);
+	plan.inputBytes = (uint64_t)ftello(input);
+	fclose(input);
+	plan.chunks = options.chunks > 0 ? options.chunks : (size_t)std::max<uint64_t>(1, (plan.inputBytes + CONVERT_CHUNK_BYTES - 1) / CONVERT_CHUNK_BYTES);
+	plan.tileLevel = options.tileLevel;
+	plan.nodePoints = options.nodePoints;
+
+	const std::string temp = planPath + ".tmp";
+	FILE *file = fopen(temp.c_str(), "w");
+	if (file == NULL) {
+		std::cerr << "Cannot write " << temp << std::endl;
+		return false;
+	}
+	fprintf(file, "%zu %d %zu %llu\n", plan.chunks, plan.tileLevel, plan.nodePoints, (unsigned long long)plan.inputBytes);
+	if (fclose(file) != 0 || rename(temp.c_str(), planPath.c_str()) != 0) {
+		std::cerr << "Cannot write " << planPath << std::endl;
+		remove(temp.c_str());
+		return false;
+	}
+	return true;
+}
+
+/**
+* Drops the locks of tasks that never finished so they run again.
+*/
+void DistributedConvert::reclaim()
+{
+	if (!fileExists(path("plan")) && remove(path("plan.lock").c_str()) == 0)
+		std::cout << "Reclaimed plan" << std::endl;
+	if (!fileExists(path("plan")))
+		return;
+	if (!joinPlan())
+		return;
+
+	for (int phase = 0; phase < PHASE_COUNT; phase++) {
+		const size_t count = phase == PHASE_TILE ? tileCount() : phase == PHASE_MERGE ? 1 : plan.chunks;
+		for (size_t i = 0; i < count; i++) {
+			const std::string name = taskName({ (ConvertPhase)phase, i });
+			if (!fileExists(path(name + ".done")) && remove(path(name + ".lock").c_str()) == 0)
+				std::cout << "Reclaimed " << name << std::endl;
+		}
+	}
+}
+
+bool DistributedConvert::parse(size_t chunk)
+{
+	const uint64_t first = plan.inputBytes * chunk / plan.chunks;
+	const uint64_t last = plan.inputBytes * (chunk + 1) / plan.chunks;
+	ObjPointStream stream;
+	if (!stream.openRange(options.input, first, last)) {
+		std::cerr << "Cannot open " << options.input << std::endl;
+		return false;
+	}
+
+	std::vector<float> positions, batch;
+	glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+	while (stream.read(batch, CONVERT_BATCH_POINTS)) {
+		for (size_t i = 0; i < batch.size(); i += 3) {
+			const glm::vec3 p(batch[i], batch[i + 1], batch[i + 2]);
+			min = glm::min(min, p);
+			max = glm::max(max, p);
+		}
+		positions.insert(positions.end(), batch.begin(), batch.end());
+	}
+	if (stream.failed()) {
+		std::cerr << stream.error() << std::endl;
+		return false;
+	}
+
+	RunHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = RUN_MAGIC;
+	header.count = positions.size() / 3;
+	memcpy(header.min, &min[0], sizeof(header.min));
+	memcpy(header.max, &max[0], sizeof(header.max));
+	pointsRun += header.count;
+	return writeRun(runPath(PHASE_PARSE, chunk), header, std::vector<uint64_t>(), positions);
+}
+
+bool DistributedConvert::bucket(size_t chunk)
+{
+	// Every parse task is done, their headers hold the global bounds
+	glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+	RunHeader header;
+	std::vector<uint64_t> tileStarts;
+	for (size_t c = 0; c < plan.chunks; c++) {
+		FILE *file = openRun(runPath(PHASE_PARSE, c), header, tileStarts);
+		if (file == NULL)
+			return false;
+		fclose(file);
+		if (header.count > 0) {
+			min = glm::min(min, glm::vec3(header.min[0], header.min[1], header.min[2]));
+			max = glm::max(max, glm::vec3(header.max[0], header.max[1], header.max[2]));
+		}
+	}
+
+	FILE *file = openRun(runPath(PHASE_PARSE, chunk), header, tileStarts);
+	if (file == NULL)
+		return false;
+	std::vector<float> positions((size_t)header.count * 3);
+	const bool ok = fread(positions.data(), sizeof(float), positions.size(), file) == positions.size();
+	fclose(file);
+	if (!ok)
+		return false;
+
+	// Counting sort by the top Morton bits, the full sort happens per tile
+	const size_t count = (size_t)header.count;
+	const int shift = 30 - 3 * plan.tileLevel;
+	const glm::vec3 invExtent = 1.f / glm::max(max - min, glm::vec3(FLT_MIN));
+	std::vector<uint32_t> tiles(count);
+	parallelFor(count, [&](size_t, size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+			tiles[i] = mortonCode(&positions[i * 3], &min[0], &invExtent[0]) >> shift;
+	});
+	tileStarts.assign(tileCount() + 1, 0);
+	for (size_t i = 0; i < count; i++)
+		tileStarts[tiles[i] + 1]++;
+	for (size_t t = 0; t < tileCount(); t++)
+		tileStarts[t + 1] += tileStarts[t];
+
+	std::vector<float> grouped(positions.size());
+	std::vector<uint64_t> cursor(tileStarts.begin(), tileStarts.end() - 1);
+	for (size_t i = 0; i < count; i++)
+		memcpy(&grouped[(size_t)cursor[tiles[i]]++ * 3], &positions[i * 3], 3 * sizeof(float));
+
+	header.tiles = (uint32_t)tileCount();
+	memcpy(header.min, &min[0], sizeof(header.min));
+	memcpy(header.max, &max[0], sizeof(header.max));
+	pointsRun += count;
+	return writeRun(runPath(PHASE_BUCKET, chunk), header, tileStarts, grouped);
+}
+
+bool DistributedConvert::tile(size_t index)
+{
+	std::vector<float> positions;
+	RunHeader header;
+	std::vector<uint64_t> tileStarts;
+	for (size_t c = 0; c < plan.chunks; c++) {
+		FILE *file = openRun(runPath(PHASE_BUCKET, c), header, tileStarts);
+		if (file == NULL || tileStarts.size() != tileCount() + 1) {
+			if (file != NULL)
+				fclose(file);
+			return false;
+		}
+		const size_t used = positions.size();
+		const size_t count = (size_t)(tileStarts[index + 1] - tileStarts[index]);
+		positions.resize(used + count * 3);
+		const bool ok = fseeko(file, (off_t)(tileStarts[index] * 3 * sizeof(float)), SEEK_CUR) == 0 &&
+			fread(&positions[used], sizeof(float), count * 3, file) == count * 3;
+		fclose(file);
+		if (!ok)
+			return false;
+	}
+
+	// Same bounds as the bucket step, so the tiles' orders join seamlessly
+	const glm::vec3 min(header.min[0], header.min[1], header.min[2]);
+	const glm::vec3 max(header.max[0], header.max[1], header.max[2]);
+	std::vector<uint32_t> keys, order;
+	mortonOrder(positions, min, max, keys, order);
+	std::vector<PointCloud> nodes;
+	buildNodes(positions, order, plan.nodePoints, nodes);
+	pointsRun += order.size();
+	return writePointFile(tilePath(index), nodes, 0, 0);
+}
+
+bool DistributedConvert::merge()
+{
+	std::vector<PointFileHeader> headers(tileCount());
+	std::vector<PointFileNode> table;
+	for (size_t t = 0; t < tileCount(); t++) {
+		FILE *file = fopen(tilePath(t).c_str(), "rb");
+		if (file == NULL)
+			return false;
+		std::vector<PointFileNode> nodes;
+		bool ok = fread(&headers[t], sizeof(PointFileHeader), 1, file) == 1 && checkPointFileHeader(headers[t], UINT64_MAX);
+		if (ok) {
+			nodes.resize(headers[t].nodes);
+			ok = fread(nodes.data(), sizeof(PointFileNode), nodes.size(), file) == nodes.size();
+		}
+		fclose(file);
+		if (!ok)
+			return false;
+		table.insert(table.end(), nodes.begin(), nodes.end());
+	}
+
+	// Node arrays keep their alignment as every tile's data moves by a
+	// multiple of it
+	uint64_t offset = pointFileTableBytes(table.size()), pointCount = 0;
+	for (size_t t = 0, n = 0; t < tileCount(); t++) {
+		const uint64_t data = pointFileTableBytes(headers[t].nodes);
+		for (uint32_t i = 0; i < headers[t].nodes; i++, n++) {
+			table[n].positions += offset - data;
+			if (table[n].normals != 0)
+				table[n].normals += offset - data;
+			pointCount += table[n].count;
+		}
+		offset += headers[t].bytes - data;
+	}
+
+	PointFileHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = POINT_FILE_MAGIC;
+	header.version = POINT_FILE_VERSION;
+	header.nodes = (uint32_t)table.size();
+	header.sourceSize = plan.inputBytes;
+	header.bytes = offset;
+
+	const std::string temp = options.output + ".tmp." + std::to_string((int)getpid());
+	FILE *output = fopen(temp.c_str(), "wb");
+	if (output == NULL)
+		return false;
+	std::vector<char> padding(pointFileTableBytes(table.size()) - sizeof(header) - table.size() * sizeof(PointFileNode), 0);
+	bool ok = fwrite(&header, sizeof(header), 1, output) == 1 &&
+		fwrite(table.data(), sizeof(PointFileNode), table.size(), output) == table.size() &&
+		fwrite(padding.data(), 1, padding.size(), output) == padding.size();
+
+	std::vector<char> buffer(CONVERT_COPY_BYTES);
+	for (size_t t = 0; ok && t < tileCount(); t++) {
+		FILE *file = fopen(tilePath(t).c_str(), "rb");
+		ok = file != NULL && fseeko(file, (off_t)pointFileTableBytes(headers[t].nodes), SEEK_SET) == 0;
+		for (uint64_t left = headers[t].bytes - pointFileTableBytes(headers[t].nodes); ok && left > 0;) {
+			const size_t bytes = (size_t)std::min<uint64_t>(left, buffer.size());
+			ok = fread(buffer.data(), 1, bytes, file) == bytes && fwrite(buffer.data(), 1, bytes, output) == bytes;
+			left -= bytes;
+		}
+		if (file != NULL)
+			fclose(file);
+	}
+	ok = fclose(output) == 0 && ok;
+	if (!ok || rename(temp.c_str(), options.output.c_str()) != 0) {
+		remove(temp.c_str());
+		return false;
+	}
+	pointsRun += pointCount;
+	std::cout << table.size() << " nodes of " << pointCount << " points written to " << options.output << std::endl;
+	return true;
+}
+
+/**
+* Only the done markers stay, so late workers see the job is finished.
+*/
+void DistributedConvert::removeIntermediates()
+{
+	for (size_t c = 0; c < plan.chunks; c++) {
+		remove(runPath(PHASE_PARSE, c).c_str());
+		remove(runPath(PHASE_BUCKET, c).c_str());
+	}
+	for (size_t t = 0; t < tileCount(); t++)
+		remove(tilePath(t).c_str());
+}
+
+bool DistributedConvert::runTask(const ConvertTask &task)
+{
+	switch (task.phase) {
+	case PHASE_PARSE: return parse(task.index);
+	case PHASE_BUCKET: return bucket(task.index);
+	case PHASE_TILE: return tile(task.index);
+	case PHASE_MERGE: return merge();
+	default: return false;
+	}
+}
+
+int DistributedConvert::run()
+{
+	mkdir(options.workDir.c_str(), 0777);
+	if (options.reclaim)
+		reclaim();
+	if (!joinPlan())
+		return EXIT_FAILURE;
+	std::cout << "Worker " << owner << ": " << plan.chunks << " chunks, " << tileCount() << " tiles" << std::endl;
+
+	for (size_t c = 0; c < plan.chunks; c++)
+		tasks.push_back({ PHASE_PARSE, c });
+	for (size_t c = 0; c < plan.chunks; c++)
+		tasks.push_back({ PHASE_BUCKET, c });
+	for (size_t t = 0; t < tileCount(); t++)
+		tasks.push_back({ PHASE_TILE, t });
+	tasks.push_back({ PHASE_MERGE, 0 });
+
+	auto start = std::chrono::high_resolution_clock::now();
+	double idleMs = 0;
+	for (;;) {
+		// First claimable task whose earlier phases are all done
+		bool pending = false, ran = false;
+		int blockedPhase = PHASE_COUNT;
+		for (const auto &task : tasks) {
+			if (task.phase > blockedPhase)
+				break;
+			const std::string name = taskName(task);
+			if (fileExists(path(name + ".done")))
+				continue;
+			pending = true;
+			blockedPhase = task.phase;
+			if (!claimFile(path(name + ".lock"), owner))
+				continue;
+
+			auto stage = std::chrono::high_resolution_clock::now();
+			if (!runTask(task)) {
+				std::cerr << "Task " << name << " failed, restart a worker with --reclaim once the cause is fixed" << std::endl;
+				return EXIT_FAILURE;
+			}
+
+			// The other workers wait on a task until it is marked done, and the
+			// merge inputs stay until then so a rerun can still find them
+			const double ms = elapsedMs(stage);
+			if (!claimFile(path(name + ".done"), owner) && !fileExists(path(name + ".done"))) {
+				std::cerr << "Cannot mark " << name << " done in " << options.workDir << ", restart a worker with --reclaim once the cause is fixed" << std::endl;
+				return EXIT_FAILURE;
+			}
+			if (task.phase == PHASE_MERGE)
+				removeIntermediates();
+			tasksRun[task.phase]++;
+			taskMs[task.phase] += ms;
+			std::cout << name << " done in " << ms << " ms" << std::endl;
+			ran = true;
+			break;
+		}
+		if (!pending)
+			break;
+		if (!ran) {
+			auto stage = std::chrono::high_resolution_clock::now();
+			std::this_thread::sleep_for(std::chrono::milliseconds(CONVERT_POLL_MS));
+			idleMs += elapsedMs(stage);
+		}
+	}
+
+	std::cout << "Worker " << owner << " ran";
+	for (int phase = 0; phase < PHASE_COUNT; phase++)
+		std::cout << " " << tasksRun[phase] << " " << phaseNames[phase] << " (" << taskMs[phase] << " ms)";
+	std::cout << ", idle " << idleMs << " ms" << std::endl;
+	const double seconds = elapsedMs(start) / 1000.0;
+	std::cout << "Done in " << seconds << " s (" << (pointsRun / 1000000.0) / seconds << " M points/s handled by this worker)" << std::endl;
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char **args)
+{
+	ConvertOptions options;
+	if (!parseArgs(argc, args, options)) {
+		usage();
+		return EXIT_FAILURE;
+	}
+	workerLimit() = options.threads;
+
+	if (!options.workDir.empty()) {
+		// Workers split the input by byte ranges, which needs plain text
+		if (detectCompression(options.input) != INPUT_PLAIN) {
+			std::cerr << "Decompress " << options.input << " before a distributed conversion" << std::endl;
+			return EXIT_FAILURE;
+		}
+		DistributedConvert convert(options);
+		return convert.run();
+	}
+	if (options.memoryMB > 0)
+		return convertExternal(options);
+	return convertLocal(options);
+}
@@ -0,0 +1,29 @@
+# Runs pcv-convert on INPUT in memory and within a budget small enough to
+# spill several sorted runs, and fails unless both outputs are byte
+# identical.
+# cmake -DCONVERT=<pcv-convert> -DINPUT=<input.obj> -DOUTPUT_DIR=<dir> -P convert_memory_test.cmake
+
+set(ARGS --node-points 4096 --threads 3)
+execute_process(COMMAND ${CONVERT} ${INPUT} ${OUTPUT_DIR}/convert-memory-0.pcvc ${ARGS}
+    RESULT_VARIABLE RESULT OUTPUT_QUIET)
+if(NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "pcv-convert failed on ${INPUT}")
+endif()
+
+execute_process(COMMAND ${CONVERT} ${INPUT} ${OUTPUT_DIR}/convert-memory-1.pcvc ${ARGS} --memory 1
+    RESULT_VARIABLE RESULT OUTPUT_VARIABLE OUTPUT)
+if(NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "pcv-convert --memory 1 failed on ${INPUT}")
+endif()
+
+# A single run would not test the merge
+string(REGEX MATCH "([0-9]+) runs" RUNS "${OUTPUT}")
+if(NOT RUNS OR CMAKE_MATCH_1 LESS 2)
+    message(FATAL_ERROR "--memory 1 sorted ${INPUT} without spilling at least two runs:\n${OUTPUT}")
+endif()
+
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${OUTPUT_DIR}/convert-memory-0.pcvc ${OUTPUT_DIR}/convert-memory-1.pcvc
+    RESULT_VARIABLE RESULT)
+if(NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "--memory changed the point file")
+endif()
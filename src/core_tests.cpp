@@ -0,0 +1,781 @@
+///////////////////////////////////////////////////////////
+// pcvcore-tests: Headless tests of the core library     //
+///////////////////////////////////////////////////////////
+
+#include <iostream>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "cluster.h"
+#include "ground_filter.h"
+#include "http_fetch.h"
+#include "obj_stream.h"
+#include "point_cloud.h"
+#include "point_file.h"
+#include "radix_sort.h"
+#include "spatial_query.h"
+
+#define TEST_RANDOM_SEED 1234
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static size_t failures = 0;
+static std::string tileServer; // pcv-tile-server binary for the http test, from --tile-server
+static std::string converter; // pcv-convert binary for the convert test, from --convert
+
+/**
+* Reports a failed condition and keeps going, so one run lists every failure.
+*/
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition << std::endl; \
+			failures++; \
+		} \
+	} while (0)
+
+/**
+* Worker counts results must not depend on, odd ones split ranges unevenly.
+* They are used as given even on machines with fewer threads.
+*/
+static const unsigned testThreads[] = { 1, 2, 3, 8 };
+
+/**
+* Thread counts to benchmark, 1 up to all hardware threads.
+*/
+static std::vector<unsigned> threadCounts()
+{
+	std::vector<unsigned> counts;
+	const unsigned maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	for (unsigned threads = 1;; threads = std::min(threads * 2, maxThreads)) {
+		counts.push_back(threads);
+		if (threads == maxThreads)
+			break;
+	}
+	return counts;
+}
+
+static std::vector<float> randomPoints(size_t count, float extent, std::mt19937 &random)
+{
+	std::uniform_real_distribution<float> coordinate(0.f, extent);
+	std::vector<float> positions(count * 3);
+	for (auto &p : positions)
+		p = coordinate(random);
+	return positions;
+}
+
+static void testLoader()
+{
+	const char *objPath = "pcvcore-tests.obj";
+	const char *pointPath = "pcvcore-tests.pcvc";
+	FILE *file = fopen(objPath, "w");
+	CHECK(file != NULL);
+	if (file == NULL)
+		return;
+	fputs("o first\nv 0 0 0\nv 1 0 0\nv 0 2 0\nvn 0 0 1\nf 1//1 2//1 3//1\n"
+		"o second\nv 5 5 5\nv 6 5 5\nv 6 6 5\nv 5 6 -1\nf 4 5 6\nf 4 6 7\n", file);
+	fclose(file);
+
+	// Shapes load as separate clouds with their own bounds
+	std::vector<PointCloud> clouds;
+	std::string error;
+	CHECK(loadPointClouds(objPath, clouds, error));
+	CHECK(clouds.size() == 2);
+	if (clouds.size() == 2) {
+		const float first[] = { 0, 0, 0, 1, 0, 0, 0, 2, 0 };
+		const float second[] = { 5, 5, 5, 6, 5, 5, 6, 6, 5, 5, 6, -1 };
+		CHECK(clouds[0].positions == std::vector<float>(first, first + 9));
+		CHECK(clouds[1].positions == std::vector<float>(second, second + 12));
+		CHECK(clouds[0].hasNormals() && !clouds[1].hasNormals());
+		CHECK(clouds[1].min == glm::vec3(5, 5, -1) && clouds[1].max == glm::vec3(6, 6, 5));
+	}
+
+	// The streaming reader sees the same positions in file order
+	ObjPointStream stream;
+	std::vector<float> streamed, batch;
+	CHECK(stream.open(objPath));
+	while (stream.read(batch, 2))
+		streamed.insert(streamed.end(), batch.begin(), batch.end());
+	CHECK(!stream.failed());
+	CHECK(streamed.size() == 21);
+
+	// A last line without a line break, read after the buffer was refilled
+	const size_t longCount = 400000;
+	file = fopen(objPath, "w");
+	CHECK(file != NULL);
+	if (file != NULL) {
+		for (size_t i = 0; i < longCount; i++)
+			fprintf(file, i + 1 < longCount ? "v %zu 1 2\n" : "v %zu 1 2", i);
+		fclose(file);
+	}
+	size_t longPoints = 0;
+	bool lastRead = false;
+	CHECK(stream.open(objPath));
+	while (stream.read(batch, 65536)) {
+		longPoints += batch.size() / 3;
+		lastRead = batch.size() >= 3 && batch[batch.size() - 3] == (float)(longCount - 1);
+	}
+	CHECK(longPoints == longCount && lastRead);
+
+	// Point files come back as written
+	std::vector<PointCloud> reread;
+	CHECK(writePointFile(pointPath, clouds, 0, 0));
+	CHECK(isPointFile(pointPath) && !isPointFile(objPath));
+	CHECK(loadPointClouds(pointPath, reread, error));
+	CHECK(reread.size() == clouds.size());
+	for (size_t i = 0; i < reread.size() && i < clouds.size(); i++) {
+		CHECK(reread[i].positions == clouds[i].positions);
+		CHECK(reread[i].normals == clouds[i].normals);
+	}
+
+	std::vector<PointCloud> missing;
+	CHECK(!loadPointClouds("pcvcore-tests-missing.obj", missing, error));
+	remove(objPath);
+	remove(pointPath);
+}
+
+static void testRadixSort()
+{
+	std::mt19937 random(TEST_RANDOM_SEED);
+	for (int keyBits : { 7, 16, 30, 32 }) {
+		for (size_t count : { (size_t)1, (size_t)1000, (size_t)300000 }) {
+			std::vector<uint32_t> keys(count), values(count);
+			for (size_t i = 0; i < count; i++) {
+				keys[i] = (uint32_t)random();
+				values[i] = (uint32_t)i;
+			}
+			const uint32_t mask = keyBits >= 32 ? 0xffffffffu : (1u << keyBits) - 1;
+			std::vector<uint32_t> expected = values;
+			std::stable_sort(expected.begin(), expected.end(), [&](uint32_t a, uint32_t b) {
+				return (keys[a] & mask) < (keys[b] & mask);
+			});
+
+			std::vector<uint32_t> sortedKeys = keys, sortedValues = values;
+			radixSort(sortedKeys, sortedValues, keyBits);
+			CHECK(sortedValues == expected);
+			for (size_t i = 0; i < count; i++)
+				CHECK(sortedKeys[i] == keys[sortedValues[i]]);
+
+			// Nearly sorted input takes the insertion sort path, swap two distinct keys
+			size_t i = 1;
+			while (i < count && (sortedKeys[i - 1] & mask) == (sortedKeys[i] & mask))
+				i++;
+			if (i < count) {
+				std::swap(sortedKeys[i - 1], sortedKeys[i]);
+				std::swap(sortedValues[i - 1], sortedValues[i]);
+			}
+			sortNearlySorted(sortedKeys, sortedValues, keyBits);
+			CHECK(sortedValues == expected);
+		}
+	}
+}
+
+static void testSpatialQueries()
+{
+	std::mt19937 random(TEST_RANDOM_SEED);
+	const size_t count = 20000, queries = 2000, k = 12;
+	const float radius = 0.08f;
+	const std::vector<float> positions = randomPoints(count, 1.f, random);
+	const std::vector<float> points = randomPoints(queries, 1.f, random);
+
+	KdTree tree;
+	tree.build(positions.data(), count);
+	PointGrid grid;
+	grid.build(positions.data(), count, radius);
+
+	QueryResults nearest, treeRadius, gridRadius;
+	batchNearestK(tree, points.data(), queries, k, FLT_MAX, nearest);
+	batchRadius(tree, points.data(), queries, radius, treeRadius);
+	batchRadius(grid, points.data(), queries, radius, gridRadius);
+	CHECK(nearest.queries() == queries && treeRadius.queries() == queries && gridRadius.queries() == queries);
+
+	for (size_t q = 0; q < queries; q++) {
+		const float *p = &points[q * 3];
+		std::vector<float> distances(count);
+		std::vector<uint32_t> inside;
+		for (size_t i = 0; i < count; i++) {
+			const float dx = positions[i * 3] - p[0], dy = positions[i * 3 + 1] - p[1], dz = positions[i * 3 + 2] - p[2];
+			distances[i] = dx * dx + dy * dy + dz * dz;
+			if (distances[i] <= radius * radius)
+				inside.push_back((uint32_t)i);
+		}
+
+		// kNN: the k smallest distances in ascending order
+		std::vector<float> smallest = distances;
+		std::partial_sort(smallest.begin(), smallest.begin() + k, smallest.end());
+		CHECK(nearest.count(q) == k);
+		for (size_t j = 0; j < nearest.count(q) && j < k; j++)
+			CHECK(fabsf(nearest.distSq[nearest.offsets[q] + j] - smallest[j]) <= 1e-6f);
+
+		// Radius: the same points from both indexes, as original indices
+		std::vector<uint32_t> fromTree, fromGrid;
+		for (size_t e = treeRadius.offsets[q]; e < treeRadius.offsets[q + 1]; e++)
+			fromTree.push_back(tree.order[treeRadius.entries[e]]);
+		for (size_t e = gridRadius.offsets[q]; e < gridRadius.offsets[q + 1]; e++)
+			fromGrid.push_back(grid.order[gridRadius.entries[e]]);
+		std::sort(fromTree.begin(), fromTree.end());
+		std::sort(fromGrid.begin(), fromGrid.end());
+		CHECK(fromTree == inside);
+		CHECK(fromGrid == inside);
+	}
+
+	// Boxes of random size, every tenth one away from the points so it is empty
+	std::uniform_real_distribution<float> unit(0.f, 1.f);
+	std::vector<float> boxes(queries * 6);
+	for (size_t q = 0; q < queries; q++) {
+		const float offset = q % 10 == 0 ? 2.f : 0.f;
+		for (int a = 0; a < 3; a++) {
+			const float size = unit(random) * 0.2f;
+			boxes[q * 6 + a] = unit(random) - size * 0.5f + offset;
+			boxes[q * 6 + 3 + a] = boxes[q * 6 + a] + size;
+		}
+	}
+	QueryResults treeBox, gridBox;
+	batchBox(tree, boxes.data(), queries, treeBox);
+	batchBox(grid, boxes.data(), queries, gridBox);
+	CHECK(treeBox.queries() == queries && gridBox.queries() == queries);
+
+	size_t emptyBoxes = 0;
+	for (size_t q = 0; q < queries; q++) {
+		const float *lo = &boxes[q * 6], *hi = &boxes[q * 6 + 3];
+		std::vector<uint32_t> inside;
+		for (size_t i = 0; i < count; i++) {
+			const float *p = &positions[i * 3];
+			if (p[0] >= lo[0] && p[0] <= hi[0] && p[1] >= lo[1] && p[1] <= hi[1] && p[2] >= lo[2] && p[2] <= hi[2])
+				inside.push_back((uint32_t)i);
+		}
+		emptyBoxes += inside.empty() ? 1 : 0;
+
+		std::vector<uint32_t> fromTree, fromGrid;
+		for (size_t e = treeBox.offsets[q]; e < treeBox.offsets[q + 1]; e++)
+			fromTree.push_back(tree.order[treeBox.entries[e]]);
+		for (size_t e = gridBox.offsets[q]; e < gridBox.offsets[q + 1]; e++)
+			fromGrid.push_back(grid.order[gridBox.entries[e]]);
+		std::sort(fromTree.begin(), fromTree.end());
+		std::sort(fromGrid.begin(), fromGrid.end());
+		CHECK(fromTree == inside);
+		CHECK(fromGrid == inside);
+	}
+	CHECK(emptyBoxes >= queries / 10 && emptyBoxes < queries);
+
+	// Rays from around the points, half of them aimed into the points and the
+	// rest in random directions where most of them miss
+	const float rayRadius = 0.01f, maxT = 2.f;
+	std::normal_distribution<float> normal(0.f, 1.f);
+	std::vector<float> rays(queries * 6);
+	for (size_t q = 0; q < queries; q++) {
+		for (int a = 0; a < 3; a++) {
+			rays[q * 6 + a] = unit(random) * 3.f - 1.f;
+			rays[q * 6 + 3 + a] = q % 2 == 0 ? unit(random) - rays[q * 6 + a] : normal(random);
+		}
+	}
+	std::vector<uint32_t> treeHits, gridHits;
+	std::vector<float> treeT, gridT;
+	batchRaycast(tree, rays.data(), queries, rayRadius, maxT, treeHits, treeT);
+	batchRaycast(grid, rays.data(), queries, rayRadius, maxT, gridHits, gridT);
+	CHECK(treeHits.size() == queries && gridHits.size() == queries);
+
+	size_t misses = 0;
+	for (size_t q = 0; q < queries && treeHits.size() == queries && gridHits.size() == queries; q++) {
+		const float *origin = &rays[q * 6], *dir = &rays[q * 6 + 3];
+		const float length = sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+		const float d[3] = { dir[0] / length, dir[1] / length, dir[2] / length };
+		float best = maxT;
+		for (size_t i = 0; i < count; i++) {
+			const float *p = &positions[i * 3];
+			const float v[3] = { p[0] - origin[0], p[1] - origin[1], p[2] - origin[2] };
+			const float along = v[0] * d[0] + v[1] * d[1] + v[2] * d[2];
+			const float w[3] = { v[0] - d[0] * along, v[1] - d[1] * along, v[2] - d[2] * along };
+			if (along >= 0 && along < best && w[0] * w[0] + w[1] * w[1] + w[2] * w[2] <= rayRadius * rayRadius)
+				best = along;
+		}
+
+		// Both find the nearest hit, or agree there is none
+		if (best == maxT) {
+			misses++;
+			CHECK(treeHits[q] == SPATIAL_NO_HIT && gridHits[q] == SPATIAL_NO_HIT);
+			continue;
+		}
+		CHECK(treeHits[q] != SPATIAL_NO_HIT && fabsf(treeT[q] - best) <= 1e-5f);
+		CHECK(gridHits[q] != SPATIAL_NO_HIT && fabsf(gridT[q] - best) <= 1e-5f);
+	}
+	CHECK(misses > 0 && misses < queries);
+
+	// Batches come out the same whatever the thread count
+	for (unsigned threads : testThreads) {
+		workerLimit() = threads;
+		QueryResults again;
+		batchNearestK(tree, points.data(), queries, k, FLT_MAX, again);
+		CHECK(again.entries == nearest.entries && again.offsets == nearest.offsets);
+	}
+	workerLimit() = 0;
+}
+
+#ifndef _WIN32
+
+/**
+* Answers the first request on a local port with "response" and closes the
+* connection, for responses pcv-tile-server never sends. Returns the port.
+*/
+static int cannedServer(const std::string &response, std::thread &thread)
+{
+	const int listener = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t length = sizeof(address);
+	if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listener, 1) != 0 ||
+		getsockname(listener, (struct sockaddr *)&address, &length) != 0)
+		return -1;
+
+	thread = std::thread([listener, response]() {
+		const int client = accept(listener, NULL, NULL);
+		std::string request;
+		char buffer[4096];
+		ssize_t received = 1;
+		while (client >= 0 && request.find("\r\n\r\n") == std::string::npos && received > 0) {
+			received = recv(client, buffer, sizeof(buffer), 0);
+			request.append(buffer, received > 0 ? (size_t)received : 0);
+		}
+		if (client >= 0) {
+			send(client, response.data(), response.size(), MSG_NOSIGNAL);
+			close(client);
+		}
+		close(listener);
+	});
+	return ntohs(address.sin_port);
+}
+
+/**
+* Starts pcv-tile-server on a free port serving "directory", returns its
+* process and port or -1.
+*/
+static pid_t startTileServer(const std::string &directory, int &port)
+{
+	int out[2];
+	if (pipe(out) != 0)
+		return -1;
+	const pid_t pid = fork();
+	if (pid == 0) {
+		dup2(out[1], STDOUT_FILENO);
+		close(out[0]);
+		close(out[1]);
+		execl(tileServer.c_str(), tileServer.c_str(), directory.c_str(), "--port", "0", (char *)NULL);
+		_exit(127);
+	}
+	close(out[1]);
+
+	// "Serving <directory> on http://127.0.0.1:<port>/" once it listens
+	std::string line;
+	char c;
+	while (pid > 0 && line.find('\n') == std::string::npos && read(out[0], &c, 1) == 1)
+		line += c;
+	close(out[0]);
+	const size_t colon = line.rfind(':');
+	port = colon != std::string::npos ? atoi(line.c_str() + colon + 1) : 0;
+	if (pid > 0 && port <= 0) {
+		kill(pid, SIGTERM);
+		waitpid(pid, NULL, 0);
+		return -1;
+	}
+	return pid;
+}
+
+static void testHttp()
+{
+	// Bracketed IPv6 hosts, bare ones are ambiguous
+	HttpUrl url;
+	CHECK(parseHttpUrl("http://[::1]:8081/a/b.pcvc", url) && url.host == "::1" && url.port == 8081 && url.path == "/a/b.pcvc");
+	CHECK(parseHttpUrl("http://[fe80::1]/", url) && url.host == "fe80::1" && url.port == 80);
+	CHECK(parseHttpUrl("http://example.com:81", url) && url.host == "example.com" && url.port == 81 && url.path == "/");
+	CHECK(!parseHttpUrl("http://::1/a", url));
+	CHECK(!parseHttpUrl("http://[::1/a", url));
+	CHECK(!parseHttpUrl("http://[::1]x/a", url));
+
+	// A range that starts elsewhere than asked is an error, not data
+	std::vector<char> body;
+	std::string error;
+	std::thread server;
+	HttpConnection wrongRange;
+	CHECK(parseHttpUrl("http://127.0.0.1:" + std::to_string(cannedServer(
+		"HTTP/1.1 206 Partial Content\r\nContent-Range: bytes 0-3/100\r\nContent-Length: 4\r\n\r\nabcd", server)) + "/f", url));
+	CHECK(!wrongRange.get(url, 10, 4, body, NULL, error) && !error.empty());
+	if (server.joinable())
+		server.join();
+
+	// Without a length the body runs to the end of the connection
+	HttpConnection toClose;
+	CHECK(parseHttpUrl("http://127.0.0.1:" + std::to_string(cannedServer("HTTP/1.1 200 OK\r\n\r\nno length given", server)) + "/f", url));
+	CHECK(toClose.get(url, 0, 0, body, NULL, error) && std::string(body.begin(), body.end()) == "no length given");
+	if (server.joinable())
+		server.join();
+
+	if (tileServer.empty()) {
+		std::cout << "http: no --tile-server, skipping the server checks" << std::endl;
+		return;
+	}
+
+	const char *dataPath = "pcvcore-tests-http.bin";
+	std::mt19937 random(TEST_RANDOM_SEED);
+	std::vector<char> data(3 << 20);
+	for (auto &byte : data)
+		byte = (char)random();
+	FILE *file = fopen(dataPath, "wb");
+	CHECK(file != NULL);
+	if (file == NULL)
+		return;
+	fwrite(data.data(), 1, data.size(), file);
+	fclose(file);
+
+	int port = 0;
+	const pid_t pid = startTileServer(".", port);
+	CHECK(pid > 0);
+	if (pid > 0) {
+		CHECK(parseHttpUrl("http://127.0.0.1:" + std::to_string(port) + "/" + dataPath, url));
+
+		// One connection serves every request
+		HttpConnection connection;
+		uint64_t size = 0;
+		for (uint64_t offset : { (uint64_t)0, (uint64_t)1000, (uint64_t)data.size() - 10 }) {
+			CHECK(connection.get(url, offset, 100, body, &size, error));
+			CHECK(size == data.size() && body.size() == std::min<size_t>(100, data.size() - offset));
+			CHECK(std::equal(body.begin(), body.end(), data.begin() + offset));
+		}
+		CHECK(connection.connects() == 1);
+
+		// Ranges over a few connections at once, the last ones read to the end
+		const unsigned connections = 4;
+		const size_t requests = 64;
+		std::uniform_int_distribution<size_t> offsets(0, data.size() - 1);
+		std::vector<uint64_t> starts(requests), lengths(requests);
+		FetchPipeline pipeline;
+		pipeline.start(url, connections);
+		for (size_t i = 0; i < requests; i++) {
+			starts[i] = offsets(random);
+			lengths[i] = i + 4 < requests ? std::min<size_t>(offsets(random) % 100000 + 1, data.size() - starts[i]) : 0;
+			pipeline.request(i, starts[i], lengths[i]);
+		}
+		FetchResult result;
+		size_t fetched = 0;
+		while (pipeline.wait(result)) {
+			const size_t expected = result.length > 0 ? (size_t)result.length : data.size() - (size_t)result.offset;
+			CHECK(result.ok && result.data.size() == expected);
+			CHECK(result.ok && std::equal(result.data.begin(), result.data.end(), data.begin() + result.offset));
+			fetched++;
+		}
+		CHECK(fetched == requests);
+		CHECK(pipeline.connects() <= connections);
+		pipeline.stop();
+
+		kill(pid, SIGTERM);
+		waitpid(pid, NULL, 0);
+	}
+	remove(dataPath);
+}
+
+#else
+
+static void testHttp()
+{
+	std::cout << "http: needs POSIX sockets, skipped" << std::endl;
+}
+
+#endif
+
+#ifndef _WIN32
+
+/**
+* Starts "args" with its output discarded, returns the process or -1.
+*/
+static pid_t startProcess(const std::vector<std::string> &args)
+{
+	const pid_t pid = fork();
+	if (pid == 0) {
+		const int null = open("/dev/null", O_WRONLY);
+		dup2(null, STDOUT_FILENO);
+		std::vector<char *> argv;
+		for (auto &arg : args)
+			argv.push_back((char *)arg.c_str());
+		argv.push_back(NULL);
+		execv(argv[0], argv.data());
+		_exit(127);
+	}
+	return pid;
+}
+
+static bool processSucceeded(pid_t pid)
+{
+	int status = 0;
+	return pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+* Points of a point file node by node, in file order.
+*/
+static bool loadNodes(const char *path, std::vector<PointCloud> &nodes)
+{
+	std::string error;
+	nodes.clear();
+	if (!loadPointClouds(path, nodes, error)) {
+		std::cerr << error << std::endl;
+		return false;
+	}
+	return true;
+}
+
+static void testConvert()
+{
+	if (converter.empty()) {
+		std::cout << "convert: no --convert, skipped" << std::endl;
+		return;
+	}
+
+	const char *objPath = "pcvcore-tests-convert.obj";
+	const char *localPath = "pcvcore-tests-local.pcvc";
+	const char *distributedPath = "pcvcore-tests-distributed.pcvc";
+	const std::string workDir = "pcvcore-tests-work";
+	const size_t count = 60000, nodePoints = 4096;
+	std::mt19937 random(TEST_RANDOM_SEED);
+	const std::vector<float> positions = randomPoints(count, 10.f, random);
+	FILE *file = fopen(objPath, "w");
+	CHECK(file != NULL);
+	if (file == NULL)
+		return;
+	for (size_t i = 0; i < count; i++)
+		fprintf(file, "v %.9g %.9g %.9g\n", positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2]);
+	fclose(file);
+
+	// Workers racing for the same tasks, each with one thread so they overlap
+	const std::string nodes = std::to_string(nodePoints);
+	std::vector<pid_t> workers;
+	for (int w = 0; w < 4; w++) {
+		workers.push_back(startProcess({ converter, objPath, distributedPath, "--work-dir", workDir,
+			"--chunks", "5", "--tile-level", "1", "--node-points", nodes, "--threads", "1" }));
+	}
+	for (pid_t worker : workers)
+		CHECK(processSucceeded(worker));
+	CHECK(processSucceeded(startProcess({ converter, objPath, localPath, "--node-points", nodes })));
+
+	// Tiles split nodes where a local run does not, but the points come out
+	// in the same order
+	std::vector<PointCloud> local, distributed;
+	CHECK(loadNodes(localPath, local) && loadNodes(distributedPath, distributed));
+	std::vector<float> localPoints, distributedPoints;
+	for (auto &node : local)
+		localPoints.insert(localPoints.end(), node.positions.begin(), node.positions.end());
+	for (auto &node : distributed) {
+		CHECK(node.size() > 0 && node.size() <= nodePoints);
+		distributedPoints.insert(distributedPoints.end(), node.positions.begin(), node.positions.end());
+	}
+	CHECK(localPoints.size() == count * 3);
+	CHECK(distributedPoints == localPoints);
+
+	remove(objPath);
+	remove(localPath);
+	remove(distributedPath);
+	DIR *dir = opendir(workDir.c_str());
+	for (struct dirent *entry = dir != NULL ? readdir(dir) : NULL; entry != NULL; entry = readdir(dir))
+		remove((workDir + "/" + entry->d_name).c_str());
+	if (dir != NULL)
+		closedir(dir);
+	rmdir(workDir.c_str());
+}
+
+#else
+
+static void testConvert()
+{
+	std::cout << "convert: needs POSIX processes, skipped" << std::endl;
+}
+
+#endif
+
+static void testDeterminism()
+{
+	// Blobs of points for clustering, bumpy terrain with boxes on it for the ground filter
+	std::mt19937 random(TEST_RANDOM_SEED);
+	std::normal_distribution<float> spread(0.f, 0.05f);
+	std::uniform_real_distribution<float> unit(0.f, 1.f);
+	std::vector<float> blobs;
+	for (int b = 0; b < 20; b++) {
+		const float cx = unit(random) * 4, cy = unit(random) * 4, cz = unit(random) * 4;
+		for (int i = 0; i < 2000; i++) {
+			blobs.push_back(cx + spread(random));
+			blobs.push_back(cy + spread(random));
+			blobs.push_back(cz + spread(random));
+		}
+	}
+	std::vector<float> terrain;
+	for (int i = 0; i < 200000; i++) {
+		const float x = unit(random) * 100, z = unit(random) * 100;
+		float y = sinf(x * 0.05f) * 3 + cosf(z * 0.07f) * 2;
+		if (fmodf(x, 20.f) < 4 && fmodf(z, 20.f) < 4)
+			y += 5 * unit(random);
+		terrain.push_back(x);
+		terrain.push_back(y);
+		terrain.push_back(z);
+	}
+
+	ClusterOptions clusterOptions;
+	clusterOptions.epsilon = 0.05f;
+	clusterOptions.minPoints = 4;
+	GroundOptions groundOptions;
+	groundOptions.cellSize = 1.f;
+	groundOptions.tileSize = 32; // Several tiles even on this small raster
+
+	std::vector<uint32_t> clusters, classes;
+	size_t clusterCount = 0, groundPoints = 0;
+	for (unsigned threads : testThreads) {
+		workerLimit() = threads;
+		std::vector<uint32_t> labels, ground;
+		const size_t found = clusterPoints(blobs.data(), blobs.size() / 3, clusterOptions, labels);
+		const GroundStats stats = classifyGround(terrain.data(), terrain.size() / 3, groundOptions, ground);
+		if (threads == 1) {
+			clusters = labels;
+			clusterCount = found;
+			classes = ground;
+			groundPoints = stats.groundPoints;
+			CHECK(found > 0 && stats.groundPoints > 0 && stats.tiles > 1);
+			continue;
+		}
+		CHECK(found == clusterCount && labels == clusters);
+		CHECK(stats.groundPoints == groundPoints && ground == classes);
+	}
+	workerLimit() = 0;
+}
+
+template <typename Fn>
+static double timeMs(Fn fn)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	fn();
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+/**
+* Throughput of the core stages across thread counts, on random points or
+* the positions of "input".
+*/
+static void benchmark(const std::string &input)
+{
+	std::mt19937 random(TEST_RANDOM_SEED);
+	std::vector<float> positions;
+	if (!input.empty()) {
+		std::vector<PointCloud> clouds;
+		std::string error;
+		const double ms = timeMs([&]() {
+			if (!loadPointClouds(input, clouds, error))
+				std::cerr << error;
+		});
+		for (auto &cloud : clouds)
+			positions.insert(positions.end(), cloud.positions.begin(), cloud.positions.end());
+		printf("load             %9.1f ms  %8.2f M points/s\n", ms, ms > 0 ? positions.size() / 3 / (ms * 1000.0) : 0.0);
+	}
+	if (positions.empty())
+		positions = randomPoints(2000000, 1.f, random);
+	const size_t count = positions.size() / 3;
+	std::vector<uint32_t> keys(count);
+	for (auto &key : keys)
+		key = (uint32_t)random();
+
+	KdTree tree;
+	tree.build(positions.data(), count);
+	const size_t queries = std::min<size_t>(count, 200000);
+	for (unsigned threads : threadCounts()) {
+		workerLimit() = threads;
+		std::vector<uint32_t> sortedKeys = keys, order(count);
+		double ms = timeMs([&]() { radixSort(sortedKeys, order); });
+		printf("radix sort       %2u threads  %9.1f ms  %8.2f M keys/s\n", threads, ms, ms > 0 ? count / (ms * 1000.0) : 0.0);
+		ms = timeMs([&]() { tree.build(positions.data(), count); });
+		printf("KD-tree build    %2u threads  %9.1f ms  %8.2f M points/s\n", threads, ms, ms > 0 ? count / (ms * 1000.0) : 0.0);
+		QueryResults results;
+		ms = timeMs([&]() { batchNearestK(tree, positions.data(), queries, 16, FLT_MAX, results); });
+		printf("kNN 16           %2u threads  %9.1f ms  %8.2f M queries/s\n", threads, ms, ms > 0 ? queries / (ms * 1000.0) : 0.0);
+	}
+	workerLimit() = 0;
+}
+
+struct Test {
+	const char *name;
+	void (*run)();
+};
+
+static const Test tests[] = {
+	{ "loader", testLoader },
+	{ "radix-sort", testRadixSort },
+	{ "spatial", testSpatialQueries },
+	{ "determinism", testDeterminism },
+	{ "http", testHttp },
+	{ "convert", testConvert },
+};
+
+static void usage()
+{
+	std::cerr << "Usage: pcvcore-tests [test...] [options]\n"
+		"  Runs the given tests, or all of them: loader, radix-sort, spatial, determinism, http, convert\n"
+		"  --tile-server <path>  pcv-tile-server for the http test to fetch from\n"
+		"  --convert <path>    pcv-convert for the convert test to run\n"
+		"  --bench [input]     Times the core stages across thread counts instead\n";
+}
+
+int main(int argc, char **args)
+{
+	std::vector<std::string> names;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(args[i], "--bench") == 0) {
+			benchmark(i + 1 < argc ? args[i + 1] : "");
+			return EXIT_SUCCESS;
+		}
+		if (strcmp(args[i], "--tile-server") == 0 && i + 1 < argc) {
+			tileServer = args[++i];
+			continue;
+		}
+		if (strcmp(args[i], "--convert") == 0 && i + 1 < argc) {
+			converter = args[++i];
+			continue;
+		}
+		names.push_back(args[i]);
+	}
+
+	for (auto &name : names) {
+		bool known = false;
+		for (auto &test : tests)
+			known = known || name == test.name;
+		if (!known) {
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	for (auto &test : tests) {
+		if (!names.empty() && std::find(names.begin(), names.end(), test.name) == names.end())
+			continue;
+		const size_t before = failures;
+		test.run();
+		std::cout << test.name << (failures == before ? ": passed" : ": FAILED") << std::endl;
+	}
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,298 @@
+#include "dataset_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "async_file.h"
+
+#define CACHE_HASH_BLOCK (1 << 20)
+#define CACHE_STALE_SECONDS 600 // Temporary files of writers that died
+
+namespace {
+
+std::string cacheDirectory(const DatasetCacheOptions &options)
+{
+	if (!options.directory.empty())
+		return options.directory;
+	const char *env = getenv("PCV_CACHE_DIR");
+	return env != NULL && env[0] != '\0' ? env : DATASET_CACHE_DIRECTORY;
+}
+
+/**
+* Entries are named per user as well, the cache directory is shared like
+* /tmp and only a user's own entries are trusted.
+*/
+std::string entryPath(const DatasetCacheOptions &options, uint64_t hash)
+{
+	char name[48];
+#ifndef _WIN32
+	snprintf(name, sizeof(name), "/%016llx-%u.pcvc", (unsigned long long)hash, (unsigned)geteuid());
+#else
+	snprintf(name, sizeof(name), "/%016llx.pcvc", (unsigned long long)hash);
+#endif
+	return cacheDirectory(options) + name;
+}
+
+void setShape(CachedShape &shape, const float *positions, const float *normals, size_t count,
+	const glm::vec3 &center, const glm::vec3 &min, const glm::vec3 &max)
+{
+	shape.positions = positions;
+	shape.normals = normals;
+	shape.count = count;
+	shape.center = center;
+	shape.min = min;
+	shape.max = max;
+}
+
+}
+
+bool hashFileContent(const std::string &filename, uint64_t &hash, uint64_t &size)
+{
+	ReadAheadFile file;
+	if (!file.open(filename, 0, UINT64_MAX, CACHE_HASH_BLOCK))
+		return false;
+
+	uint64_t h = CONTENT_HASH_SEED;
+	size = 0;
+	const char *data;
+	size_t read;
+	while (file.next(data, read)) {
+		h = hashBytes(h, data, read);
+		size += read;
+	}
+	const bool ok = !file.failed();
+	hash = finishHash(h, size);
+	return ok;
+}
+
+uint64_t hashBytes(uint64_t h, const void *data, size_t bytes)
+{
+	// Word at a time multiply and xorshift mixing, bytes beyond the last full
+	// word are mixed in one by one
+	const unsigned char *block = (const unsigned char *)data;
+	size_t i = 0;
+	for (; i + 8 <= bytes; i += 8) {
+		uint64_t word;
+		memcpy(&word, &block[i], 8);
+		h = (h ^ word) * 0x9e3779b97f4a7c15ull;
+		h ^= h >> 29;
+	}
+	for (; i < bytes; i++) {
+		h = (h ^ block[i]) * 0x100000001b3ull;
+		h ^= h >> 29;
+	}
+	return h;
+}
+
+uint64_t finishHash(uint64_t h, uint64_t size)
+{
+	h ^= size;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	return h;
+}
+
+uint64_t hashPoints(const float *positions, const float *normals, size_t count)
+{
+	const size_t positionBytes = count * 3 * sizeof(float);
+	const size_t normalBytes = normals != NULL ? positionBytes : 0;
+	uint64_t h = hashBytes(CONTENT_HASH_SEED, positions, positionBytes);
+	h = hashBytes(h, normals, normalBytes);
+	return finishHash(h, ((uint64_t)positionBytes << 32) ^ normalBytes);
+}
+
+uint64_t hashPointCloud(const PointCloud &cloud)
+{
+	return hashPoints(cloud.positions.data(), cloud.hasNormals() ? cloud.normals.data() : NULL, cloud.size());
+}
+
+CachedDataset::~CachedDataset()
+{
+	close();
+}
+
+bool CachedDataset::open(const std::string &filename, const DatasetCacheOptions &options, std::string &error)
+{
+	close();
+	uint64_t size = 0;
+	if (!hashFileContent(filename, contentHash, size)) {
+		error = "Cannot read " + filename;
+		return false;
+	}
+
+	const std::string path = entryPath(options, contentHash);
+	if (map(path, size)) {
+		wasHit = true;
+		return true;
+	}
+
+	if (!loadPointClouds(filename, decoded, error))
+		return false;
+
+#ifndef _WIN32
+	// Shared by every user like /tmp, evicted after mapping so the new entry
+	// is locked by then
+	const std::string directory = cacheDirectory(options);
+	if (mkdir(directory.c_str(), 0777) == 0)
+		chmod(directory.c_str(), 01777);
+	if (writePointFile(path, decoded, contentHash, size) && map(path, size)) {
+		decoded.clear();
+		evictDatasetCache(options);
+		return true;
+	}
+#endif
+
+	// The cache is not writable, work from a private copy instead
+	for (auto &cloud : decoded) {
+		shapeList.emplace_back();
+		setShape(shapeList.back(), cloud.positions.data(), cloud.hasNormals() ? cloud.normals.data() : NULL,
+			cloud.size(), cloud.center, cloud.min, cloud.max);
+	}
+	return true;
+}
+
+#ifndef _WIN32
+
+bool CachedDataset::map(const std::string &path, uint64_t sourceSize)
+{
+	const int file = ::open(path.c_str(), O_RDONLY | O_NOFOLLOW);
+	if (file < 0)
+		return false;
+
+	// The shared lock is this process' reference, held until close. An entry
+	// unlinked by eviction before the lock was taken counts as a miss, and so
+	// does one another user placed in the shared directory.
+	struct stat info;
+	if (flock(file, LOCK_SH) != 0 || fstat(file, &info) != 0 || info.st_nlink == 0 || !S_ISREG(info.st_mode) ||
+		info.st_uid != geteuid() || (size_t)info.st_size < sizeof(PointFileHeader)) {
+		::close(file);
+		return false;
+	}
+	const size_t bytes = (size_t)info.st_size;
+	void *mapped = mmap(NULL, bytes, PROT_READ, MAP_SHARED, file, 0);
+	if (mapped == MAP_FAILED) {
+		::close(file);
+		return false;
+	}
+
+	// Reject entries of other loader versions and hash collisions of files
+	// with another size, and every offset outside the mapping
+	const char *base = static_cast<const char *>(mapped);
+	const PointFileHeader *header = reinterpret_cast<const PointFileHeader *>(base);
+	bool ok = checkPointFileHeader(*header, bytes) && header->sourceHash == contentHash && header->sourceSize == sourceSize;
+	const PointFileNode *table = reinterpret_cast<const PointFileNode *>(base + sizeof(PointFileHeader));
+	for (uint32_t i = 0; ok && i < header->nodes; i++) {
+		const PointFileNode &node = table[i];
+		ok = checkPointFileNode(node, bytes);
+		if (!ok)
+			break;
+		shapeList.emplace_back();
+		setShape(shapeList.back(), reinterpret_cast<const float *>(base + node.positions),
+			node.normals != 0 ? reinterpret_cast<const float *>(base + node.normals) : NULL, (size_t)node.count,
+			glm::vec3(node.center[0], node.center[1], node.center[2]),
+			glm::vec3(node.min[0], node.min[1], node.min[2]), glm::vec3(node.max[0], node.max[1], node.max[2]));
+	}
+	if (!ok) {
+		shapeList.clear();
+		munmap(mapped, bytes);
+		::close(file);
+		return false;
+	}
+
+	// Recently used for eviction
+	futimens(file, NULL);
+	fd = file;
+	memory = mapped;
+	mappedBytes = bytes;
+	return true;
+}
+
+void CachedDataset::close()
+{
+	if (memory != NULL)
+		munmap(memory, mappedBytes);
+	if (fd >= 0)
+		::close(fd);
+	fd = -1;
+	memory = NULL;
+	mappedBytes = 0;
+	wasHit = false;
+	shapeList.clear();
+	decoded.clear();
+}
+
+uint64_t evictDatasetCache(const DatasetCacheOptions &options)
+{
+	const std::string directory = cacheDirectory(options);
+	DIR *dir = opendir(directory.c_str());
+	if (dir == NULL)
+		return 0;
+
+	struct Entry {
+		std::string path;
+		uint64_t bytes;
+		time_t used;
+	};
+	std::vector<Entry> entries;
+	uint64_t total = 0;
+	const time_t now = time(NULL);
+	while (struct dirent *item = readdir(dir)) {
+		const std::string name = item->d_name;
+		const std::string path = directory + "/" + name;
+		struct stat info;
+		if (stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode))
+			continue;
+		if (name.find(".pcvc.tmp.") != std::string::npos) {
+			if (now - info.st_mtime > CACHE_STALE_SECONDS)
+				unlink(path.c_str());
+		}
+		else if (name.size() > 5 && name.compare(name.size() - 5, 5, ".pcvc") == 0) {
+			entries.push_back({ path, (uint64_t)info.st_size, info.st_mtime });
+			total += (uint64_t)info.st_size;
+		}
+	}
+	closedir(dir);
+
+	std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+		return a.used < b.used;
+	});
+
+	// An exclusive lock only succeeds if no process holds the entry open
+	uint64_t freed = 0;
+	for (size_t i = 0; i < entries.size() && total - freed > options.maxBytes; i++) {
+		const int fd = ::open(entries[i].path.c_str(), O_RDONLY);
+		if (fd < 0)
+			continue;
+		if (flock(fd, LOCK_EX | LOCK_NB) == 0 && unlink(entries[i].path.c_str()) == 0)
+			freed += entries[i].bytes;
+		::close(fd);
+	}
+	return freed;
+}
+
+#else
+
+bool CachedDataset::map(const std::string &, uint64_t) { return false; }
+
+void CachedDataset::close()
+{
+	wasHit = false;
+	shapeList.clear();
+	decoded.clear();
+}
+
+uint64_t evictDatasetCache(const DatasetCacheOptions &) { return 0; }
+
+#endif
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "point_file.h"
+
+#define DATASET_CACHE_DIRECTORY "/dev/shm/pcv-cache"
+#define CONTENT_HASH_SEED 0x243f6a8885a308d3ull
+
+/**
+* Where decoded datasets are shared and how much of it they may use.
+*/
+struct DatasetCacheOptions {
+	std::string directory; // Empty uses $PCV_CACHE_DIR or DATASET_CACHE_DIRECTORY
+	uint64_t maxBytes = 4ull << 30; // Entries not in use are evicted above this
+};
+
+/**
+* One decoded shape inside a mapped cache entry.
+*/
+struct CachedShape {
+	const float *positions = NULL;
+	const float *normals = NULL; // NULL if the shape has none
+	size_t count = 0;
+	glm::vec3 center = glm::vec3(0);
+	glm::vec3 min = glm::vec3(0);
+	glm::vec3 max = glm::vec3(0);
+};
+
+/**
+* A dataset decoded once and shared between processes through a point file
+* (point_file.h) in a tmpfs directory, named after a hash of the source
+* file's content. The
+* first process to open a dataset decodes it and publishes the entry, later
+* ones map it read-only so the OS shares the pages between them. Entries
+* are per user: the directory is writable by everyone, so entries owned by
+* another user are never mapped.
+*
+* Every open entry holds a shared flock on its file, which acts as the
+* reference count: eviction only removes entries nobody has locked, and the
+* locks of crashed processes go away with them. Entries are evicted least
+* recently used first once the directory grows past "maxBytes".
+*/
+class CachedDataset {
+public:
+	CachedDataset() {}
+	~CachedDataset();
+
+	/**
+	* Maps the entry of "filename", decoding the file and adding the entry
+	* first on a miss. "error" holds the loader's messages on a miss.
+	*/
+	bool open(const std::string &filename, const DatasetCacheOptions &options, std::string &error);
+	void close();
+
+	const std::vector<CachedShape> &shapes() const { return shapeList; }
+	bool hit() const { return wasHit; } // Mapped an existing entry without decoding
+	uint64_t hash() const { return contentHash; }
+	size_t bytes() const { return mappedBytes; }
+
+private:
+	CachedDataset(const CachedDataset &);
+	CachedDataset &operator=(const CachedDataset &);
+
+	bool map(const std::string &path, uint64_t sourceSize);
+
+	int fd = -1;
+	void *memory = NULL;
+	size_t mappedBytes = 0;
+	uint64_t contentHash = 0;
+	bool wasHit = false;
+	std::vector<CachedShape> shapeList;
+	std::vector<PointCloud> decoded; // Private copy when the cache cannot be written
+};
+
+/**
+* 64-bit hash of a file's content and its size, false if it cannot be read.
+*/
+bool hashFileContent(const std::string &filename, uint64_t &hash, uint64_t &size);
+
+/**
+* The mixing of hashFileContent: hashBytes continues "h", starting from
+* CONTENT_HASH_SEED, over a block and finishHash folds in the total size.
+*/
+uint64_t hashBytes(uint64_t h, const void *data, size_t bytes);
+uint64_t finishHash(uint64_t h, uint64_t size);
+
+/**
+* Hash of a cloud's positions and normals, tells which shapes of a file
+* changed between two loads. "normals" may be NULL.
+*/
+uint64_t hashPoints(const float *positions, const float *normals, size_t count);
+uint64_t hashPointCloud(const PointCloud &cloud);
+
+/**
+* Removes least recently used entries nobody has open until the cache fits
+* "maxBytes", returns the bytes freed.
+*/
+uint64_t evictDatasetCache(const DatasetCacheOptions &options);
@@ -0,0 +1,210 @@
+//////////////////////////////////////////////////
+// pcv-dem: Elevation rasters from point clouds //
+//////////////////////////////////////////////////
+
+#include <iostream>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+#include "obj_stream.h"
+#include "parallel.h"
+#include "raster.h"
+
+#define DEM_BATCH_POINTS (1 << 22)
+
+/**
+* Command line options.
+*/
+struct DemOptions {
+	std::string input;
+	std::string output;
+	float cellSize = 0; // 0 picks 1024 cells along the longest axis
+	RasterLayer layer = RASTER_MEAN;
+	int fillRadius = 2;
+	int upAxis = 1;
+	int tileRows = 0; // 0 derives it from the memory budget
+	size_t memoryMB = 1024;
+	unsigned threads = 0;
+};
+
+static void usage()
+{
+	std::cerr << "Usage: pcv-dem <input.obj> <output.asc> [options]\n"
+		"  --cell <size>       Cell size in model units (default: 1024 cells on the longest axis)\n"
+		"  --stat <min|max|mean>  Height statistic per cell (default: mean)\n"
+		"  --fill <radius>     Fill empty cells from neighbours within radius cells (default: 2, 0 disables)\n"
+		"  --up <x|y|z>        Up axis (default: y)\n"
+		"  --tile-rows <rows>  Rows processed per pass over the input (default: from --memory)\n"
+		"  --memory <MB>       Memory budget for the grid (default: 1024)\n"
+		"  --threads <count>   Worker threads (default: all)\n";
+}
+
+static bool parseArgs(int argc, char **args, DemOptions &options)
+{
+	int positional = 0;
+	for (int i = 1; i < argc; i++) {
+		const char *arg = args[i];
+		const bool hasValue = i + 1 < argc;
+		if (strcmp(arg, "--cell") == 0 && hasValue) {
+			options.cellSize = (float)atof(args[++i]);
+		}
+		else if (strcmp(arg, "--stat") == 0 && hasValue) {
+			const char *stat = args[++i];
+			if (strcmp(stat, "min") == 0) options.layer = RASTER_MIN;
+			else if (strcmp(stat, "max") == 0) options.layer = RASTER_MAX;
+			else if (strcmp(stat, "mean") == 0) options.layer = RASTER_MEAN;
+			else return false;
+		}
+		else if (strcmp(arg, "--fill") == 0 && hasValue) {
+			options.fillRadius = std::max(0, atoi(args[++i]));
+		}
+		else if (strcmp(arg, "--up") == 0 && hasValue) {
+			const char axis = args[++i][0];
+			if (axis < 'x' || axis > 'z')
+				return false;
+			options.upAxis = axis - 'x';
+		}
+		else if (strcmp(arg, "--tile-rows") == 0 && hasValue) {
+			options.tileRows = std::max(0, atoi(args[++i]));
+		}
+		else if (strcmp(arg, "--memory") == 0 && hasValue) {
+			options.memoryMB = (size_t)std::max(1, atoi(args[++i]));
+		}
+		else if (strcmp(arg, "--threads") == 0 && hasValue) {
+			options.threads = (unsigned)std::max(0, atoi(args[++i]));
+		}
+		else if (arg[0] == '-') {
+			return false;
+		}
+		else if (positional == 0) {
+			options.input = arg;
+			positional++;
+		}
+		else if (positional == 1) {
+			options.output = arg;
+			positional++;
+		}
+		else {
+			return false;
+		}
+	}
+	return positional == 2;
+}
+
+int main(int argc, char **args)
+{
+	DemOptions options;
+	if (!parseArgs(argc, args, options)) {
+		usage();
+		return EXIT_FAILURE;
+	}
+	workerLimit() = options.threads;
+
+	ObjPointStream stream;
+	if (!stream.open(options.input)) {
+		std::cerr << "Cannot open " << options.input << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// First pass finds the bounds
+	int u, v;
+	rasterAxes(options.upAxis, u, v);
+	float minU = FLT_MAX, minV = FLT_MAX, maxU = -FLT_MAX, maxV = -FLT_MAX;
+	size_t pointCount = 0;
+	std::vector<float> batch;
+	while (stream.read(batch, DEM_BATCH_POINTS)) {
+		for (size_t i = 0; i < batch.size(); i += 3) {
+			minU = std::min(minU, batch[i + u]);
+			minV = std::min(minV, batch[i + v]);
+			maxU = std::max(maxU, batch[i + u]);
+			maxV = std::max(maxV, batch[i + v]);
+		}
+		pointCount += batch.size() / 3;
+	}
+	if (stream.failed()) {
+		std::cerr << stream.error() << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (pointCount == 0) {
+		std::cerr << "No points in " << options.input << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	const float longest = std::max(maxU - minU, maxV - minV);
+	const float cellSize = options.cellSize > 0 ? options.cellSize : std::max(longest / 1024.f, FLT_MIN);
+	const int width = (int)floorf((maxU - minU) / cellSize) + 1;
+	const int height = (int)floorf((maxV - minV) / cellSize) + 1;
+
+	// Every worker keeps a private copy of the band while binning
+	int tileRows = options.tileRows;
+	if (tileRows == 0) {
+		const size_t rowBytes = (size_t)width * (sizeof(uint32_t) + 3 * sizeof(float)) * (workerCount() + 2);
+		tileRows = (int)std::max<size_t>(1, options.memoryMB * 1024 * 1024 / rowBytes);
+	}
+	tileRows = std::min(tileRows, height);
+	const int bands = (height + tileRows - 1) / tileRows;
+
+	std::cout << pointCount << " points, " << width << "x" << height << " cells of " << cellSize
+		<< ", " << bands << (bands == 1 ? " band" : " bands") << std::endl;
+
+	FILE *file = fopen(options.output.c_str(), "w");
+	if (file == NULL) {
+		std::cerr << "Cannot write " << options.output << std::endl;
+		return EXIT_FAILURE;
+	}
+	writeAsciiGridHeader(file, width, height, minU, minV, cellSize);
+
+	// The format stores the top row first, so bands go from the top down.
+	// Bands overlap by the fill radius so gaps along their edges fill the same
+	// as they would in a single pass, and all of them find rows from the
+	// grid's origin so the output does not depend on the band height.
+	Raster band;
+	size_t filled = 0;
+	for (int b = bands - 1; b >= 0; b--) {
+		const int first = b * tileRows;
+		const int last = std::min(height, first + tileRows);
+		const int below = std::min(options.fillRadius, first);
+		const int above = std::min(options.fillRadius, height - last);
+
+		band.resize(width, last - first + below + above, minU, minV, cellSize, options.upAxis, first - below);
+
+		stream.rewind();
+		while (stream.read(batch, DEM_BATCH_POINTS))
+			rasterizePoints(band, batch.data(), batch.size() / 3);
+		if (stream.failed()) {
+			std::cerr << stream.error() << std::endl;
+			fclose(file);
+			remove(options.output.c_str());
+			return EXIT_FAILURE;
+		}
+
+		// Only count the cells this band writes, not the overlap
+		const size_t rowsBegin = (size_t)below * width;
+		const size_t rowsEnd = (size_t)(below + last - first) * width;
+		const size_t empty = std::count(band.counts.begin() + rowsBegin, band.counts.begin() + rowsEnd, 0u);
+		fillRasterGaps(band, options.fillRadius);
+		filled += empty - std::count(band.counts.begin() + rowsBegin, band.counts.begin() + rowsEnd, 0u);
+
+		writeAsciiGridRows(file, band, options.layer, below, below + last - first);
+	}
+
+	const bool ok = ferror(file) == 0;
+	fclose(file);
+	if (!ok) {
+		std::cerr << "Failed writing " << options.output << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	std::cout << "Filled " << filled << " empty cells" << std::endl;
+	std::cout << "Done in " << seconds << " s (" << (pointCount / 1000000.0) / seconds << " M points/s)" << std::endl;
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,23 @@
+# Runs pcv-dem on INPUT with several band heights and fails unless every
+# output is byte identical to the single band one.
+# cmake -DDEM=<pcv-dem> -DINPUT=<input.obj> -DOUTPUT_DIR=<dir> -P dem_bands_test.cmake
+
+set(ARGS --cell 0.002 --threads 3)
+execute_process(COMMAND ${DEM} ${INPUT} ${OUTPUT_DIR}/dem-bands-0.asc ${ARGS}
+    RESULT_VARIABLE RESULT OUTPUT_QUIET)
+if(NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "pcv-dem failed on ${INPUT}")
+endif()
+
+foreach(ROWS 1 7 64)
+    execute_process(COMMAND ${DEM} ${INPUT} ${OUTPUT_DIR}/dem-bands-${ROWS}.asc ${ARGS} --tile-rows ${ROWS}
+        RESULT_VARIABLE RESULT OUTPUT_QUIET)
+    if(NOT RESULT EQUAL 0)
+        message(FATAL_ERROR "pcv-dem --tile-rows ${ROWS} failed on ${INPUT}")
+    endif()
+    execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${OUTPUT_DIR}/dem-bands-0.asc ${OUTPUT_DIR}/dem-bands-${ROWS}.asc
+        RESULT_VARIABLE RESULT)
+    if(NOT RESULT EQUAL 0)
+        message(FATAL_ERROR "--tile-rows ${ROWS} changed the raster")
+    endif()
+endforeach()
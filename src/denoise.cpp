@@ -0,0 +1,139 @@
+#include "denoise.h"
+
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+
+#include <glm/glm.hpp>
+
+#include "kd_tree.h"
+#include "parallel.h"
+#include "pca.h"
+
+#define DENOISE_SIGMA_SAMPLES 1024
+
+namespace {
+
+/**
+* Half the mean distance to the farthest of "k" neighbours, from a sample.
+*/
+float estimateSigma(const KdTree &tree, int k)
+{
+	const size_t count = tree.size();
+	const size_t stride = std::max<size_t>(count / DENOISE_SIGMA_SAMPLES, 1);
+	uint32_t entries[DENOISE_MAX_NEIGHBOURS];
+	float dists[DENOISE_MAX_NEIGHBOURS];
+
+	double sum = 0;
+	size_t samples = 0;
+	for (size_t e = 0; e < count; e += stride) {
+		const size_t found = tree.nearestK(tree.point(e), k, FLT_MAX, entries, dists);
+		if (found > 1) {
+			sum += sqrt(dists[found - 1]);
+			samples++;
+		}
+	}
+	return samples > 0 ? (float)(sum / samples) * 0.5f : 1.f;
+}
+
+}
+
+DenoiseStats denoisePoints(std::vector<float> &positions, std::vector<float> &normals, const DenoiseOptions &options)
+{
+	DenoiseStats stats;
+	const size_t count = positions.size() / 3;
+	if (count < 3)
+		return stats;
+
+	const int k = std::min(std::max(options.neighbours, 3), DENOISE_MAX_NEIGHBOURS);
+	if (normals.size() != positions.size())
+		normals.assign(positions.size(), 0.f);
+
+	std::vector<float> nextPositions(positions.size());
+	std::vector<float> nextNormals(normals.size());
+	for (int it = 0; it < options.iterations; it++) {
+		auto start = std::chrono::high_resolution_clock::now();
+
+		KdTree tree;
+		tree.build(positions.data(), count);
+		const float sigma = options.sigma > 0 ? options.sigma : estimateSigma(tree, k);
+		const float sigmaNormal = options.sigmaNormal > 0 ? options.sigmaNormal : sigma * 0.5f;
+		const float spatialFactor = -0.5f / (sigma * sigma);
+		const float normalFactor = -0.5f / (sigmaNormal * sigmaNormal);
+
+		// Walk the points in tree order so neighbouring queries share cache lines
+		std::vector<double> shifts(parallelWorkers(count, 1024), 0.0);
+		parallelFor(count, [&](size_t w, size_t begin, size_t end) {
+			uint32_t entries[DENOISE_MAX_NEIGHBOURS];
+			float dists[DENOISE_MAX_NEIGHBOURS];
+			float weights[DENOISE_MAX_NEIGHBOURS];
+			for (size_t e = begin; e < end; e++) {
+				const size_t i = tree.order[e];
+				const glm::vec3 p(tree.point(e)[0], tree.point(e)[1], tree.point(e)[2]);
+				const size_t found = tree.nearestK(&p[0], k, FLT_MAX, entries, dists);
+
+				// Weighted plane through the neighbourhood
+				glm::dvec3 centroid(0);
+				double weightSum = 0;
+				for (size_t j = 0; j < found; j++) {
+					const float *q = tree.point(entries[j]);
+					weights[j] = expf(dists[j] * spatialFactor);
+					centroid += glm::dvec3(q[0], q[1], q[2]) * (double)weights[j];
+					weightSum += weights[j];
+				}
+				centroid /= weightSum;
+
+				double cov[3][3] = {};
+				for (size_t j = 0; j < found; j++) {
+					const float *q = tree.point(entries[j]);
+					const glm::dvec3 d = glm::dvec3(q[0], q[1], q[2]) - centroid;
+					for (int r = 0; r < 3; r++) {
+						for (int c = 0; c < 3; c++)
+							cov[r][c] += weights[j] * d[r] * d[c];
+					}
+				}
+
+				const glm::vec3 oldNormal(normals[i * 3], normals[i * 3 + 1], normals[i * 3 + 2]);
+				glm::vec3 planeNormal = smallestEigenvector(cov);
+				if (glm::dot(planeNormal, oldNormal) < 0)
+					planeNormal = -planeNormal;
+
+				glm::vec3 moved = p;
+				if (options.method == DENOISE_MLS) {
+					moved = p - glm::dot(p - glm::vec3(centroid), planeNormal) * planeNormal;
+				}
+				else {
+					const glm::vec3 n = glm::dot(oldNormal, oldNormal) > 0 ? glm::normalize(oldNormal) : planeNormal;
+					float offset = 0, sum = 0;
+					for (size_t j = 0; j < found; j++) {
+						const float *q = tree.point(entries[j]);
+						const float along = glm::dot(n, glm::vec3(q[0], q[1], q[2]) - p);
+						const float weight = weights[j] * expf(along * along * normalFactor);
+						offset += weight * along;
+						sum += weight;
+					}
+					if (sum > 0)
+						moved = p + n * (offset / sum);
+				}
+
+				for (int a = 0; a < 3; a++) {
+					nextPositions[i * 3 + a] = moved[a];
+					nextNormals[i * 3 + a] = planeNormal[a];
+				}
+				shifts[w] += glm::length(moved - p);
+			}
+		}, 1024);
+
+		positions.swap(nextPositions);
+		normals.swap(nextNormals);
+
+		double shift = 0;
+		for (double s : shifts)
+			shift += s;
+		stats.meanShift = (float)(shift / count);
+		stats.iterationMs.push_back(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+		stats.totalMs += stats.iterationMs.back();
+	}
+	return stats;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+enum DenoiseMethod {
+	DENOISE_BILATERAL = 0,
+	DENOISE_MLS
+};
+
+struct DenoiseOptions {
+	DenoiseMethod method = DENOISE_BILATERAL;
+	int iterations = 1;
+	int neighbours = 16; // Neighbourhood size, at most DENOISE_MAX_NEIGHBOURS
+	float sigma = 0; // Spatial weight falloff, 0 uses the mean neighbour distance
+	float sigmaNormal = 0; // Bilateral falloff along the normal, 0 uses sigma / 2
+};
+
+#define DENOISE_MAX_NEIGHBOURS 64
+
+struct DenoiseStats {
+	std::vector<double> iterationMs; // Time of every iteration, index rebuild included
+	double totalMs = 0;
+	float meanShift = 0; // Mean distance points moved by the last iteration
+};
+
+/**
+* Smooths a point cloud in place. The bilateral filter moves every point
+* along its normal by the weighted offsets of its neighbours, weighted by
+* both distance and offset along the normal so sharp edges survive. MLS
+* projects every point onto the weighted least squares plane of its
+* neighbours. Both refresh the normals from that weighted plane. Every
+* iteration rebuilds a KD-tree over the current positions and processes the
+* points in parallel chunks. "normals" may be empty, in which case they are
+* estimated.
+*/
+DenoiseStats denoisePoints(std::vector<float> &positions, std::vector<float> &normals, const DenoiseOptions &options);
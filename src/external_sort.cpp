@@ -0,0 +1,328 @@
+#include "external_sort.h"
+
+#include <float.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <queue>
+#include <thread>
+#include <utility>
+
+#include "morton.h"
+#include "parallel.h"
+#include "radix_sort.h"
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#define SORT_BYTES_PER_POINT 44 // Positions, key, order and two sorted copies, one of them being written
+#define SORT_MIN_BLOCK_BYTES (256 << 10) // Smallest read per merged run, below that seeks dominate
+#define POINT_BYTES (3 * sizeof(float))
+
+namespace {
+
+double elapsedMs(std::chrono::high_resolution_clock::time_point since)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - since).count();
+}
+
+/**
+* Reads one sorted run block by block, the next block is read on a thread
+* while the current one is merged.
+*/
+class RunReader {
+public:
+	RunReader() {}
+	~RunReader()
+	{
+		if (reading.joinable())
+			reading.join();
+		if (file != NULL)
+			fclose(file);
+	}
+
+	bool open(const std::string &path, uint64_t count, size_t blockPoints)
+	{
+		file = fopen(path.c_str(), "rb");
+		if (file == NULL)
+			return false;
+		left = count;
+		current.resize(blockPoints * 3);
+		ahead.resize(blockPoints * 3);
+		prefetch();
+		return true;
+	}
+
+	const float *point() const { return &current[position * 3]; }
+
+	/**
+	* Moves to the next point, false at the end of the run.
+	*/
+	bool next()
+	{
+		if (++position < size)
+			return true;
+		if (!reading.joinable())
+			return false;
+		reading.join();
+		current.swap(ahead);
+		size = aheadCount;
+		position = 0;
+		prefetch();
+		return size > 0;
+	}
+
+	uint64_t bytesRead() const { return read; }
+	bool failed() const { return error; }
+
+private:
+	RunReader(const RunReader &);
+	RunReader &operator=(const RunReader &);
+
+	void prefetch()
+	{
+		const size_t count = (size_t)std::min<uint64_t>(left, ahead.size() / 3);
+		if (count == 0)
+			return;
+		left -= count;
+		reading = std::thread([this, count]() {
+			aheadCount = fread(ahead.data(), POINT_BYTES, count, file);
+			read += aheadCount * POINT_BYTES;
+			error = error || aheadCount != count;
+		});
+	}
+
+	FILE *file = NULL;
+	uint64_t left = 0;
+	std::vector<float> current;
+	std::vector<float> ahead;
+	size_t position = 0;
+	size_t size = 0;
+	size_t aheadCount = 0;
+	uint64_t read = 0;
+	bool error = false;
+	std::thread reading;
+};
+
+}
+
+ExternalMortonSort::ExternalMortonSort(const std::string &tempPrefix, size_t memoryBytes)
+	: prefix(tempPrefix + "." + std::to_string((int)getpid())), memory(memoryBytes), lower(FLT_MAX), upper(-FLT_MAX)
+{
+	runPoints = memory > 0 ? std::max<size_t>(memory / SORT_BYTES_PER_POINT, 1) : SIZE_MAX;
+}
+
+ExternalMortonSort::~ExternalMortonSort()
+{
+	if (spillFile != NULL)
+		fclose(spillFile);
+	if (!spillPath.empty())
+		remove(spillPath.c_str());
+	for (const auto &path : runPaths)
+		remove(path.c_str());
+}
+
+bool ExternalMortonSort::add(const float *positions, size_t count)
+{
+	for (size_t i = 0; i < count * 3; i += 3) {
+		const glm::vec3 p(positions[i], positions[i + 1], positions[i + 2]);
+		lower = glm::min(lower, p);
+		upper = glm::max(upper, p);
+	}
+	pending.insert(pending.end(), positions, positions + count * 3);
+	total += count;
+	return pending.size() / 3 < runPoints || spill();
+}
+
+bool ExternalMortonSort::spill()
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	if (spillFile == NULL) {
+		spillPath = prefix + ".spill";
+		spillFile = fopen(spillPath.c_str(), "wb");
+		if (spillFile == NULL)
+			return false;
+	}
+	const bool ok = fwrite(pending.data(), sizeof(float), pending.size(), spillFile) == pending.size();
+	statistics.bytesWritten += pending.size() * sizeof(float);
+	pending.clear();
+	statistics.spillMs += elapsedMs(start);
+	return ok;
+}
+
+void ExternalMortonSort::sortPoints(const std::vector<float> &positions, std::vector<float> &sorted)
+{
+	const size_t count = positions.size() / 3;
+	std::vector<uint32_t> keys(count), order(count);
+	parallelFor(count, [&](size_t, size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			keys[i] = mortonCode(&positions[i * 3], &lower[0], &invExtent[0]);
+			order[i] = (uint32_t)i;
+		}
+	});
+	radixSort(keys, order, 30);
+
+	sorted.resize(positions.size());
+	parallelFor(count, [&](size_t, size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+			memcpy(&sorted[i * 3], &positions[(size_t)order[i] * 3], POINT_BYTES);
+	});
+}
+
+/**
+* Reads the spill back one run at a time, the sorted run is written on a
+* thread while the next one is read and sorted.
+*/
+bool ExternalMortonSort::writeRuns()
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	if (!pending.empty() && !spill())
+		return false;
+	const bool closed = fclose(spillFile) == 0;
+	spillFile = NULL;
+	FILE *input = fopen(spillPath.c_str(), "rb");
+	if (!closed || input == NULL) {
+		if (input != NULL)
+			fclose(input);
+		return false;
+	}
+
+	std::vector<float> batch, sorted;
+	std::thread writing;
+	bool ok = true, written = true;
+	for (uint64_t done = 0; ok && done < total;) {
+		const size_t count = (size_t)std::min<uint64_t>(runPoints, total - done);
+		batch.resize(count * 3);
+		ok = fread(batch.data(), POINT_BYTES, count, input) == count;
+		statistics.bytesRead += count * POINT_BYTES;
+		done += count;
+		if (!ok)
+			break;
+
+		// The previous run's copy must be on disk before it is reused
+		std::vector<float> next;
+		sortPoints(batch, next);
+		if (writing.joinable())
+			writing.join();
+		ok = written;
+		sorted.swap(next);
+		next.clear();
+		next.shrink_to_fit();
+
+		runPaths.push_back(prefix + ".run-" + std::to_string(runPaths.size()));
+		runCounts.push_back(count);
+		statistics.bytesWritten += count * POINT_BYTES;
+		const std::string path = runPaths.back();
+		writing = std::thread([&sorted, &written, path]() {
+			FILE *file = fopen(path.c_str(), "wb");
+			written = file != NULL && fwrite(sorted.data(), sizeof(float), sorted.size(), file) == sorted.size();
+			if (file != NULL)
+				written = fclose(file) == 0 && written;
+		});
+	}
+	if (writing.joinable())
+		writing.join();
+	fclose(input);
+
+	// The spill is not needed anymore, free the disk space early
+	remove(spillPath.c_str());
+	spillPath.clear();
+	statistics.runs = runPaths.size();
+	statistics.runMs = elapsedMs(start);
+	return ok && written;
+}
+
+bool ExternalMortonSort::mergeRuns(size_t first, size_t last, const std::function<bool(const float *positions, size_t count)> &sink)
+{
+	// Every run reads a block while merging another, the output takes one more
+	const size_t runs = last - first;
+	const size_t blockPoints = std::max<size_t>(memory / (2 * runs + 1), SORT_MIN_BLOCK_BYTES) / POINT_BYTES;
+	std::vector<std::unique_ptr<RunReader>> readers;
+	typedef std::pair<uint32_t, size_t> Head; // Key and reader, ties go to the earlier run
+	std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+	for (size_t r = first; r < last; r++) {
+		readers.emplace_back(new RunReader());
+		RunReader &reader = *readers.back();
+		if (!reader.open(runPaths[r], runCounts[r], blockPoints))
+			return false;
+		if (reader.next())
+			heads.push(Head(mortonCode(reader.point(), &lower[0], &invExtent[0]), readers.size() - 1));
+	}
+
+	std::vector<float> output(blockPoints * 3);
+	size_t used = 0;
+	bool ok = true;
+	while (ok && !heads.empty()) {
+		const size_t r = heads.top().second;
+		heads.pop();
+		RunReader &reader = *readers[r];
+		memcpy(&output[used * 3], reader.point(), POINT_BYTES);
+		if (++used == blockPoints) {
+			ok = sink(output.data(), used);
+			used = 0;
+		}
+		if (reader.next())
+			heads.push(Head(mortonCode(reader.point(), &lower[0], &invExtent[0]), r));
+	}
+	if (ok && used > 0)
+		ok = sink(output.data(), used);
+
+	for (const auto &reader : readers) {
+		statistics.bytesRead += reader->bytesRead();
+		ok = ok && !reader->failed();
+	}
+	return ok;
+}
+
+bool ExternalMortonSort::finish(const std::function<bool(const float *positions, size_t count)> &sink)
+{
+	invExtent = 1.f / glm::max(upper - lower, glm::vec3(FLT_MIN));
+	if (spillFile == NULL) {
+		auto start = std::chrono::high_resolution_clock::now();
+		std::vector<float> sorted;
+		sortPoints(pending, sorted);
+		pending.clear();
+		pending.shrink_to_fit();
+		statistics.runMs = elapsedMs(start);
+		return sorted.empty() || sink(sorted.data(), sorted.size() / 3);
+	}
+	if (!writeRuns())
+		return false;
+
+	// Merge groups of runs into longer ones until a single merge of all of
+	// them fits the budget
+	auto start = std::chrono::high_resolution_clock::now();
+	const size_t fanIn = std::max<size_t>(memory / (2 * SORT_MIN_BLOCK_BYTES), 2);
+	size_t first = 0;
+	while (runPaths.size() - first > fanIn) {
+		const size_t last = runPaths.size();
+		for (size_t group = first; group < last; group += fanIn) {
+			const size_t end = std::min(group + fanIn, last);
+			const std::string path = prefix + ".run-" + std::to_string(runPaths.size());
+			FILE *file = fopen(path.c_str(), "wb");
+			if (file == NULL)
+				return false;
+			runPaths.push_back(path);
+			runCounts.push_back(0);
+			const bool ok = mergeRuns(group, end, [&](const float *positions, size_t count) {
+				runCounts.back() += count;
+				statistics.bytesWritten += count * POINT_BYTES;
+				return fwrite(positions, POINT_BYTES, count, file) == count;
+			});
+			if (fclose(file) != 0 || !ok)
+				return false;
+			for (size_t r = group; r < end; r++)
+				remove(runPaths[r].c_str());
+		}
+		first = last;
+		statistics.mergePasses++;
+	}
+	const bool ok = mergeRuns(first, runPaths.size(), sink);
+	statistics.mergeMs = elapsedMs(start);
+	return ok;
+}
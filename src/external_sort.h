@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+/**
+* Work done by an ExternalMortonSort, for benchmarks.
+*/
+struct ExternalSortStats {
+	size_t runs = 0;
+	size_t mergePasses = 0; // Intermediate passes before the final merge
+	uint64_t bytesWritten = 0;
+	uint64_t bytesRead = 0;
+	double spillMs = 0; // Time add spent writing
+	double runMs = 0;
+	double mergeMs = 0;
+};
+
+/**
+* Sorts points along the Morton curve of their bounds within a memory
+* budget. Added points are spilled to a file, as the bounds are only known
+* once all of them are in. finish reads them back in runs that fit the
+* budget, radix sorts every run while the previous one is written and
+* merges the runs with large sequential reads, prefetching each run's next
+* block while the current one is merged. Nothing touches the disk when all
+* points fit the budget.
+*/
+class ExternalMortonSort {
+public:
+	/**
+	* Temporary files are named "tempPrefix" and a suffix. A budget of 0
+	* keeps everything in memory.
+	*/
+	ExternalMortonSort(const std::string &tempPrefix, size_t memoryBytes);
+	~ExternalMortonSort();
+
+	bool add(const float *positions, size_t count);
+
+	/**
+	* Passes the sorted points to "sink" in consecutive blocks, stops early
+	* when it returns false. Only once per sort.
+	*/
+	bool finish(const std::function<bool(const float *positions, size_t count)> &sink);
+
+	uint64_t count() const { return total; }
+	const glm::vec3 &min() const { return lower; }
+	const glm::vec3 &max() const { return upper; }
+	const ExternalSortStats &stats() const { return statistics; }
+
+private:
+	ExternalMortonSort(const ExternalMortonSort &);
+	ExternalMortonSort &operator=(const ExternalMortonSort &);
+
+	bool spill();
+	bool writeRuns();
+	bool mergeRuns(size_t first, size_t last, const std::function<bool(const float *positions, size_t count)> &sink);
+	void sortPoints(const std::vector<float> &positions, std::vector<float> &sorted);
+
+	std::string prefix;
+	size_t memory;
+	size_t runPoints; // Points sorted at once within the budget
+	std::vector<float> pending; // Added, not spilled yet
+	FILE *spillFile = NULL;
+	std::string spillPath;
+	std::vector<std::string> runPaths;
+	std::vector<uint64_t> runCounts;
+	uint64_t total = 0;
+	glm::vec3 lower;
+	glm::vec3 upper;
+	glm::vec3 invExtent;
+	ExternalSortStats statistics;
+};
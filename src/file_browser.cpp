@@ -0,0 +1,351 @@
+#include "file_browser.h"
+
+#include <ctype.h>
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <direct.h>
+#include <io.h>
+#define getcwd _getcwd
+#define fseeko _fseeki64
+#define ftello _ftelli64
+#endif
+
+#include "input_file.h"
+#include "point_file.h"
+
+namespace {
+
+bool endsWith(const std::string &name, const char *suffix)
+{
+	const size_t length = strlen(suffix);
+	if (name.size() < length)
+		return false;
+	for (size_t i = 0; i < length; i++) {
+		if (tolower((unsigned char)name[name.size() - length + i]) != suffix[i])
+			return false;
+	}
+	return true;
+}
+
+bool loadable(const std::string &name)
+{
+	return endsWith(name, ".obj") || endsWith(name, ".pcvc") || endsWith(name, ".gz") || endsWith(name, ".zst");
+}
+
+/**
+* Counts the vertex lines in [data, data + bytes) and grows the bounds
+* around them. Every line end is overwritten with 0, and data[bytes] must be
+* writable.
+*/
+uint64_t countVertices(char *data, size_t bytes, glm::vec3 &min, glm::vec3 &max)
+{
+	uint64_t count = 0;
+	char *end = data + bytes;
+	for (char *line = data; line < end;) {
+		char *newline = (char *)memchr(line, '\n', end - line);
+		if (newline == NULL)
+			newline = end;
+		*newline = 0;
+
+		char *cursor = line;
+		line = newline + 1;
+		while (*cursor == ' ' || *cursor == '\t')
+			cursor++;
+		if (cursor[0] != 'v' || (cursor[1] != ' ' && cursor[1] != '\t'))
+			continue;
+		cursor += 2;
+		glm::vec3 p;
+		for (int i = 0; i < 3; i++)
+			p[i] = strtof(cursor, &cursor);
+		min = glm::min(min, p);
+		max = glm::max(max, p);
+		count++;
+	}
+	return count;
+}
+
+/**
+* Start of the first whole line and end of the last one in a range read
+* from the middle of a file.
+*/
+void wholeLines(const std::vector<char> &data, bool fromStart, bool toEnd, size_t &begin, size_t &end)
+{
+	begin = 0;
+	if (!fromStart) {
+		const char *newline = (const char *)memchr(data.data(), '\n', data.size());
+		begin = newline != NULL ? newline - data.data() + 1 : data.size();
+	}
+	end = data.size();
+	if (!toEnd) {
+		while (end > begin && data[end - 1] != '\n')
+			end--;
+	}
+}
+
+/**
+* Whether the caller gave up on the result, checked between reads.
+*/
+bool cancelled(const std::atomic<bool> *cancel)
+{
+	return cancel != NULL && *cancel;
+}
+
+bool summarizeObj(const std::string &path, FileSummary &summary, const std::atomic<bool> *cancel)
+{
+	glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+	std::vector<char> data;
+	size_t begin, end;
+
+	// Compressed files cannot be sampled, only their start is read
+	if (detectCompression(path) != INPUT_PLAIN) {
+		InputFile file;
+		if (!file.open(path))
+			return false;
+		const char *block;
+		size_t bytes;
+		bool finished = false;
+		while (data.size() < SUMMARY_PREFIX_BYTES) {
+			if (cancelled(cancel))
+				return false;
+			if (!file.next(block, bytes)) {
+				finished = true;
+				break;
+			}
+			data.insert(data.end(), block, block + bytes);
+		}
+		if (file.failed())
+			return false;
+		wholeLines(data, true, finished, begin, end);
+		data.push_back(0);
+		summary.points = countVertices(&data[begin], end - begin, min, max);
+		summary.kind = finished ? SUMMARY_COUNTED : SUMMARY_PREFIX;
+	}
+	else {
+		FILE *file = fopen(path.c_str(), "rb");
+		if (file == NULL)
+			return false;
+		fseeko(file, 0, SEEK_END);
+		const uint64_t size = (uint64_t)ftello(file);
+		const bool whole = size <= (uint64_t)SUMMARY_SAMPLES * SUMMARY_SAMPLE_BYTES;
+		const size_t samples = whole ? 1 : SUMMARY_SAMPLES;
+		uint64_t counted = 0, sampledBytes = 0;
+		bool ok = true;
+		for (size_t k = 0; ok && k < samples; k++) {
+			if (cancelled(cancel)) {
+				ok = false;
+				break;
+			}
+			const uint64_t offset = whole ? 0 : (size - SUMMARY_SAMPLE_BYTES) * k / (SUMMARY_SAMPLES - 1);
+			data.resize(whole ? (size_t)size : SUMMARY_SAMPLE_BYTES);
+			ok = fseeko(file, (off_t)offset, SEEK_SET) == 0 && fread(data.data(), 1, data.size(), file) == data.size();
+			wholeLines(data, offset == 0, offset + data.size() == size, begin, end);
+			data.push_back(0);
+			counted += countVertices(&data[begin], end - begin, min, max);
+			sampledBytes += end - begin;
+		}
+		fclose(file);
+		if (!ok)
+			return false;
+		summary.points = whole || sampledBytes == 0 ? counted : (uint64_t)((double)counted * size / sampledBytes);
+		summary.kind = whole ? SUMMARY_COUNTED : SUMMARY_SAMPLED;
+	}
+
+	if (summary.points > 0) {
+		summary.min = min;
+		summary.max = max;
+	}
+	return true;
+}
+
+/**
+* Directories and loadable files in "path", false if it cannot be listed or
+* the listing was cancelled.
+*/
+bool listDirectory(const std::string &path, std::vector<BrowserEntry> &entries, const std::atomic<bool> *cancel)
+{
+#ifndef _WIN32
+	DIR *directory = opendir(path.c_str());
+	if (directory == NULL)
+		return false;
+	while (struct dirent *item = readdir(directory)) {
+		if (cancelled(cancel))
+			break;
+		BrowserEntry entry;
+		entry.name = item->d_name;
+		struct stat status;
+		if (entry.name[0] == '.' || stat(joinPath(path, entry.name).c_str(), &status) != 0)
+			continue;
+		entry.directory = S_ISDIR(status.st_mode);
+		entry.size = (uint64_t)status.st_size;
+		if (entry.directory || loadable(entry.name))
+			entries.push_back(entry);
+	}
+	closedir(directory);
+	return !cancelled(cancel);
+#else
+	struct _finddata64_t item;
+	const intptr_t find = _findfirst64(joinPath(path, "*").c_str(), &item);
+	if (find == -1)
+		return false;
+	do {
+		if (cancelled(cancel))
+			break;
+		BrowserEntry entry;
+		entry.name = item.name;
+		entry.directory = (item.attrib & _A_SUBDIR) != 0;
+		entry.size = (uint64_t)item.size;
+		if (entry.name[0] != '.' && (entry.directory || loadable(entry.name)))
+			entries.push_back(entry);
+	} while (_findnext64(find, &item) == 0);
+	_findclose(find);
+	return !cancelled(cancel);
+#endif
+}
+
+}
+
+std::string currentDirectory()
+{
+#ifndef _WIN32
+	char path[PATH_MAX];
+#else
+	char path[_MAX_PATH];
+#endif
+	return getcwd(path, sizeof(path)) != NULL ? std::string(path) : std::string(".");
+}
+
+std::string parentDirectory(const std::string &path)
+{
+	size_t end = path.size();
+	while (end > 1 && (path[end - 1] == '/' || path[end - 1] == '\\'))
+		end--;
+	const size_t slash = path.find_last_of("/\\", end - 1);
+	if (slash == std::string::npos || end <= 1)
+		return path;
+	if (slash == 0)
+		return "/";
+	std::string parent = path.substr(0, slash);
+	if (parent.back() == ':')
+		parent += '\\'; // Drive root
+	return parent;
+}
+
+std::string joinPath(const std::string &directory, const std::string &name)
+{
+	if (directory.empty() || directory.back() == '/' || directory.back() == '\\')
+		return directory + name;
+	return directory + "/" + name;
+}
+
+bool summarizeFile(const std::string &path, FileSummary &summary, const std::atomic<bool> *cancel)
+{
+	summary = FileSummary();
+	if (!isPointFile(path))
+		return summarizeObj(path, summary, cancel);
+
+	PointFileHeader header;
+	std::vector<PointFileNode> nodes;
+	if (!readPointFileTable(path, header, nodes))
+		return false;
+	glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+	for (const auto &node : nodes) {
+		if (node.count == 0)
+			continue;
+		summary.points += node.count;
+		min = glm::min(min, glm::vec3(node.min[0], node.min[1], node.min[2]));
+		max = glm::max(max, glm::vec3(node.max[0], node.max[1], node.max[2]));
+	}
+	if (summary.points > 0) {
+		summary.min = min;
+		summary.max = max;
+	}
+	summary.kind = SUMMARY_HEADER;
+	return true;
+}
+
+FileBrowser::~FileBrowser()
+{
+	stop();
+}
+
+void FileBrowser::open(const std::string &path)
+{
+	stop();
+	current = path;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		entries.clear();
+		message.clear();
+		changed = true;
+	}
+	stopping = false;
+	done = false;
+	worker = std::thread(&FileBrowser::run, this, path);
+}
+
+bool FileBrowser::poll(std::vector<BrowserEntry> &list)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!changed)
+		return false;
+	list = entries;
+	changed = false;
+	return true;
+}
+
+std::string FileBrowser::error() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return message;
+}
+
+void FileBrowser::stop()
+{
+	stopping = true;
+	if (worker.joinable())
+		worker.join();
+}
+
+void FileBrowser::run(std::string path)
+{
+	std::vector<BrowserEntry> list;
+	if (!listDirectory(path, list, &stopping)) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!stopping)
+			message = "Cannot list " + path;
+		changed = true;
+		done = true;
+		return;
+	}
+	std::sort(list.begin(), list.end(), [](const BrowserEntry &a, const BrowserEntry &b) {
+		return a.directory != b.directory ? a.directory : a.name < b.name;
+	});
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		entries = list;
+		changed = true;
+	}
+
+	// Summaries fill in one file at a time, the listing shows meanwhile
+	for (size_t i = 0; i < list.size() && !stopping; i++) {
+		if (list[i].directory)
+			continue;
+		FileSummary summary;
+		if (!summarizeFile(joinPath(path, list[i].name), summary, &stopping))
+			continue;
+		std::lock_guard<std::mutex> lock(mutex);
+		entries[i].summary = summary;
+		changed = true;
+	}
+	done = true;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#define SUMMARY_SAMPLES 8 // Ranges read to estimate a large OBJ file
+#define SUMMARY_SAMPLE_BYTES (256 << 10)
+#define SUMMARY_PREFIX_BYTES (2 << 20) // Decompressed bytes read of a compressed OBJ file
+
+enum SummaryKind {
+	SUMMARY_NONE, // Not scanned (yet) or not a point file
+	SUMMARY_HEADER, // From a point file's node table, exact
+	SUMMARY_COUNTED, // Small enough to read whole, exact
+	SUMMARY_SAMPLED, // Scaled up from ranges spread over the file
+	SUMMARY_PREFIX // From the start of a compressed file, a lower bound
+};
+
+/**
+* Point count and bounds of a file, found without loading it. Sampled
+* bounds only cover the points seen.
+*/
+struct FileSummary {
+	SummaryKind kind = SUMMARY_NONE;
+	uint64_t points = 0;
+	glm::vec3 min = glm::vec3(0);
+	glm::vec3 max = glm::vec3(0);
+};
+
+/**
+* Reads a point file's node table, or up to a few MB of an OBJ file.
+* False if the file cannot be read, or once "cancel" is set between reads.
+*/
+bool summarizeFile(const std::string &path, FileSummary &summary, const std::atomic<bool> *cancel = NULL);
+
+/**
+* Working directory of the process, "." if unknown.
+*/
+std::string currentDirectory();
+
+/**
+* Directory holding "path", "path" itself at the root.
+*/
+std::string parentDirectory(const std::string &path);
+
+std::string joinPath(const std::string &directory, const std::string &name);
+
+struct BrowserEntry {
+	std::string name;
+	bool directory = false;
+	uint64_t size = 0;
+	FileSummary summary;
+};
+
+/**
+* Lists a directory and summarizes its point files on a thread, so a file
+* dialog can draw every frame while a slow disk or a large directory is
+* read. Only directories and files that look loadable (.obj, .pcvc and
+* gzip or zstd compressed ones) are listed, directories first.
+*/
+class FileBrowser {
+public:
+	FileBrowser() {}
+	~FileBrowser();
+
+	/**
+	* Starts listing "path", a listing in progress is abandoned.
+	*/
+	void open(const std::string &path);
+
+	/**
+	* Copies the listing into "entries" if it changed since the last call.
+	*/
+	bool poll(std::vector<BrowserEntry> &entries);
+
+	const std::string &directory() const { return current; }
+	bool busy() const { return !done; }
+	std::string error() const;
+
+private:
+	FileBrowser(const FileBrowser &);
+	FileBrowser &operator=(const FileBrowser &);
+
+	void stop();
+	void run(std::string path);
+
+	std::string current;
+	std::thread worker;
+	std::atomic<bool> stopping{false};
+	std::atomic<bool> done{true};
+	mutable std::mutex mutex;
+	std::vector<BrowserEntry> entries; // Shared with the worker
+	bool changed = false;
+	std::string message;
+};
@@ -0,0 +1,205 @@
+#include "file_watch.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#define FILE_WATCH_EVENTS (IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE)
+
+namespace {
+
+/**
+* Splits a path into its directory and name, the directory resolved so every
+* spelling of it gets the same watch.
+*/
+void splitPath(const std::string &path, std::string &directory, std::string &name)
+{
+	const size_t slash = path.find_last_of("/\\");
+	directory = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+	name = slash == std::string::npos ? path : path.substr(slash + 1);
+#ifndef _WIN32
+	char resolved[PATH_MAX];
+	if (realpath(directory.c_str(), resolved) != NULL)
+		directory = resolved;
+#endif
+}
+
+bool fileStatus(const std::string &path, uint64_t &size, int64_t &modified)
+{
+	struct stat status;
+	if (stat(path.c_str(), &status) != 0)
+		return false;
+	size = (uint64_t)status.st_size;
+#ifdef __linux__
+	modified = (int64_t)status.st_mtim.tv_sec * 1000000000 + status.st_mtim.tv_nsec;
+#else
+	modified = (int64_t)status.st_mtime;
+#endif
+	return true;
+}
+
+}
+
+FileWatcher::~FileWatcher()
+{
+	clear();
+#ifdef __linux__
+	if (fd >= 0)
+		close(fd);
+#endif
+}
+
+bool FileWatcher::add(const std::string &path)
+{
+	std::string directory, name;
+	splitPath(path, directory, name);
+	const std::string key = directory + "/" + name;
+	if (files.count(key) > 0)
+		return true;
+
+	File file;
+	file.path = path;
+	if (!fileStatus(path, file.size, file.modified))
+		return false;
+
+#ifdef __linux__
+	if (!started) {
+		fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		started = true;
+	}
+	if (fd >= 0) {
+		// The kernel hands out one watch per directory however often it is added
+		const int watch = inotify_add_watch(fd, directory.c_str(), FILE_WATCH_EVENTS);
+		if (watch >= 0) {
+			file.directory = watch;
+			directories[watch] = directory;
+		}
+	}
+#endif
+	files[key] = file;
+	return true;
+}
+
+void FileWatcher::remove(const std::string &path)
+{
+	std::string directory, name;
+	splitPath(path, directory, name);
+	auto found = files.find(directory + "/" + name);
+	if (found == files.end())
+		return;
+	const int watch = found->second.directory;
+	files.erase(found);
+
+	for (const auto &file : files) {
+		if (file.second.directory == watch)
+			return;
+	}
+#ifdef __linux__
+	if (watch >= 0) {
+		inotify_rm_watch(fd, watch);
+		directories.erase(watch);
+	}
+#endif
+}
+
+void FileWatcher::clear()
+{
+#ifdef __linux__
+	for (const auto &directory : directories)
+		inotify_rm_watch(fd, directory.first);
+#endif
+	directories.clear();
+	files.clear();
+}
+
+void FileWatcher::poll(std::vector<std::string> &changed)
+{
+	if (fd >= 0)
+		readEvents();
+	const Clock::time_point now = Clock::now();
+	if (now - lastCheck >= std::chrono::milliseconds(FILE_WATCH_POLL_MS)) {
+		checkFiles();
+		lastCheck = now;
+	}
+
+	for (auto &entry : files) {
+		File &file = entry.second;
+		if (file.dirty && now - file.lastWrite >= std::chrono::milliseconds(FILE_WATCH_SETTLE_MS)) {
+			file.dirty = false;
+			changed.push_back(file.path);
+		}
+	}
+}
+
+void FileWatcher::readEvents()
+{
+#ifdef __linux__
+	alignas(struct inotify_event) char buffer[16 << 10];
+	for (;;) {
+		const ssize_t bytes = read(fd, buffer, sizeof(buffer));
+		if (bytes <= 0)
+			break;
+		const Clock::time_point now = Clock::now();
+		for (ssize_t offset = 0; offset < bytes;) {
+			const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(buffer + offset);
+			offset += sizeof(struct inotify_event) + event->len;
+
+			// Events were dropped, anything may have changed
+			if (event->mask & IN_Q_OVERFLOW) {
+				for (auto &file : files) {
+					file.second.dirty = true;
+					file.second.lastWrite = now;
+				}
+				continue;
+			}
+
+			// The directory went away, its files are polled from now on
+			if (event->mask & IN_IGNORED) {
+				for (auto &file : files) {
+					if (file.second.directory == event->wd)
+						file.second.directory = -1;
+				}
+				directories.erase(event->wd);
+				continue;
+			}
+
+			auto directory = directories.find(event->wd);
+			if (event->len == 0 || directory == directories.end())
+				continue;
+			auto found = files.find(directory->second + "/" + event->name);
+			if (found != files.end()) {
+				found->second.dirty = true;
+				found->second.lastWrite = now;
+			}
+		}
+	}
+#endif
+}
+
+/**
+* Compares the size and modification time of the files no directory watch
+* covers.
+*/
+void FileWatcher::checkFiles()
+{
+	const Clock::time_point now = Clock::now();
+	for (auto &entry : files) {
+		File &file = entry.second;
+		uint64_t size;
+		int64_t modified;
+		if (file.directory >= 0 || !fileStatus(file.path, size, modified))
+			continue;
+		if (size != file.size || modified != file.modified) {
+			file.size = size;
+			file.modified = modified;
+			file.dirty = true;
+			file.lastWrite = now;
+		}
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#define FILE_WATCH_SETTLE_MS 250 // Quiet time after the last write before a file counts as changed
+#define FILE_WATCH_POLL_MS 1000 // Interval of the modification time checks without inotify
+
+/**
+* Tells which of a set of files were rewritten. On Linux the directories
+* holding them are watched through inotify, so files replaced by a rename,
+* the way writers publish complete files, are seen too. Elsewhere, or if
+* inotify is unavailable, the size and modification time of every file are
+* checked every FILE_WATCH_POLL_MS. Files are only reported once nothing
+* wrote to them for FILE_WATCH_SETTLE_MS, so a file being written is not
+* read halfway.
+*/
+class FileWatcher {
+public:
+	FileWatcher() {}
+	~FileWatcher();
+
+	bool add(const std::string &path);
+	void remove(const std::string &path);
+	void clear();
+
+	/**
+	* Appends the files that changed since the last call, as passed to add.
+	* Never blocks.
+	*/
+	void poll(std::vector<std::string> &changed);
+
+	size_t size() const { return files.size(); }
+	bool usesInotify() const { return fd >= 0; }
+	const char *backend() const { return fd >= 0 ? "inotify" : "polling"; }
+
+private:
+	FileWatcher(const FileWatcher &);
+	FileWatcher &operator=(const FileWatcher &);
+
+	typedef std::chrono::steady_clock Clock;
+
+	struct File {
+		std::string path; // As passed to add
+		int directory = -1; // inotify watch of the parent directory
+		uint64_t size = 0;
+		int64_t modified = 0;
+		bool dirty = false;
+		Clock::time_point lastWrite;
+	};
+
+	void readEvents();
+	void checkFiles();
+
+	int fd = -1;
+	bool started = false; // inotify was tried
+	std::map<std::string, File> files; // By canonical path
+	std::map<int, std::string> directories; // Watch to canonical directory
+	Clock::time_point lastCheck;
+};
@@ -0,0 +1,178 @@
+#include "ground_filter.h"
+
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+
+#include "parallel.h"
+#include "raster.h"
+
+namespace {
+
+/**
+* Scratch buffers of one worker, reused for all its tiles.
+*/
+struct TileScratch {
+	std::vector<float> surface;
+	std::vector<float> opened;
+	std::vector<uint8_t> objects;
+	std::vector<float> line, pad, prefix, suffix;
+};
+
+/**
+* Min or max filter of radius "r" over "n" values "stride" apart, with the
+* van Herk/Gil-Werman algorithm so the cost does not depend on the radius.
+* Empty cells (NAN) are ignored, windows without data stay empty.
+*/
+void filterLine(float *data, size_t stride, int n, int r, bool isMax, TileScratch &s)
+{
+	const float identity = isMax ? -INFINITY : INFINITY;
+	const int w = 2 * r + 1;
+	const int m = n + 2 * r;
+	s.pad.resize(m);
+	s.prefix.resize(m);
+	s.suffix.resize(m);
+	s.line.resize(n);
+
+	for (int i = 0; i < m; i++) {
+		const float v = i < r || i >= n + r ? identity : data[(size_t)(i - r) * stride];
+		s.pad[i] = isnan(v) ? identity : v;
+	}
+
+	// Running extremes from the start and from the end of each block of w
+	for (int i = 0; i < m; i++) {
+		const float v = s.pad[i];
+		s.prefix[i] = i % w == 0 ? v : (isMax ? std::max(s.prefix[i - 1], v) : std::min(s.prefix[i - 1], v));
+	}
+	for (int i = m - 1; i >= 0; i--) {
+		const float v = s.pad[i];
+		s.suffix[i] = i == m - 1 || (i + 1) % w == 0 ? v : (isMax ? std::max(s.suffix[i + 1], v) : std::min(s.suffix[i + 1], v));
+	}
+
+	for (int x = 0; x < n; x++) {
+		const float a = s.suffix[x], b = s.prefix[x + 2 * r];
+		const float v = isMax ? std::max(a, b) : std::min(a, b);
+		s.line[x] = v == identity ? NAN : v;
+	}
+	for (int x = 0; x < n; x++)
+		data[(size_t)x * stride] = s.line[x];
+}
+
+/**
+* Square window erosion or dilation, done separably along rows then columns.
+*/
+void morph(std::vector<float> &image, int width, int height, int r, bool isMax, TileScratch &s)
+{
+	for (int y = 0; y < height; y++)
+		filterLine(&image[(size_t)y * width], 1, width, r, isMax, s);
+	for (int x = 0; x < width; x++)
+		filterLine(&image[x], width, height, r, isMax, s);
+}
+
+}
+
+GroundStats classifyGround(const float *positions, size_t count, const GroundOptions &options, std::vector<uint32_t> &classes)
+{
+	GroundStats stats;
+	classes.assign(count, CLASS_UNCLASSIFIED);
+	if (count == 0)
+		return stats;
+
+	int u, v;
+	rasterAxes(options.upAxis, u, v);
+	float minU = FLT_MAX, minV = FLT_MAX, maxU = -FLT_MAX, maxV = -FLT_MAX;
+	for (size_t i = 0; i < count; i++) {
+		minU = std::min(minU, positions[i * 3 + u]);
+		minV = std::min(minV, positions[i * 3 + v]);
+		maxU = std::max(maxU, positions[i * 3 + u]);
+		maxV = std::max(maxV, positions[i * 3 + v]);
+	}
+
+	// About four points per cell when not given
+	float cellSize = options.cellSize;
+	if (cellSize <= 0)
+		cellSize = std::max(2.f * sqrtf((maxU - minU) * (maxV - minV) / count), FLT_MIN);
+
+	Raster raster;
+	raster.init(minU, minV, maxU, maxV, cellSize, options.upAxis);
+	rasterizePoints(raster, positions, count);
+	stats.width = raster.width;
+	stats.height = raster.height;
+
+	// Windows of 2^k + 1 cells and their height thresholds
+	std::vector<int> radii;
+	std::vector<float> thresholds;
+	int margin = 0;
+	for (int k = 1, prev = 1; (1 << k) + 1 <= std::max(options.maxWindow, 3); k++) {
+		const int window = (1 << k) + 1;
+		const float dh = k == 1 ? options.initialDistance
+			: std::min(options.slope * (window - prev) * cellSize + options.initialDistance, options.maxDistance);
+		radii.push_back(window / 2);
+		thresholds.push_back(dh);
+		margin += 2 * (window / 2); // Each opening reads this much further out
+		prev = window;
+	}
+
+	const int tileSize = std::max(options.tileSize, 16);
+	const int tilesU = (raster.width + tileSize - 1) / tileSize;
+	const int tilesV = (raster.height + tileSize - 1) / tileSize;
+	stats.tiles = (size_t)tilesU * tilesV;
+
+	std::vector<uint8_t> objects(raster.cells(), 0);
+	parallelFor(stats.tiles, [&](size_t, size_t begin, size_t end) {
+		TileScratch s;
+		for (size_t t = begin; t < end; t++) {
+			const int x0 = (int)(t % tilesU) * tileSize, y0 = (int)(t / tilesU) * tileSize;
+			const int x1 = std::min(x0 + tileSize, raster.width), y1 = std::min(y0 + tileSize, raster.height);
+
+			// Region with its margin
+			const int rx0 = std::max(0, x0 - margin), ry0 = std::max(0, y0 - margin);
+			const int rx1 = std::min(raster.width, x1 + margin), ry1 = std::min(raster.height, y1 + margin);
+			const int rw = rx1 - rx0, rh = ry1 - ry0;
+
+			s.surface.resize((size_t)rw * rh);
+			for (int y = 0; y < rh; y++) {
+				for (int x = 0; x < rw; x++) {
+					const size_t cell = (size_t)(ry0 + y) * raster.width + rx0 + x;
+					s.surface[(size_t)y * rw + x] = raster.counts[cell] > 0 ? raster.minH[cell] : NAN;
+				}
+			}
+			s.objects.assign(s.surface.size(), 0);
+
+			for (size_t k = 0; k < radii.size(); k++) {
+				s.opened = s.surface;
+				morph(s.opened, rw, rh, radii[k], false, s);
+				morph(s.opened, rw, rh, radii[k], true, s);
+				for (size_t c = 0; c < s.surface.size(); c++) {
+					if (s.surface[c] - s.opened[c] > thresholds[k])
+						s.objects[c] = 1;
+				}
+				s.surface.swap(s.opened);
+			}
+
+			for (int y = y0; y < y1; y++) {
+				for (int x = x0; x < x1; x++)
+					objects[(size_t)y * raster.width + x] = s.objects[(size_t)(y - ry0) * rw + x - rx0];
+			}
+		}
+	}, 1);
+
+	// Ground points lie in a ground cell, close to its lowest point
+	const float inv = 1.f / cellSize;
+	std::vector<size_t> ground(parallelWorkers(count), 0);
+	parallelFor(count, [&](size_t w, size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			const float *p = positions + i * 3;
+			const int x = std::min((int)((p[u] - minU) * inv), raster.width - 1);
+			const int y = std::min((int)((p[v] - minV) * inv), raster.height - 1);
+			const size_t cell = (size_t)y * raster.width + x;
+			if (!objects[cell] && p[options.upAxis] - raster.minH[cell] <= options.initialDistance) {
+				classes[i] = CLASS_GROUND;
+				ground[w]++;
+			}
+		}
+	});
+	for (size_t g : ground)
+		stats.groundPoints += g;
+	return stats;
+}
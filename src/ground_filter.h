@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+* ASPRS classification codes written by the ground filter.
+*/
+#define CLASS_UNCLASSIFIED 1
+#define CLASS_GROUND 2
+
+struct GroundOptions {
+	int upAxis = 1;
+	float cellSize = 0; // 0 derives it from the point density
+	int maxWindow = 33; // Largest opening window in cells
+	float slope = 1.f; // Terrain slope used to grow the height threshold
+	float initialDistance = 0.5f; // Height threshold of the first window
+	float maxDistance = 3.f; // Upper bound of the height threshold
+	int tileSize = 256; // Cells per tile side, tiles are filtered in parallel
+};
+
+struct GroundStats {
+	size_t groundPoints = 0;
+	int width = 0; // Raster size in cells
+	int height = 0;
+	size_t tiles = 0;
+};
+
+/**
+* Progressive morphological filter (Zhang et al. 2003). The lowest point of
+* every cell forms a surface that is opened with windows of 3, 5, 9, 17...
+* cells, and cells that drop by more than a threshold growing with the window
+* are objects. The raster is split into tiles that are filtered in parallel,
+* each one with a margin wide enough for all windows so the result matches a
+* single pass. classes[i] is set to CLASS_GROUND or CLASS_UNCLASSIFIED.
+*/
+GroundStats classifyGround(const float *positions, size_t count, const GroundOptions &options, std::vector<uint32_t> &classes);
@@ -0,0 +1,435 @@
+#include "http_fetch.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+#define HTTP_RECV_CHUNK (1 << 16)
+#define HTTP_TIMEOUT_SECONDS 30
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace {
+
+bool startsWithNoCase(const std::string &line, const char *prefix)
+{
+	const size_t length = strlen(prefix);
+	if (line.size() < length)
+		return false;
+	for (size_t i = 0; i < length; i++) {
+		if (tolower((unsigned char)line[i]) != tolower((unsigned char)prefix[i]))
+			return false;
+	}
+	return true;
+}
+
+}
+
+bool parseHttpUrl(const std::string &url, HttpUrl &parsed)
+{
+	const std::string scheme = "http://";
+	if (url.compare(0, scheme.size(), scheme) != 0)
+		return false;
+
+	const size_t hostStart = scheme.size();
+	const size_t pathStart = url.find('/', hostStart);
+	const std::string authority = url.substr(hostStart, pathStart == std::string::npos ? std::string::npos : pathStart - hostStart);
+
+	// IPv6 addresses are bracketed since they are full of colons themselves
+	size_t portStart = std::string::npos;
+	if (!authority.empty() && authority[0] == '[') {
+		const size_t close = authority.find(']');
+		if (close == std::string::npos || (close + 1 < authority.size() && authority[close + 1] != ':'))
+			return false;
+		parsed.host = authority.substr(1, close - 1);
+		portStart = close + 1 < authority.size() ? close + 2 : std::string::npos;
+	}
+	else {
+		const size_t colon = authority.find(':');
+		if (colon != std::string::npos && authority.find(':', colon + 1) != std::string::npos)
+			return false;
+		parsed.host = authority.substr(0, colon);
+		portStart = colon != std::string::npos ? colon + 1 : std::string::npos;
+	}
+	parsed.port = portStart != std::string::npos ? atoi(authority.c_str() + portStart) : 80;
+	parsed.path = pathStart != std::string::npos ? url.substr(pathStart) : "/";
+	return !parsed.host.empty() && parsed.port > 0 && parsed.port < 65536;
+}
+
+HttpConnection::~HttpConnection()
+{
+	close();
+}
+
+#ifndef _WIN32
+
+bool HttpConnection::connect(const HttpUrl &url, std::string &error)
+{
+	close();
+	char service[16];
+	snprintf(service, sizeof(service), "%d", url.port);
+	struct addrinfo hints, *addresses = NULL;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(url.host.c_str(), service, &hints, &addresses) != 0) {
+		error = "Cannot resolve " + url.host;
+		return false;
+	}
+
+	for (struct addrinfo *a = addresses; a != NULL && fd < 0; a = a->ai_next) {
+		fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+		if (fd >= 0 && ::connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+			::close(fd);
+			fd = -1;
+		}
+	}
+	freeaddrinfo(addresses);
+	if (fd < 0) {
+		error = "Cannot connect to " + url.host;
+		return false;
+	}
+
+	// Requests are small and sent whole, waiting to coalesce them only adds latency
+	const int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	struct timeval timeout = { HTTP_TIMEOUT_SECONDS, 0 };
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+	setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+	host = url.host;
+	port = url.port;
+	connectCount++;
+	return true;
+}
+
+void HttpConnection::close()
+{
+	if (fd >= 0)
+		::close(fd);
+	fd = -1;
+	buffer.clear();
+	bufferStart = 0;
+}
+
+bool HttpConnection::readLine(std::string &line)
+{
+	for (;;) {
+		const char *begin = buffer.data() + bufferStart;
+		const char *end = buffer.data() + buffer.size();
+		const char *newline = std::find(begin, end, '\n');
+		if (newline != end) {
+			line.assign(begin, newline);
+			if (!line.empty() && line.back() == '\r')
+				line.pop_back();
+			bufferStart += newline - begin + 1;
+			return true;
+		}
+
+		// Keep the partial line and receive more after it
+		buffer.erase(buffer.begin(), buffer.begin() + bufferStart);
+		bufferStart = 0;
+		const size_t used = buffer.size();
+		buffer.resize(used + HTTP_RECV_CHUNK);
+		const ssize_t received = recv(fd, buffer.data() + used, HTTP_RECV_CHUNK, 0);
+		buffer.resize(used + (received > 0 ? (size_t)received : 0));
+		if (received <= 0)
+			return false;
+	}
+}
+
+bool HttpConnection::readToClose(std::vector<char> &data)
+{
+	data.assign(buffer.begin() + bufferStart, buffer.end());
+	bufferStart = buffer.size();
+	for (;;) {
+		const size_t used = data.size();
+		data.resize(used + HTTP_RECV_CHUNK);
+		const ssize_t received = recv(fd, data.data() + used, HTTP_RECV_CHUNK, 0);
+		data.resize(used + (received > 0 ? (size_t)received : 0));
+		if (received <= 0)
+			return received == 0;
+	}
+}
+
+bool HttpConnection::readBytes(char *data, size_t bytes)
+{
+	// Whatever came with the headers first, the rest straight into "data"
+	const size_t buffered = std::min(bytes, buffer.size() - bufferStart);
+	memcpy(data, buffer.data() + bufferStart, buffered);
+	bufferStart += buffered;
+	for (size_t done = buffered; done < bytes;) {
+		const ssize_t received = recv(fd, data + done, bytes - done, 0);
+		if (received <= 0)
+			return false;
+		done += (size_t)received;
+	}
+	return true;
+}
+
+bool HttpConnection::request(const HttpUrl &url, uint64_t offset, uint64_t length, std::vector<char> &body, uint64_t *size, std::string &error)
+{
+	broken = true;
+	const std::string hostName = url.host.find(':') != std::string::npos ? "[" + url.host + "]" : url.host;
+	std::string message = "GET " + url.path + " HTTP/1.1\r\nHost: " + hostName + ":" + std::to_string(url.port) + "\r\n";
+	if (offset > 0 || length > 0) {
+		message += "Range: bytes=" + std::to_string(offset) + "-";
+		if (length > 0)
+			message += std::to_string(offset + length - 1);
+		message += "\r\n";
+	}
+	message += "\r\n";
+	for (size_t sent = 0; sent < message.size();) {
+		const ssize_t written = send(fd, message.data() + sent, message.size() - sent, MSG_NOSIGNAL);
+		if (written <= 0) {
+			error = "Connection lost";
+			return false;
+		}
+		sent += (size_t)written;
+	}
+
+	std::string status, line;
+	if (!readLine(status)) {
+		error = "Connection lost";
+		return false;
+	}
+	const int code = status.size() > 12 ? atoi(status.c_str() + 9) : 0;
+
+	uint64_t contentLength = 0, total = 0, rangeFirst = 0;
+	bool hasLength = false, hasRange = false, keepAlive = true;
+	while (readLine(line) && !line.empty()) {
+		if (startsWithNoCase(line, "Content-Length:")) {
+			contentLength = strtoull(line.c_str() + 15, NULL, 10);
+			hasLength = true;
+		}
+		else if (startsWithNoCase(line, "Content-Range:")) {
+			// "bytes first-last/total", or "bytes */total" when unsatisfiable
+			const size_t bytes = line.find_first_not_of(' ', 14);
+			hasRange = bytes != std::string::npos && line.compare(bytes, 6, "bytes ") == 0 && isdigit((unsigned char)line[bytes + 6]);
+			rangeFirst = hasRange ? strtoull(line.c_str() + bytes + 6, NULL, 10) : 0;
+			if (line.find('/') != std::string::npos)
+				total = strtoull(line.c_str() + line.find('/') + 1, NULL, 10);
+		}
+		else if (startsWithNoCase(line, "Connection:") && line.find("close") != std::string::npos)
+			keepAlive = false;
+		else if (startsWithNoCase(line, "Transfer-Encoding:")) {
+			error = "Chunked responses are not supported";
+			return false;
+		}
+	}
+	if (!line.empty()) {
+		error = "Connection lost";
+		return false;
+	}
+
+	// Without a length the body runs until the server closes the connection,
+	// except for the responses that never have one
+	if (hasLength || code == 204 || code == 304 || (code >= 100 && code < 200)) {
+		body.resize((size_t)contentLength);
+		if (!readBytes(body.data(), body.size())) {
+			error = "Connection lost";
+			return false;
+		}
+	}
+	else {
+		if (!readToClose(body)) {
+			error = "Connection lost";
+			return false;
+		}
+		contentLength = body.size();
+		keepAlive = false;
+	}
+	broken = false;
+	if (!keepAlive)
+		close();
+
+	if (code != 200 && code != 206) {
+		error = status;
+		return false;
+	}
+	if (code == 206 && (!hasRange || rangeFirst != offset)) {
+		error = "Server sent a range starting at " + (hasRange ? std::to_string(rangeFirst) : std::string("an unknown offset")) +
+			", not " + std::to_string(offset);
+		return false;
+	}
+
+	// A server ignoring the range sends everything
+	if (code == 200) {
+		total = contentLength;
+		const size_t begin = (size_t)std::min<uint64_t>(offset, body.size());
+		const size_t end = length > 0 ? (size_t)std::min<uint64_t>(offset + length, body.size()) : body.size();
+		body.erase(body.begin() + end, body.end());
+		body.erase(body.begin(), body.begin() + begin);
+	}
+	if (size != NULL)
+		*size = total;
+	return true;
+}
+
+bool HttpConnection::get(const HttpUrl &url, uint64_t offset, uint64_t length, std::vector<char> &body, uint64_t *size, std::string &error)
+{
+	const bool reuse = fd >= 0 && host == url.host && port == url.port;
+	if (!reuse && !connect(url, error))
+		return false;
+	if (request(url, offset, length, body, size, error))
+		return true;
+
+	// The server may have closed an idle connection, retry once on a new one
+	if (!reuse || !broken || !connect(url, error))
+		return false;
+	return request(url, offset, length, body, size, error);
+}
+
+#else
+
+bool HttpConnection::connect(const HttpUrl &, std::string &error)
+{
+	error = "HTTP is not supported on this platform";
+	return false;
+}
+
+void HttpConnection::close() {}
+bool HttpConnection::readLine(std::string &) { return false; }
+bool HttpConnection::readBytes(char *, size_t) { return false; }
+bool HttpConnection::readToClose(std::vector<char> &) { return false; }
+
+bool HttpConnection::request(const HttpUrl &, uint64_t, uint64_t, std::vector<char> &, uint64_t *, std::string &)
+{
+	return false;
+}
+
+bool HttpConnection::get(const HttpUrl &url, uint64_t, uint64_t, std::vector<char> &, uint64_t *, std::string &error)
+{
+	return connect(url, error);
+}
+
+#endif
+
+FetchPipeline::~FetchPipeline()
+{
+	stop();
+}
+
+void FetchPipeline::start(const HttpUrl &target, unsigned connections)
+{
+	stop();
+	url = target;
+	for (unsigned i = 0; i < std::max(connections, 1u); i++)
+		workers.emplace_back(&FetchPipeline::run, this);
+}
+
+void FetchPipeline::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		jobs.clear();
+	}
+	wake.notify_all();
+	for (auto &worker : workers)
+		worker.join();
+	workers.clear();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	results.clear();
+	received = 0;
+	connectCount = 0;
+	stopping = false;
+}
+
+void FetchPipeline::request(uint64_t id, uint64_t offset, uint64_t length)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back({ id, offset, length, std::chrono::steady_clock::now() });
+	}
+	wake.notify_one();
+}
+
+bool FetchPipeline::poll(FetchResult &result)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (results.empty())
+		return false;
+	result = std::move(results.front());
+	results.pop_front();
+	return true;
+}
+
+bool FetchPipeline::wait(FetchResult &result)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this]() {
+		return !results.empty() || (jobs.empty() && running == 0);
+	});
+	if (results.empty())
+		return false;
+	result = std::move(results.front());
+	results.pop_front();
+	return true;
+}
+
+size_t FetchPipeline::inFlight() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return jobs.size() + running;
+}
+
+uint64_t FetchPipeline::bytesReceived() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return received;
+}
+
+size_t FetchPipeline::connects() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return connectCount;
+}
+
+void FetchPipeline::run()
+{
+	HttpConnection connection;
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		wake.wait(lock, [this]() {
+			return stopping || !jobs.empty();
+		});
+		if (stopping)
+			return;
+		const Job job = jobs.front();
+		jobs.pop_front();
+		running++;
+		lock.unlock();
+
+		FetchResult result;
+		result.id = job.id;
+		result.offset = job.offset;
+		result.length = job.length;
+		const size_t connectsBefore = connection.connects();
+		result.ok = connection.get(url, job.offset, job.length, result.data, NULL, result.error);
+		result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - job.queued).count();
+
+		lock.lock();
+		running--;
+		received += result.data.size();
+		connectCount += connection.connects() - connectsBefore;
+		if (!stopping)
+			results.push_back(std::move(result));
+		done.notify_all();
+	}
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+* Parts of an "http://host[:port]/path" URL, HTTPS is not supported. IPv6
+* hosts are written in brackets, "http://[::1]:8080/path", and stored
+* without them.
+*/
+struct HttpUrl {
+	std::string host;
+	int port = 80;
+	std::string path = "/";
+};
+
+bool parseHttpUrl(const std::string &url, HttpUrl &parsed);
+
+/**
+* One persistent HTTP/1.1 connection, reconnected on demand when the server
+* closed it between requests.
+*/
+class HttpConnection {
+public:
+	HttpConnection() {}
+	~HttpConnection();
+
+	/**
+	* GETs bytes [offset, offset + length) of "url" into "body", length 0
+	* reads to the end. Fails on anything but 200 or 206 (error holds the
+	* status line then), and on a 206 whose range starts anywhere else. "size" receives the full size of the resource when
+	* the server tells.
+	*/
+	bool get(const HttpUrl &url, uint64_t offset, uint64_t length, std::vector<char> &body, uint64_t *size, std::string &error);
+	void close();
+
+	size_t connects() const { return connectCount; } // Connections opened so far
+
+private:
+	HttpConnection(const HttpConnection &);
+	HttpConnection &operator=(const HttpConnection &);
+
+	bool connect(const HttpUrl &url, std::string &error);
+	bool request(const HttpUrl &url, uint64_t offset, uint64_t length, std::vector<char> &body, uint64_t *size, std::string &error);
+	bool readLine(std::string &line);
+	bool readBytes(char *data, size_t bytes);
+	bool readToClose(std::vector<char> &data);
+
+	int fd = -1;
+	bool broken = false; // Last request failed on the socket rather than the status
+	std::string host;
+	int port = 0;
+	std::vector<char> buffer; // Received but not consumed yet
+	size_t bufferStart = 0;
+	size_t connectCount = 0;
+};
+
+/**
+* A byte range to fetch and what came back.
+*/
+struct FetchResult {
+	uint64_t id = 0;
+	uint64_t offset = 0;
+	uint64_t length = 0;
+	bool ok = false;
+	std::vector<char> data;
+	std::string error;
+	double ms = 0; // From being queued until done
+};
+
+/**
+* Fetches byte ranges of one URL over several persistent connections at
+* once, so the latency of one request overlaps with the others in flight.
+* Requests are taken in order by whichever connection is free, results are
+* collected by polling so the caller never blocks.
+*/
+class FetchPipeline {
+public:
+	FetchPipeline() {}
+	~FetchPipeline();
+
+	void start(const HttpUrl &url, unsigned connections);
+
+	/**
+	* Stops the connections after their current request, pending requests
+	* are dropped.
+	*/
+	void stop();
+
+	void request(uint64_t id, uint64_t offset, uint64_t length);
+
+	/**
+	* Takes a finished request, false if none is done yet.
+	*/
+	bool poll(FetchResult &result);
+
+	/**
+	* Like poll but waits for a request to finish, false if none is queued.
+	*/
+	bool wait(FetchResult &result);
+
+	size_t inFlight() const; // Queued or running
+	uint64_t bytesReceived() const;
+	size_t connects() const; // Connections opened, less than requests when reused
+
+private:
+	FetchPipeline(const FetchPipeline &);
+	FetchPipeline &operator=(const FetchPipeline &);
+
+	struct Job {
+		uint64_t id;
+		uint64_t offset;
+		uint64_t length;
+		std::chrono::steady_clock::time_point queued;
+	};
+
+	void run();
+
+	HttpUrl url;
+	std::vector<std::thread> workers;
+	mutable std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	std::deque<Job> jobs;
+	std::deque<FetchResult> results;
+	size_t running = 0;
+	uint64_t received = 0;
+	size_t connectCount = 0;
+	bool stopping = false;
+};
@@ -0,0 +1,221 @@
+#include "icp.h"
+
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "kd_tree.h"
+#include "parallel.h"
+#include "pca.h"
+
+#define ICP_NORMAL_NEIGHBOURS 10
+#define ICP_MIN_SAMPLES 64
+
+namespace {
+
+/**
+* Normal equations of one worker, the upper triangle of A^T A and A^T b.
+*/
+struct Accumulator {
+	double ata[21];
+	double atb[6];
+	double residual;
+	size_t inliers;
+
+	void clear()
+	{
+		std::fill(ata, ata + 21, 0.0);
+		std::fill(atb, atb + 6, 0.0);
+		residual = 0;
+		inliers = 0;
+	}
+};
+
+/**
+* Normals of the tree entries from the covariance of their neighbours.
+*/
+void estimateNormals(const KdTree &tree, std::vector<float> &normals)
+{
+	normals.resize(tree.size() * 3);
+	parallelFor(tree.size(), [&](size_t, size_t begin, size_t end) {
+		uint32_t entries[ICP_NORMAL_NEIGHBOURS];
+		float dists[ICP_NORMAL_NEIGHBOURS];
+		for (size_t e = begin; e < end; e++) {
+			const size_t n = tree.nearestK(tree.point(e), ICP_NORMAL_NEIGHBOURS, FLT_MAX, entries, dists);
+
+			glm::dvec3 mean(0);
+			for (size_t i = 0; i < n; i++)
+				mean += glm::dvec3(tree.point(entries[i])[0], tree.point(entries[i])[1], tree.point(entries[i])[2]);
+			mean /= (double)std::max<size_t>(n, 1);
+
+			double cov[3][3] = {};
+			for (size_t i = 0; i < n; i++) {
+				const float *q = tree.point(entries[i]);
+				const glm::dvec3 d = glm::dvec3(q[0], q[1], q[2]) - mean;
+				for (int r = 0; r < 3; r++) {
+					for (int c = 0; c < 3; c++)
+						cov[r][c] += d[r] * d[c];
+				}
+			}
+
+			const glm::vec3 normal = smallestEigenvector(cov);
+			normals[e * 3 + 0] = normal.x;
+			normals[e * 3 + 1] = normal.y;
+			normals[e * 3 + 2] = normal.z;
+		}
+	}, 1024);
+}
+
+/**
+* Solves the 6x6 system with Gaussian elimination, false if it is singular.
+*/
+bool solve6(const double *ata, const double *atb, double *x)
+{
+	double m[6][7];
+	for (int r = 0, i = 0; r < 6; r++) {
+		for (int c = r; c < 6; c++, i++)
+			m[r][c] = m[c][r] = ata[i];
+		m[r][6] = atb[r];
+	}
+
+	for (int c = 0; c < 6; c++) {
+		int pivot = c;
+		for (int r = c + 1; r < 6; r++)
+			pivot = fabs(m[r][c]) > fabs(m[pivot][c]) ? r : pivot;
+		if (fabs(m[pivot][c]) < 1e-12)
+			return false;
+		for (int k = 0; k < 7; k++)
+			std::swap(m[c][k], m[pivot][k]);
+
+		for (int r = c + 1; r < 6; r++) {
+			const double f = m[r][c] / m[c][c];
+			for (int k = c; k < 7; k++)
+				m[r][k] -= f * m[c][k];
+		}
+	}
+	for (int r = 5; r >= 0; r--) {
+		double sum = m[r][6];
+		for (int c = r + 1; c < 6; c++)
+			sum -= m[r][c] * x[c];
+		x[r] = sum / m[r][r];
+	}
+	return true;
+}
+
+}
+
+IcpResult registerPointToPlane(const float *source, size_t sourceCount, const float *target, const float *targetNormals,
+	size_t targetCount, const glm::mat4 &initial, const IcpOptions &options)
+{
+	IcpResult result;
+	result.transform = initial;
+	if (sourceCount == 0 || targetCount < 3)
+		return result;
+
+	KdTree tree;
+	tree.build(target, targetCount);
+
+	// Normals in tree entry order
+	std::vector<float> normals;
+	if (targetNormals != NULL) {
+		normals.resize(targetCount * 3);
+		parallelFor(targetCount, [&](size_t, size_t begin, size_t end) {
+			for (size_t e = begin; e < end; e++) {
+				for (int a = 0; a < 3; a++)
+					normals[e * 3 + a] = targetNormals[tree.order[e] * 3 + a];
+			}
+		});
+	}
+	else {
+		estimateNormals(tree, normals);
+	}
+
+	glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+	for (size_t i = 0; i < targetCount; i++) {
+		lo = glm::min(lo, glm::vec3(target[i * 3], target[i * 3 + 1], target[i * 3 + 2]));
+		hi = glm::max(hi, glm::vec3(target[i * 3], target[i * 3 + 1], target[i * 3 + 2]));
+	}
+	const float size = glm::max(glm::length(hi - lo), FLT_MIN);
+	float maxDistance = options.maxDistance > 0 ? options.maxDistance : size * 0.1f;
+
+	std::vector<Accumulator> accumulators;
+	std::vector<glm::vec3> samples;
+	const int levels = std::max(options.levels, 1);
+	for (int level = 0; level < levels; level++) {
+		// Evenly strided source samples, 4x more on every finer level
+		const size_t wanted = std::max<size_t>(options.maxSamples >> (2 * (levels - 1 - level)), ICP_MIN_SAMPLES);
+		const size_t stride = std::max<size_t>(sourceCount / wanted, 1);
+		samples.clear();
+		for (size_t i = 0; i < sourceCount; i += stride)
+			samples.push_back(glm::vec3(source[i * 3], source[i * 3 + 1], source[i * 3 + 2]));
+
+		const float maxDistSq = maxDistance * maxDistance;
+		bool converged = false;
+		for (int it = 0; it < options.maxIterations && !converged; it++) {
+			const glm::mat4 transform = result.transform;
+			accumulators.resize(parallelWorkers(samples.size(), 256));
+			parallelFor(samples.size(), [&](size_t w, size_t begin, size_t end) {
+				Accumulator &acc = accumulators[w];
+				acc.clear();
+				for (size_t i = begin; i < end; i++) {
+					const glm::vec3 p = glm::vec3(transform * glm::vec4(samples[i], 1));
+					uint32_t entry;
+					float distSq;
+					if (!tree.nearest(&p[0], maxDistSq, entry, distSq))
+						continue;
+
+					const float *q = tree.point(entry);
+					const glm::vec3 n(normals[entry * 3], normals[entry * 3 + 1], normals[entry * 3 + 2]);
+					const glm::vec3 c = glm::cross(p, n);
+					const double row[6] = { c.x, c.y, c.z, n.x, n.y, n.z };
+					const double b = glm::dot(n, glm::vec3(q[0], q[1], q[2]) - p);
+
+					for (int r = 0, k = 0; r < 6; r++) {
+						for (int col = r; col < 6; col++, k++)
+							acc.ata[k] += row[r] * row[col];
+						acc.atb[r] += row[r] * b;
+					}
+					acc.residual += b * b;
+					acc.inliers++;
+				}
+			}, 256);
+
+			Accumulator total;
+			total.clear();
+			for (auto &acc : accumulators) {
+				for (int k = 0; k < 21; k++)
+					total.ata[k] += acc.ata[k];
+				for (int k = 0; k < 6; k++)
+					total.atb[k] += acc.atb[k];
+				total.residual += acc.residual;
+				total.inliers += acc.inliers;
+			}
+
+			result.iterations++;
+			result.inliers = total.inliers;
+			result.residual = total.inliers > 0 ? (float)sqrt(total.residual / total.inliers) : 0.f;
+
+			double x[6];
+			if (total.inliers < 6 || !solve6(total.ata, total.atb, x))
+				break;
+
+			// Small angle rotation followed by the translation
+			glm::mat4 update = glm::translate(glm::mat4(1), glm::vec3((float)x[3], (float)x[4], (float)x[5]));
+			update = glm::rotate(update, (float)x[2], glm::vec3(0, 0, 1));
+			update = glm::rotate(update, (float)x[1], glm::vec3(0, 1, 0));
+			update = glm::rotate(update, (float)x[0], glm::vec3(1, 0, 0));
+			result.transform = update * result.transform;
+
+			const double rotation = sqrt(x[0] * x[0] + x[1] * x[1] + x[2] * x[2]);
+			const double translation = sqrt(x[3] * x[3] + x[4] * x[4] + x[5] * x[5]) / size;
+			converged = rotation < options.tolerance && translation < options.tolerance;
+		}
+
+		result.converged = converged;
+		maxDistance *= 0.5f;
+	}
+	return result;
+}
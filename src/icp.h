@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <glm/glm.hpp>
+
+struct IcpOptions {
+	int levels = 3; // Pyramid levels, each one uses 4x the samples of the last
+	int maxIterations = 30; // Per level
+	size_t maxSamples = 50000; // Source samples at the finest level
+	float maxDistance = 0; // Correspondence distance at the coarsest level, 0 picks 10% of the target size
+	float tolerance = 1e-5f; // Stops a level once the update is smaller than this
+};
+
+struct IcpResult {
+	glm::mat4 transform = glm::mat4(1); // Maps source points onto the target
+	float residual = 0; // RMS point to plane distance of the last iteration
+	size_t inliers = 0; // Correspondences used by the last iteration
+	int iterations = 0;
+	bool converged = false;
+};
+
+/**
+* Point to plane ICP. Source points are sampled coarse to fine, and each
+* iteration finds their closest target points in a KD-tree in parallel and
+* solves the linearized 6 DOF update. Target normals are estimated from
+* their neighbours when "targetNormals" is NULL.
+*/
+IcpResult registerPointToPlane(const float *source, size_t sourceCount, const float *target, const float *targetNormals,
+	size_t targetCount, const glm::mat4 &initial, const IcpOptions &options);
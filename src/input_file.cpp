@@ -0,0 +1,497 @@
+#include "input_file.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+
+#ifdef PCV_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef PCV_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "parallel.h"
+
+namespace {
+
+enum FrameStatus {
+	FRAME_INVALID = -1, // Not a frame with known sizes, decode as one stream
+	FRAME_INCOMPLETE = 0,
+	FRAME_OK = 1
+};
+
+uint32_t readLE32(const unsigned char *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+* Sizes of a BGZF member: a gzip member whose "BC" extra field holds its
+* compressed size and whose trailer holds the decompressed one.
+*/
+FrameStatus gzipFrame(const unsigned char *data, size_t available, size_t &compressed, size_t &decompressed)
+{
+	if (available < 18)
+		return FRAME_INCOMPLETE;
+	if (data[0] != 0x1f || data[1] != 0x8b || data[2] != 8 || (data[3] & 4) == 0)
+		return FRAME_INVALID;
+	const size_t extraEnd = 12 + (data[10] | (data[11] << 8));
+	if (available < extraEnd)
+		return FRAME_INCOMPLETE;
+
+	compressed = 0;
+	for (size_t field = 12; field + 4 <= extraEnd; field += 4 + (data[field + 2] | (data[field + 3] << 8))) {
+		if (data[field] == 'B' && data[field + 1] == 'C' && (data[field + 2] | (data[field + 3] << 8)) == 2 && field + 6 <= extraEnd)
+			compressed = (size_t)(data[field + 4] | (data[field + 5] << 8)) + 1;
+	}
+	if (compressed < extraEnd + 8)
+		return FRAME_INVALID;
+	if (available < compressed)
+		return FRAME_INCOMPLETE;
+	decompressed = readLE32(data + compressed - 4);
+	return FRAME_OK;
+}
+
+FrameStatus zstdFrame(const unsigned char *data, size_t available, size_t &compressed, size_t &decompressed)
+{
+#ifdef PCV_HAVE_ZSTD
+	const size_t frame = ZSTD_findFrameCompressedSize(data, available);
+	if (ZSTD_isError(frame))
+		return FRAME_INCOMPLETE; // Corrupt frames fail once the input ends
+	const unsigned long long content = ZSTD_getFrameContentSize(data, available);
+	if (content == ZSTD_CONTENTSIZE_UNKNOWN || content == ZSTD_CONTENTSIZE_ERROR)
+		return FRAME_INVALID;
+	compressed = frame;
+	decompressed = (size_t)content;
+	return FRAME_OK;
+#else
+	return FRAME_INVALID;
+#endif
+}
+
+/**
+* Whether "data" starts a zstd frame decompressing to more than one batch,
+* known from its header alone.
+*/
+bool largeFrame(InputCompression format, const char *data, size_t available)
+{
+#ifdef PCV_HAVE_ZSTD
+	if (format != INPUT_ZSTD)
+		return false;
+	const unsigned long long content = ZSTD_getFrameContentSize(data, available);
+	return content != ZSTD_CONTENTSIZE_UNKNOWN && content != ZSTD_CONTENTSIZE_ERROR && content > INPUT_BATCH;
+#else
+	(void)format;
+	(void)data;
+	(void)available;
+	return false;
+#endif
+}
+
+FrameStatus frameSize(InputCompression format, const char *data, size_t available, size_t &compressed, size_t &decompressed)
+{
+	const unsigned char *bytes = (const unsigned char *)data;
+	return format == INPUT_GZIP ? gzipFrame(bytes, available, compressed, decompressed) : zstdFrame(bytes, available, compressed, decompressed);
+}
+
+bool decodeFrame(InputCompression format, const char *source, size_t compressed, char *target, size_t decompressed)
+{
+#ifdef PCV_HAVE_ZLIB
+	if (format == INPUT_GZIP) {
+		char empty;
+		z_stream z;
+		memset(&z, 0, sizeof(z));
+		if (inflateInit2(&z, 16 + MAX_WBITS) != Z_OK)
+			return false;
+		z.next_in = (Bytef *)source;
+		z.avail_in = (uInt)compressed;
+		z.next_out = (Bytef *)(decompressed > 0 ? target : &empty); // zlib rejects a null output even when empty
+		z.avail_out = (uInt)decompressed;
+		const bool ok = inflate(&z, Z_FINISH) == Z_STREAM_END && z.total_out == decompressed;
+		inflateEnd(&z);
+		return ok;
+	}
+#endif
+#ifdef PCV_HAVE_ZSTD
+	if (format == INPUT_ZSTD)
+		return ZSTD_decompress(target, decompressed, source, compressed) == decompressed;
+#endif
+	return false;
+}
+
+}
+
+InputCompression detectCompression(const std::string &path)
+{
+	unsigned char magic[4] = {};
+	FILE *file = fopen(path.c_str(), "rb");
+	if (file == NULL)
+		return INPUT_PLAIN;
+	const size_t read = fread(magic, 1, sizeof(magic), file);
+	fclose(file);
+	if (read >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+		return INPUT_GZIP;
+
+	// A zstd frame or a skippable frame, pzstd starts with one
+	const uint32_t word = readLE32(magic);
+	if (read == 4 && (word == 0xfd2fb528u || (word & 0xfffffff0u) == 0x184d2a50u))
+		return INPUT_ZSTD;
+	return INPUT_PLAIN;
+}
+
+InputFile::~InputFile()
+{
+	close();
+}
+
+bool InputFile::open(const std::string &filename, uint64_t first)
+{
+	close();
+	path = filename;
+	message.clear();
+	format = detectCompression(filename);
+	if (format != INPUT_PLAIN && first > 0) {
+		message = "Compressed files can only be read from the start";
+		return false;
+	}
+#ifndef PCV_HAVE_ZLIB
+	if (format == INPUT_GZIP) {
+		message = "Built without zlib, cannot read gzip files";
+		return false;
+	}
+#endif
+#ifndef PCV_HAVE_ZSTD
+	if (format == INPUT_ZSTD) {
+		message = "Built without zstd, cannot read zstd files";
+		return false;
+	}
+#endif
+	if (!file.open(filename, first)) {
+		message = "Cannot open file [" + filename + "]";
+		return false;
+	}
+	if (format != INPUT_PLAIN)
+		worker = std::thread(&InputFile::run, this);
+	return true;
+}
+
+void InputFile::close()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	room.notify_all();
+	if (worker.joinable())
+		worker.join();
+	file.close();
+
+	blocks.clear();
+	current.clear();
+	format = INPUT_PLAIN;
+	frames = false;
+	finished = false;
+	stopping = false;
+	broken = false;
+}
+
+bool InputFile::next(const char *&data, size_t &bytes)
+{
+	if (format == INPUT_PLAIN)
+		return file.next(data, bytes);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	current = std::vector<char>();
+	ready.wait(lock, [this]() {
+		return !blocks.empty() || finished;
+	});
+	if (blocks.empty())
+		return false;
+	current.swap(blocks.front());
+	blocks.pop_front();
+	room.notify_one();
+	data = current.data();
+	bytes = current.size();
+	return true;
+}
+
+bool InputFile::failed() const
+{
+	if (format == INPUT_PLAIN)
+		return file.failed();
+	std::lock_guard<std::mutex> lock(mutex);
+	return broken;
+}
+
+std::string InputFile::error() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (message.empty() && format == INPUT_PLAIN && file.failed())
+		return "Cannot read file [" + path + "]";
+	return message;
+}
+
+bool InputFile::parallel() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return frames;
+}
+
+bool InputFile::push(std::vector<char> &block)
+{
+	if (block.empty())
+		return true;
+	std::unique_lock<std::mutex> lock(mutex);
+	room.wait(lock, [this]() {
+		return blocks.size() < INPUT_QUEUE || stopping;
+	});
+	if (stopping)
+		return false;
+	blocks.push_back(std::move(block));
+	block = std::vector<char>();
+	ready.notify_one();
+	return true;
+}
+
+void InputFile::fail(const std::string &error)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (message.empty())
+		message = error;
+	broken = true;
+}
+
+void InputFile::run()
+{
+	const char *data;
+	size_t bytes;
+	bool ok = true;
+	if (file.next(data, bytes)) {
+		// Only worth splitting when there is more than one frame
+		size_t compressed = 0, decompressed = 0;
+		const bool split = frameSize(format, data, bytes, compressed, decompressed) == FRAME_OK && compressed < file.size();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			frames = split;
+		}
+		if (split)
+			ok = decodeFrames(data, bytes);
+		else
+			ok = format == INPUT_GZIP ? inflateStream(data, bytes) : zstdStream(data, bytes);
+	}
+	if (file.failed())
+		fail("Cannot read file [" + path + "]");
+	else if (!ok)
+		fail("Corrupt or truncated compressed file [" + path + "]");
+
+	std::lock_guard<std::mutex> lock(mutex);
+	finished = true;
+	ready.notify_all();
+}
+
+bool InputFile::inflateStream(const char *data, size_t bytes)
+{
+#ifdef PCV_HAVE_ZLIB
+	z_stream z;
+	memset(&z, 0, sizeof(z));
+	if (inflateInit2(&z, 16 + MAX_WBITS) != Z_OK)
+		return false;
+
+	std::vector<char> block(INPUT_BLOCK);
+	size_t used = 0;
+	bool ok = true, ended = false;
+	do {
+		z.next_in = (Bytef *)data;
+		z.avail_in = (uInt)bytes;
+		while (ok && z.avail_in > 0) {
+			z.next_out = (Bytef *)&block[used];
+			z.avail_out = (uInt)(block.size() - used);
+			const int result = inflate(&z, Z_NO_FLUSH);
+			used = block.size() - z.avail_out;
+			ended = result == Z_STREAM_END;
+			ok = result == Z_OK || result == Z_STREAM_END;
+
+			// Concatenated members, as gzip and pigz write for appended input
+			if (ended && z.avail_in > 0)
+				ok = inflateReset(&z) == Z_OK;
+			if (ok && used == block.size()) {
+				ok = push(block);
+				block.resize(INPUT_BLOCK);
+				used = 0;
+			}
+		}
+	} while (ok && file.next(data, bytes));
+	inflateEnd(&z);
+
+	block.resize(used);
+	return ok && ended && push(block);
+#else
+	(void)data;
+	(void)bytes;
+	return false;
+#endif
+}
+
+bool InputFile::zstdStream(const char *data, size_t bytes)
+{
+#ifdef PCV_HAVE_ZSTD
+	ZSTD_DStream *stream = ZSTD_createDStream();
+	if (stream == NULL)
+		return false;
+	ZSTD_initDStream(stream);
+
+	std::vector<char> block(INPUT_BLOCK);
+	size_t used = 0, hint = 0;
+	bool ok = true;
+	do {
+		ZSTD_inBuffer input = { data, bytes, 0 };
+		for (;;) {
+			ZSTD_outBuffer output = { &block[used], block.size() - used, 0 };
+			hint = ZSTD_decompressStream(stream, &output, &input);
+			used += output.pos;
+			ok = !ZSTD_isError(hint);
+			if (ok && used == block.size()) {
+				ok = push(block);
+				block.resize(INPUT_BLOCK);
+				used = 0;
+				continue; // The decoder may hold more output for this input
+			}
+			if (!ok || input.pos == input.size)
+				break;
+		}
+	} while (ok && file.next(data, bytes));
+	ZSTD_freeDStream(stream);
+
+	// A hint other than 0 means the last frame was cut off
+	block.resize(used);
+	return ok && hint == 0 && push(block);
+#else
+	(void)data;
+	(void)bytes;
+	return false;
+#endif
+}
+
+/**
+* Decodes the frame at "position" of "window" one block at a time, reading
+* on through the file. Leaves the rest of the input after the frame in
+* "window" from "position".
+*/
+bool InputFile::zstdFrameStream(std::vector<char> &window, size_t &position)
+{
+#ifdef PCV_HAVE_ZSTD
+	ZSTD_DStream *stream = ZSTD_createDStream();
+	if (stream == NULL)
+		return false;
+	ZSTD_initDStream(stream);
+
+	std::vector<char> block(INPUT_BLOCK);
+	size_t used = 0, hint = 1;
+	bool ok = true, flushing = false;
+	while (ok && hint != 0) {
+		// The decoder may hold more output for the input it already has
+		if (position == window.size() && !flushing) {
+			const char *data;
+			size_t bytes;
+			if (!file.next(data, bytes))
+				break;
+			window.assign(data, data + bytes);
+			position = 0;
+		}
+		ZSTD_inBuffer input = { &window[position], window.size() - position, 0 };
+		ZSTD_outBuffer output = { &block[used], block.size() - used, 0 };
+		hint = ZSTD_decompressStream(stream, &output, &input);
+		position += input.pos;
+		used += output.pos;
+		ok = !ZSTD_isError(hint);
+		flushing = ok && used == block.size();
+		if (flushing) {
+			ok = push(block);
+			block.resize(INPUT_BLOCK);
+			used = 0;
+		}
+	}
+	ZSTD_freeDStream(stream);
+
+	block.resize(used);
+	return ok && hint == 0 && push(block);
+#else
+	(void)window;
+	(void)position;
+	return false;
+#endif
+}
+
+/**
+* Collects whole frames in a window of the compressed input and decodes up
+* to INPUT_BATCH of output at once, one frame per worker. Frames larger than
+* a batch go through the streaming decoder instead, so neither the
+* compressed frame nor its output is ever held whole.
+*/
+bool InputFile::decodeFrames(const char *data, size_t bytes)
+{
+	struct Frame {
+		size_t offset;
+		size_t compressed;
+		size_t decompressed;
+		size_t output;
+	};
+
+	std::vector<char> window(data, data + bytes);
+	size_t position = 0;
+	bool more = true;
+	for (;;) {
+		if (position < window.size() && largeFrame(format, &window[position], window.size() - position)) {
+			if (!zstdFrameStream(window, position))
+				return false;
+			continue;
+		}
+
+		std::vector<Frame> batch;
+		size_t total = 0, scan = position;
+		FrameStatus status = FRAME_INCOMPLETE;
+		while (scan < window.size()) {
+			Frame frame;
+			if (largeFrame(format, &window[scan], window.size() - scan))
+				break;
+			status = frameSize(format, &window[scan], window.size() - scan, frame.compressed, frame.decompressed);
+			if (status != FRAME_OK || (!batch.empty() && total + frame.decompressed > INPUT_BATCH))
+				break;
+			frame.offset = scan;
+			frame.output = total;
+			batch.push_back(frame);
+			total += frame.decompressed;
+			scan += frame.compressed;
+		}
+
+		if (batch.empty()) {
+			// A frame without known sizes after splittable ones is not
+			// something bgzip or pzstd write
+			if (status == FRAME_INVALID)
+				return false;
+			if (!more)
+				return position == window.size();
+			window.erase(window.begin(), window.begin() + position);
+			position = 0;
+			more = file.next(data, bytes);
+			if (more)
+				window.insert(window.end(), data, data + bytes);
+			continue;
+		}
+
+		std::vector<char> output(total);
+		std::atomic<bool> ok(true);
+		parallelFor(batch.size(), [&](size_t, size_t begin, size_t end) {
+			for (size_t i = begin; i < end && ok; i++) {
+				const Frame &frame = batch[i];
+				if (!decodeFrame(format, &window[frame.offset], frame.compressed, output.data() + frame.output, frame.decompressed))
+					ok = false;
+			}
+		}, 1);
+		if (!ok || !push(output))
+			return false;
+		position = scan;
+	}
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "async_file.h"
+
+#define INPUT_BLOCK (4 << 20) // Decompressed bytes per block of the sequential decoders
+#define INPUT_QUEUE 4 // Decompressed blocks waiting for the reader at most
+#define INPUT_BATCH (16 << 20) // Decompressed bytes of the frames decoded in parallel at once
+
+enum InputCompression {
+	INPUT_PLAIN,
+	INPUT_GZIP,
+	INPUT_ZSTD
+};
+
+/**
+* Compression of a file by its magic bytes, the name does not matter.
+*/
+InputCompression detectCompression(const std::string &path);
+
+/**
+* A file read front to back in blocks for the parsers. Plain files come
+* straight from a ReadAheadFile. gzip and zstd files are decompressed on a
+* thread into a short queue, so memory stays bounded however large the
+* file. Files made of independent frames with known sizes, BGZF (bgzip) or
+* multi-frame zstd (pzstd, zstd -T with --block-size), have batches of
+* frames decoded in parallel, anything else one stream at a time.
+*/
+class InputFile {
+public:
+	InputFile() {}
+	~InputFile();
+
+	/**
+	* Starts reading at byte "first" of the decompressed content, which
+	* compressed files only support for 0.
+	*/
+	bool open(const std::string &filename, uint64_t first = 0);
+	void close();
+
+	/**
+	* Next block, valid until the following call. False at the end or on an
+	* error.
+	*/
+	bool next(const char *&data, size_t &bytes);
+
+	bool failed() const;
+	std::string error() const;
+	InputCompression compression() const { return format; }
+
+	/**
+	* Whether frames are decoded in parallel, known once the first block was
+	* read.
+	*/
+	bool parallel() const;
+
+private:
+	InputFile(const InputFile &);
+	InputFile &operator=(const InputFile &);
+
+	void run();
+	bool inflateStream(const char *data, size_t bytes);
+	bool zstdStream(const char *data, size_t bytes);
+	bool zstdFrameStream(std::vector<char> &window, size_t &position);
+	bool decodeFrames(const char *data, size_t bytes);
+	bool push(std::vector<char> &block);
+	void fail(const std::string &message);
+
+	ReadAheadFile file;
+	std::string path;
+	InputCompression format = INPUT_PLAIN;
+	bool frames = false;
+	std::thread worker;
+	mutable std::mutex mutex;
+	std::condition_variable ready;
+	std::condition_variable room;
+	std::deque<std::vector<char>> blocks;
+	std::vector<char> current; // Handed out by the last next
+	bool finished = false;
+	bool stopping = false;
+	bool broken = false;
+	std::string message;
+};
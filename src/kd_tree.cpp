@@ -0,0 +1,260 @@
+#include "kd_tree.h"
+
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+
+#include "parallel.h"
+
+void KdTree::build(const float *positions, size_t count, size_t leafSize)
+{
+	leafSize = std::max<size_t>(leafSize, 1);
+	depth = 0;
+	while ((count >> depth) > leafSize)
+		depth++;
+
+	const size_t nodes = ((size_t)1 << depth) - 1;
+	splits.assign(nodes, 0);
+	axes.assign(nodes, 0);
+	order.resize(count);
+	for (size_t i = 0; i < count; i++)
+		order[i] = (uint32_t)i;
+
+	for (int level = 0; level < depth; level++) {
+		const size_t levelNodes = (size_t)1 << level;
+		parallelFor(levelNodes, [&](size_t, size_t first, size_t last) {
+			for (size_t k = first; k < last; k++) {
+				// Walk down from the root to find the range of this node
+				size_t begin = 0, end = count;
+				for (int bit = level - 1; bit >= 0; bit--) {
+					const size_t mid = begin + (end - begin) / 2;
+					if ((k >> bit) & 1)
+						begin = mid;
+					else
+						end = mid;
+				}
+
+				// Split along the widest axis of the range
+				float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+				for (size_t i = begin; i < end; i++) {
+					const float *p = positions + order[i] * 3;
+					for (int a = 0; a < 3; a++) {
+						lo[a] = std::min(lo[a], p[a]);
+						hi[a] = std::max(hi[a], p[a]);
+					}
+				}
+				int axis = 0;
+				for (int a = 1; a < 3; a++)
+					axis = hi[a] - lo[a] > hi[axis] - lo[axis] ? a : axis;
+
+				const size_t mid = begin + (end - begin) / 2;
+				std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&](uint32_t a, uint32_t b) {
+					return positions[a * 3 + axis] < positions[b * 3 + axis];
+				});
+
+				const size_t node = levelNodes - 1 + k;
+				splits[node] = end > begin ? positions[order[mid] * 3 + axis] : 0;
+				axes[node] = (uint8_t)axis;
+			}
+		}, 1);
+	}
+
+	points.resize(count * 3);
+	parallelFor(count, [&](size_t, size_t begin, size_t end) {
+		for (size_t e = begin; e < end; e++) {
+			for (int a = 0; a < 3; a++)
+				points[e * 3 + a] = positions[order[e] * 3 + a];
+		}
+	});
+}
+
+bool KdTree::nearest(const float *p, float maxDistSq, uint32_t &entry, float &distSq) const
+{
+	return nearestK(p, 1, maxDistSq, &entry, &distSq) == 1;
+}
+
+size_t KdTree::nearestK(const float *p, size_t k, float maxDistSq, uint32_t *entries, float *distSq) const
+{
+	size_t found = 0;
+	if (k > 0 && !order.empty())
+		searchK(0, 0, 0, order.size(), p, k, found, entries, distSq, maxDistSq);
+	return found;
+}
+
+void KdTree::inRadius(const float *p, float radius, std::vector<uint32_t> &entries, std::vector<float> &distSq) const
+{
+	if (!order.empty())
+		searchRadius(0, 0, 0, order.size(), p, radius, entries, distSq);
+}
+
+void KdTree::inBox(const float *lo, const float *hi, std::vector<uint32_t> &entries) const
+{
+	if (!order.empty())
+		searchBox(0, 0, 0, order.size(), lo, hi, entries);
+}
+
+bool KdTree::raycast(const float *origin, const float *dir, float radius, float maxT, uint32_t &entry, float &t) const
+{
+	const float length = sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+	if (order.empty() || length == 0)
+		return false;
+	const float d[3] = { dir[0] / length, dir[1] / length, dir[2] / length };
+	const float radiusSq = radius * radius;
+
+	// Depth first with the near child on top. Every node keeps the part of
+	// the ray inside its half space, widened by the radius.
+	struct Item {
+		size_t node, begin, end;
+		int level;
+		float t0, t1;
+	};
+	Item stack[64];
+	size_t top = 0;
+	stack[top++] = { 0, 0, order.size(), 0, 0.f, maxT };
+
+	bool hit = false;
+	float best = maxT;
+	while (top > 0) {
+		const Item item = stack[--top];
+		if (item.t0 > best)
+			continue;
+
+		if (item.level == depth) {
+			for (size_t e = item.begin; e < item.end; e++) {
+				const float *q = point(e);
+				const float v[3] = { q[0] - origin[0], q[1] - origin[1], q[2] - origin[2] };
+				const float along = v[0] * d[0] + v[1] * d[1] + v[2] * d[2];
+				if (along < 0 || along >= best)
+					continue;
+				const float w[3] = { v[0] - d[0] * along, v[1] - d[1] * along, v[2] - d[2] * along };
+				if (w[0] * w[0] + w[1] * w[1] + w[2] * w[2] <= radiusSq) {
+					best = along;
+					entry = (uint32_t)e;
+					hit = true;
+				}
+			}
+			continue;
+		}
+
+		// Left entries are at or below the split, right ones at or above
+		const int axis = axes[item.node];
+		float leftT0 = item.t0, leftT1 = item.t1, rightT0 = item.t0, rightT1 = item.t1;
+		if (d[axis] != 0) {
+			const float leftCross = (splits[item.node] + radius - origin[axis]) / d[axis];
+			const float rightCross = (splits[item.node] - radius - origin[axis]) / d[axis];
+			if (d[axis] > 0) {
+				leftT1 = std::min(leftT1, leftCross);
+				rightT0 = std::max(rightT0, rightCross);
+			}
+			else {
+				leftT0 = std::max(leftT0, leftCross);
+				rightT1 = std::min(rightT1, rightCross);
+			}
+		}
+		else if (origin[axis] > splits[item.node] + radius) {
+			leftT0 = FLT_MAX;
+		}
+		else if (origin[axis] < splits[item.node] - radius) {
+			rightT0 = FLT_MAX;
+		}
+
+		const size_t mid = item.begin + (item.end - item.begin) / 2;
+		const size_t left = item.node * 2 + 1;
+		const Item leftItem = { left, item.begin, mid, item.level + 1, leftT0, leftT1 };
+		const Item rightItem = { left + 1, mid, item.end, item.level + 1, rightT0, rightT1 };
+		const bool leftFirst = leftT0 <= rightT0;
+		const Item &nearItem = leftFirst ? leftItem : rightItem;
+		const Item &farItem = leftFirst ? rightItem : leftItem;
+		if (farItem.t0 <= farItem.t1)
+			stack[top++] = farItem;
+		if (nearItem.t0 <= nearItem.t1)
+			stack[top++] = nearItem;
+	}
+
+	t = best;
+	return hit;
+}
+
+void KdTree::searchK(size_t node, int level, size_t begin, size_t end, const float *p, size_t k,
+	size_t &found, uint32_t *entries, float *distSq, float maxDistSq) const
+{
+	if (level == depth) {
+		for (size_t e = begin; e < end; e++) {
+			const float *q = point(e);
+			const float dx = q[0] - p[0], dy = q[1] - p[1], dz = q[2] - p[2];
+			const float d = dx * dx + dy * dy + dz * dz;
+			const float worst = found < k ? maxDistSq : distSq[k - 1];
+			if (d > worst || (found == k && d == worst))
+				continue;
+
+			// Insert into the sorted result list
+			size_t i = found < k ? found++ : k - 1;
+			for (; i > 0 && distSq[i - 1] > d; i--) {
+				distSq[i] = distSq[i - 1];
+				entries[i] = entries[i - 1];
+			}
+			distSq[i] = d;
+			entries[i] = (uint32_t)e;
+		}
+		return;
+	}
+
+	const size_t mid = begin + (end - begin) / 2;
+	const float diff = p[axes[node]] - splits[node];
+	const size_t left = node * 2 + 1;
+	if (diff < 0) {
+		searchK(left, level + 1, begin, mid, p, k, found, entries, distSq, maxDistSq);
+		if (diff * diff <= (found < k ? maxDistSq : distSq[k - 1]))
+			searchK(left + 1, level + 1, mid, end, p, k, found, entries, distSq, maxDistSq);
+	}
+	else {
+		searchK(left + 1, level + 1, mid, end, p, k, found, entries, distSq, maxDistSq);
+		if (diff * diff <= (found < k ? maxDistSq : distSq[k - 1]))
+			searchK(left, level + 1, begin, mid, p, k, found, entries, distSq, maxDistSq);
+	}
+}
+
+void KdTree::searchRadius(size_t node, int level, size_t begin, size_t end, const float *p, float radius,
+	std::vector<uint32_t> &entries, std::vector<float> &distSq) const
+{
+	if (level == depth) {
+		const float radiusSq = radius * radius;
+		for (size_t e = begin; e < end; e++) {
+			const float *q = point(e);
+			const float dx = q[0] - p[0], dy = q[1] - p[1], dz = q[2] - p[2];
+			const float d = dx * dx + dy * dy + dz * dz;
+			if (d <= radiusSq) {
+				entries.push_back((uint32_t)e);
+				distSq.push_back(d);
+			}
+		}
+		return;
+	}
+
+	const size_t mid = begin + (end - begin) / 2;
+	const size_t left = node * 2 + 1;
+	if (p[axes[node]] - radius <= splits[node])
+		searchRadius(left, level + 1, begin, mid, p, radius, entries, distSq);
+	if (p[axes[node]] + radius >= splits[node])
+		searchRadius(left + 1, level + 1, mid, end, p, radius, entries, distSq);
+}
+
+void KdTree::searchBox(size_t node, int level, size_t begin, size_t end, const float *lo, const float *hi,
+	std::vector<uint32_t> &entries) const
+{
+	if (level == depth) {
+		for (size_t e = begin; e < end; e++) {
+			const float *q = point(e);
+			if (q[0] >= lo[0] && q[0] <= hi[0] && q[1] >= lo[1] && q[1] <= hi[1] && q[2] >= lo[2] && q[2] <= hi[2])
+				entries.push_back((uint32_t)e);
+		}
+		return;
+	}
+
+	const size_t mid = begin + (end - begin) / 2;
+	const size_t left = node * 2 + 1;
+	if (lo[axes[node]] <= splits[node])
+		searchBox(left, level + 1, begin, mid, lo, hi, entries);
+	if (hi[axes[node]] >= splits[node])
+		searchBox(left + 1, level + 1, mid, end, lo, hi, entries);
+}
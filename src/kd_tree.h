@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+* Balanced KD-tree for nearest neighbour queries. The tree is implicit: every
+* node splits its range of entries at the middle, so node ranges follow from
+* their position and only the split planes are stored. Levels are built one
+* at a time with the nodes of a level split in parallel.
+*/
+struct KdTree {
+	int depth = 0; // Levels of split nodes, leaves sit below the last one
+	std::vector<float> splits; // Split coordinate per node, in heap order
+	std::vector<uint8_t> axes; // Split axis per node
+	std::vector<uint32_t> order; // Point index of every entry
+	std::vector<float> points; // Positions in entry order
+
+	void build(const float *positions, size_t count, size_t leafSize = 16);
+
+	size_t size() const { return order.size(); }
+	const float *point(size_t entry) const { return &points[entry * 3]; }
+
+	/**
+	* Closest entry within sqrt(maxDistSq) of "p". Returns false if none.
+	*/
+	bool nearest(const float *p, float maxDistSq, uint32_t &entry, float &distSq) const;
+
+	/**
+	* Up to "k" closest entries within sqrt(maxDistSq), ordered by distance.
+	* Returns the number found.
+	*/
+	size_t nearestK(const float *p, size_t k, float maxDistSq, uint32_t *entries, float *distSq) const;
+
+	/**
+	* Appends every entry within "radius" of "p" and its squared distance.
+	*/
+	void inRadius(const float *p, float radius, std::vector<uint32_t> &entries, std::vector<float> &distSq) const;
+
+	/**
+	* Appends every entry inside the box from "lo" to "hi", bounds included.
+	*/
+	void inBox(const float *lo, const float *hi, std::vector<uint32_t> &entries) const;
+
+	/**
+	* First entry within "radius" of the ray from "origin" along "dir", points
+	* are treated as spheres of that radius. "t" is the distance along the
+	* ray to the point's closest approach, hits beyond "maxT" are ignored.
+	* Returns false if nothing was hit.
+	*/
+	bool raycast(const float *origin, const float *dir, float radius, float maxT, uint32_t &entry, float &t) const;
+
+private:
+	void searchK(size_t node, int level, size_t begin, size_t end, const float *p, size_t k,
+		size_t &found, uint32_t *entries, float *distSq, float maxDistSq) const;
+	void searchRadius(size_t node, int level, size_t begin, size_t end, const float *p, float radius,
+		std::vector<uint32_t> &entries, std::vector<float> &distSq) const;
+	void searchBox(size_t node, int level, size_t begin, size_t end, const float *lo, const float *hi,
+		std::vector<uint32_t> &entries) const;
+};
@@ -6,7 +6,16 @@
 #include <iostream>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <stddef.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
 #include <thread>
 
 #include <glad/glad.h>
@@ -21,10 +30,28 @@
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include "tiny_obj_loader.h"
 #include "tinyfiledialogs.h"
 
+#include "axis_index.h"
+#include "cluster.h"
+#include "dataset_cache.h"
+#include "denoise.h"
+#include "file_browser.h"
+#include "file_watch.h"
+#include "ground_filter.h"
+#include "http_fetch.h"
+#include "icp.h"
+#include "merge.h"
+#include "parallel.h"
+#include "point_cloud.h"
+#include "point_file.h"
+#include "profiler.h"
+#include "radix_sort.h"
+#include "ransac.h"
+#include "raster.h"
+#include "shm_ring.h"
+#include "voxel_grid.h"
+
 #define WIN_TITLE "Point Cloud Viewer"
 #define WIN_WIDTH 1024
 #define WIN_HEIGHT 480
@@ -32,6 +59,12 @@
 #define GL_MINOR 3
 #define VSYNC 0 // Use if supported
 #define MSAA 2
+#define SHADOW_MAP_SIZE 2048
+#define SLICE_VIEW_SIZE 512
+#define REMOTE_HEAD_BYTES (64 << 10) // First range, covers the node table of most files
+#define REMOTE_TABLE 0 // Fetch ID of the node table, nodes follow
+#define REMOTE_FIRST_NODE 1
+#define REMOTE_ATTEMPTS 3
 
 /////////////
 // Shaders //
@@ -59,239 +92,1865 @@ static const char *pointcloud_vert =
 "#version 330 core\n\
     layout(location = 0) in vec3 POSITION;\n\
     layout(location = 1) in vec3 NORMAL;\n\
+    layout(location = 2) in uint LABEL;\n\
     out vec3 _Normal;\n\
+    out vec4 _LightPos;\n\
+    flat out uint _Label;\n\
     uniform mat4 MVP;\n\
+    uniform mat4 LightMVP;\n\
+    uniform mat4 Model;\n\
     void main() {\n\
         gl_Position = vec4(POSITION, 1.0) * MVP;\n\
-        _Normal = NORMAL;\n\
+        _Normal = (vec4(NORMAL, 0.0) * Model).xyz;\n\
+        _LightPos = vec4(POSITION, 1.0) * LightMVP;\n\
+        _Label = LABEL;\n\
     }\n";
 
 static const char *pointcloud_frag =
 "#version 330 core\n\
     in vec3 _Normal;\n\
+    in vec4 _LightPos;\n\
+    flat in uint _Label;\n\
     out vec4 frag;\n\
 	uniform int DrawMode;\n\
+	uniform int Shadows;\n\
+	uniform float ShadowBias;\n\
+	uniform float Alpha;\n\
 	uniform float LightIntensity;\n\
     uniform vec3 LightDir;\n\
     uniform vec3 LightCol;\n\
     uniform vec3 DiffuseCol;\n\
     uniform vec3 AmbientCol;\n\
+    uniform sampler2DShadow ShadowMap;\n\
+    float shadow() {\n\
+		vec3 p = _LightPos.xyz / _LightPos.w * 0.5 + 0.5;\n\
+		vec2 texel = 1.0 / textureSize(ShadowMap, 0);\n\
+		float lit = 0.0;\n\
+		for (int x = -1; x <= 1; ++x)\n\
+			for (int y = -1; y <= 1; ++y)\n\
+				lit += texture(ShadowMap, vec3(p.xy + vec2(x, y) * texel, p.z - ShadowBias));\n\
+		return lit / 9.0;\n\
+    }\n\
+    vec3 labelColor() {\n\
+		if (_Label == 0u) return vec3(0.5);\n\
+		float h = fract(float(_Label) * 0.618034);\n\
+		return clamp(abs(fract(h + vec3(0.0, 2.0 / 3.0, 1.0 / 3.0)) * 6.0 - 3.0) - 1.0, 0.0, 1.0);\n\
+    }\n\
     void main() {\n\
 		if (DrawMode == 0) {\n\
-			frag = vec4(DiffuseCol, 1);\n\
+			frag = vec4(DiffuseCol, Alpha);\n\
 		} else if (DrawMode == 1) {\n\
-			frag = vec4(abs(normalize(_Normal)), 1);\n\
+			frag = vec4(abs(normalize(_Normal)), Alpha);\n\
 		} else {\n\
 			float d = dot(_Normal, normalize(-LightDir));\n\
-			frag = vec4(AmbientCol + d * LightIntensity * LightCol * DiffuseCol, 1);\n\
+			if (Shadows == 1) d *= shadow();\n\
+			vec3 diffuse = DrawMode == 4 ? labelColor() : DiffuseCol;\n\
+			frag = vec4(AmbientCol + d * LightIntensity * LightCol * diffuse, Alpha);\n\
 		}\n\
     }\n";
 
-////////////////////////////
-// GLFW callback bindings //
-////////////////////////////
+// For voxel overview cubes (uses pointcloud_frag)
+static const char *voxel_vert =
+"#version 330 core\n\
+    layout(location = 0) in vec3 POSITION;\n\
+    layout(location = 1) in vec3 OFFSET;\n\
+    layout(location = 2) in vec3 NORMAL;\n\
+    out vec3 _Normal;\n\
+    out vec4 _LightPos;\n\
+    flat out uint _Label;\n\
+    uniform mat4 MVP;\n\
+    uniform mat4 LightMVP;\n\
+    uniform float VoxelSize;\n\
+    void main() {\n\
+        vec4 pos = vec4(OFFSET + POSITION * VoxelSize, 1.0);\n\
+        gl_Position = pos * MVP;\n\
+        _Normal = NORMAL;\n\
+        _LightPos = pos * LightMVP;\n\
+        _Label = 0u;\n\
+    }\n";
+
+// For the shadow map depth pass (uses shape_vert)
+static const char *shadow_frag =
+"#version 330 core\n\
+    void main() {\n\
+    }\n";
+
+////////////////////////////
+// GLFW callback bindings //
+////////////////////////////
+
+static void error_callback(int error, const char* description)
+{
+	fprintf(stderr, "Error: %s\n", description);
+}
+
+static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
+		glfwSetWindowShouldClose(window, GLFW_TRUE);
+}
+
+///////////////////////
+// Utility functions //
+///////////////////////
+
+/**
+* Creates a shader program given a vertex and fragment shaders.
+*/
+static bool createShader(GLuint &prog, const char *vertSrc, const char *fragSrc)
+{
+	GLint success = 0;
+	GLchar errBuff[1024] = { 0 };
+
+	// Create vertex shader
+	GLuint vert = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(vert, 1, &vertSrc, NULL);
+	glCompileShader(vert);
+
+	glGetShaderiv(vert, GL_COMPILE_STATUS, &success);
+	if (success == GL_FALSE) {
+		glGetShaderInfoLog(vert, sizeof(errBuff), NULL, errBuff);
+		std::cerr << errBuff << std::endl;
+		return false;
+	}
+
+	// Create fragment shader
+	GLuint frag = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(frag, 1, &fragSrc, NULL);
+	glCompileShader(frag);
+
+	glGetShaderiv(frag, GL_COMPILE_STATUS, &success);
+	if (success == GL_FALSE) {
+		glGetShaderInfoLog(frag, sizeof(errBuff), NULL, errBuff);
+		std::cerr << errBuff << std::endl;
+		return false;
+	}
+
+	// Create shader program
+	prog = glCreateProgram();
+	glAttachShader(prog, vert);
+	glAttachShader(prog, frag);
+
+	glLinkProgram(prog);
+
+	glGetProgramiv(prog, GL_LINK_STATUS, &success);
+	if (success == GL_FALSE) {
+		glGetShaderInfoLog(frag, sizeof(errBuff), NULL, errBuff);
+		std::cerr << errBuff << std::endl;
+		return false;
+	}
+
+	glValidateProgram(prog);
+
+	glGetProgramiv(prog, GL_LINK_STATUS, &success);
+	if (success == GL_FALSE) {
+		glGetShaderInfoLog(frag, sizeof(errBuff), NULL, errBuff);
+		std::cerr << errBuff << std::endl;
+		return false;
+	}
+
+	// No need for these so we can delete them
+	glDeleteShader(vert);
+	glDeleteShader(frag);
+	return true;
+}
+
+/**
+* A loaded point cloud shape, its CPU side data and GPU buffers.
+*/
+struct Mesh : PointCloud {
+	GLuint vao = 0;
+	GLuint shadowVAO = 0; // Draws the points in shadowEBO for the shadow pass
+	GLuint shadowEBO = 0; // Every "shadowStride"th point index
+	GLuint posVBO = 0;
+	GLuint norVBO = 0;
+	GLuint labelVBO = 0; // Per point segment label, 0 when unassigned
+	GLuint orderEBO = 0; // Back to front draw order for transparency
+	size_t count = 0; // Number of points
+	size_t shadowStride = 0; // Of shadowEBO, 0 until first filled
+
+	std::vector<uint32_t> order; // Last sorted draw order
+	std::vector<uint32_t> depthKeys;
+
+	AxisIndex slice; // Points sorted along the slice axis
+	GLuint sliceVAO = 0; // Draws from the sorted slice order
+	GLuint sliceEBO = 0;
+
+	int source = -1; // Index into Scene::sources, -1 for merged or streamed meshes
+	size_t chunk = 0; // Shape of the source file
+	uint64_t revision = 0; // Unique to these points, changes whenever they do
+
+	// Points left in a mapped dataset cache entry instead of "positions" and
+	// "normals", the entry stays mapped and locked while a mesh uses it
+	std::shared_ptr<CachedDataset> cached;
+	const float *cachedPositions = NULL;
+	const float *cachedNormals = NULL; // NULL if the shape has none
+};
+
+static const float *meshPositions(const Mesh &mesh)
+{
+	return mesh.cached ? mesh.cachedPositions : mesh.positions.data();
+}
+
+/**
+* Normals of a mesh, NULL if it has none.
+*/
+static const float *meshNormals(const Mesh &mesh)
+{
+	if (mesh.cached)
+		return mesh.cachedNormals;
+	return mesh.hasNormals() ? mesh.normals.data() : NULL;
+}
+
+/**
+* Copies the points of a mesh out of its cache entry before they are edited
+* in place, the entry is let go once no mesh uses it anymore.
+*/
+static void ownMeshPoints(Mesh &mesh)
+{
+	if (!mesh.cached)
+		return;
+	mesh.positions.assign(mesh.cachedPositions, mesh.cachedPositions + mesh.count * 3);
+	if (mesh.cachedNormals != NULL)
+		mesh.normals.assign(mesh.cachedNormals, mesh.cachedNormals + mesh.count * 3);
+	else
+		mesh.normals.clear();
+	mesh.cached.reset();
+	mesh.cachedPositions = mesh.cachedNormals = NULL;
+}
+
+/**
+* Returns a revision no mesh had before, for meshes whose points were
+* created or rewritten.
+*/
+static uint64_t newMeshRevision()
+{
+	static uint64_t revision = 0;
+	return ++revision;
+}
+
+/**
+* A file the scene was loaded from, with the hash of every shape as last
+* loaded so a reload can tell which of them changed.
+*/
+struct SceneSource {
+	std::string path;
+	bool useCache = false;
+	std::vector<uint64_t> hashes;
+};
+
+/**
+* All the meshes of a loaded scene file and their bounds.
+*/
+struct Scene {
+	int version = 0; // Incremented on every load so caches can tell it changed
+	GLuint bounds = 0;
+	GLuint boundsVBO = 0;
+	GLuint boundsEBO = 0;
+	std::vector<Mesh> meshes;
+	std::vector<SceneSource> sources;
+	glm::vec3 min = glm::vec3(0);
+	glm::vec3 max = glm::vec3(0);
+};
+
+/**
+* Creates the GPU buffers of a mesh from its CPU side positions and normals,
+* which cached meshes upload straight from the mapped entry.
+*/
+static void createMeshBuffers(Mesh &mesh)
+{
+	mesh.revision = newMeshRevision();
+	if (!mesh.cached)
+		mesh.count = mesh.positions.size() / 3;
+	const float *normals = meshNormals(mesh);
+	glGenVertexArrays(1, &mesh.vao);
+	glBindVertexArray(mesh.vao);
+
+	// Positions buffer
+	glGenBuffers(1, &mesh.posVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.posVBO);
+	glBufferData(GL_ARRAY_BUFFER, mesh.count * 3 * sizeof(float), meshPositions(mesh), GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
+	glEnableVertexAttribArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// Normals buffer
+	glGenBuffers(1, &mesh.norVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.norVBO);
+	glBufferData(GL_ARRAY_BUFFER, normals != NULL ? mesh.count * 3 * sizeof(float) : 0, normals, GL_STATIC_DRAW);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
+	glEnableVertexAttribArray(1);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// Labels buffer, all unassigned until a processing stage writes them
+	mesh.labels.assign(mesh.count, 0);
+	glGenBuffers(1, &mesh.labelVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.labelVBO);
+	glBufferData(GL_ARRAY_BUFFER, mesh.count * sizeof(uint32_t), mesh.labels.data(), GL_DYNAMIC_DRAW);
+	glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, sizeof(uint32_t), (void *)0);
+	glEnableVertexAttribArray(2);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// Draw order buffer, starts in file order and is sorted when transparent
+	mesh.order.resize(mesh.count);
+	for (size_t j = 0; j < mesh.count; j++)
+		mesh.order[j] = (uint32_t)j;
+
+	glGenBuffers(1, &mesh.orderEBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.orderEBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.count * sizeof(uint32_t), mesh.order.data(), GL_STREAM_DRAW);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	// Shadow pass only needs positions, its indices are filled once the stride is known
+	glGenVertexArrays(1, &mesh.shadowVAO);
+	glBindVertexArray(mesh.shadowVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.posVBO);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
+	glEnableVertexAttribArray(0);
+	glGenBuffers(1, &mesh.shadowEBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.shadowEBO);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	mesh.shadowStride = 0;
+}
+
+/**
+* Deletes the GPU buffers of a mesh.
+*/
+static void deleteMeshBuffers(Mesh &mesh)
+{
+	glDeleteVertexArrays(1, &mesh.vao);
+	glDeleteVertexArrays(1, &mesh.shadowVAO);
+	glDeleteBuffers(1, &mesh.posVBO);
+	glDeleteBuffers(1, &mesh.norVBO);
+	glDeleteBuffers(1, &mesh.labelVBO);
+	glDeleteBuffers(1, &mesh.orderEBO);
+	glDeleteBuffers(1, &mesh.shadowEBO);
+	glDeleteVertexArrays(1, &mesh.sliceVAO);
+	glDeleteBuffers(1, &mesh.sliceEBO);
+}
+
+/**
+* Uploads the scene bounds box, created on first use.
+*/
+static void updateSceneBounds(Scene &scene)
+{
+	const glm::vec3 min = scene.min, max = scene.max;
+	float boundsData[] = {
+		min.x, min.y, min.z,
+		max.x, min.y, min.z,
+		min.x, max.y, min.z,
+		max.x, max.y, min.z,
+		min.x, min.y, max.z,
+		max.x, min.y, max.z,
+		min.x, max.y, max.z,
+		max.x, max.y, max.z
+	};
+
+	unsigned int boundsIndices[] = {
+		0, 1, 3, 1, 2, 0, 2, 3,
+		4, 5, 7, 5, 6, 4, 6, 7,
+		0, 4, 1, 5, 2, 6, 3, 7
+	};
+
+	// Scenes streamed in grow their bounds many times, only the corners change
+	if (scene.bounds != 0) {
+		glBindBuffer(GL_ARRAY_BUFFER, scene.boundsVBO);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(boundsData), boundsData);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		return;
+	}
+	glGenVertexArrays(1, &scene.bounds);
+	glBindVertexArray(scene.bounds);
+
+	glGenBuffers(1, &scene.boundsVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, scene.boundsVBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(boundsData), boundsData, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
+	glEnableVertexAttribArray(0);
+
+	glGenBuffers(1, &scene.boundsEBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, scene.boundsEBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(boundsIndices), boundsIndices, GL_STATIC_DRAW);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+/**
+* Adds meshes without GPU buffers yet to the scene and grows the scene
+* bounds around them.
+*/
+static void addSceneMeshes(Scene &scene, std::vector<Mesh> &meshes)
+{
+	// Grow the bounds of the meshes already loaded and generate vertex arrays
+	glm::vec3 min(0), max(0);
+	if (!scene.meshes.empty()) {
+		min = scene.min;
+		max = scene.max;
+	}
+	for (auto &mesh : meshes) {
+		createMeshBuffers(mesh);
+		if (mesh.count > 0) {
+			min = glm::min(min, mesh.min);
+			max = glm::max(max, mesh.max);
+		}
+
+		// Push to list for later drawing
+		scene.meshes.push_back(std::move(mesh));
+	}
+
+	scene.min = min;
+	scene.max = max;
+	scene.version++;
+	updateSceneBounds(scene);
+}
+
+static void addSceneMeshes(Scene &scene, std::vector<PointCloud> &clouds)
+{
+	std::vector<Mesh> meshes(clouds.size());
+	for (size_t i = 0; i < clouds.size(); i++)
+		static_cast<PointCloud &>(meshes[i]) = std::move(clouds[i]);
+	addSceneMeshes(scene, meshes);
+}
+
+/**
+* A file loaded and its shapes hashed on a thread, the scene keeps drawing
+* meanwhile. With "useCache" the decoded points come from the dataset cache
+* shared with other viewer instances, and stay in its mapped entry rather
+* than in "clouds".
+*/
+struct SceneLoad {
+	std::thread loader;
+	std::atomic<bool> loaded{false};
+	std::string path;
+	bool useCache = false;
+	std::vector<PointCloud> clouds;
+	std::shared_ptr<CachedDataset> cached;
+	std::vector<uint64_t> hashes; // Let a later reload upload only the shapes that changed
+	std::string error;
+	bool ok = false;
+	double ms = 0;
+};
+
+static void startSceneLoad(SceneLoad &load, const std::string &path, bool useCache)
+{
+	load.path = path;
+	load.useCache = useCache;
+	load.loaded = false;
+	load.loader = std::thread([&load]() {
+		auto start = std::chrono::high_resolution_clock::now();
+		load.clouds.clear();
+		load.cached.reset();
+		load.error.clear();
+		if (load.useCache) {
+			load.cached.reset(new CachedDataset());
+			load.ok = load.cached->open(load.path, DatasetCacheOptions(), load.error);
+			const std::vector<CachedShape> &shapes = load.cached->shapes();
+			load.hashes.resize(shapes.size());
+			parallelFor(shapes.size(), [&](size_t, size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++)
+					load.hashes[i] = hashPoints(shapes[i].positions, shapes[i].normals, shapes[i].count);
+			}, 1);
+		}
+		else {
+			load.ok = loadPointClouds(load.path, load.clouds, load.error);
+			load.hashes.resize(load.clouds.size());
+			parallelFor(load.clouds.size(), [&](size_t, size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++)
+					load.hashes[i] = hashPointCloud(load.clouds[i]);
+			}, 1);
+		}
+		load.ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		load.loaded = true;
+	});
+}
+
+static bool sceneLoading(const SceneLoad &load)
+{
+	return load.loader.joinable();
+}
+
+/**
+* True once the load finished, its results may be used from then on.
+*/
+static bool finishSceneLoad(SceneLoad &load)
+{
+	if (!load.loader.joinable() || !load.loaded)
+		return false;
+	load.loader.join();
+	return true;
+}
+
+static void waitSceneLoad(SceneLoad &load)
+{
+	if (load.loader.joinable())
+		load.loader.join();
+}
+
+/**
+* Drops the points of a finished load, unmapping its cache entry unless
+* meshes still use it.
+*/
+static void releaseSceneLoad(SceneLoad &load)
+{
+	load.clouds.clear();
+	load.cached.reset();
+}
+
+static size_t loadedShapes(const SceneLoad &load)
+{
+	return load.cached ? load.cached->shapes().size() : load.clouds.size();
+}
+
+/**
+* Takes shape "i" of a finished load as a mesh without GPU buffers. Cached
+* shapes are not copied, the mesh points into the shared mapping so the
+* instances showing the same dataset share its pages.
+*/
+static Mesh takeLoadedShape(SceneLoad &load, size_t i)
+{
+	Mesh mesh;
+	if (!load.cached) {
+		static_cast<PointCloud &>(mesh) = std::move(load.clouds[i]);
+		mesh.count = mesh.size();
+		return mesh;
+	}
+	const CachedShape &shape = load.cached->shapes()[i];
+	mesh.cached = load.cached;
+	mesh.cachedPositions = shape.positions;
+	mesh.cachedNormals = shape.normals;
+	mesh.count = shape.count;
+	mesh.center = shape.center;
+	mesh.min = shape.min;
+	mesh.max = shape.max;
+	return mesh;
+}
+
+/**
+* Adds the clouds of a finished load to the scene as meshes of a new source,
+* returns their points.
+*/
+static size_t addSceneSource(Scene &scene, SceneLoad &load)
+{
+	SceneSource source;
+	source.path = load.path;
+	source.useCache = load.useCache;
+	source.hashes.swap(load.hashes);
+	scene.sources.push_back(std::move(source));
+
+	std::vector<Mesh> meshes;
+	for (size_t i = 0; i < loadedShapes(load); i++)
+		meshes.push_back(takeLoadedShape(load, i));
+	releaseSceneLoad(load);
+
+	size_t points = 0;
+	const size_t first = scene.meshes.size();
+	addSceneMeshes(scene, meshes);
+	for (size_t i = first; i < scene.meshes.size(); i++) {
+		scene.meshes[i].source = (int)scene.sources.size() - 1;
+		scene.meshes[i].chunk = i - first;
+		points += scene.meshes[i].count;
+	}
+	return points;
+}
+
+/**
+* Deletes the GPU resources of a scene.
+*/
+void clearScene(Scene &scene) {
+	if (scene.bounds != 0) {
+		glDeleteVertexArrays(1, &scene.bounds);
+		glDeleteBuffers(1, &scene.boundsVBO);
+		glDeleteBuffers(1, &scene.boundsEBO);
+	}
+	for (auto &m : scene.meshes)
+		deleteMeshBuffers(m);
+	scene.bounds = 0;
+	scene.boundsVBO = 0;
+	scene.boundsEBO = 0;
+	scene.meshes.clear();
+	scene.sources.clear();
+}
+
+/**
+* File > Load Scene and Add Scan. The listing and the file summaries come
+* from a FileBrowser thread and the chosen file loads on another one, so the
+* old scene keeps drawing until the new one is ready.
+*/
+struct OpenDialog {
+	FileBrowser browser;
+	std::vector<BrowserEntry> entries;
+	char directory[512] = "";
+	int selected = -1;
+	bool add = false; // Add Scan, the loaded file joins the scene
+	SceneLoad load;
+	bool replace = false; // The load in flight replaces the scene
+	std::string status;
+};
+
+static void openDialogDirectory(OpenDialog &dialog, const std::string &path)
+{
+	dialog.browser.open(path);
+	dialog.entries.clear();
+	dialog.selected = -1;
+	snprintf(dialog.directory, sizeof(dialog.directory), "%s", path.c_str());
+}
+
+static std::string summaryText(const FileSummary &summary)
+{
+	char text[64] = "";
+	const unsigned long long points = (unsigned long long)summary.points;
+	if (summary.kind == SUMMARY_HEADER || summary.kind == SUMMARY_COUNTED)
+		snprintf(text, sizeof(text), "%llu points", points);
+	else if (summary.kind == SUMMARY_SAMPLED)
+		snprintf(text, sizeof(text), "~%llu points", points);
+	else if (summary.kind == SUMMARY_PREFIX)
+		snprintf(text, sizeof(text), "%llu+ points", points);
+	return text;
+}
+
+/**
+* Draws the dialog and starts loading the file picked by a double click or
+* the button. Directories open with a double click.
+*/
+static void drawOpenDialog(OpenDialog &dialog, bool &show, bool useCache)
+{
+	ImGui::Begin(dialog.add ? "- Add Scan -###Open" : "- Load Scene -###Open", &show);
+	dialog.browser.poll(dialog.entries);
+	if (ImGui::Button("Up"))
+		openDialogDirectory(dialog, parentDirectory(dialog.browser.directory()));
+	ImGui::SameLine();
+	if (ImGui::InputText("Directory", dialog.directory, sizeof(dialog.directory), ImGuiInputTextFlags_EnterReturnsTrue))
+		openDialogDirectory(dialog, dialog.directory);
+
+	// Leaves room for the summary, the status and the button below
+	int picked = -1;
+	ImGui::BeginChild("Files", ImVec2(0, -ImGui::GetItemsLineHeightWithSpacing() * 3), true);
+	ImGui::Columns(3, "FileColumns");
+	for (size_t i = 0; i < dialog.entries.size(); i++) {
+		const BrowserEntry &entry = dialog.entries[i];
+		const std::string label = entry.directory ? entry.name + "/" : entry.name;
+		if (ImGui::Selectable(label.c_str(), dialog.selected == (int)i, ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowDoubleClick)) {
+			dialog.selected = (int)i;
+			if (ImGui::IsMouseDoubleClicked(0))
+				picked = (int)i;
+		}
+		ImGui::NextColumn();
+		if (!entry.directory)
+			ImGui::Text("%.1f MB", entry.size / 1048576.0);
+		ImGui::NextColumn();
+		ImGui::Text("%s", summaryText(entry.summary).c_str());
+		ImGui::NextColumn();
+	}
+	ImGui::Columns(1);
+	ImGui::EndChild();
+
+	const std::string error = dialog.browser.error();
+	const BrowserEntry *selected = dialog.selected >= 0 && dialog.selected < (int)dialog.entries.size() ? &dialog.entries[dialog.selected] : NULL;
+	if (!error.empty()) {
+		ImGui::Text("%s", error.c_str());
+	}
+	else if (selected != NULL && selected->summary.kind != SUMMARY_NONE && selected->summary.points > 0) {
+		const FileSummary &summary = selected->summary;
+		ImGui::Text("Bounds (%g, %g, %g) to (%g, %g, %g)%s", summary.min.x, summary.min.y, summary.min.z,
+			summary.max.x, summary.max.y, summary.max.z, summary.kind == SUMMARY_HEADER || summary.kind == SUMMARY_COUNTED ? "" : " of the points sampled");
+	}
+	else {
+		ImGui::Text("%s", dialog.browser.busy() ? "Scanning..." : "");
+	}
+	ImGui::Text("%s", sceneLoading(dialog.load) ? ("Loading " + dialog.load.path).c_str() : dialog.status.c_str());
+
+	if (selected != NULL && !selected->directory && !sceneLoading(dialog.load) && ImGui::Button(dialog.add ? "Add" : "Load"))
+		picked = dialog.selected;
+	ImGui::End();
+
+	if (picked < 0)
+		return;
+	const BrowserEntry entry = dialog.entries[picked];
+	const std::string path = joinPath(dialog.browser.directory(), entry.name);
+	if (entry.directory) {
+		openDialogDirectory(dialog, path);
+	}
+	else if (!sceneLoading(dialog.load)) {
+		dialog.replace = !dialog.add;
+		startSceneLoad(dialog.load, path, useCache);
+	}
+}
+
+/**
+* Sets the transforms of a point shader for drawing one mesh.
+*/
+static void setMeshUniforms(GLuint shader, const Mesh &mesh, const glm::mat4 &mvpT, const glm::mat4 &lightT)
+{
+	glUniformMatrix4fv(glGetUniformLocation(shader, "MVP"), 1, GL_TRUE, glm::value_ptr(mvpT * mesh.model));
+	glUniformMatrix4fv(glGetUniformLocation(shader, "LightMVP"), 1, GL_TRUE, glm::value_ptr(lightT * mesh.model));
+	glUniformMatrix4fv(glGetUniformLocation(shader, "Model"), 1, GL_TRUE, glm::value_ptr(mesh.model));
+}
+
+/**
+* Creates the depth texture and framebuffer used for shadow mapping.
+*/
+static bool createShadowMap(GLuint &fbo, GLuint &depthTex, int size)
+{
+	glGenTextures(1, &depthTex);
+	glBindTexture(GL_TEXTURE_2D, depthTex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+	// Anything outside the light frustum is lit
+	const float border[] = { 1, 1, 1, 1 };
+	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTex, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (!complete)
+		std::cerr << "Shadow map framebuffer is incomplete" << std::endl;
+	return complete;
+}
+
+/**
+* Calculates an orthographic light transform fitting the scene bounds.
+*/
+static glm::mat4 lightTransform(const Scene &scene, const glm::mat4 &modelT, glm::vec3 lightDir)
+{
+	const glm::vec3 center = glm::vec3(modelT * glm::vec4((scene.min + scene.max) * 0.5f, 1));
+	const float radius = glm::max(glm::length(glm::vec3(modelT * glm::vec4(scene.max - scene.min, 0))) * 0.5f, 0.01f);
+
+	lightDir = glm::dot(lightDir, lightDir) > 0 ? glm::normalize(lightDir) : glm::vec3(0, -1, 0);
+	const glm::vec3 lightUp = glm::abs(lightDir.y) > 0.99f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+
+	glm::mat4 view = glm::lookAt(center - lightDir * radius * 2.f, center, lightUp);
+	glm::mat4 proj = glm::ortho(-radius, radius, -radius, radius, radius, radius * 3.f);
+	return proj * view;
+}
+
+/**
+* Renders every "stride"th point of each mesh into the shadow map, the stride
+* is picked so the pass stays within the given point budget. The points are
+* picked through an index buffer, a vertex stride that large could exceed
+* GL_MAX_VERTEX_ATTRIB_STRIDE.
+*/
+static size_t renderShadowMap(Scene &scene, GLuint shader, const glm::mat4 &lightT, size_t budget, float pointSize)
+{
+	size_t total = 0;
+	for (auto &mesh : scene.meshes)
+		total += mesh.count;
+
+	const size_t stride = budget > 0 && total > budget ? (total + budget - 1) / budget : 1;
+
+	// Sparser points need to be bigger to cover the same area
+	glPointSize(pointSize * sqrtf((float)stride));
+
+	size_t drawn = 0;
+	for (auto &mesh : scene.meshes) {
+		glUniformMatrix4fv(glGetUniformLocation(shader, "MVP"), 1, GL_TRUE, glm::value_ptr(lightT * mesh.model));
+		glBindVertexArray(mesh.shadowVAO);
+		const size_t count = (mesh.count + stride - 1) / stride;
+		if (mesh.shadowStride != stride) {
+			std::vector<uint32_t> indices(count);
+			for (size_t i = 0; i < count; i++)
+				indices[i] = (uint32_t)(i * stride);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+			mesh.shadowStride = stride;
+		}
+		glDrawElements(GL_POINTS, (GLsizei)count, GL_UNSIGNED_INT, (void *)0);
+		drawn += count;
+	}
+	glBindVertexArray(0);
+	return drawn;
+}
+
+/**
+* Instanced cubes drawn instead of the points when zoomed out.
+*/
+struct VoxelOverview {
+	GLuint vao = 0;
+	GLuint cubeVBO = 0;
+	GLuint cubeEBO = 0;
+	GLuint instanceVBO = 0;
+	size_t count = 0; // Number of occupied voxels
+	float size = 0; // Voxel size the instances were built with
+	int sceneVersion = -1;
+	std::vector<Voxel> voxels;
+};
+
+/**
+* Creates the unit cube and instance buffers of the voxel overview.
+*/
+static void createVoxelOverview(VoxelOverview &overview)
+{
+	const float cubeData[] = {
+		-0.5f, -0.5f, -0.5f,
+		0.5f, -0.5f, -0.5f,
+		-0.5f, 0.5f, -0.5f,
+		0.5f, 0.5f, -0.5f,
+		-0.5f, -0.5f, 0.5f,
+		0.5f, -0.5f, 0.5f,
+		-0.5f, 0.5f, 0.5f,
+		0.5f, 0.5f, 0.5f
+	};
+
+	const unsigned int cubeIndices[] = {
+		0, 2, 1, 1, 2, 3,
+		4, 5, 6, 5, 7, 6,
+		0, 1, 4, 1, 5, 4,
+		2, 6, 3, 3, 6, 7,
+		0, 4, 2, 2, 4, 6,
+		1, 3, 5, 3, 7, 5
+	};
+
+	glGenVertexArrays(1, &overview.vao);
+	glBindVertexArray(overview.vao);
+
+	glGenBuffers(1, &overview.cubeVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, overview.cubeVBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(cubeData), cubeData, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
+	glEnableVertexAttribArray(0);
+
+	// Per instance center and normal
+	glGenBuffers(1, &overview.instanceVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, overview.instanceVBO);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Voxel), (void *)offsetof(Voxel, center));
+	glEnableVertexAttribArray(1);
+	glVertexAttribDivisor(1, 1);
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Voxel), (void *)offsetof(Voxel, normal));
+	glEnableVertexAttribArray(2);
+	glVertexAttribDivisor(2, 1);
+
+	glGenBuffers(1, &overview.cubeEBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, overview.cubeEBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cubeIndices), cubeIndices, GL_STATIC_DRAW);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+static void deleteVoxelOverview(VoxelOverview &overview)
+{
+	glDeleteVertexArrays(1, &overview.vao);
+	glDeleteBuffers(1, &overview.cubeVBO);
+	glDeleteBuffers(1, &overview.cubeEBO);
+	glDeleteBuffers(1, &overview.instanceVBO);
+	overview = VoxelOverview();
+}
+
+/**
+* Picks the overview voxel size so a voxel covers about "pixels" pixels at the
+* scene's distance from the camera. Sizes snap to power of two steps of the
+* finest size so the grid is only rebuilt when the distance changes a lot,
+* and never get finer than "maxCells" voxels along the longest axis which
+* keeps the cost constant however big the scene is.
+*/
+static float overviewVoxelSize(const Scene &scene, const glm::vec3 &camPosModel, const glm::mat4 &projT, int height, float pixels, int maxCells)
+{
+	const glm::vec3 extent = scene.max - scene.min;
+	const float longest = glm::max(extent.x, glm::max(extent.y, extent.z));
+	if (longest <= 0 || height <= 0)
+		return 0;
+
+	const float dist = glm::max(glm::distance(camPosModel, (scene.min + scene.max) * 0.5f), 0.001f);
+	const float pixelSize = 2.f * dist / (projT[1][1] * height);
+	const float minSize = longest / maxCells;
+	const float size = glm::max(pixelSize * pixels, minSize);
+	return minSize * powf(2.f, ceilf(log2f(size / minSize) - 0.001f));
+}
+
+/**
+* Rebuilds the overview voxels from all meshes if the size or scene changed.
+* Returns true if a rebuild happened.
+*/
+static bool updateVoxelOverview(VoxelOverview &overview, const Scene &scene, float size)
+{
+	if (size <= 0 || (overview.size == size && overview.sceneVersion == scene.version))
+		return false;
+
+	overview.voxels.clear();
+	std::vector<Voxel> voxels;
+	std::vector<float> placed, placedNormals;
+	for (auto &mesh : scene.meshes) {
+		const float *positions = meshPositions(mesh);
+		const float *normals = meshNormals(mesh);
+
+		// Registered meshes are voxelized where they are drawn
+		if (mesh.model != glm::mat4(1)) {
+			placed.resize(mesh.count * 3);
+			placedNormals.resize(normals ? mesh.count * 3 : 0);
+			parallelFor(mesh.count, [&](size_t, size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++) {
+					const glm::vec4 p = mesh.model * glm::vec4(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2], 1);
+					placed[i * 3] = p.x;
+					placed[i * 3 + 1] = p.y;
+					placed[i * 3 + 2] = p.z;
+					if (normals) {
+						const glm::vec4 n = mesh.model * glm::vec4(normals[i * 3], normals[i * 3 + 1], normals[i * 3 + 2], 0);
+						placedNormals[i * 3] = n.x;
+						placedNormals[i * 3 + 1] = n.y;
+						placedNormals[i * 3 + 2] = n.z;
+					}
+				}
+			});
+			positions = placed.data();
+			normals = normals ? placedNormals.data() : NULL;
+		}
+
+		buildVoxelGrid(positions, normals, mesh.count, size, voxels);
+		overview.voxels.insert(overview.voxels.end(), voxels.begin(), voxels.end());
+	}
+
+	overview.count = overview.voxels.size();
+	overview.size = size;
+	overview.sceneVersion = scene.version;
+
+	glBindBuffer(GL_ARRAY_BUFFER, overview.instanceVBO);
+	glBufferData(GL_ARRAY_BUFFER, overview.count * sizeof(Voxel), overview.voxels.data(), GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return true;
+}
+
+/**
+* Bounds of the meshes where their models place them, which registration
+* moves away from the bounds they were loaded with.
+*/
+static void placedBounds(const Scene &scene, glm::vec3 &min, glm::vec3 &max)
+{
+	min = glm::vec3(FLT_MAX);
+	max = glm::vec3(-FLT_MAX);
+	for (auto &mesh : scene.meshes) {
+		for (int corner = 0; corner < 8; corner++) {
+			const glm::vec3 local(corner & 1 ? mesh.max.x : mesh.min.x, corner & 2 ? mesh.max.y : mesh.min.y, corner & 4 ? mesh.max.z : mesh.min.z);
+			const glm::vec3 p = glm::vec3(mesh.model * glm::vec4(local, 1));
+			min = glm::min(min, p);
+			max = glm::max(max, p);
+		}
+	}
+	if (scene.meshes.empty())
+		min = max = glm::vec3(0);
+}
+
+/**
+* A mesh as it was when binned into the heatmap.
+*/
+struct HeatmapMesh {
+	uint64_t revision;
+	glm::mat4 model;
+};
+
+/**
+* Top down density and height view of the scene. Meshes are binned one per
+* frame so the view fills in progressively as they arrive.
+*/
+struct HeatmapView {
+	GLuint texture = 0;
+	Raster raster;
+	glm::vec4 bounds = glm::vec4(0); // Horizontal extent the raster covers, min U, min V, max U, max V
+	std::vector<HeatmapMesh> binned; // Meshes binned so far, in scene order
+	std::vector<uint8_t> pixels;
+	int layer = RASTER_COUNT;
+	int resolution = 512; // Cells along the longest horizontal axis
+};
+
+/**
+* Bins the next mesh not binned yet into the heatmap and refreshes its
+* texture. Cells cannot take points back out, so the grid starts over only
+* when its extent or resolution changes or a binned mesh was moved, changed
+* or removed. Returns the points binned.
+*/
+static size_t updateHeatmap(HeatmapView &heatmap, const Scene &scene, bool recolor)
+{
+	int u, v;
+	rasterAxes(1, u, v);
+	glm::vec3 min, max;
+	placedBounds(scene, min, max);
+	const glm::vec4 bounds(min[u], min[v], max[u], max[v]);
+	const float longest = glm::max(max[u] - min[u], max[v] - min[v]);
+	const float cellSize = longest > 0 ? longest / heatmap.resolution : 1.f;
+
+	bool stale = heatmap.raster.counts.empty() || heatmap.bounds != bounds || heatmap.raster.cellSize != cellSize ||
+		heatmap.binned.size() > scene.meshes.size();
+	for (size_t i = 0; i < heatmap.binned.size() && !stale; i++)
+		stale = heatmap.binned[i].revision != scene.meshes[i].revision || heatmap.binned[i].model != scene.meshes[i].model;
+	if (stale) {
+		heatmap.raster.init(bounds.x, bounds.y, bounds.z, bounds.w, cellSize, 1);
+		heatmap.bounds = bounds;
+		heatmap.binned.clear();
+		recolor = true;
+	}
+
+	// Registered meshes are binned where their model places them
+	size_t points = 0;
+	if (heatmap.binned.size() < scene.meshes.size()) {
+		const Mesh &mesh = scene.meshes[heatmap.binned.size()];
+		heatmap.binned.push_back({ mesh.revision, mesh.model });
+		points = mesh.count;
+		if (mesh.model == glm::mat4(1)) {
+			rasterizePoints(heatmap.raster, meshPositions(mesh), mesh.count);
+		}
+		else {
+			const float *positions = meshPositions(mesh);
+			std::vector<float> placed(mesh.count * 3);
+			parallelFor(mesh.count, [&](size_t, size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++) {
+					const glm::vec3 p = glm::vec3(mesh.model * glm::vec4(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2], 1));
+					placed[i * 3] = p.x;
+					placed[i * 3 + 1] = p.y;
+					placed[i * 3 + 2] = p.z;
+				}
+			});
+			rasterizePoints(heatmap.raster, placed.data(), mesh.count);
+		}
+		recolor = true;
+	}
+
+	if (!recolor)
+		return points;
+
+	colorizeRaster(heatmap.raster, (RasterLayer)heatmap.layer, heatmap.pixels);
+	if (heatmap.texture == 0) {
+		glGenTextures(1, &heatmap.texture);
+		glBindTexture(GL_TEXTURE_2D, heatmap.texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+	glBindTexture(GL_TEXTURE_2D, heatmap.texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, heatmap.raster.width, heatmap.raster.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, heatmap.pixels.data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return points;
+}
+
+/**
+* Handles the "export raster" event.
+*/
+static void exportHeatmap(const HeatmapView &heatmap)
+{
+	const char *patterns[] = { "*.asc" };
+	const char *filename = tinyfd_saveFileDialog("Export Raster", "heatmap.asc", 1, patterns, "ESRI ASCII grid");
+	if (filename != NULL && !writeAsciiGrid(heatmap.raster, (RasterLayer)heatmap.layer, filename))
+		std::cerr << "Failed to write " << filename << std::endl;
+}
+
+/**
+* Uploads the CPU side labels of a mesh after a processing stage changed them.
+*/
+static void uploadLabels(Mesh &mesh)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.labelVBO);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, mesh.count * sizeof(uint32_t), mesh.labels.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/**
+* Detects primitives in every mesh and stores them as the mesh labels,
+* numbered across the whole scene. Returns the time taken in ms.
+*/
+static double detectScenePrimitives(Scene &scene, const RansacOptions &options, std::vector<Primitive> &primitives)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	primitives.clear();
+
+	std::vector<Primitive> found;
+	for (auto &mesh : scene.meshes) {
+		detectPrimitives(meshPositions(mesh), meshNormals(mesh), mesh.count, options, found, mesh.labels);
+
+		const uint32_t offset = (uint32_t)primitives.size();
+		for (auto &label : mesh.labels)
+			label = label != 0 ? label + offset : 0;
+		primitives.insert(primitives.end(), found.begin(), found.end());
+		uploadLabels(mesh);
+	}
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+/**
+* Clusters every mesh and stores the cluster IDs as the mesh labels, numbered
+* across the whole scene. Returns the time taken in ms.
+*/
+static double clusterScene(Scene &scene, const ClusterOptions &options, size_t &clusters, size_t &noise)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	clusters = noise = 0;
+
+	for (auto &mesh : scene.meshes) {
+		const uint32_t offset = (uint32_t)clusters;
+		clusters += clusterPoints(meshPositions(mesh), mesh.count, options, mesh.labels);
+		for (auto &label : mesh.labels) {
+			noise += label == 0 ? 1 : 0;
+			label = label != 0 ? label + offset : 0;
+		}
+		uploadLabels(mesh);
+	}
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+/**
+* Classifies ground points in every mesh, the classes become the mesh labels.
+* Returns the time taken in ms.
+*/
+static double classifySceneGround(Scene &scene, const GroundOptions &options, GroundStats &total)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	total = GroundStats();
+
+	for (auto &mesh : scene.meshes) {
+		const GroundStats stats = classifyGround(meshPositions(mesh), mesh.count, options, mesh.labels);
+		total.groundPoints += stats.groundPoints;
+		total.tiles += stats.tiles;
+		total.width = glm::max(total.width, stats.width);
+		total.height = glm::max(total.height, stats.height);
+		uploadLabels(mesh);
+	}
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+/**
+* Registers "source" onto "target" with point to plane ICP and updates the
+* source's model matrix. Returns the time taken in ms.
+*/
+static double alignMesh(Mesh &source, const Mesh &target, const IcpOptions &options, IcpResult &result)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// ICP works in the target's own space, starting from the current placement
+	const glm::mat4 initial = glm::inverse(target.model) * source.model;
+	result = registerPointToPlane(meshPositions(source), source.count, meshPositions(target), meshNormals(target), target.count, initial, options);
+	source.model = target.model * result.transform;
+
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+/**
+* Denoises the selected mesh, or every mesh when "selected" is negative, and
+* rewrites its position and normal buffers in place. Returns the time taken
+* in ms.
+*/
+static double denoiseScene(Scene &scene, int selected, const DenoiseOptions &options, DenoiseStats &total)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	total = DenoiseStats();
+
+	for (size_t m = 0; m < scene.meshes.size(); m++) {
+		if (selected >= 0 && (size_t)selected != m)
+			continue;
+		Mesh &mesh = scene.meshes[m];
+		ownMeshPoints(mesh);
+		const size_t normalBytes = mesh.normals.size() * sizeof(float);
+		const DenoiseStats stats = denoisePoints(mesh.positions, mesh.normals, options);
+		total.iterationMs.resize(glm::max(total.iterationMs.size(), stats.iterationMs.size()), 0.0);
+		for (size_t i = 0; i < stats.iterationMs.size(); i++)
+			total.iterationMs[i] += stats.iterationMs[i];
+		total.totalMs += stats.totalMs;
+		total.meanShift = glm::max(total.meanShift, stats.meanShift);
+
+		// Same sizes, so the existing buffers are overwritten rather than reallocated
+		glBindBuffer(GL_ARRAY_BUFFER, mesh.posVBO);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, mesh.positions.size() * sizeof(float), mesh.positions.data());
+		glBindBuffer(GL_ARRAY_BUFFER, mesh.norVBO);
+		if (mesh.normals.size() * sizeof(float) == normalBytes)
+			glBufferSubData(GL_ARRAY_BUFFER, 0, normalBytes, mesh.normals.data());
+		else
+			glBufferData(GL_ARRAY_BUFFER, mesh.normals.size() * sizeof(float), mesh.normals.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		mesh.updateBounds();
+		mesh.slice.axis = -1; // Sorted slice order is stale
+		mesh.revision = newMeshRevision();
+	}
+	scene.version++;
+
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+/**
+* Replaces the selected meshes with one merged mesh, dropping duplicate
+* points. Only the merged mesh gets new GPU buffers, the other meshes keep
+* theirs. Returns the time taken in ms.
+*/
+static double mergeSceneMeshes(Scene &scene, const std::vector<char> &selected, float tolerance, MergeStats &stats)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	std::vector<MergeInput> inputs;
+	for (size_t i = 0; i < scene.meshes.size(); i++) {
+		if (!selected[i])
+			continue;
+		const Mesh &mesh = scene.meshes[i];
+		MergeInput input;
+		input.positions = meshPositions(mesh);
+		input.normals = meshNormals(mesh);
+		input.count = mesh.count;
+		input.transform = glm::value_ptr(mesh.model);
+		inputs.push_back(input);
+	}
+
+	Mesh merged;
+	stats = mergeClouds(inputs, tolerance, merged.positions, merged.normals);
+	merged.updateBounds();
+	createMeshBuffers(merged);
+
+	for (size_t i = scene.meshes.size(); i-- > 0;) {
+		if (selected[i]) {
+			deleteMeshBuffers(scene.meshes[i]);
+			scene.meshes.erase(scene.meshes.begin() + i);
+		}
+	}
+	scene.meshes.push_back(std::move(merged));
+	scene.version++;
+
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+/**
+* Handles the "export primitives" event.
+*/
+static void exportPrimitives(const std::vector<Primitive> &primitives)
+{
+	const char *patterns[] = { "*.txt" };
+	const char *filename = tinyfd_saveFileDialog("Export Primitives", "primitives.txt", 1, patterns, "text files");
+	if (filename != NULL && !writePrimitives(primitives, filename))
+		std::cerr << "Failed to write " << filename << std::endl;
+}
+
+/**
+* Side panel showing a thin slab of the scene perpendicular to an axis.
+*/
+struct SliceView {
+	GLuint fbo = 0;
+	GLuint colorTex = 0;
+	GLuint depthRBO = 0;
+	int axis = 1;
+	float position = 0; // Slab center along the axis, where the mesh models place the points
+	float thickness = 0.02f;
+	size_t points = 0; // Points in the slab last frame
+};
 
-static void error_callback(int error, const char* description)
+/**
+* Creates the render target of the slice panel.
+*/
+static bool createSliceView(SliceView &slice, int size)
 {
-	fprintf(stderr, "Error: %s\n", description);
+	glGenTextures(1, &slice.colorTex);
+	glBindTexture(GL_TEXTURE_2D, slice.colorTex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenRenderbuffers(1, &slice.depthRBO);
+	glBindRenderbuffer(GL_RENDERBUFFER, slice.depthRBO);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &slice.fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, slice.fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, slice.colorTex, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, slice.depthRBO);
+
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (!complete)
+		std::cerr << "Slice framebuffer is incomplete" << std::endl;
+	return complete;
 }
 
-static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+static void deleteSliceView(SliceView &slice)
 {
-	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
-		glfwSetWindowShouldClose(window, GLFW_TRUE);
+	glDeleteFramebuffers(1, &slice.fbo);
+	glDeleteTextures(1, &slice.colorTex);
+	glDeleteRenderbuffers(1, &slice.depthRBO);
 }
 
-///////////////////////
-// Utility functions //
-///////////////////////
-
 /**
-* Creates a shader program given a vertex and fragment shaders.
+* Sorts the mesh points along the slice axis, after the mesh's model moved
+* them, and uploads the sorted order. Only needed once per axis and
+* placement.
 */
-static bool createShader(GLuint &prog, const char *vertSrc, const char *fragSrc)
+static bool updateSliceIndex(Mesh &mesh, int axis)
 {
-	GLint success = 0;
-	GLchar errBuff[1024] = { 0 };
+	// Row "axis" of the model gives the placed coordinate along the axis
+	const float plane[4] = { mesh.model[0][axis], mesh.model[1][axis], mesh.model[2][axis], mesh.model[3][axis] };
+	if (mesh.slice.axis == axis && memcmp(mesh.slice.plane, plane, sizeof(plane)) == 0)
+		return false;
 
-	// Create vertex shader
-	GLuint vert = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vert, 1, &vertSrc, NULL);
-	glCompileShader(vert);
+	mesh.slice.build(meshPositions(mesh), mesh.count, axis, plane);
 
-	glGetShaderiv(vert, GL_COMPILE_STATUS, &success);
-	if (success == GL_FALSE) {
-		glGetShaderInfoLog(vert, sizeof(errBuff), NULL, errBuff);
-		std::cerr << errBuff << std::endl;
-		return false;
-	}
+	if (mesh.sliceVAO == 0) {
+		glGenVertexArrays(1, &mesh.sliceVAO);
+		glBindVertexArray(mesh.sliceVAO);
 
-	// Create fragment shader
-	GLuint frag = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(frag, 1, &fragSrc, NULL);
-	glCompileShader(frag);
+		glBindBuffer(GL_ARRAY_BUFFER, mesh.posVBO);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
+		glEnableVertexAttribArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, mesh.norVBO);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
+		glEnableVertexAttribArray(1);
+		glBindBuffer(GL_ARRAY_BUFFER, mesh.labelVBO);
+		glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, sizeof(uint32_t), (void *)0);
+		glEnableVertexAttribArray(2);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-	glGetShaderiv(frag, GL_COMPILE_STATUS, &success);
-	if (success == GL_FALSE) {
-		glGetShaderInfoLog(frag, sizeof(errBuff), NULL, errBuff);
-		std::cerr << errBuff << std::endl;
-		return false;
+		glGenBuffers(1, &mesh.sliceEBO);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.sliceEBO);
 	}
 
-	// Create shader program
-	prog = glCreateProgram();
-	glAttachShader(prog, vert);
-	glAttachShader(prog, frag);
+	glBindVertexArray(mesh.sliceVAO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.count * sizeof(uint32_t), mesh.slice.order.data(), GL_STATIC_DRAW);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	return true;
+}
 
-	glLinkProgram(prog);
+/**
+* Orthographic transform looking down the slice axis at the placed scene
+* bounds.
+*/
+static glm::mat4 sliceTransform(const Scene &scene, const SliceView &slice)
+{
+	glm::vec3 min, max;
+	placedBounds(scene, min, max);
+	const glm::vec3 center = (min + max) * 0.5f;
+	const glm::vec3 extent = max - min;
+	const float radius = glm::max(glm::max(extent.x, extent.y), glm::max(extent.z, 0.01f)) * 0.55f;
+
+	glm::vec3 axisDir(0);
+	axisDir[slice.axis] = 1;
+	const glm::vec3 viewUp = slice.axis == 1 ? glm::vec3(0, 0, -1) : glm::vec3(0, 1, 0);
+
+	glm::mat4 view = glm::lookAt(center + axisDir * radius * 2.f, center, viewUp);
+	glm::mat4 proj = glm::ortho(-radius, radius, -radius, radius, 0.f, radius * 4.f);
+	return proj * view;
+}
 
-	glGetProgramiv(prog, GL_LINK_STATUS, &success);
-	if (success == GL_FALSE) {
-		glGetShaderInfoLog(frag, sizeof(errBuff), NULL, errBuff);
-		std::cerr << errBuff << std::endl;
-		return false;
+/**
+* Draws the slab of every mesh, each one is a single range of the mesh's
+* sorted slice order. Returns the amount of points drawn.
+*/
+static size_t renderSlice(const Scene &scene, const SliceView &slice, GLuint shader, const glm::mat4 &sliceT)
+{
+	const float lo = slice.position - slice.thickness * 0.5f;
+	const float hi = slice.position + slice.thickness * 0.5f;
+
+	size_t drawn = 0;
+	for (auto &mesh : scene.meshes) {
+		size_t first, last;
+		mesh.slice.range(lo, hi, first, last);
+		if (first == last)
+			continue;
+
+		setMeshUniforms(shader, mesh, sliceT, glm::mat4(1));
+		glBindVertexArray(mesh.sliceVAO);
+		glDrawElements(GL_POINTS, (GLsizei)(last - first), GL_UNSIGNED_INT, (void *)(first * sizeof(uint32_t)));
+		drawn += last - first;
 	}
+	glBindVertexArray(0);
+	return drawn;
+}
 
-	glValidateProgram(prog);
+/**
+* Sorts the points of a mesh back to front and uploads the new draw order.
+* Sorting starts from last frame's order since it is usually almost sorted,
+* returns true if that was enough to avoid a full radix sort.
+*/
+static bool sortMeshByDepth(Mesh &mesh, const glm::mat4 &modelViewT)
+{
+	const size_t count = mesh.count;
+	if (count == 0)
+		return true;
+
+	// View space depth is the z row of the model view transform
+	const glm::vec4 row(modelViewT[0][2], modelViewT[1][2], modelViewT[2][2], modelViewT[3][2]);
+	const float *pos = meshPositions(mesh);
+	const uint32_t *order = mesh.order.data();
+
+	std::vector<float> depths(count);
+	std::vector<float> minDepths(parallelWorkers(count), FLT_MAX);
+	std::vector<float> maxDepths(parallelWorkers(count), -FLT_MAX);
+	parallelFor(count, [&](size_t w, size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			const float *p = pos + order[i] * 3;
+			const float d = row.x * p[0] + row.y * p[1] + row.z * p[2] + row.w;
+			depths[i] = d;
+			minDepths[w] = d < minDepths[w] ? d : minDepths[w];
+			maxDepths[w] = d > maxDepths[w] ? d : maxDepths[w];
+		}
+	});
 
-	glGetProgramiv(prog, GL_LINK_STATUS, &success);
-	if (success == GL_FALSE) {
-		glGetShaderInfoLog(frag, sizeof(errBuff), NULL, errBuff);
-		std::cerr << errBuff << std::endl;
-		return false;
-	}
+	const float minDepth = *std::min_element(minDepths.begin(), minDepths.end());
+	const float maxDepth = *std::max_element(maxDepths.begin(), maxDepths.end());
+	const float scale = maxDepth > minDepth ? 65535.f / (maxDepth - minDepth) : 0.f;
 
-	// No need for these so we can delete them
-	glDeleteShader(vert);
-	glDeleteShader(frag);
-	return true;
+	// Quantize to 16 bits, farthest points (most negative z) come first
+	mesh.depthKeys.resize(count);
+	parallelFor(count, [&](size_t w, size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+			mesh.depthKeys[i] = (uint32_t)((depths[i] - minDepth) * scale);
+	});
+
+	bool incremental = sortNearlySorted(mesh.depthKeys, mesh.order, 16);
+
+	glBindVertexArray(mesh.vao);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * sizeof(uint32_t), mesh.order.data(), GL_STREAM_DRAW);
+	glBindVertexArray(0);
+	return incremental;
 }
 
 /**
-* Loads and generates the meshes for rendering.
+* Points streamed live from a producer through a shared memory ring, drawn
+* on top of the scene. Only the newest frame is uploaded, frames arriving
+* faster than the viewer draws are skipped.
 */
-void loadScene(const std::string filename, GLuint &bounds, std::vector<std::pair<GLuint, size_t>> &meshes) {
-	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> materials;
-
-	// Load file and check for errors
-	std::string err;
-	bool ret = tinyobj::LoadObj(shapes, materials, err, filename.c_str());
-
-	if (!err.empty()) std::cerr << err << std::endl;
-	if (!ret) exit(1);
+struct LiveStream {
+	ShmRingReader reader;
+	Mesh mesh; // Only the vertex array, position and normal buffers are used
+	size_t capacity = 0; // Points the buffers hold
+	uint64_t nextFrame = 0;
+	bool normals = false;
+
+	uint64_t frames = 0; // Frames uploaded since connecting
+	uint64_t skipped = 0;
+	uint64_t torn = 0; // Overwritten by the producer during the upload
+	double latencyMs = 0; // Commit to upload of the last frame
+};
+
+static bool connectLiveStream(LiveStream &live, const std::string &name)
+{
+	if (!live.reader.open(name))
+		return false;
+	live.nextFrame = live.reader.published();
+	live.mesh.count = 0;
+	live.frames = live.skipped = live.torn = 0;
+	live.latencyMs = 0;
+	return true;
+}
 
-	// Calculate min max points and generate vertex arrays
-	glm::vec3 min(0), max(0), tmp(0);
-	for (size_t i = 0; i < shapes.size(); i++) {
-		size_t posCount = shapes[i].mesh.positions.size();
-		size_t norCount = shapes[i].mesh.normals.size();
-		GLuint mesh = 0;
-		GLuint posVBO = 0;
-		GLuint norVBO = 0;
+static void deleteLiveStream(LiveStream &live)
+{
+	live.reader.close();
+	deleteMeshBuffers(live.mesh);
+	live.mesh = Mesh();
+	live.capacity = 0;
+}
 
-		for (size_t j = 0; j < shapes[i].mesh.positions.size();) {
-			tmp.x = shapes[i].mesh.positions[j++];
-			tmp.y = shapes[i].mesh.positions[j++];
-			tmp.z = shapes[i].mesh.positions[j++];
-			min.x = tmp.x < min.x ? tmp.x : min.x;
-			min.y = tmp.y < min.y ? tmp.y : min.y;
-			min.z = tmp.z < min.z ? tmp.z : min.z;
-			max.x = tmp.x > max.x ? tmp.x : max.x;
-			max.y = tmp.y > max.y ? tmp.y : max.y;
-			max.z = tmp.z > max.z ? tmp.z : max.z;
-		}
+/**
+* Uploads the newest frame straight from the mapping, returns the points
+* uploaded. A frame overwritten during the upload only counts as torn, its
+* partly newer points are drawn until the next frame replaces them.
+*/
+static size_t updateLiveStream(LiveStream &live)
+{
+	ShmFrame frame;
+	if (!live.reader.latest(live.nextFrame, frame))
+		return 0;
+
+	Mesh &mesh = live.mesh;
+	if (mesh.vao == 0) {
+		glGenVertexArrays(1, &mesh.vao);
+		glGenBuffers(1, &mesh.posVBO);
+		glGenBuffers(1, &mesh.norVBO);
+	}
+	glBindVertexArray(mesh.vao);
 
-		glGenVertexArrays(1, &mesh);
-		glBindVertexArray(mesh);
+	// Buffers only grow, orphaned with every resize
+	const bool resize = frame.count > live.capacity;
+	if (resize)
+		live.capacity = frame.count;
 
-		// Positions buffer
-		glGenBuffers(1, &posVBO);
-		glBindBuffer(GL_ARRAY_BUFFER, posVBO);
-		glBufferData(GL_ARRAY_BUFFER, posCount * sizeof(float), &shapes[i].mesh.positions[0], GL_STATIC_DRAW);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
-		glEnableVertexAttribArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.posVBO);
+	if (resize)
+		glBufferData(GL_ARRAY_BUFFER, live.capacity * 3 * sizeof(float), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, frame.count * 3 * sizeof(float), frame.positions);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
+	glEnableVertexAttribArray(0);
 
-		// Normals buffer
-		glGenBuffers(1, &norVBO);
-		glBindBuffer(GL_ARRAY_BUFFER, norVBO);
-		glBufferData(GL_ARRAY_BUFFER, norCount * sizeof(float), &shapes[i].mesh.normals[0], GL_STATIC_DRAW);
+	// Without normals the attribute falls back to a constant
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.norVBO);
+	if (resize)
+		glBufferData(GL_ARRAY_BUFFER, live.capacity * 3 * sizeof(float), NULL, GL_STREAM_DRAW);
+	if (frame.normals != NULL) {
+		glBufferSubData(GL_ARRAY_BUFFER, 0, frame.count * 3 * sizeof(float), frame.normals);
 		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
 		glEnableVertexAttribArray(1);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	else {
+		glDisableVertexAttribArray(1);
+	}
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-		glBindVertexArray(0);
+	live.skipped += frame.number - live.nextFrame;
+	live.nextFrame = frame.number + 1;
+	if (!live.reader.valid(frame)) {
+		live.torn++;
+		return 0;
+	}
+	mesh.count = frame.count;
+	live.normals = frame.normals != NULL;
+	live.latencyMs = (shmTimestampNs() - frame.timestampNs) / 1e6;
+	live.frames++;
+	return frame.count;
+}
 
-		// This is valid since we have unbinded the VA
-		glDeleteBuffers(1, &posVBO);
-		glDeleteBuffers(1, &norVBO);
+/**
+* A point file (e.g. pcv-convert output) streamed from a pcv-tile-server or
+* any HTTP server with range requests. The node table comes first, then
+* every node's range is queued at once so the pipeline keeps several in
+* flight, and nodes join the scene as meshes in whatever order they arrive.
+*/
+struct RemoteScene {
+	FetchPipeline pipeline;
+	std::vector<PointFileNode> nodes;
+	std::vector<int> attempts;
+	uint64_t fileBytes = 0;
+	size_t received = 0; // Nodes added to the scene
+	size_t failed = 0;
+	double latencyMs = 0; // Summed over the node ranges
+	bool active = false;
+	std::string status;
+	std::chrono::steady_clock::time_point started;
+	double seconds = 0; // Time to the last node
+};
+
+static void openRemoteScene(RemoteScene &remote, const std::string &address, int connections)
+{
+	HttpUrl url;
+	remote.pipeline.stop();
+	remote.nodes.clear();
+	remote.attempts.clear();
+	remote.fileBytes = 0;
+	remote.received = remote.failed = 0;
+	remote.latencyMs = remote.seconds = 0;
+	remote.active = false;
+	if (!parseHttpUrl(address, url)) {
+		remote.status = "Not an http:// URL";
+		return;
+	}
+	remote.pipeline.start(url, (unsigned)connections);
+	remote.pipeline.request(REMOTE_TABLE, 0, REMOTE_HEAD_BYTES);
+	remote.active = true;
+	remote.status = "Reading node table";
+	remote.started = std::chrono::steady_clock::now();
+}
 
-		// Push to list for later drawing
-		meshes.emplace_back(std::make_pair(mesh, posCount));
+/**
+* Parses the node table out of the start of the file and queues every node,
+* returns false if it is incomplete and was requested in full.
+*/
+static bool readRemoteTable(RemoteScene &remote, const FetchResult &result)
+{
+	const PointFileHeader *header = reinterpret_cast<const PointFileHeader *>(result.data.data());
+	if (result.data.size() < sizeof(PointFileHeader) || !checkPointFileHeader(*header, header->bytes)) {
+		remote.status = "Not a point file";
+		remote.active = false;
+		return true;
+	}
+	const uint64_t tableBytes = sizeof(PointFileHeader) + (uint64_t)header->nodes * sizeof(PointFileNode);
+	if (tableBytes > result.data.size()) {
+		remote.pipeline.request(REMOTE_TABLE, 0, tableBytes);
+		return false;
 	}
 
-	// Not needed anymore
-	shapes.clear();
-	materials.clear();
+	if (header->nodes == 0) {
+		remote.status = "No nodes";
+		remote.active = false;
+		return true;
+	}
+	remote.fileBytes = header->bytes;
+	const PointFileNode *table = reinterpret_cast<const PointFileNode *>(result.data.data() + sizeof(PointFileHeader));
+	remote.nodes.assign(table, table + header->nodes);
+	remote.attempts.assign(header->nodes, 1);
+	for (size_t i = 0; i < remote.nodes.size(); i++) {
+		const PointFileNode &node = remote.nodes[i];
+		if (!checkPointFileNode(node, remote.fileBytes)) {
+			remote.status = "Corrupt node table";
+			remote.active = false;
+			return true;
+		}
+	}
+	for (size_t i = 0; i < remote.nodes.size(); i++)
+		remote.pipeline.request(REMOTE_FIRST_NODE + i, remote.nodes[i].positions, pointFileNodeEnd(remote.nodes[i]) - remote.nodes[i].positions);
+	remote.status = "Loading";
+	return true;
+}
 
-	// Generate bounds mesh
-	float boundsData[] = {
-		min.x, min.y, min.z,
-		max.x, min.y, min.z,
-		min.x, max.y, min.z,
-		max.x, max.y, min.z,
-		min.x, min.y, max.z,
-		max.x, min.y, max.z,
-		min.x, max.y, max.z,
-		max.x, max.y, max.z
-	};
+/**
+* Adds the nodes that arrived since the last frame, returns their points.
+*/
+static size_t updateRemoteScene(RemoteScene &remote, Scene &scene)
+{
+	std::vector<PointCloud> clouds;
+	size_t points = 0;
+	FetchResult result;
+	while (remote.active && remote.pipeline.poll(result)) {
+		if (!result.ok) {
+			// Retried a few times before giving the node up
+			const size_t node = (size_t)(result.id - REMOTE_FIRST_NODE);
+			if (result.id >= REMOTE_FIRST_NODE && remote.attempts[node]++ < REMOTE_ATTEMPTS) {
+				remote.pipeline.request(result.id, result.offset, result.length);
+				continue;
+			}
+			remote.status = result.error;
+			if (result.id == REMOTE_TABLE) {
+				remote.active = false;
+				break;
+			}
+			remote.failed++;
+		}
+		else if (result.id == REMOTE_TABLE) {
+			readRemoteTable(remote, result);
+		}
+		else {
+			const PointFileNode &node = remote.nodes[(size_t)(result.id - REMOTE_FIRST_NODE)];
+			if (result.data.size() == pointFileNodeEnd(node) - node.positions) {
+				clouds.emplace_back();
+				readPointFileNode(node, result.data.data(), clouds.back());
+				points += clouds.back().size();
+				remote.received++;
+				remote.latencyMs += result.ms;
+			}
+			else {
+				remote.failed++;
+			}
+		}
 
-	unsigned int boundsIndices[] = {
-		0, 1, 3, 1, 2, 0, 2, 3,
-		4, 5, 7, 5, 6, 4, 6, 7,
-		0, 4, 1, 5, 2, 6, 3, 7
-	};
+		if (!remote.nodes.empty() && remote.received + remote.failed == remote.nodes.size()) {
+			remote.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - remote.started).count();
+			remote.status = remote.failed == 0 ? "Done" : "Done with missing nodes";
+			remote.active = false;
+		}
+	}
+	if (!clouds.empty())
+		addSceneMeshes(scene, clouds);
+	return points;
+}
 
-	glGenVertexArrays(1, &bounds);
-	glBindVertexArray(bounds);
+/**
+* Reloads the scene's files in the background when they are rewritten on
+* disk. A changed file is loaded and its shapes hashed on a thread while the
+* old meshes stay drawn, then only the shapes whose hash differs from the
+* last load are uploaded again. Unchanged shapes keep their buffers, labels
+* and placement.
+*/
+struct SceneWatch {
+	FileWatcher watcher;
+	std::vector<std::string> paths; // Scene sources given to the watcher
+	std::deque<std::string> queued; // Changed while another file was loading
+
+	SceneLoad load;
+	double loadMs = 0; // Loading and hashing of the last reload
+
+	size_t reloads = 0;
+	size_t uploaded = 0; // Shapes of the last reload uploaded again
+	size_t kept = 0;
+	size_t removed = 0;
+	std::string status;
+};
+
+static void stopSceneWatch(SceneWatch &watch)
+{
+	waitSceneLoad(watch.load);
+	watch.watcher.clear();
+	watch.paths.clear();
+	watch.queued.clear();
+	releaseSceneLoad(watch.load);
+}
 
-	GLuint boundsVBO;
-	glGenBuffers(1, &boundsVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, boundsVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(boundsData), boundsData, GL_STATIC_DRAW);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
-	glEnableVertexAttribArray(0);
+/**
+* Puts the points of a reloaded shape into its mesh, keeping the placement.
+* Owned arrays of the same size are overwritten in the existing buffers as
+* denoising does, otherwise the buffers are created again.
+*/
+static void replaceMeshPoints(Mesh &mesh, Mesh &loaded)
+{
+	if (!mesh.cached && !loaded.cached && loaded.positions.size() == mesh.positions.size() && loaded.normals.size() == mesh.normals.size()) {
+		mesh.positions.swap(loaded.positions);
+		mesh.normals.swap(loaded.normals);
+		mesh.labels.assign(mesh.count, 0); // Labels of the old points say nothing about the new ones
+
+		glBindBuffer(GL_ARRAY_BUFFER, mesh.posVBO);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, mesh.positions.size() * sizeof(float), mesh.positions.data());
+		glBindBuffer(GL_ARRAY_BUFFER, mesh.norVBO);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, mesh.normals.size() * sizeof(float), mesh.normals.data());
+		glBindBuffer(GL_ARRAY_BUFFER, mesh.labelVBO);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, mesh.labels.size() * sizeof(uint32_t), mesh.labels.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-	GLuint boundsEBO;
-	glGenBuffers(1, &boundsEBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, boundsEBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(boundsIndices), boundsIndices, GL_STATIC_DRAW);
+		mesh.updateBounds();
+		mesh.slice.axis = -1; // Sorted slice order is stale
+		mesh.revision = newMeshRevision();
+		return;
+	}
 
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	loaded.model = mesh.model;
+	loaded.source = mesh.source;
+	loaded.chunk = mesh.chunk;
+	createMeshBuffers(loaded);
+	deleteMeshBuffers(mesh);
+	mesh = std::move(loaded);
 }
 
 /**
-* Handles the "load scene" event.
+* Swaps the changed shapes of a reloaded file into the scene, returns the
+* points uploaded. Shapes merged away or otherwise gone from the scene come
+* back only if they changed.
 */
-void loadSceneFile(GLuint &bounds, std::vector<std::pair<GLuint, size_t>> &meshes) {
-	const char *filename = tinyfd_openFileDialog("Open", "", 0, NULL, "scene files", 0);
-	if (filename != NULL) {
-		// Deletes buffers if any was created
-		if (bounds != 0) {
-			glDeleteVertexArrays(1, &bounds);
+static size_t applyReload(SceneWatch &watch, Scene &scene)
+{
+	SceneLoad &load = watch.load;
+	watch.loadMs = load.ms;
+	int s = -1;
+	for (size_t i = 0; i < scene.sources.size() && s < 0; i++)
+		s = scene.sources[i].path == load.path ? (int)i : -1;
+	if (s < 0) {
+		releaseSceneLoad(load);
+		return 0; // The scene was replaced while loading
+	}
+	if (!load.ok) {
+		if (!load.error.empty())
+			std::cerr << load.error << std::endl;
+		watch.status = "Cannot reload " + load.path + ", showing the previous version";
+		releaseSceneLoad(load);
+		return 0;
+	}
+
+	SceneSource &source = scene.sources[s];
+	const size_t shapes = loadedShapes(load);
+	std::vector<int> meshOf(glm::max(source.hashes.size(), shapes), -1);
+	for (size_t i = 0; i < scene.meshes.size(); i++) {
+		if (scene.meshes[i].source == s && scene.meshes[i].chunk < meshOf.size())
+			meshOf[scene.meshes[i].chunk] = (int)i;
+	}
+
+	size_t points = 0;
+	std::vector<Mesh> added;
+	std::vector<size_t> addedChunks;
+	watch.uploaded = watch.kept = watch.removed = 0;
+	for (size_t c = 0; c < shapes; c++) {
+		if (c < source.hashes.size() && source.hashes[c] == load.hashes[c]) {
+			watch.kept++;
+			continue;
+		}
+		Mesh loaded = takeLoadedShape(load, c);
+		points += loaded.count;
+		watch.uploaded++;
+		if (meshOf[c] >= 0) {
+			replaceMeshPoints(scene.meshes[meshOf[c]], loaded);
+		}
+		else {
+			added.push_back(std::move(loaded));
+			addedChunks.push_back(c);
+		}
+	}
+	releaseSceneLoad(load);
+
+	// Shapes the file does not have anymore
+	for (size_t i = scene.meshes.size(); i-- > 0;) {
+		if (scene.meshes[i].source == s && scene.meshes[i].chunk >= shapes) {
+			deleteMeshBuffers(scene.meshes[i]);
+			scene.meshes.erase(scene.meshes.begin() + i);
+			watch.removed++;
+		}
+	}
+	source.hashes.swap(load.hashes);
+
+	const size_t first = scene.meshes.size();
+	addSceneMeshes(scene, added);
+	for (size_t i = first; i < scene.meshes.size(); i++) {
+		scene.meshes[i].source = s;
+		scene.meshes[i].chunk = addedChunks[i - first];
+	}
+
+	// Shapes may have shrunk, so the bounds start over
+	glm::vec3 min(0), max(0);
+	for (const auto &mesh : scene.meshes) {
+		if (mesh.count > 0) {
+			min = glm::min(min, mesh.min);
+			max = glm::max(max, mesh.max);
 		}
-		for (auto m : meshes) {
-			glDeleteVertexArrays(1, &m.first);
+	}
+	scene.min = min;
+	scene.max = max;
+	scene.version++;
+	updateSceneBounds(scene);
+
+	watch.reloads++;
+	watch.status = "Reloaded " + load.path;
+	return points;
+}
+
+/**
+* Keeps the watcher on the scene's files, applies a finished reload and
+* starts the next one. Returns the points uploaded. Without "enabled" the
+* files are let go and a reload in flight is dropped once it finished.
+*/
+static size_t updateSceneWatch(SceneWatch &watch, Scene &scene, bool enabled)
+{
+	if (!enabled) {
+		if (!watch.paths.empty()) {
+			watch.watcher.clear();
+			watch.paths.clear();
+			watch.queued.clear();
 		}
-		bounds = 0;
-		meshes.clear();
+		if (finishSceneLoad(watch.load))
+			releaseSceneLoad(watch.load);
+		return 0;
+	}
+
+	// Sources are appended to until the scene is cleared
+	bool same = watch.paths.size() <= scene.sources.size();
+	for (size_t i = 0; same && i < watch.paths.size(); i++)
+		same = watch.paths[i] == scene.sources[i].path;
+	if (!same) {
+		watch.watcher.clear();
+		watch.paths.clear();
+	}
+	for (size_t i = watch.paths.size(); i < scene.sources.size(); i++) {
+		watch.watcher.add(scene.sources[i].path);
+		watch.paths.push_back(scene.sources[i].path);
+	}
+
+	std::vector<std::string> changed;
+	watch.watcher.poll(changed);
+	for (const auto &path : changed) {
+		if (std::find(watch.queued.begin(), watch.queued.end(), path) == watch.queued.end())
+			watch.queued.push_back(path);
+	}
 
-		// Loads the scene meshes
-		loadScene(filename, bounds, meshes);
+	size_t points = 0;
+	if (finishSceneLoad(watch.load))
+		points = applyReload(watch, scene);
+	while (!sceneLoading(watch.load) && !watch.queued.empty()) {
+		const std::string path = watch.queued.front();
+		watch.queued.pop_front();
+		for (const auto &source : scene.sources) {
+			if (source.path == path) {
+				startSceneLoad(watch.load, source.path, source.useCache);
+				watch.status = "Reloading " + source.path;
+				break;
+			}
+		}
 	}
+	return points;
 }
 
 /////////////////
@@ -330,8 +1989,7 @@ int main(int argc, char ** args)
 	glDisable(GL_CULL_FACE);
 
 	// Rendering vars
-	GLuint bounds = 0;
-	std::vector<std::pair<GLuint, size_t>> meshes;
+	Scene scene;
 
 	GLuint pointcloundShader;
 	createShader(pointcloundShader, pointcloud_vert, pointcloud_frag);
@@ -339,6 +1997,66 @@ int main(int argc, char ** args)
 	GLuint shapeShader;
 	createShader(shapeShader, shape_vert, shape_frag);
 
+	GLuint voxelShader;
+	createShader(voxelShader, voxel_vert, pointcloud_frag);
+
+	VoxelOverview overview;
+	createVoxelOverview(overview);
+
+	HeatmapView heatmap;
+
+	SliceView slice;
+	createSliceView(slice, SLICE_VIEW_SIZE);
+
+	RansacOptions ransacOptions;
+	std::vector<Primitive> primitives;
+	double ransacMs = 0;
+	std::vector<std::pair<unsigned, double>> ransacBenchmark; // Threads and ms
+
+	ClusterOptions clusterOptions;
+	size_t clusterCount = 0, noiseCount = 0;
+	double clusterMs = 0;
+
+	GroundOptions groundOptions;
+	GroundStats groundStats;
+	double groundMs = 0;
+
+	IcpOptions icpOptions;
+	IcpResult icpResult;
+	int icpSource = 1, icpTarget = 0;
+	double icpMs = 0;
+
+	std::vector<char> mergeSelection;
+	float mergeTolerance = 0.001f;
+	MergeStats mergeStats;
+	size_t mergeInputBytes = 0;
+	double mergeMs = 0;
+
+	DenoiseOptions denoiseOptions;
+	DenoiseStats denoiseStats;
+	int denoiseMesh = -1;
+	double denoiseMs = 0;
+
+	SceneWatch watch;
+	OpenDialog openDialog;
+
+	RemoteScene remote;
+	char remoteUrl[256] = "http://127.0.0.1:8080/scene.pcvc";
+	int remoteConnections = 8;
+
+	LiveStream live;
+	char liveName[128] = "/pcv-frames";
+	bool liveFailed = false;
+
+	GLuint shadowShader;
+	createShader(shadowShader, shape_vert, shadow_frag);
+
+	GLuint shadowFBO = 0, shadowTex = 0;
+	bool shadowsSupported = createShadowMap(shadowFBO, shadowTex, SHADOW_MAP_SIZE);
+
+	Profiler profiler;
+	profiler.init();
+
 	// Window vars
 	float ratio;
 	int width, height;
@@ -362,6 +2080,19 @@ int main(int argc, char ** args)
 
 	glm::vec4 boundsColor(0, 1, 0, 0.5f);
 
+	bool shadows = shadowsSupported;
+	int shadowBudget = 500000; // Max points drawn into the shadow map
+	float shadowBias = 0.002f;
+	float shadowPointSize = 2.0f;
+
+	bool transparent = false;
+	float alpha = 0.3f;
+
+	int overviewMode = 0; // Off, auto or always. Off by default, rebuilds stall the frame they run in
+	float overviewPixels = 4.0f; // Target on screen voxel size
+	int overviewMaxCells = 512;
+	const int overviewMinPointsPerVoxel = 8; // Auto mode threshold
+
 	// Camera control vars
 	glm::vec3 camPos(-12.5, 7.0f, -10.0f);
 	glm::quat camRot(-0.83, 0.14, 0.53, -0.09); // Used to transform forward dir
@@ -372,6 +2103,7 @@ int main(int argc, char ** args)
 	glm::mat4 viewT = glm::lookAt(camPos, camPos + forward * camRot, up); // Looks at the forward direction of rotated camera
 	glm::mat4 modelT = glm::scale(glm::vec3(2));
 	glm::mat4 mvpT;
+	glm::mat4 lightT;
 
 	glm::dvec2 mousePos;
 	glm::dvec2 mouseDelta;
@@ -393,6 +2125,15 @@ int main(int argc, char ** args)
 	bool scalePoints = true;
 	bool drawBounds = true;
 	bool vsync = VSYNC;
+	bool showHeatmap = false;
+	bool showSlice = false;
+	bool showProcessing = false;
+	bool showIngest = false;
+	bool showOpenUrl = false;
+	bool showOpenDialog = false;
+	bool datasetCache = false; // Share decoded datasets with other instances
+	bool watchFiles = false; // Reload the scene's files when they change
+	int workerThreads = 0;
 
 	while (!glfwWindowShouldClose(window))
 	{
@@ -411,20 +2152,50 @@ int main(int argc, char ** args)
 
 		// GUI input
 		ImGui_ImplGlfwGL3_NewFrame();
+		profiler.newFrame(delta);
 
 		ImGui::BeginMainMenuBar();
 		if (ImGui::BeginMenu("File")) {
-			if (ImGui::MenuItem("Load Scene", "", false, true))
-				loadSceneFile(bounds, meshes);
+			const bool loadScene = ImGui::MenuItem("Load Scene", "", false, true);
+			const bool addScan = ImGui::MenuItem("Add Scan", "", false, true);
+			if (loadScene || addScan) {
+				// Listed again, files may have appeared since
+				const std::string directory = openDialog.browser.directory();
+				openDialogDirectory(openDialog, directory.empty() ? currentDirectory() : directory);
+				openDialog.add = addScan;
+				showOpenDialog = true;
+			}
+			ImGui::MenuItem("Open URL", "", &showOpenUrl);
+			ImGui::MenuItem("Watch for Changes", "", &watchFiles);
+			if (watchFiles) {
+				ImGui::TextDisabled("%zu files through %s", watch.watcher.size(), watch.watcher.backend());
+				if (!watch.status.empty())
+					ImGui::TextDisabled("%s", watch.status.c_str());
+				if (watch.reloads > 0)
+					ImGui::TextDisabled("Last reload: %zu shapes uploaded, %zu unchanged, %zu removed, loaded in %.1f ms",
+						watch.uploaded, watch.kept, watch.removed, watch.loadMs);
+			}
+			ImGui::EndMenu();
+		}
+		if (ImGui::BeginMenu("View")) {
+			ImGui::MenuItem("Heatmap", "", &showHeatmap);
+			ImGui::MenuItem("Slice", "", &showSlice);
+			ImGui::MenuItem("Processing", "", &showProcessing);
+			ImGui::MenuItem("Ingest", "", &showIngest);
 			ImGui::EndMenu();
 		}
 		if (ImGui::BeginMenu("Settings")) {
 			if (ImGui::Checkbox("VSync", &vsync))
 				glfwSwapInterval(vsync);
+			ImGui::Checkbox("Dataset Cache", &datasetCache);
 			if (ImGui::InputFloat("Mouse Sensitivity", &mouseSensitivity, 0.01f, 0.1f, 2))
 				mouseSensitivity = glm::clamp(mouseSensitivity, 0.1f, 1.0f);
 			if (ImGui::InputFloat("Move Sensitivity", &moveSensitivity, 0.05f, 0.2f, 2))
 				moveSensitivity = glm::clamp(moveSensitivity, 0.1f, 10.0f);
+			if (ImGui::InputInt("Worker Threads (0 = all)", &workerThreads)) {
+				workerThreads = glm::max(workerThreads, 0);
+				workerLimit() = (unsigned)workerThreads;
+			}
 			ImGui::EndMenu();
 		}
 		ImGui::EndMainMenuBar();
@@ -443,6 +2214,32 @@ int main(int argc, char ** args)
 		ImGui::RadioButton("Unlit", &drawMode, 0);
 		ImGui::RadioButton("Normals", &drawMode, 1);
 		ImGui::RadioButton("Lit", &drawMode, 3);
+		ImGui::RadioButton("Labels", &drawMode, 4);
+
+		if (shadowsSupported) {
+			ImGui::Checkbox("Shadows", &shadows);
+			if (shadows) {
+				if (ImGui::InputInt("Shadow Budget", &shadowBudget, 10000, 100000))
+					shadowBudget = glm::max(shadowBudget, 1000);
+				ImGui::InputFloat("Shadow Bias", &shadowBias, 0.0005f, 0.005f, 4);
+				ImGui::InputFloat("Shadow Point Size", &shadowPointSize, 0.5f, 1.0f, 1);
+			}
+		}
+
+		ImGui::Checkbox("Transparent", &transparent);
+		if (transparent) {
+			if (ImGui::InputFloat("Alpha", &alpha, 0.05f, 0.1f, 2))
+				alpha = glm::clamp(alpha, 0.0f, 1.0f);
+		}
+
+		ImGui::Combo("Overview", &overviewMode, "Off\0Auto\0Always\0\0");
+		if (overviewMode != 0) {
+			if (ImGui::InputFloat("Voxel Pixels", &overviewPixels, 0.5f, 1.0f, 1))
+				overviewPixels = glm::clamp(overviewPixels, 1.0f, 64.0f);
+			if (ImGui::InputInt("Voxel Max Cells", &overviewMaxCells, 32, 128))
+				overviewMaxCells = glm::clamp(overviewMaxCells, 16, 2048);
+			ImGui::Text("%zu voxels of size %.4f", overview.count, overview.size);
+		}
 
 		ImGui::Checkbox("Bounds", &drawBounds);
 		ImGui::Checkbox("Scaled", &scalePoints);
@@ -451,6 +2248,317 @@ int main(int argc, char ** args)
 		}
 		ImGui::End();
 
+		profiler.draw();
+
+		if (showHeatmap && !scene.meshes.empty()) {
+			ImGui::Begin("- Heatmap -", &showHeatmap);
+			bool recolor = ImGui::Combo("Layer", &heatmap.layer, "Density\0Min Height\0Max Height\0Mean Height\0\0");
+			if (ImGui::InputInt("Resolution", &heatmap.resolution, 64, 256))
+				heatmap.resolution = glm::clamp(heatmap.resolution, 16, 4096);
+			if (ImGui::Button("Export"))
+				exportHeatmap(heatmap);
+
+			auto binStart = std::chrono::high_resolution_clock::now();
+			const size_t binnedPoints = updateHeatmap(heatmap, scene, recolor);
+			if (binnedPoints > 0)
+				profiler.record("Heatmap binning", std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - binStart).count(), binnedPoints);
+
+			// Fit the image to the window keeping the grid aspect, min V at the bottom
+			const float avail = glm::max(ImGui::GetContentRegionAvailWidth(), 64.f);
+			const float aspect = heatmap.raster.height / (float)heatmap.raster.width;
+			ImGui::Image((ImTextureID)(intptr_t)heatmap.texture, ImVec2(avail, avail * aspect), ImVec2(0, 1), ImVec2(1, 0));
+			ImGui::End();
+		}
+
+		if (showProcessing && !scene.meshes.empty()) {
+			ImGui::Begin("- Processing -", &showProcessing);
+			if (ImGui::CollapsingHeader("Primitive Detection")) {
+				ImGui::InputFloat("Epsilon", &ransacOptions.epsilon, 0.001f, 0.01f, 4);
+				ImGui::InputFloat("Normal Angle", &ransacOptions.normalAngle, 1.f, 5.f, 1);
+				int minSupport = (int)ransacOptions.minSupport;
+				if (ImGui::InputInt("Min Support", &minSupport, 50, 500))
+					ransacOptions.minSupport = (size_t)glm::max(minSupport, 3);
+				ImGui::InputInt("Max Primitives", &ransacOptions.maxPrimitives);
+				ImGui::Checkbox("Planes", &ransacOptions.planes);
+				ImGui::SameLine();
+				ImGui::Checkbox("Cylinders", &ransacOptions.cylinders);
+
+				if (ImGui::Button("Detect")) {
+					ransacMs = detectScenePrimitives(scene, ransacOptions, primitives);
+					size_t points = 0;
+					for (auto &p : primitives)
+						points += p.support;
+					profiler.record("Primitive detection", ransacMs, points);
+					drawMode = 4;
+				}
+				ImGui::SameLine();
+				if (ImGui::Button("Benchmark Threads")) {
+					// Same seed every run so only the thread count changes
+					ransacBenchmark.clear();
+					const unsigned maxThreads = glm::max(std::thread::hardware_concurrency(), 1u);
+					for (unsigned threads = 1; ; threads = glm::min(threads * 2, maxThreads)) {
+						workerLimit() = threads;
+						ransacBenchmark.emplace_back(threads, detectScenePrimitives(scene, ransacOptions, primitives));
+						if (threads == maxThreads)
+							break;
+					}
+					workerLimit() = (unsigned)workerThreads;
+					drawMode = 4;
+				}
+				if (!primitives.empty()) {
+					ImGui::SameLine();
+					if (ImGui::Button("Export"))
+						exportPrimitives(primitives);
+				}
+
+				size_t planes = 0;
+				for (auto &p : primitives)
+					planes += p.type == PRIMITIVE_PLANE ? 1 : 0;
+				ImGui::Text("%zu planes, %zu cylinders in %.1f ms", planes, primitives.size() - planes, ransacMs);
+				for (auto &b : ransacBenchmark)
+					ImGui::Text("%u threads: %.1f ms (%.2fx)", b.first, b.second, ransacBenchmark[0].second / b.second);
+			}
+			if (ImGui::CollapsingHeader("Clustering")) {
+				ImGui::InputFloat("Radius", &clusterOptions.epsilon, 0.005f, 0.05f, 4);
+				clusterOptions.epsilon = glm::max(clusterOptions.epsilon, 1e-5f);
+				int minPoints = (int)clusterOptions.minPoints;
+				if (ImGui::InputInt("Min Neighbours", &minPoints))
+					clusterOptions.minPoints = (size_t)glm::max(minPoints, 1);
+				int minClusterSize = (int)clusterOptions.minClusterSize;
+				if (ImGui::InputInt("Min Cluster Size", &minClusterSize, 10, 100))
+					clusterOptions.minClusterSize = (size_t)glm::max(minClusterSize, 1);
+
+				if (ImGui::Button("Cluster")) {
+					clusterMs = clusterScene(scene, clusterOptions, clusterCount, noiseCount);
+					size_t points = 0;
+					for (auto &mesh : scene.meshes)
+						points += mesh.count;
+					profiler.record("Clustering", clusterMs, points);
+					drawMode = 4;
+				}
+				ImGui::Text("%zu clusters, %zu noise points in %.1f ms", clusterCount, noiseCount, clusterMs);
+			}
+			if (ImGui::CollapsingHeader("Ground Filter")) {
+				ImGui::Combo("Up Axis##Ground", &groundOptions.upAxis, "X\0Y\0Z\0");
+				ImGui::InputFloat("Cell Size (0 = auto)", &groundOptions.cellSize, 0.1f, 1.f, 3);
+				groundOptions.cellSize = glm::max(groundOptions.cellSize, 0.f);
+				ImGui::SliderInt("Max Window", &groundOptions.maxWindow, 3, 129);
+				ImGui::InputFloat("Slope", &groundOptions.slope, 0.1f, 1.f, 2);
+				ImGui::InputFloat("Initial Distance", &groundOptions.initialDistance, 0.05f, 0.5f, 3);
+				ImGui::InputFloat("Max Distance", &groundOptions.maxDistance, 0.1f, 1.f, 2);
+				ImGui::InputInt("Tile Size", &groundOptions.tileSize, 16, 128);
+				groundOptions.tileSize = glm::max(groundOptions.tileSize, 16);
+
+				size_t points = 0;
+				for (auto &mesh : scene.meshes)
+					points += mesh.count;
+				if (ImGui::Button("Classify Ground")) {
+					groundMs = classifySceneGround(scene, groundOptions, groundStats);
+					profiler.record("Ground filter", groundMs, points);
+					drawMode = 4;
+				}
+				ImGui::Text("%zu ground, %zu other points", groundStats.groundPoints, points - glm::min(points, groundStats.groundPoints));
+				ImGui::Text("%dx%d cells, %zu tiles", groundStats.width, groundStats.height, groundStats.tiles);
+				ImGui::Text("%.1f ms (%.1f ms per million points)", groundMs, points > 0 ? groundMs * 1e6 / points : 0.0);
+			}
+			if (ImGui::CollapsingHeader("Registration")) {
+				std::string meshNames;
+				for (size_t i = 0; i < scene.meshes.size(); i++)
+					meshNames += "Mesh " + std::to_string(i) + '\0';
+				icpSource = glm::clamp(icpSource, 0, (int)scene.meshes.size() - 1);
+				icpTarget = glm::clamp(icpTarget, 0, (int)scene.meshes.size() - 1);
+				ImGui::Combo("Source", &icpSource, meshNames.c_str());
+				ImGui::Combo("Target", &icpTarget, meshNames.c_str());
+
+				ImGui::SliderInt("Levels", &icpOptions.levels, 1, 5);
+				ImGui::InputInt("Iterations per Level", &icpOptions.maxIterations);
+				icpOptions.maxIterations = glm::max(icpOptions.maxIterations, 1);
+				int maxSamples = (int)icpOptions.maxSamples;
+				if (ImGui::InputInt("Max Samples", &maxSamples, 1000, 10000))
+					icpOptions.maxSamples = (size_t)glm::max(maxSamples, 64);
+				ImGui::InputFloat("Max Distance (0 = auto)", &icpOptions.maxDistance, 0.01f, 0.1f, 3);
+				icpOptions.maxDistance = glm::max(icpOptions.maxDistance, 0.f);
+
+				Mesh &source = scene.meshes[icpSource];
+				if (icpSource != icpTarget && ImGui::Button("Align")) {
+					icpMs = alignMesh(source, scene.meshes[icpTarget], icpOptions, icpResult);
+					profiler.record("Registration", icpMs, source.count);
+					scene.version++; // Cached views follow the new placement
+				}
+				ImGui::SameLine();
+				if (ImGui::Button("Reset Placement")) {
+					source.model = glm::mat4(1);
+					scene.version++;
+				}
+				ImGui::Text("%d iterations in %.1f ms, %s", icpResult.iterations, icpMs, icpResult.converged ? "converged" : "not converged");
+				ImGui::Text("Residual %g over %zu correspondences", icpResult.residual, icpResult.inliers);
+			}
+			if (ImGui::CollapsingHeader("Denoise")) {
+				std::string meshNames = "All meshes";
+				meshNames += '\0';
+				for (size_t i = 0; i < scene.meshes.size(); i++)
+					meshNames += "Mesh " + std::to_string(i) + '\0';
+				denoiseMesh = glm::clamp(denoiseMesh, -1, (int)scene.meshes.size() - 1);
+				int meshItem = denoiseMesh + 1;
+				if (ImGui::Combo("Mesh##Denoise", &meshItem, meshNames.c_str()))
+					denoiseMesh = meshItem - 1;
+
+				int method = (int)denoiseOptions.method;
+				if (ImGui::Combo("Method", &method, "Bilateral\0MLS\0"))
+					denoiseOptions.method = (DenoiseMethod)method;
+				ImGui::SliderInt("Iterations##Denoise", &denoiseOptions.iterations, 1, 10);
+				ImGui::SliderInt("Neighbours", &denoiseOptions.neighbours, 4, DENOISE_MAX_NEIGHBOURS);
+				ImGui::InputFloat("Sigma (0 = auto)", &denoiseOptions.sigma, 0.001f, 0.01f, 4);
+				denoiseOptions.sigma = glm::max(denoiseOptions.sigma, 0.f);
+				if (denoiseOptions.method == DENOISE_BILATERAL) {
+					ImGui::InputFloat("Normal Sigma (0 = auto)", &denoiseOptions.sigmaNormal, 0.001f, 0.01f, 4);
+					denoiseOptions.sigmaNormal = glm::max(denoiseOptions.sigmaNormal, 0.f);
+				}
+
+				size_t points = 0;
+				for (size_t i = 0; i < scene.meshes.size(); i++)
+					points += denoiseMesh < 0 || (size_t)denoiseMesh == i ? scene.meshes[i].count : 0;
+				if (ImGui::Button("Denoise")) {
+					denoiseMs = denoiseScene(scene, denoiseMesh, denoiseOptions, denoiseStats);
+					profiler.record("Denoise", denoiseMs, points * denoiseOptions.iterations);
+				}
+				for (size_t i = 0; i < denoiseStats.iterationMs.size(); i++)
+					ImGui::Text("Iteration %zu: %.1f ms", i + 1, denoiseStats.iterationMs[i]);
+				ImGui::Text("%.1f ms total, %.2f M points/s", denoiseMs,
+					denoiseMs > 0 ? points * denoiseStats.iterationMs.size() / (denoiseMs * 1000.0) : 0.0);
+				ImGui::Text("Mean shift of last iteration %g", denoiseStats.meanShift);
+			}
+			if (ImGui::CollapsingHeader("Merge")) {
+				mergeSelection.resize(scene.meshes.size(), 0);
+				size_t selectedCount = 0, selectedBytes = 0;
+				for (size_t i = 0; i < scene.meshes.size(); i++) {
+					const Mesh &mesh = scene.meshes[i];
+					bool checked = mergeSelection[i] != 0;
+					const std::string label = "Mesh " + std::to_string(i) + " (" + std::to_string(mesh.count) + " points)";
+					if (ImGui::Checkbox(label.c_str(), &checked))
+						mergeSelection[i] = checked ? 1 : 0;
+					if (checked) {
+						selectedCount++;
+						selectedBytes += mesh.count * (meshNormals(mesh) != NULL ? 6 : 3) * sizeof(float);
+					}
+				}
+				ImGui::InputFloat("Tolerance", &mergeTolerance, 0.0001f, 0.001f, 5);
+				mergeTolerance = glm::max(mergeTolerance, 0.f);
+
+				if (selectedCount >= 2 && ImGui::Button("Merge Selected")) {
+					mergeInputBytes = selectedBytes;
+					mergeMs = mergeSceneMeshes(scene, mergeSelection, mergeTolerance, mergeStats);
+					profiler.record("Merge", mergeMs, mergeStats.inputPoints);
+					mergeSelection.assign(scene.meshes.size(), 0);
+				}
+				ImGui::Text("%zu points in, %zu out, %zu duplicates removed", mergeStats.inputPoints, mergeStats.outputPoints,
+					mergeStats.inputPoints - mergeStats.outputPoints);
+				ImGui::Text("%.1f MB in, %.1f MB out, %.1f MB hash table", mergeInputBytes / 1048576.0,
+					mergeStats.outputBytes / 1048576.0, mergeStats.tableBytes / 1048576.0);
+				ImGui::Text("%.1f ms", mergeMs);
+			}
+			ImGui::End();
+		}
+
+		if (showSlice && !scene.meshes.empty()) {
+			ImGui::Begin("- Slice -", &showSlice);
+			ImGui::Combo("Axis", &slice.axis, "X\0Y\0Z\0\0");
+			glm::vec3 sliceMin, sliceMax;
+			placedBounds(scene, sliceMin, sliceMax);
+			ImGui::SliderFloat("Position", &slice.position, sliceMin[slice.axis], sliceMax[slice.axis], "%.3f");
+			if (ImGui::InputFloat("Thickness", &slice.thickness, 0.005f, 0.05f, 3))
+				slice.thickness = glm::max(slice.thickness, 0.0001f);
+			ImGui::Text("%zu points in slab", slice.points);
+
+			const float avail = glm::max(ImGui::GetContentRegionAvailWidth(), 64.f);
+			ImGui::Image((ImTextureID)(intptr_t)slice.colorTex, ImVec2(avail, avail), ImVec2(0, 1), ImVec2(1, 0));
+			ImGui::End();
+		}
+
+		if (showOpenDialog)
+			drawOpenDialog(openDialog, showOpenDialog, datasetCache);
+
+		// The old scene is only dropped once the new one loaded
+		if (finishSceneLoad(openDialog.load)) {
+			if (!openDialog.load.ok) {
+				std::cerr << openDialog.load.error << std::endl;
+				openDialog.status = "Cannot load " + openDialog.load.path;
+				releaseSceneLoad(openDialog.load);
+			}
+			else {
+				if (openDialog.replace) {
+					remote.pipeline.stop();
+					remote.active = false;
+					clearScene(scene);
+				}
+				const size_t points = addSceneSource(scene, openDialog.load);
+				profiler.record("Scene load", openDialog.load.ms, points);
+				openDialog.status = "Loaded " + openDialog.load.path;
+			}
+		}
+
+		if (showOpenUrl) {
+			ImGui::Begin("- Open URL -", &showOpenUrl);
+			ImGui::InputText("URL", remoteUrl, sizeof(remoteUrl));
+			if (ImGui::InputInt("Connections", &remoteConnections))
+				remoteConnections = glm::clamp(remoteConnections, 1, 64);
+			if (ImGui::Button("Open")) {
+				clearScene(scene);
+				scene.version++;
+				openRemoteScene(remote, remoteUrl, remoteConnections);
+			}
+			if (!remote.status.empty())
+				ImGui::Text("%s", remote.status.c_str());
+			if (!remote.nodes.empty()) {
+				const double seconds = remote.active ? std::chrono::duration<double>(std::chrono::steady_clock::now() - remote.started).count() : remote.seconds;
+				const double megabytes = remote.pipeline.bytesReceived() / 1048576.0;
+				ImGui::Text("%zu / %zu nodes, %zu failed", remote.received, remote.nodes.size(), remote.failed);
+				ImGui::Text("%.1f MB in %.2f s, %.1f MB/s", megabytes, seconds, seconds > 0 ? megabytes / seconds : 0.0);
+				ImGui::Text("%zu in flight over %zu connections opened", remote.pipeline.inFlight(), remote.pipeline.connects());
+				ImGui::Text("Mean range time %.2f ms", remote.received > 0 ? remote.latencyMs / remote.received : 0.0);
+			}
+			ImGui::End();
+		}
+
+		if (remote.active) {
+			auto addStart = std::chrono::high_resolution_clock::now();
+			const size_t added = updateRemoteScene(remote, scene);
+			if (added > 0)
+				profiler.record("Remote nodes", std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - addStart).count(), added);
+		}
+
+		if (showIngest) {
+			ImGui::Begin("- Ingest -", &showIngest);
+			if (!live.reader.isOpen()) {
+				ImGui::InputText("Shared Memory", liveName, sizeof(liveName));
+				if (ImGui::Button("Connect"))
+					liveFailed = !connectLiveStream(live, liveName);
+				if (liveFailed)
+					ImGui::Text("No frame ring named %s", liveName);
+			}
+			else {
+				if (ImGui::Button("Disconnect"))
+					deleteLiveStream(live);
+				ImGui::Text("%zu points%s", live.mesh.count, live.normals ? " with normals" : "");
+				ImGui::Text("%llu frames, %llu skipped, %llu torn", (unsigned long long)live.frames,
+					(unsigned long long)live.skipped, (unsigned long long)live.torn);
+				ImGui::Text("Latency %.2f ms", live.latencyMs);
+			}
+			ImGui::End();
+		}
+
+		auto reloadStart = std::chrono::high_resolution_clock::now();
+		const size_t reloaded = updateSceneWatch(watch, scene, watchFiles);
+		if (reloaded > 0)
+			profiler.record("Reload upload", std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - reloadStart).count(), reloaded);
+
+		if (live.reader.isOpen()) {
+			auto uploadStart = std::chrono::high_resolution_clock::now();
+			const size_t uploaded = updateLiveStream(live);
+			if (uploaded > 0)
+				profiler.record("Ingest upload", std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - uploadStart).count(), uploaded);
+		}
+
 		// Camera input
 		mouseDelta = mousePos;
 		glfwGetCursorPos(window, &mousePos.x, &mousePos.y);
@@ -483,26 +2591,82 @@ int main(int argc, char ** args)
 		projT = glm::perspective(70.f, ratio, 0.1f, 1000.f);
 		viewT = glm::lookAt(camPos, camPos + forward * camRot, up);
 		mvpT = projT * viewT * modelT;
+		lightT = lightTransform(scene, modelT, lightDir) * modelT;
 
 		glfwGetFramebufferSize(window, &width, &height);
 		ratio = width / (float)height;
 
+		// Shadow pass, only the lit modes sample the shadow map
+		const bool castShadows = shadows && (drawMode == 3 || drawMode == 4);
+		if (castShadows && !scene.meshes.empty()) {
+			profiler.begin("Shadow pass");
+			glBindFramebuffer(GL_FRAMEBUFFER, shadowFBO);
+			glViewport(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+			glClear(GL_DEPTH_BUFFER_BIT);
+
+			glUseProgram(shadowShader);
+			size_t shadowPoints = renderShadowMap(scene, shadowShader, lightT, shadowBudget, shadowPointSize);
+
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			profiler.end(shadowPoints);
+		}
+
 		// Draw
 		glViewport(0, 0, width, height);
 
 		glClearColor(0.1f, 0.1f, 0.1f, 1);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		// Update point cloud shader
-		glUseProgram(pointcloundShader);
-		glUniformMatrix4fv(glGetUniformLocation(pointcloundShader, "MVP"), 1, GL_TRUE, glm::value_ptr(mvpT));
-		glUniform1f(glGetUniformLocation(pointcloundShader, "LightIntensity"), lightIntensity);
-		glUniform1i(glGetUniformLocation(pointcloundShader, "DrawMode"), drawMode);
-		glUniform3fv(glGetUniformLocation(pointcloundShader, "LightDir"), 1, glm::value_ptr(lightDir));
-		glUniform3fv(glGetUniformLocation(pointcloundShader, "LightCol"), 1, glm::value_ptr(lightCol));
-		glUniform3fv(glGetUniformLocation(pointcloundShader, "DiffuseCol"), 1, glm::value_ptr(diffuseCol));
-		glUniform3fv(glGetUniformLocation(pointcloundShader, "AmbientCol"), 1, glm::value_ptr(ambientCol));
+		// Point and voxel shaders share the lighting uniforms
+		auto updateLitShader = [&](GLuint shader) {
+			glUseProgram(shader);
+			glUniformMatrix4fv(glGetUniformLocation(shader, "MVP"), 1, GL_TRUE, glm::value_ptr(mvpT));
+			glUniform1f(glGetUniformLocation(shader, "LightIntensity"), lightIntensity);
+			glUniform1i(glGetUniformLocation(shader, "DrawMode"), drawMode);
+			glUniform3fv(glGetUniformLocation(shader, "LightDir"), 1, glm::value_ptr(lightDir));
+			glUniform3fv(glGetUniformLocation(shader, "LightCol"), 1, glm::value_ptr(lightCol));
+			glUniform3fv(glGetUniformLocation(shader, "DiffuseCol"), 1, glm::value_ptr(diffuseCol));
+			glUniform3fv(glGetUniformLocation(shader, "AmbientCol"), 1, glm::value_ptr(ambientCol));
+			glUniformMatrix4fv(glGetUniformLocation(shader, "LightMVP"), 1, GL_TRUE, glm::value_ptr(lightT));
+			glUniform1i(glGetUniformLocation(shader, "Shadows"), castShadows ? 1 : 0);
+			glUniform1f(glGetUniformLocation(shader, "ShadowBias"), shadowBias);
+			glUniform1i(glGetUniformLocation(shader, "ShadowMap"), 0);
+		};
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, shadowTex);
+
+		// Decide whether the voxel overview replaces the points this frame
+		size_t totalPoints = 0;
+		for (auto &mesh : scene.meshes)
+			totalPoints += mesh.count;
+
+		bool useOverview = false;
+		if (overviewMode != 0 && totalPoints > 0) {
+			const glm::vec3 camPosModel = glm::vec3(glm::inverse(modelT) * glm::vec4(camPos, 1));
+			const float voxelSize = overviewVoxelSize(scene, camPosModel, projT, height, overviewPixels, overviewMaxCells);
+
+			auto buildStart = std::chrono::high_resolution_clock::now();
+			if (updateVoxelOverview(overview, scene, voxelSize))
+				profiler.record("Voxel build", std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - buildStart).count(), totalPoints);
+
+			useOverview = overviewMode == 2 || totalPoints >= overview.count * overviewMinPointsPerVoxel;
+		}
+
+		if (useOverview) {
+			updateLitShader(voxelShader);
+			glUniform1f(glGetUniformLocation(voxelShader, "Alpha"), 1.0f);
+			glUniform1f(glGetUniformLocation(voxelShader, "VoxelSize"), overview.size);
 
+			profiler.begin("Voxel pass");
+			glBindVertexArray(overview.vao);
+			glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0, (GLsizei)overview.count);
+			profiler.end(overview.count);
+		}
+
+		// Update point cloud shader
+		updateLitShader(pointcloundShader);
+		glUniform1f(glGetUniformLocation(pointcloundShader, "Alpha"), transparent ? alpha : 1.0f);
 
 		if (scalePoints) {
 			const float size = (1.f / pow(glm::length(camPos), scaleExp)) * 20;
@@ -512,21 +2676,100 @@ int main(int argc, char ** args)
 			glPointSize(1.f);
 		}
 
-		for (auto mesh : meshes) {
-			glBindVertexArray(mesh.first);
-			glDrawArrays(GL_POINTS, 0, mesh.second);
+		// The overview voxels drawn above replace the points
+		if (transparent && !useOverview) {
+			// Sort meshes and then their points back to front
+			const glm::mat4 modelViewT = viewT * modelT;
+			std::vector<std::pair<float, Mesh *>> sorted;
+			for (auto &mesh : scene.meshes)
+				sorted.emplace_back((modelViewT * mesh.model * glm::vec4(mesh.center, 1)).z, &mesh);
+			std::sort(sorted.begin(), sorted.end(), [](const std::pair<float, Mesh *> &a, const std::pair<float, Mesh *> &b) {
+				return a.first < b.first;
+			});
+
+			auto sortStart = std::chrono::high_resolution_clock::now();
+			size_t sortedPoints = 0, incremental = 0;
+			for (auto &m : sorted) {
+				incremental += sortMeshByDepth(*m.second, modelViewT * m.second->model) ? 1 : 0;
+				sortedPoints += m.second->count;
+			}
+			profiler.record("Depth sort", std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - sortStart).count(), sortedPoints);
+			profiler.counter("Depth sorts reusing order", (double)incremental);
+
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			glDepthMask(GL_FALSE);
+
+			profiler.begin("Point pass");
+			for (auto &m : sorted) {
+				setMeshUniforms(pointcloundShader, *m.second, mvpT, lightT);
+				glBindVertexArray(m.second->vao);
+				glDrawElements(GL_POINTS, (GLsizei)m.second->count, GL_UNSIGNED_INT, 0);
+			}
+			profiler.end(sortedPoints);
+
+			glDepthMask(GL_TRUE);
+			glDisable(GL_BLEND);
+		}
+		else if (!useOverview) {
+			profiler.begin("Point pass");
+			size_t drawnPoints = 0;
+			for (auto &mesh : scene.meshes) {
+				setMeshUniforms(pointcloundShader, mesh, mvpT, lightT);
+				glBindVertexArray(mesh.vao);
+				glDrawArrays(GL_POINTS, 0, (GLsizei)mesh.count);
+				drawnPoints += mesh.count;
+			}
+			profiler.end(drawnPoints);
+		}
+
+		// Live points are never part of the overview or the depth sort
+		if (live.mesh.count > 0) {
+			profiler.begin("Ingest pass");
+			setMeshUniforms(pointcloundShader, live.mesh, mvpT, lightT);
+			glBindVertexArray(live.mesh.vao);
+			glDrawArrays(GL_POINTS, 0, (GLsizei)live.mesh.count);
+			profiler.end(live.mesh.count);
 		}
+		glBindTexture(GL_TEXTURE_2D, 0);
 
 		// Update shape shader
 		glUseProgram(shapeShader);
 		glUniformMatrix4fv(glGetUniformLocation(shapeShader, "MVP"), 1, GL_TRUE, glm::value_ptr(mvpT));
 		glUniform4fv(glGetUniformLocation(shapeShader, "Color"), 1, glm::value_ptr(boundsColor));
 
-		if (bounds && drawBounds) {
-			glBindVertexArray(bounds);
+		if (scene.bounds && drawBounds) {
+			glBindVertexArray(scene.bounds);
 			glDrawElements(GL_LINES, 24, GL_UNSIGNED_INT, 0);
 		}
 
+		// Slice panel
+		if (showSlice && !scene.meshes.empty()) {
+			auto indexStart = std::chrono::high_resolution_clock::now();
+			bool rebuilt = false;
+			for (auto &mesh : scene.meshes)
+				rebuilt |= updateSliceIndex(mesh, slice.axis);
+			if (rebuilt)
+				profiler.record("Slice index", std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - indexStart).count(), totalPoints);
+
+			const glm::mat4 sliceT = sliceTransform(scene, slice);
+			glBindFramebuffer(GL_FRAMEBUFFER, slice.fbo);
+			glViewport(0, 0, SLICE_VIEW_SIZE, SLICE_VIEW_SIZE);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+			updateLitShader(pointcloundShader);
+			glUniform1i(glGetUniformLocation(pointcloundShader, "Shadows"), 0);
+			glUniform1f(glGetUniformLocation(pointcloundShader, "Alpha"), 1.0f);
+			glPointSize(2.f);
+
+			profiler.begin("Slice pass");
+			slice.points = renderSlice(scene, slice, pointcloundShader, sliceT);
+			profiler.end(slice.points);
+
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			glViewport(0, 0, width, height);
+		}
+
 		ImGui::Render();
 
 		// Display
@@ -535,9 +2778,17 @@ int main(int argc, char ** args)
 	}
 
 	// Clean resources
-	for (auto mesh : meshes)
-		glDeleteVertexArrays(1, &mesh.first);
-	glDeleteVertexArrays(1, &bounds);
+	waitSceneLoad(openDialog.load);
+	stopSceneWatch(watch);
+	remote.pipeline.stop();
+	clearScene(scene);
+	deleteLiveStream(live);
+	deleteVoxelOverview(overview);
+	glDeleteTextures(1, &heatmap.texture);
+	deleteSliceView(slice);
+	profiler.shutdown();
+	glDeleteFramebuffers(1, &shadowFBO);
+	glDeleteTextures(1, &shadowTex);
 
 	glfwDestroyWindow(window);
 	glfwTerminate();
@@ -0,0 +1,172 @@
+#include "merge.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+
+#include "parallel.h"
+
+#define MERGE_AXIS_BITS 21
+#define MERGE_AXIS_OFFSET (1 << (MERGE_AXIS_BITS - 1))
+#define MERGE_EMPTY 0xffffffffffffffffull
+#define MERGE_NO_OWNER 0xffffffffu
+
+namespace {
+
+inline uint64_t cellKey(const float *p, float invSize)
+{
+	const uint64_t mask = (1ull << MERGE_AXIS_BITS) - 1;
+	const uint64_t x = (uint64_t)((int64_t)floorf(p[0] * invSize) + MERGE_AXIS_OFFSET) & mask;
+	const uint64_t y = (uint64_t)((int64_t)floorf(p[1] * invSize) + MERGE_AXIS_OFFSET) & mask;
+	const uint64_t z = (uint64_t)((int64_t)floorf(p[2] * invSize) + MERGE_AXIS_OFFSET) & mask;
+	return x | (y << MERGE_AXIS_BITS) | (z << (MERGE_AXIS_BITS * 2));
+}
+
+inline uint64_t mixKey(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdull;
+	k ^= k >> 33;
+	k *= 0xc4ceb3fe1a85ec53ull;
+	return k ^ (k >> 33);
+}
+
+/**
+* Open addressing table of cells with linear probing. Slots are claimed with
+* a compare and swap, so any number of threads can insert at once.
+*/
+struct CellTable {
+	std::vector<std::atomic<uint64_t>> keys;
+	std::vector<std::atomic<uint32_t>> owners;
+	uint64_t mask = 0;
+
+	explicit CellTable(size_t count)
+	{
+		size_t slots = 1024;
+		while (slots < count * 2)
+			slots *= 2;
+		mask = slots - 1;
+		keys = std::vector<std::atomic<uint64_t>>(slots);
+		owners = std::vector<std::atomic<uint32_t>>(slots);
+		parallelFor(slots, [&](size_t, size_t begin, size_t end) {
+			for (size_t s = begin; s < end; s++) {
+				keys[s].store(MERGE_EMPTY, std::memory_order_relaxed);
+				owners[s].store(MERGE_NO_OWNER, std::memory_order_relaxed);
+			}
+		});
+	}
+
+	size_t bytes() const { return keys.size() * (sizeof(uint64_t) + sizeof(uint32_t)); }
+
+	/**
+	* Slot of "key", inserting it if "insert" is set.
+	*/
+	size_t find(uint64_t key, bool insert)
+	{
+		for (size_t s = mixKey(key) & mask; ; s = (s + 1) & mask) {
+			uint64_t current = keys[s].load(std::memory_order_acquire);
+			if (current == key)
+				return s;
+			if (current == MERGE_EMPTY) {
+				if (!insert)
+					return MERGE_EMPTY;
+				if (keys[s].compare_exchange_strong(current, key, std::memory_order_acq_rel) || current == key)
+					return s;
+			}
+		}
+	}
+};
+
+}
+
+MergeStats mergeClouds(const std::vector<MergeInput> &inputs, float tolerance, std::vector<float> &positions, std::vector<float> &normals)
+{
+	MergeStats stats;
+	std::vector<size_t> offsets;
+	bool withNormals = !inputs.empty();
+	for (auto &input : inputs) {
+		offsets.push_back(stats.inputPoints);
+		stats.inputPoints += input.count;
+		withNormals = withNormals && input.normals != NULL;
+	}
+	const size_t total = stats.inputPoints;
+
+	// Place every input in the merged space
+	std::vector<float> placed(total * 3);
+	std::vector<float> placedNormals(withNormals ? total * 3 : 0);
+	for (size_t k = 0; k < inputs.size(); k++) {
+		const MergeInput &input = inputs[k];
+		float *dst = &placed[offsets[k] * 3];
+		float *dstNormals = withNormals ? &placedNormals[offsets[k] * 3] : NULL;
+		const float *m = input.transform;
+		parallelFor(input.count, [&](size_t, size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				const float *p = input.positions + i * 3;
+				const float *n = withNormals ? input.normals + i * 3 : NULL;
+				for (int a = 0; a < 3; a++) {
+					dst[i * 3 + a] = m ? m[a] * p[0] + m[4 + a] * p[1] + m[8 + a] * p[2] + m[12 + a] : p[a];
+					if (n)
+						dstNormals[i * 3 + a] = m ? m[a] * n[0] + m[4 + a] * n[1] + m[8 + a] * n[2] : n[a];
+				}
+			}
+		});
+	}
+
+	if (tolerance <= 0) {
+		positions.swap(placed);
+		normals.swap(placedNormals);
+		stats.outputPoints = total;
+		stats.outputBytes = (positions.size() + normals.size()) * sizeof(float);
+		return stats;
+	}
+
+	// Every cell keeps the lowest index of the points that fall in it
+	const float invSize = 1.f / tolerance;
+	std::vector<uint8_t> keep(total);
+	{
+		CellTable table(total);
+		stats.tableBytes = table.bytes();
+		parallelFor(total, [&](size_t, size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				std::atomic<uint32_t> &owner = table.owners[table.find(cellKey(&placed[i * 3], invSize), true)];
+				uint32_t current = owner.load(std::memory_order_relaxed);
+				while (i < current && !owner.compare_exchange_weak(current, (uint32_t)i, std::memory_order_relaxed)) {}
+			}
+		});
+		parallelFor(total, [&](size_t, size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				const size_t slot = table.find(cellKey(&placed[i * 3], invSize), false);
+				keep[i] = table.owners[slot].load(std::memory_order_relaxed) == i ? 1 : 0;
+			}
+		});
+	}
+
+	// Compact in the original order, workers get the same ranges in both passes
+	std::vector<size_t> kept(parallelWorkers(total), 0);
+	parallelFor(total, [&](size_t w, size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+			kept[w] += keep[i];
+	});
+	std::vector<size_t> starts(kept.size(), 0);
+	for (size_t w = 1; w < kept.size(); w++)
+		starts[w] = starts[w - 1] + kept[w - 1];
+	stats.outputPoints = kept.empty() ? 0 : starts.back() + kept.back();
+
+	positions.resize(stats.outputPoints * 3);
+	normals.resize(withNormals ? stats.outputPoints * 3 : 0);
+	parallelFor(total, [&](size_t w, size_t begin, size_t end) {
+		size_t o = starts[w];
+		for (size_t i = begin; i < end; i++) {
+			if (!keep[i])
+				continue;
+			std::copy(&placed[i * 3], &placed[i * 3] + 3, &positions[o * 3]);
+			if (withNormals)
+				std::copy(&placedNormals[i * 3], &placedNormals[i * 3] + 3, &normals[o * 3]);
+			o++;
+		}
+	});
+
+	stats.outputBytes = (positions.size() + normals.size()) * sizeof(float);
+	return stats;
+}
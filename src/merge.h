@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+/**
+* One input of a merge, "transform" is a column major 4x4 matrix placing the
+* points in the merged cloud, or NULL to keep them as they are.
+*/
+struct MergeInput {
+	const float *positions = NULL;
+	const float *normals = NULL; // Optional, dropped unless every input has them
+	size_t count = 0;
+	const float *transform = NULL;
+};
+
+struct MergeStats {
+	size_t inputPoints = 0;
+	size_t outputPoints = 0;
+	size_t tableBytes = 0; // Peak size of the duplicate hash table
+	size_t outputBytes = 0;
+};
+
+/**
+* Concatenates the inputs, dropping points that quantize to the same cell of
+* size "tolerance" as an earlier point. Cells go into a lock free open
+* addressing table filled in parallel, each cell remembering the lowest point
+* index that hit it, so the kept points are the same for any thread count.
+* Coordinates wrap after 2^21 cells per axis. A tolerance of 0 keeps every
+* point.
+*/
+MergeStats mergeClouds(const std::vector<MergeInput> &inputs, float tolerance, std::vector<float> &positions, std::vector<float> &normals);
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+* Spreads the lower 10 bits of "v" so there are two zero bits between each.
+*/
+inline uint32_t mortonSpread(uint32_t v)
+{
+	v &= 0x3ff;
+	v = (v | (v << 16)) & 0x030000ff;
+	v = (v | (v << 8)) & 0x0300f00f;
+	v = (v | (v << 4)) & 0x030c30c3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
+}
+
+/**
+* 30 bit Morton code of a point inside the given bounds, 10 bits per axis.
+* Points sharing the top 3 * L bits lie in the same octree cell of level L.
+*/
+inline uint32_t mortonCode(const float *p, const float *min, const float *invExtent)
+{
+	uint32_t code = 0;
+	for (int a = 0; a < 3; a++) {
+		float t = (p[a] - min[a]) * invExtent[a];
+		t = t < 0 ? 0 : (t > 1 ? 1 : t);
+		code |= mortonSpread((uint32_t)(t * 1023.f)) << (2 - a);
+	}
+	return code;
+}
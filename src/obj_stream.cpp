@@ -0,0 +1,137 @@
+#include "obj_stream.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#define OBJ_STREAM_BUFFER (4 << 20)
+
+ObjPointStream::~ObjPointStream()
+{
+	close();
+}
+
+bool ObjPointStream::open(const std::string &filename)
+{
+	return openRange(filename, 0, UINT64_MAX);
+}
+
+bool ObjPointStream::openRange(const std::string &filename, uint64_t first, uint64_t last)
+{
+	close();
+	path = filename;
+	rangeFirst = first;
+	rangeLast = last;
+
+	// One extra byte keeps the unparsed range null terminated for strtof
+	buffer.resize(OBJ_STREAM_BUFFER + 1);
+	if (!restart()) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void ObjPointStream::close()
+{
+	file.close();
+	path.clear();
+	block = NULL;
+	blockLeft = 0;
+}
+
+void ObjPointStream::rewind()
+{
+	restart();
+}
+
+bool ObjPointStream::restart()
+{
+	// Starts one byte early, the line read there ends right at the range
+	// start if a line starts exactly there
+	const uint64_t start = rangeFirst > 0 ? rangeFirst - 1 : 0;
+	const bool ok = !path.empty() && file.open(path, start);
+	block = NULL;
+	blockLeft = 0;
+	begin = end = 0;
+	consumed = (size_t)start;
+	skipLine = rangeFirst > 0;
+	eof = !ok;
+	return ok;
+}
+
+bool ObjPointStream::fill()
+{
+	if (eof)
+		return false;
+
+	// Keep the partial line at the front
+	memmove(&buffer[0], &buffer[begin], end - begin);
+	end -= begin;
+	begin = 0;
+
+	size_t read = 0;
+	while (end + read < OBJ_STREAM_BUFFER) {
+		if (blockLeft == 0 && !file.next(block, blockLeft))
+			break;
+		const size_t bytes = std::min(blockLeft, OBJ_STREAM_BUFFER - end - read);
+		memcpy(&buffer[end + read], block, bytes);
+		block += bytes;
+		blockLeft -= bytes;
+		read += bytes;
+	}
+	end += read;
+	buffer[end] = 0;
+	if (read == 0)
+		eof = true;
+	return read > 0;
+}
+
+bool ObjPointStream::read(std::vector<float> &positions, size_t maxPoints)
+{
+	positions.clear();
+	while (positions.size() < maxPoints * 3) {
+		char *line = &buffer[begin];
+		char *newline = (char *)memchr(line, '\n', end - begin);
+		if (newline == NULL) {
+			if (end - begin == OBJ_STREAM_BUFFER) {
+				// Line longer than the buffer, not something we care about
+				consumed += end - begin;
+				begin = end;
+			}
+			if (fill())
+				continue;
+			if (begin == end)
+				break;
+			// fill moved the partial line to the front
+			line = &buffer[begin];
+			newline = &buffer[end]; // Last line without a line break
+		}
+
+		// Lines starting past the range belong to the next one
+		if (consumed >= rangeLast) {
+			begin = end;
+			eof = true;
+			break;
+		}
+
+		const size_t length = newline - line + (newline < &buffer[end] ? 1 : 0);
+		*newline = 0;
+		begin += length;
+		consumed += length;
+		if (skipLine) {
+			skipLine = false;
+			continue;
+		}
+
+		while (*line == ' ' || *line == '\t')
+			line++;
+		if (line[0] != 'v' || (line[1] != ' ' && line[1] != '\t'))
+			continue;
+
+		char *cursor = line + 2;
+		for (int i = 0; i < 3; i++)
+			positions.push_back(strtof(cursor, &cursor));
+	}
+	return !positions.empty();
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "input_file.h"
+
+/**
+* Reads the vertex positions ("v" lines) of an OBJ file in batches, so files
+* larger than memory can be processed a piece at a time. Everything other
+* than positions is skipped. The next blocks of the file are read, and
+* decompressed for gzip and zstd files, while the current one is parsed.
+*/
+class ObjPointStream {
+public:
+	ObjPointStream() {}
+	~ObjPointStream();
+
+	bool open(const std::string &filename);
+
+	/**
+	* Like open but only reads the lines starting within bytes [first, last),
+	* so workers can split one file between them by byte ranges. Compressed
+	* files only open with "first" 0.
+	*/
+	bool openRange(const std::string &filename, uint64_t first, uint64_t last);
+	void close();
+
+	/**
+	* Goes back to the start of the file.
+	*/
+	void rewind();
+
+	/**
+	* Replaces "positions" with up to "maxPoints" xyz triplets.
+	* Returns false once the end of the file was reached and nothing was read.
+	*/
+	bool read(std::vector<float> &positions, size_t maxPoints);
+
+	/**
+	* Bytes consumed so far, for progress reporting.
+	*/
+	size_t offset() const { return consumed; }
+
+	/**
+	* Whether reading stopped early on an I/O error or corrupt compressed
+	* data, "error" tells which.
+	*/
+	bool failed() const { return file.failed(); }
+	std::string error() const { return file.error(); }
+
+private:
+	ObjPointStream(const ObjPointStream &);
+	ObjPointStream &operator=(const ObjPointStream &);
+
+	bool restart();
+	bool fill();
+
+	std::string path;
+	InputFile file;
+	const char *block = NULL; // Read ahead but not copied into "buffer" yet
+	size_t blockLeft = 0;
+	std::vector<char> buffer;
+	size_t begin = 0; // Unparsed range of the buffer
+	size_t end = 0;
+	size_t consumed = 0;
+	bool eof = false;
+	uint64_t rangeFirst = 0;
+	uint64_t rangeLast = UINT64_MAX;
+	bool skipLine = false; // Rest of a line that started before the range
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+/**
+* Amount of worker threads, 0 means one per hardware thread. Larger amounts
+* than the hardware has are used as given, so splits can be reproduced on any
+* machine.
+*/
+inline unsigned &workerLimit()
+{
+	static unsigned limit = 0;
+	return limit;
+}
+
+/**
+* Amount of worker threads the parallel helpers split work into.
+*/
+inline unsigned workerCount()
+{
+	if (workerLimit() > 0)
+		return workerLimit();
+	const unsigned count = std::thread::hardware_concurrency();
+	return count > 0 ? count : 1;
+}
+
+/**
+* Number of ranges parallelFor will split "count" items into.
+*/
+inline size_t parallelWorkers(size_t count, size_t minPerWorker = 4096)
+{
+	minPerWorker = std::max<size_t>(minPerWorker, 1);
+	return std::max<size_t>(1, std::min<size_t>(workerCount(), (count + minPerWorker - 1) / minPerWorker));
+}
+
+/**
+* Splits [0, count) into one contiguous range per worker and calls
+* fn(worker, begin, end) for each range in parallel. Small inputs run on the
+* calling thread only.
+*/
+template <typename Fn>
+void parallelFor(size_t count, Fn fn, size_t minPerWorker = 4096)
+{
+	const size_t workers = parallelWorkers(count, minPerWorker);
+	if (workers == 1) {
+		fn(0, 0, count);
+		return;
+	}
+
+	std::vector<std::thread> threads;
+	threads.reserve(workers - 1);
+	const size_t step = (count + workers - 1) / workers;
+	for (size_t w = 1; w < workers; w++) {
+		const size_t begin = std::min(count, w * step);
+		const size_t end = std::min(count, begin + step);
+		threads.emplace_back([&fn, w, begin, end]() { fn(w, begin, end); });
+	}
+	fn(0, 0, std::min(count, step));
+
+	for (auto &t : threads)
+		t.join();
+}
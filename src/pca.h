@@ -0,0 +1,47 @@
+#pragma once
+
+#include <math.h>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+/**
+* Eigenvector of the smallest eigenvalue of a symmetric 3x3 matrix, from the
+* closed form eigenvalues.
+*/
+inline glm::vec3 smallestEigenvector(const double m[3][3])
+{
+	const double p1 = m[0][1] * m[0][1] + m[0][2] * m[0][2] + m[1][2] * m[1][2];
+	const double q = (m[0][0] + m[1][1] + m[2][2]) / 3.0;
+	const double p2 = (m[0][0] - q) * (m[0][0] - q) + (m[1][1] - q) * (m[1][1] - q) + (m[2][2] - q) * (m[2][2] - q) + 2.0 * p1;
+	const double p = sqrt(p2 / 6.0);
+	if (p <= 1e-30)
+		return glm::vec3(0, 1, 0);
+
+	double b[3][3];
+	for (int r = 0; r < 3; r++) {
+		for (int c = 0; c < 3; c++)
+			b[r][c] = (m[r][c] - (r == c ? q : 0.0)) / p;
+	}
+	const double det = b[0][0] * (b[1][1] * b[2][2] - b[1][2] * b[2][1])
+		- b[0][1] * (b[1][0] * b[2][2] - b[1][2] * b[2][0])
+		+ b[0][2] * (b[1][0] * b[2][1] - b[1][1] * b[2][0]);
+	const double phi = acos(std::min(std::max(det / 2.0, -1.0), 1.0)) / 3.0;
+	const double lambda = q + 2.0 * p * cos(phi + 2.0943951023931957); // + 2 pi / 3
+
+	// The eigenvector is orthogonal to the rows of m - lambda * I
+	glm::dvec3 rows[3];
+	for (int r = 0; r < 3; r++)
+		rows[r] = glm::dvec3(m[r][0], m[r][1], m[r][2]) - glm::dvec3(r == 0, r == 1, r == 2) * lambda;
+	glm::dvec3 best(0);
+	double bestLen = 0;
+	for (int i = 0; i < 3; i++) {
+		const glm::dvec3 c = glm::cross(rows[i], rows[(i + 1) % 3]);
+		const double len = glm::dot(c, c);
+		if (len > bestLen) {
+			best = c;
+			bestLen = len;
+		}
+	}
+	return bestLen > 0 ? glm::vec3(best / sqrt(bestLen)) : glm::vec3(0, 1, 0);
+}
@@ -0,0 +1,315 @@
+#include "pcv.h"
+
+#include <float.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "cluster.h"
+#include "dataset_cache.h"
+#include "ground_filter.h"
+#include "icp.h"
+#include "kd_tree.h"
+#include "parallel.h"
+#include "point_cloud.h"
+
+#define PCV_SLOT_BITS 20 // Low bits of a cloud ID, the slot index + 1
+#define PCV_SLOT_MASK ((1u << PCV_SLOT_BITS) - 1)
+#define PCV_GENERATION_MASK (0xffffffffu >> PCV_SLOT_BITS)
+
+namespace {
+
+/**
+* A registered cloud, it only points at the host's arrays or at the ones
+* the core loaded itself.
+*/
+struct CloudView {
+	const float *positions = NULL;
+	const float *normals = NULL;
+	size_t count = 0;
+	pcv_release_fn release = NULL;
+	void *user = NULL;
+	std::unique_ptr<PointCloud> owned; // Arrays of clouds the core loaded itself
+	std::shared_ptr<CachedDataset> cached; // Mapped cache entry shared by the shapes of one file
+	std::vector<uint32_t> labels;
+	std::unique_ptr<KdTree> tree; // Built on the first neighbour query
+	bool used = false;
+	uint32_t generation = 0; // Bumped on every removal so old IDs of the slot stop matching
+
+	void releaseArrays()
+	{
+		if (release != NULL)
+			release(user, positions, normals);
+		const uint32_t next = (generation + 1) & PCV_GENERATION_MASK;
+		*this = CloudView();
+		generation = next;
+	}
+};
+
+}
+
+struct pcv_context {
+	std::vector<CloudView> clouds; // Freed slots are reused under a new generation
+	bool useCache = false;
+	DatasetCacheOptions cacheOptions;
+};
+
+namespace {
+
+/**
+* A cloud ID holds the slot index + 1 in its low bits and the slot's
+* generation above them, so the ID of a removed cloud never finds the cloud
+* added to its slot later. Generations wrap after 4096 reuses of one slot.
+*/
+pcv_cloud cloudId(size_t slot, uint32_t generation)
+{
+	return (pcv_cloud)((generation << PCV_SLOT_BITS) | (uint32_t)(slot + 1));
+}
+
+CloudView *findCloud(const pcv_context *context, pcv_cloud cloud)
+{
+	const size_t slot = cloud & PCV_SLOT_MASK;
+	if (context == NULL || slot == 0 || slot > context->clouds.size())
+		return NULL;
+	CloudView &view = const_cast<pcv_context *>(context)->clouds[slot - 1];
+	return view.used && view.generation == cloud >> PCV_SLOT_BITS ? &view : NULL;
+}
+
+}
+
+pcv_context *pcv_create(void)
+{
+	return new pcv_context();
+}
+
+void pcv_destroy(pcv_context *context)
+{
+	if (context == NULL)
+		return;
+	for (auto &view : context->clouds) {
+		if (view.used)
+			view.releaseArrays();
+	}
+	delete context;
+}
+
+const char *pcv_status_string(pcv_status status)
+{
+	switch (status) {
+	case PCV_OK: return "ok";
+	case PCV_INVALID_ARGUMENT: return "invalid argument";
+	case PCV_INVALID_CLOUD: return "invalid cloud";
+	case PCV_FAILED: return "failed";
+	}
+	return "unknown status";
+}
+
+void pcv_set_threads(unsigned threads)
+{
+	workerLimit() = threads;
+}
+
+pcv_status pcv_add_cloud(pcv_context *context, const float *positions, const float *normals, size_t count,
+	pcv_release_fn release, void *user, pcv_cloud *cloud)
+{
+	if (context == NULL || cloud == NULL || (positions == NULL && count > 0) || count >= PCV_NO_POINT)
+		return PCV_INVALID_ARGUMENT;
+
+	size_t slot = 0;
+	while (slot < context->clouds.size() && context->clouds[slot].used)
+		slot++;
+	if (slot == PCV_SLOT_MASK)
+		return PCV_FAILED; // Every ID is taken
+	if (slot == context->clouds.size())
+		context->clouds.emplace_back();
+
+	CloudView &view = context->clouds[slot];
+	view.positions = positions;
+	view.normals = normals;
+	view.count = count;
+	view.release = release;
+	view.user = user;
+	view.used = true;
+	*cloud = cloudId(slot, view.generation);
+	return PCV_OK;
+}
+
+pcv_status pcv_load_obj(pcv_context *context, const char *filename, pcv_cloud *clouds, size_t maxClouds, size_t *loaded)
+{
+	if (context == NULL || filename == NULL || (clouds == NULL && maxClouds > 0))
+		return PCV_INVALID_ARGUMENT;
+
+	std::vector<PointCloud> shapes;
+	std::string error;
+	if (context->useCache) {
+		std::shared_ptr<CachedDataset> dataset(new CachedDataset());
+		if (!dataset->open(filename, context->cacheOptions, error))
+			return PCV_FAILED;
+		const std::vector<CachedShape> &cached = dataset->shapes();
+		if (loaded != NULL)
+			*loaded = cached.size();
+
+		for (size_t i = 0; i < cached.size() && i < maxClouds; i++) {
+			const pcv_status status = pcv_add_cloud(context, cached[i].positions, cached[i].normals, cached[i].count,
+				NULL, NULL, &clouds[i]);
+			if (status != PCV_OK)
+				return status;
+			findCloud(context, clouds[i])->cached = dataset;
+		}
+		return PCV_OK;
+	}
+
+	if (!loadPointClouds(filename, shapes, error))
+		return PCV_FAILED;
+	if (loaded != NULL)
+		*loaded = shapes.size();
+
+	for (size_t i = 0; i < shapes.size() && i < maxClouds; i++) {
+		std::unique_ptr<PointCloud> owned(new PointCloud(std::move(shapes[i])));
+		const pcv_status status = pcv_add_cloud(context, owned->positions.data(),
+			owned->hasNormals() ? owned->normals.data() : NULL, owned->size(), NULL, NULL, &clouds[i]);
+		if (status != PCV_OK)
+			return status;
+		findCloud(context, clouds[i])->owned = std::move(owned);
+	}
+	return PCV_OK;
+}
+
+pcv_status pcv_set_dataset_cache(pcv_context *context, const char *directory, uint64_t maxBytes)
+{
+	if (context == NULL)
+		return PCV_INVALID_ARGUMENT;
+	context->useCache = directory != NULL;
+	context->cacheOptions = DatasetCacheOptions();
+	if (directory != NULL)
+		context->cacheOptions.directory = directory;
+	if (maxBytes > 0)
+		context->cacheOptions.maxBytes = maxBytes;
+	return PCV_OK;
+}
+
+pcv_status pcv_remove_cloud(pcv_context *context, pcv_cloud cloud)
+{
+	CloudView *view = findCloud(context, cloud);
+	if (view == NULL)
+		return PCV_INVALID_CLOUD;
+	view->releaseArrays();
+	return PCV_OK;
+}
+
+size_t pcv_cloud_size(const pcv_context *context, pcv_cloud cloud)
+{
+	const CloudView *view = findCloud(context, cloud);
+	return view != NULL ? view->count : 0;
+}
+
+const float *pcv_cloud_positions(const pcv_context *context, pcv_cloud cloud)
+{
+	const CloudView *view = findCloud(context, cloud);
+	return view != NULL ? view->positions : NULL;
+}
+
+const float *pcv_cloud_normals(const pcv_context *context, pcv_cloud cloud)
+{
+	const CloudView *view = findCloud(context, cloud);
+	return view != NULL ? view->normals : NULL;
+}
+
+uint32_t *pcv_cloud_labels(pcv_context *context, pcv_cloud cloud)
+{
+	CloudView *view = findCloud(context, cloud);
+	if (view == NULL)
+		return NULL;
+	if (view->labels.size() != view->count)
+		view->labels.assign(view->count, 0);
+	return view->labels.data();
+}
+
+pcv_status pcv_cluster(pcv_context *context, pcv_cloud cloud, float epsilon, size_t minPoints, size_t minClusterSize,
+	uint32_t *labels, size_t *clusters)
+{
+	const CloudView *view = findCloud(context, cloud);
+	if (view == NULL)
+		return PCV_INVALID_CLOUD;
+	if (labels == NULL || epsilon <= 0)
+		return PCV_INVALID_ARGUMENT;
+
+	ClusterOptions options;
+	options.epsilon = epsilon;
+	options.minPoints = std::max<size_t>(minPoints, 1);
+	options.minClusterSize = std::max<size_t>(minClusterSize, 1);
+	std::vector<uint32_t> result;
+	const size_t found = clusterPoints(view->positions, view->count, options, result);
+	std::copy(result.begin(), result.end(), labels);
+	if (clusters != NULL)
+		*clusters = found;
+	return PCV_OK;
+}
+
+pcv_status pcv_classify_ground(pcv_context *context, pcv_cloud cloud, int upAxis, float cellSize,
+	uint32_t *classes, size_t *groundPoints)
+{
+	const CloudView *view = findCloud(context, cloud);
+	if (view == NULL)
+		return PCV_INVALID_CLOUD;
+	if (classes == NULL || upAxis < 0 || upAxis > 2 || cellSize < 0)
+		return PCV_INVALID_ARGUMENT;
+
+	GroundOptions options;
+	options.upAxis = upAxis;
+	options.cellSize = cellSize;
+	std::vector<uint32_t> result;
+	const GroundStats stats = classifyGround(view->positions, view->count, options, result);
+	std::copy(result.begin(), result.end(), classes);
+	if (groundPoints != NULL)
+		*groundPoints = stats.groundPoints;
+	return PCV_OK;
+}
+
+pcv_status pcv_register(pcv_context *context, pcv_cloud source, pcv_cloud target, float *transform, float *residual)
+{
+	const CloudView *sourceView = findCloud(context, source);
+	const CloudView *targetView = findCloud(context, target);
+	if (sourceView == NULL || targetView == NULL)
+		return PCV_INVALID_CLOUD;
+	if (transform == NULL)
+		return PCV_INVALID_ARGUMENT;
+
+	const IcpResult result = registerPointToPlane(sourceView->positions, sourceView->count, targetView->positions,
+		targetView->normals, targetView->count, glm::make_mat4(transform), IcpOptions());
+	std::copy(glm::value_ptr(result.transform), glm::value_ptr(result.transform) + 16, transform);
+	if (residual != NULL)
+		*residual = result.residual;
+	return result.iterations > 0 ? PCV_OK : PCV_FAILED;
+}
+
+pcv_status pcv_nearest_k(pcv_context *context, pcv_cloud cloud, const float *queries, size_t count, size_t k,
+	uint32_t *indices, float *distSq)
+{
+	CloudView *view = findCloud(context, cloud);
+	if (view == NULL)
+		return PCV_INVALID_CLOUD;
+	if ((count > 0 && (queries == NULL || indices == NULL || distSq == NULL)) || k == 0)
+		return PCV_INVALID_ARGUMENT;
+
+	if (!view->tree) {
+		view->tree.reset(new KdTree());
+		view->tree->build(view->positions, view->count);
+	}
+	const KdTree &tree = *view->tree;
+	parallelFor(count, [&](size_t, size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			uint32_t *entries = indices + i * k;
+			float *dists = distSq + i * k;
+			const size_t found = tree.nearestK(queries + i * 3, k, FLT_MAX, entries, dists);
+			for (size_t j = 0; j < found; j++)
+				entries[j] = tree.order[entries[j]];
+			std::fill(entries + found, entries + k, PCV_NO_POINT);
+			std::fill(dists + found, dists + k, FLT_MAX);
+		}
+	}, 256);
+	return PCV_OK;
+}
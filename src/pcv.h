@@ -0,0 +1,129 @@
+#pragma once
+
+/**
+* C API of the viewer core for embedding in other processes. Point arrays are
+* registered by pointer and stored without copying. Clustering and the ground
+* filter read them in place on every call, neighbour queries and
+* registration search a KD-tree holding its own sorted copy of the positions.
+* The host keeps the arrays alive until the release callback runs, which
+* happens when the cloud is removed or the context is destroyed.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PCV_API_VERSION 1
+#define PCV_NO_POINT 0xffffffffu
+
+typedef struct pcv_context pcv_context;
+typedef uint32_t pcv_cloud; /* 0 is never a valid cloud, nor is one that was removed */
+
+typedef enum pcv_status {
+	PCV_OK = 0,
+	PCV_INVALID_ARGUMENT,
+	PCV_INVALID_CLOUD,
+	PCV_FAILED
+} pcv_status;
+
+/**
+* Called once the core no longer references a cloud's arrays.
+*/
+typedef void (*pcv_release_fn)(void *user, const float *positions, const float *normals);
+
+pcv_context *pcv_create(void);
+
+/**
+* Releases every cloud still registered and frees the context.
+*/
+void pcv_destroy(pcv_context *context);
+
+const char *pcv_status_string(pcv_status status);
+
+/**
+* Max amount of worker threads used by the processing stages, 0 for all.
+*/
+void pcv_set_threads(unsigned threads);
+
+/**
+* Registers "count" xyz positions and optional normals (NULL if none) without
+* copying them. "release" may be NULL if the host frees the arrays itself
+* after removing the cloud.
+*/
+pcv_status pcv_add_cloud(pcv_context *context, const float *positions, const float *normals, size_t count,
+	pcv_release_fn release, void *user, pcv_cloud *cloud);
+
+/**
+* Loads every shape of an OBJ file as a cloud with the viewer's loader. The
+* core owns the arrays of loaded clouds and frees them on removal. Up to
+* "maxClouds" shapes are loaded, "loaded" receives the amount of shapes in
+* the file.
+*/
+pcv_status pcv_load_obj(pcv_context *context, const char *filename, pcv_cloud *clouds, size_t maxClouds, size_t *loaded);
+
+/**
+* Makes pcv_load_obj go through the decoded dataset cache shared between
+* processes, see dataset_cache.h. Clouds loaded from the cache point into
+* the shared read-only mapping instead of owning a copy. "directory" NULL
+* turns the cache off again, "" picks the default tmpfs directory, and
+* "maxBytes" 0 keeps the default budget.
+*/
+pcv_status pcv_set_dataset_cache(pcv_context *context, const char *directory, uint64_t maxBytes);
+
+/**
+* Unregisters a cloud and calls its release callback. The ID stays invalid
+* even after a later cloud takes over its slot.
+*/
+pcv_status pcv_remove_cloud(pcv_context *context, pcv_cloud cloud);
+
+size_t pcv_cloud_size(const pcv_context *context, pcv_cloud cloud);
+
+/**
+* The arrays the cloud was registered with, the core stores the host's
+* pointers as they are.
+*/
+const float *pcv_cloud_positions(const pcv_context *context, pcv_cloud cloud);
+const float *pcv_cloud_normals(const pcv_context *context, pcv_cloud cloud);
+
+/**
+* One label per point owned by the core, zero until written. Pass it to the
+* processing stages to label the cloud in place.
+*/
+uint32_t *pcv_cloud_labels(pcv_context *context, pcv_cloud cloud);
+
+/**
+* DBSCAN clustering, writes one cluster ID per point to "labels" (0 for
+* noise) and the amount of clusters to "clusters".
+*/
+pcv_status pcv_cluster(pcv_context *context, pcv_cloud cloud, float epsilon, size_t minPoints, size_t minClusterSize,
+	uint32_t *labels, size_t *clusters);
+
+/**
+* Ground filter, writes the LAS class of every point to "classes" (2 for
+* ground, 1 otherwise). "upAxis" is 0, 1 or 2, "cellSize" 0 picks one.
+*/
+pcv_status pcv_classify_ground(pcv_context *context, pcv_cloud cloud, int upAxis, float cellSize,
+	uint32_t *classes, size_t *groundPoints);
+
+/**
+* Point to plane ICP of "source" onto "target". "transform" is a column
+* major 4x4 matrix holding the initial guess and receiving the result.
+*/
+pcv_status pcv_register(pcv_context *context, pcv_cloud source, pcv_cloud target, float *transform, float *residual);
+
+/**
+* The "k" nearest points of every query position. Point indices go to
+* "indices" and squared distances to "distSq", "k" per query, padded with
+* PCV_NO_POINT. The cloud's KD-tree copies the positions on first use and is
+* kept, so positions the host rewrites later are not seen by this query
+* until the cloud is added again.
+*/
+pcv_status pcv_nearest_k(pcv_context *context, pcv_cloud cloud, const float *queries, size_t count, size_t k,
+	uint32_t *indices, float *distSq);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,138 @@
+/*******************************************************/
+/* pcv-host-example: Embedding the core through pcv.h  */
+/*******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "pcv.h"
+
+#define HOST_SIDE 200
+
+/**
+* Host side frame, released through the callback once the core is done.
+*/
+typedef struct Frame {
+	float *positions;
+	size_t count;
+	int released;
+} Frame;
+
+static void releaseFrame(void *user, const float *positions, const float *normals)
+{
+	Frame *frame = (Frame *)user;
+	(void)normals;
+	if (positions == frame->positions) {
+		free(frame->positions);
+		frame->positions = NULL;
+		frame->released = 1;
+	}
+}
+
+/**
+* A flat ground with a box standing on it, like one acquisition frame.
+*/
+static void makeFrame(Frame *frame, float shift)
+{
+	size_t i = 0;
+	int x, z;
+	frame->count = HOST_SIDE * HOST_SIDE + HOST_SIDE * HOST_SIDE / 4;
+	frame->positions = (float *)malloc(frame->count * 3 * sizeof(float));
+	frame->released = 0;
+	for (z = 0; z < HOST_SIDE; z++) {
+		for (x = 0; x < HOST_SIDE; x++, i++) {
+			frame->positions[i * 3 + 0] = x * 0.05f + shift;
+			frame->positions[i * 3 + 1] = 0.01f * sinf(x * 0.3f) * cosf(z * 0.2f);
+			frame->positions[i * 3 + 2] = z * 0.05f;
+		}
+	}
+	for (z = 0; z < HOST_SIDE / 2; z++) {
+		for (x = 0; x < HOST_SIDE / 2; x++, i++) {
+			frame->positions[i * 3 + 0] = 4.f + (x % 10) * 0.05f + shift;
+			frame->positions[i * 3 + 1] = 0.2f + z * 0.02f;
+			frame->positions[i * 3 + 2] = 4.f + (x / 10) * 0.05f;
+		}
+	}
+}
+
+static int check(pcv_status status, const char *what)
+{
+	if (status != PCV_OK)
+		fprintf(stderr, "%s: %s\n", what, pcv_status_string(status));
+	return status == PCV_OK;
+}
+
+int main(void)
+{
+	Frame first, second;
+	pcv_cloud firstCloud, secondCloud, thirdCloud;
+	float single[3] = { 0, 0, 0 };
+	size_t boxPoint;
+	uint32_t *labels;
+	size_t clusters = 0, ground = 0;
+	uint32_t neighbours[4];
+	float dists[4];
+	float transform[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+	float residual = 0;
+	int ok = 1;
+
+	pcv_context *context = pcv_create();
+	makeFrame(&first, 0.f);
+	makeFrame(&second, 0.02f);
+	ok &= check(pcv_add_cloud(context, first.positions, NULL, first.count, releaseFrame, &first, &firstCloud), "add");
+	ok &= check(pcv_add_cloud(context, second.positions, NULL, second.count, releaseFrame, &second, &secondCloud), "add");
+
+	/* The core stores the registered pointers as they are */
+	if (pcv_cloud_positions(context, firstCloud) != first.positions) {
+		fprintf(stderr, "positions were not stored as registered\n");
+		ok = 0;
+	}
+
+	/* Clustering reads the host's array in place, a point the host moves away after registering turns into noise */
+	boxPoint = HOST_SIDE * HOST_SIDE;
+	labels = (uint32_t *)malloc(first.count * sizeof(uint32_t));
+	ok &= check(pcv_cluster(context, firstCloud, 0.08f, 4, 50, labels, &clusters), "cluster");
+	if (labels[boxPoint] == 0) {
+		fprintf(stderr, "box point not clustered\n");
+		ok = 0;
+	}
+	first.positions[boxPoint * 3 + 1] = 1000.f;
+	ok &= check(pcv_cluster(context, firstCloud, 0.08f, 4, 50, labels, &clusters), "cluster");
+	if (labels[boxPoint] != 0) {
+		fprintf(stderr, "clustering did not see the host's change\n");
+		ok = 0;
+	}
+	first.positions[boxPoint * 3 + 1] = 0.2f;
+	ok &= check(pcv_cluster(context, firstCloud, 0.08f, 4, 50, labels, &clusters), "cluster");
+	ok &= check(pcv_classify_ground(context, firstCloud, 1, 0.f, labels, &ground), "ground");
+	ok &= check(pcv_nearest_k(context, firstCloud, first.positions, 1, 4, neighbours, dists), "nearest");
+	ok &= check(pcv_register(context, secondCloud, firstCloud, transform, &residual), "register");
+	printf("%zu points, %zu clusters, %zu ground points\n", first.count, clusters, ground);
+	printf("nearest of point 0: %u (%g)\n", neighbours[0], dists[0]);
+	printf("registration offset %g %g %g, residual %g\n", transform[12], transform[13], transform[14], residual);
+	free(labels);
+
+	/* Removing a cloud hands its arrays back, destroying the context the rest */
+	ok &= check(pcv_remove_cloud(context, firstCloud), "remove");
+	if (!first.released || second.released) {
+		fprintf(stderr, "release callback not called as expected\n");
+		ok = 0;
+	}
+
+	/* A new cloud reuses the freed slot, the removed cloud's ID must not reach it */
+	ok &= check(pcv_add_cloud(context, single, NULL, 1, NULL, NULL, &thirdCloud), "add");
+	if (thirdCloud == firstCloud || pcv_cloud_size(context, firstCloud) != 0
+		|| pcv_remove_cloud(context, firstCloud) != PCV_INVALID_CLOUD || pcv_cloud_size(context, thirdCloud) != 1) {
+		fprintf(stderr, "removed cloud ID still valid\n");
+		ok = 0;
+	}
+	pcv_destroy(context);
+	if (!second.released) {
+		fprintf(stderr, "release callback not called on destroy\n");
+		ok = 0;
+	}
+
+	printf("%s\n", ok ? "ok" : "failed");
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
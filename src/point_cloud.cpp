@@ -0,0 +1,84 @@
+#include "point_cloud.h"
+
+#include <float.h>
+#include <istream>
+#include <streambuf>
+
+#include "input_file.h"
+#include "point_file.h"
+#include "tiny_obj_loader.h"
+
+namespace {
+
+/**
+* Hands the read ahead, or decompressed, blocks to tinyobj's istream parser
+* as they arrive.
+*/
+class ReadAheadBuffer : public std::streambuf {
+public:
+	ReadAheadBuffer(InputFile &file) : file(file) {}
+
+protected:
+	int_type underflow()
+	{
+		const char *data;
+		size_t bytes;
+		if (!file.next(data, bytes))
+			return traits_type::eof();
+		char *begin = const_cast<char *>(data); // Only read, putback never writes past gptr
+		setg(begin, begin, begin + bytes);
+		return traits_type::to_int_type(*begin);
+	}
+
+private:
+	InputFile &file;
+};
+
+}
+
+void PointCloud::updateBounds()
+{
+	const size_t count = size();
+	glm::dvec3 sum(0);
+	min = glm::vec3(count > 0 ? FLT_MAX : 0);
+	max = glm::vec3(count > 0 ? -FLT_MAX : 0);
+	for (size_t i = 0; i < count; i++) {
+		const glm::vec3 p(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2]);
+		sum += glm::dvec3(p);
+		min = glm::min(min, p);
+		max = glm::max(max, p);
+	}
+	center = count > 0 ? glm::vec3(sum / (double)count) : glm::vec3(0);
+}
+
+bool loadPointClouds(const std::string &filename, std::vector<PointCloud> &clouds, std::string &error)
+{
+	// pcv-convert output, its nodes load as separate clouds
+	if (isPointFile(filename))
+		return readPointFile(filename, clouds, error);
+
+	InputFile file;
+	if (!file.open(filename)) {
+		error = file.error() + "\n";
+		return false;
+	}
+	ReadAheadBuffer buffer(file);
+	std::istream stream(&buffer);
+	tinyobj::MaterialFileReader materialReader("");
+	std::vector<tinyobj::shape_t> shapes;
+	std::vector<tinyobj::material_t> materials;
+	if (!tinyobj::LoadObj(shapes, materials, error, stream, materialReader) || file.failed()) {
+		if (file.failed())
+			error = file.error() + "\n";
+		return false;
+	}
+
+	for (auto &shape : shapes) {
+		PointCloud cloud;
+		cloud.positions = std::move(shape.mesh.positions);
+		cloud.normals = std::move(shape.mesh.normals);
+		cloud.updateBounds();
+		clouds.push_back(std::move(cloud));
+	}
+	return true;
+}
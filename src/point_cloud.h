@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+/**
+* CPU side points of one shape, the data every processing stage works on.
+* Rendering keeps its GPU copies next to it.
+*/
+struct PointCloud {
+	std::vector<float> positions;
+	std::vector<float> normals; // Empty or one per point
+	std::vector<uint32_t> labels; // Per point segment label, 0 when unassigned
+	glm::vec3 center = glm::vec3(0);
+	glm::vec3 min = glm::vec3(0);
+	glm::vec3 max = glm::vec3(0);
+	glm::mat4 model = glm::mat4(1); // Placement in the scene, set by registration
+
+	size_t size() const { return positions.size() / 3; }
+	bool hasNormals() const { return !normals.empty() && normals.size() == positions.size(); }
+
+	/**
+	* Recomputes the center and bounds from the positions.
+	*/
+	void updateBounds();
+};
+
+/**
+* Appends every shape of an OBJ file, or every node of a point file, to
+* "clouds" as a point cloud. Returns false if the file could not be read,
+* "error" holds the loader's messages either way.
+*/
+bool loadPointClouds(const std::string &filename, std::vector<PointCloud> &clouds, std::string &error);
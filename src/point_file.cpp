@@ -0,0 +1,231 @@
+#include "point_file.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#define fseeko _fseeki64
+#define ftello _ftelli64
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+uint64_t align(uint64_t offset)
+{
+	return (offset + POINT_FILE_ALIGN - 1) / POINT_FILE_ALIGN * POINT_FILE_ALIGN;
+}
+
+bool writePadded(FILE *file, const void *data, size_t bytes, uint64_t &offset)
+{
+	static const char zeros[POINT_FILE_ALIGN] = {};
+	const uint64_t padded = align(offset + bytes);
+	const bool ok = fwrite(data, 1, bytes, file) == bytes &&
+		fwrite(zeros, 1, (size_t)(padded - offset - bytes), file) == padded - offset - bytes;
+	offset = padded;
+	return ok;
+}
+
+}
+
+uint64_t pointFileTableBytes(uint64_t nodes)
+{
+	return align(sizeof(PointFileHeader) + nodes * sizeof(PointFileNode));
+}
+
+uint64_t pointFileNodeEnd(const PointFileNode &node)
+{
+	const uint64_t arrayBytes = node.count * 3 * sizeof(float);
+	return (node.normals != 0 ? node.normals : node.positions) + arrayBytes;
+}
+
+bool checkPointFileHeader(const PointFileHeader &header, uint64_t fileBytes)
+{
+	return header.magic == POINT_FILE_MAGIC && header.version == POINT_FILE_VERSION && header.bytes <= fileBytes &&
+		pointFileTableBytes(header.nodes) <= fileBytes;
+}
+
+bool checkPointFileNode(const PointFileNode &node, uint64_t fileBytes)
+{
+	// Counts beyond the file size would overflow the array sizes below
+	const uint64_t arrayBytes = node.count * 3 * sizeof(float);
+	return node.count < fileBytes && node.positions + arrayBytes <= fileBytes && node.normals + arrayBytes <= fileBytes &&
+		(node.normals == 0 || node.normals >= node.positions + arrayBytes);
+}
+
+PointFileNode pointFileNode(const PointCloud &cloud, uint64_t &offset)
+{
+	PointFileNode node;
+	memset(&node, 0, sizeof(node));
+	node.count = cloud.size();
+	node.positions = offset;
+	offset = align(offset + cloud.size() * 3 * sizeof(float));
+	if (cloud.hasNormals()) {
+		node.normals = offset;
+		offset = align(offset + cloud.size() * 3 * sizeof(float));
+	}
+	memcpy(node.center, &cloud.center[0], sizeof(node.center));
+	memcpy(node.min, &cloud.min[0], sizeof(node.min));
+	memcpy(node.max, &cloud.max[0], sizeof(node.max));
+	return node;
+}
+
+bool writePointFile(const std::string &path, const std::vector<PointCloud> &clouds, uint64_t sourceHash, uint64_t sourceSize)
+{
+	PointFileWriter writer;
+	bool ok = writer.open(path, clouds.size(), sourceHash, sourceSize);
+	for (size_t i = 0; ok && i < clouds.size(); i++)
+		ok = writer.add(clouds[i]);
+	return ok && writer.close();
+}
+
+PointFileWriter::~PointFileWriter()
+{
+	abort();
+}
+
+bool PointFileWriter::open(const std::string &target, uint64_t nodes, uint64_t sourceHash, uint64_t sourceSize)
+{
+	abort();
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), ".tmp.%d", (int)getpid());
+	path = target;
+	temp = path + suffix;
+	file = fopen(temp.c_str(), "wb");
+	if (file == NULL)
+		return false;
+
+	memset(&header, 0, sizeof(header));
+	header.magic = POINT_FILE_MAGIC;
+	header.version = POINT_FILE_VERSION;
+	header.nodes = (uint32_t)nodes;
+	header.sourceHash = sourceHash;
+	header.sourceSize = sourceSize;
+	table.clear();
+	table.reserve((size_t)nodes);
+
+	// Room for the header and table, written for real by close
+	std::vector<char> zeros((size_t)pointFileTableBytes(nodes), 0);
+	offset = zeros.size();
+	ok = fwrite(zeros.data(), 1, zeros.size(), file) == zeros.size();
+	return ok;
+}
+
+bool PointFileWriter::add(const PointCloud &cloud)
+{
+	if (file == NULL || table.size() >= header.nodes)
+		return false;
+	uint64_t end = offset;
+	table.push_back(pointFileNode(cloud, end));
+	ok = ok && writePadded(file, cloud.positions.data(), cloud.size() * 3 * sizeof(float), offset);
+	if (cloud.hasNormals())
+		ok = ok && writePadded(file, cloud.normals.data(), cloud.size() * 3 * sizeof(float), offset);
+	return ok;
+}
+
+bool PointFileWriter::close()
+{
+	if (file == NULL)
+		return false;
+	header.bytes = offset;
+	ok = ok && table.size() == header.nodes && fseek(file, 0, SEEK_SET) == 0 &&
+		fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(table.data(), sizeof(PointFileNode), table.size(), file) == table.size();
+	ok = fclose(file) == 0 && ok;
+	file = NULL;
+	if (!ok || rename(temp.c_str(), path.c_str()) != 0) {
+		remove(temp.c_str());
+		return false;
+	}
+	return true;
+}
+
+void PointFileWriter::abort()
+{
+	if (file == NULL)
+		return;
+	fclose(file);
+	file = NULL;
+	remove(temp.c_str());
+}
+
+void readPointFileNode(const PointFileNode &node, const char *data, PointCloud &cloud)
+{
+	const float *positions = reinterpret_cast<const float *>(data);
+	cloud.positions.assign(positions, positions + node.count * 3);
+	if (node.normals != 0) {
+		const float *normals = reinterpret_cast<const float *>(data + (node.normals - node.positions));
+		cloud.normals.assign(normals, normals + node.count * 3);
+	}
+	else {
+		cloud.normals.clear();
+	}
+	cloud.center = glm::vec3(node.center[0], node.center[1], node.center[2]);
+	cloud.min = glm::vec3(node.min[0], node.min[1], node.min[2]);
+	cloud.max = glm::vec3(node.max[0], node.max[1], node.max[2]);
+}
+
+bool isPointFile(const std::string &path)
+{
+	uint32_t magic = 0;
+	FILE *file = fopen(path.c_str(), "rb");
+	if (file == NULL)
+		return false;
+	const bool read = fread(&magic, sizeof(magic), 1, file) == 1;
+	fclose(file);
+	return read && magic == POINT_FILE_MAGIC;
+}
+
+bool readPointFileTable(const std::string &path, PointFileHeader &header, std::vector<PointFileNode> &nodes)
+{
+	FILE *file = fopen(path.c_str(), "rb");
+	if (file == NULL)
+		return false;
+	fseeko(file, 0, SEEK_END);
+	const uint64_t fileBytes = (uint64_t)ftello(file);
+	fseeko(file, 0, SEEK_SET);
+
+	bool ok = fread(&header, sizeof(header), 1, file) == 1 && checkPointFileHeader(header, fileBytes);
+	if (ok) {
+		nodes.resize(header.nodes);
+		ok = nodes.empty() || fread(nodes.data(), sizeof(PointFileNode), nodes.size(), file) == nodes.size();
+	}
+	for (size_t i = 0; ok && i < nodes.size(); i++)
+		ok = checkPointFileNode(nodes[i], header.bytes);
+	fclose(file);
+	return ok;
+}
+
+bool readPointFile(const std::string &path, std::vector<PointCloud> &clouds, std::string &error)
+{
+	PointFileHeader header;
+	std::vector<PointFileNode> nodes;
+	if (!readPointFileTable(path, header, nodes)) {
+		error = "Not a point file of this version [" + path + "]\n";
+		return false;
+	}
+	FILE *file = fopen(path.c_str(), "rb");
+	if (file == NULL) {
+		error = "Cannot open file [" + path + "]\n";
+		return false;
+	}
+
+	std::vector<char> data;
+	bool ok = true;
+	for (size_t i = 0; ok && i < nodes.size(); i++) {
+		const PointFileNode &node = nodes[i];
+		data.resize((size_t)(pointFileNodeEnd(node) - node.positions));
+		ok = fseeko(file, (off_t)node.positions, SEEK_SET) == 0 && fread(data.data(), 1, data.size(), file) == data.size();
+		if (ok) {
+			clouds.emplace_back();
+			readPointFileNode(node, data.data(), clouds.back());
+		}
+	}
+	fclose(file);
+	if (!ok)
+		error = "Cannot read file [" + path + "]\n";
+	return ok;
+}
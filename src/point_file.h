@@ -0,0 +1,129 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "point_cloud.h"
+
+#define POINT_FILE_MAGIC 0x43564350u // "PCVC"
+#define POINT_FILE_VERSION 1 // Bump when the layout or the loader's output changes
+#define POINT_FILE_ALIGN 64
+
+/**
+* Decoded points laid out for mapping and range requests: this header, one
+* PointFileNode per node and then the 64 byte aligned arrays of every node,
+* positions directly followed by normals. Written by the dataset cache (a
+* node per OBJ shape) and pcv-convert (a node per spatial chunk).
+*/
+struct PointFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nodes;
+	uint32_t reserved;
+	uint64_t sourceHash; // Content hash and size of the file the points came from
+	uint64_t sourceSize;
+	uint64_t bytes; // Size of the whole file
+};
+
+struct PointFileNode {
+	uint64_t count;
+	uint64_t positions; // Offsets from the start of the file
+	uint64_t normals; // 0 if the node has none
+	float center[3];
+	float min[3];
+	float max[3];
+	uint32_t reserved;
+};
+
+/**
+* Bytes of the header and the node table, where the node arrays start.
+*/
+uint64_t pointFileTableBytes(uint64_t nodes);
+
+/**
+* End offset of a node's arrays, so [positions, end) is one contiguous range.
+*/
+uint64_t pointFileNodeEnd(const PointFileNode &node);
+
+/**
+* False if the header is not a point file of this version or does not fit
+* in "fileBytes".
+*/
+bool checkPointFileHeader(const PointFileHeader &header, uint64_t fileBytes);
+
+/**
+* False if the node's arrays lie outside "fileBytes".
+*/
+bool checkPointFileNode(const PointFileNode &node, uint64_t fileBytes);
+
+/**
+* Node description of a cloud whose arrays start at "offset", advances
+* "offset" past them.
+*/
+PointFileNode pointFileNode(const PointCloud &cloud, uint64_t &offset);
+
+/**
+* Writes the clouds as nodes under a temporary name and renames it into
+* place, so readers never see a partial file.
+*/
+bool writePointFile(const std::string &path, const std::vector<PointCloud> &clouds, uint64_t sourceHash, uint64_t sourceSize);
+
+/**
+* Writes a point file one node at a time, for files larger than memory. The
+* node table is filled in last, once every node's bounds are known, and the
+* file renamed into place like writePointFile.
+*/
+class PointFileWriter {
+public:
+	PointFileWriter() {}
+	~PointFileWriter();
+
+	bool open(const std::string &path, uint64_t nodes, uint64_t sourceHash, uint64_t sourceSize);
+	bool add(const PointCloud &cloud);
+
+	/**
+	* Fails if fewer nodes were added than announced to open.
+	*/
+	bool close();
+
+	/**
+	* Drops the partial file.
+	*/
+	void abort();
+
+private:
+	PointFileWriter(const PointFileWriter &);
+	PointFileWriter &operator=(const PointFileWriter &);
+
+	FILE *file = NULL;
+	std::string path;
+	std::string temp;
+	PointFileHeader header;
+	std::vector<PointFileNode> table;
+	uint64_t offset = 0;
+	bool ok = false;
+};
+
+/**
+* Copies a node's arrays into a cloud, "data" holds the node's range.
+*/
+void readPointFileNode(const PointFileNode &node, const char *data, PointCloud &cloud);
+
+/**
+* Whether a file starts like a point file, whatever its name.
+*/
+bool isPointFile(const std::string &path);
+
+/**
+* Reads only the header and node table, enough for the point count and
+* bounds of a file without its points.
+*/
+bool readPointFileTable(const std::string &path, PointFileHeader &header, std::vector<PointFileNode> &nodes);
+
+/**
+* Appends every node of a point file to "clouds" as a cloud of its own.
+*/
+bool readPointFile(const std::string &path, std::vector<PointCloud> &clouds, std::string &error);
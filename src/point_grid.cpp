@@ -0,0 +1,183 @@
+#include "point_grid.h"
+
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+
+#include "parallel.h"
+#include "radix_sort.h"
+
+#define POINT_GRID_MIN_BITS 10
+#define POINT_GRID_MAX_BITS 30
+
+void PointGrid::build(const float *positions, size_t count, float size)
+{
+	cellSize = std::max(size, FLT_MIN);
+	origin[0] = origin[1] = origin[2] = FLT_MAX;
+	upper[0] = upper[1] = upper[2] = -FLT_MAX;
+	for (size_t i = 0; i < count; i++) {
+		for (int a = 0; a < 3; a++) {
+			origin[a] = std::min(origin[a], positions[i * 3 + a]);
+			upper[a] = std::max(upper[a], positions[i * 3 + a]);
+		}
+	}
+
+	int bits = POINT_GRID_MIN_BITS;
+	while (bits < POINT_GRID_MAX_BITS && ((size_t)1 << bits) < count)
+		bits++;
+	mask = (1u << bits) - 1;
+
+	std::vector<uint32_t> keys(count);
+	order.resize(count);
+	parallelFor(count, [&](size_t, size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			int c[3];
+			cellOf(positions + i * 3, c);
+			keys[i] = bucketOf(c[0], c[1], c[2]);
+			order[i] = (uint32_t)i;
+		}
+	});
+	radixSort(keys, order, bits);
+
+	// Every entry starting a new bucket fills the starts of the empty buckets
+	// before it, so the ranges written by the workers never overlap
+	starts.resize((size_t)mask + 2);
+	points.resize(count * 3);
+	parallelFor(count, [&](size_t, size_t begin, size_t end) {
+		for (size_t e = begin; e < end; e++) {
+			const uint32_t first = e == 0 ? 0 : keys[e - 1] + 1;
+			if (e == 0 || keys[e] != keys[e - 1]) {
+				for (uint32_t b = first; b <= keys[e]; b++)
+					starts[b] = (uint32_t)e;
+			}
+			for (int a = 0; a < 3; a++)
+				points[e * 3 + a] = positions[order[e] * 3 + a];
+		}
+	});
+	const uint32_t tail = count == 0 ? 0 : keys[count - 1] + 1;
+	std::fill(starts.begin() + tail, starts.end(), (uint32_t)count);
+}
+
+void PointGrid::inRadius(const float *p, float radius, std::vector<uint32_t> &entries, std::vector<float> &distSq) const
+{
+	forEachInRadius(p, radius, [&](uint32_t e, float d) {
+		entries.push_back(e);
+		distSq.push_back(d);
+		return true;
+	});
+}
+
+void PointGrid::inBox(const float *lo, const float *hi, std::vector<uint32_t> &entries) const
+{
+	if (order.empty())
+		return;
+
+	float clampedLo[3], clampedHi[3];
+	for (int a = 0; a < 3; a++) {
+		clampedLo[a] = std::max(lo[a], origin[a]);
+		clampedHi[a] = std::min(hi[a], upper[a]);
+		if (clampedLo[a] > clampedHi[a])
+			return;
+	}
+	int c0[3], c1[3];
+	cellOf(clampedLo, c0);
+	cellOf(clampedHi, c1);
+
+	auto inside = [&](const float *q) {
+		return q[0] >= lo[0] && q[0] <= hi[0] && q[1] >= lo[1] && q[1] <= hi[1] && q[2] >= lo[2] && q[2] <= hi[2];
+	};
+
+	// Boxes spanning more cells than there are points are cheaper to scan
+	const double cells = (double)(c1[0] - c0[0] + 1) * (c1[1] - c0[1] + 1) * (c1[2] - c0[2] + 1);
+	if (cells > (double)order.size()) {
+		for (size_t e = 0; e < order.size(); e++) {
+			if (inside(point(e)))
+				entries.push_back((uint32_t)e);
+		}
+		return;
+	}
+
+	for (int z = c0[2]; z <= c1[2]; z++) {
+		for (int y = c0[1]; y <= c1[1]; y++) {
+			for (int x = c0[0]; x <= c1[0]; x++) {
+				forEachInCell(x, y, z, [&](uint32_t e) {
+					if (inside(point(e)))
+						entries.push_back(e);
+				});
+			}
+		}
+	}
+}
+
+bool PointGrid::raycast(const float *rayOrigin, const float *dir, float radius, float maxT, uint32_t &entry, float &t) const
+{
+	const float length = sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+	if (order.empty() || length == 0)
+		return false;
+	const float d[3] = { dir[0] / length, dir[1] / length, dir[2] / length };
+	const float radiusSq = radius * radius;
+
+	// Clip the ray to the bounds widened by the radius
+	float t0 = 0, t1 = maxT;
+	for (int a = 0; a < 3; a++) {
+		const float lo = origin[a] - radius, hi = upper[a] + radius;
+		if (d[a] == 0) {
+			if (rayOrigin[a] < lo || rayOrigin[a] > hi)
+				return false;
+			continue;
+		}
+		const float ta = (lo - rayOrigin[a]) / d[a], tb = (hi - rayOrigin[a]) / d[a];
+		t0 = std::max(t0, std::min(ta, tb));
+		t1 = std::min(t1, std::max(ta, tb));
+	}
+	if (t0 > t1)
+		return false;
+
+	// Walk the cells the ray passes. A hit closest to the ray at "t" lies
+	// within "reach" cells of the cell holding that point of the ray, so the
+	// walk can stop once it enters cells beyond the best hit.
+	const int reach = (int)ceilf(radius / cellSize);
+	int c[3], step[3];
+	float next[3], delta[3];
+	const float start[3] = { rayOrigin[0] + d[0] * t0, rayOrigin[1] + d[1] * t0, rayOrigin[2] + d[2] * t0 };
+	cellOf(start, c);
+	for (int a = 0; a < 3; a++) {
+		step[a] = d[a] > 0 ? 1 : -1;
+		delta[a] = d[a] != 0 ? cellSize / fabsf(d[a]) : FLT_MAX;
+		const float boundary = origin[a] + (c[a] + (d[a] > 0 ? 1 : 0)) * cellSize;
+		next[a] = d[a] != 0 ? (boundary - rayOrigin[a]) / d[a] : FLT_MAX;
+	}
+
+	bool hit = false;
+	float best = maxT;
+	for (float enter = t0; enter <= t1 && enter <= best;) {
+		for (int z = c[2] - reach; z <= c[2] + reach; z++) {
+			for (int y = c[1] - reach; y <= c[1] + reach; y++) {
+				for (int x = c[0] - reach; x <= c[0] + reach; x++) {
+					forEachInCell(x, y, z, [&](uint32_t e) {
+						const float *q = point(e);
+						const float v[3] = { q[0] - rayOrigin[0], q[1] - rayOrigin[1], q[2] - rayOrigin[2] };
+						const float along = v[0] * d[0] + v[1] * d[1] + v[2] * d[2];
+						if (along < 0 || along >= best)
+							return;
+						const float w[3] = { v[0] - d[0] * along, v[1] - d[1] * along, v[2] - d[2] * along };
+						if (w[0] * w[0] + w[1] * w[1] + w[2] * w[2] <= radiusSq) {
+							best = along;
+							entry = e;
+							hit = true;
+						}
+					});
+				}
+			}
+		}
+
+		int axis = next[0] < next[1] ? 0 : 1;
+		axis = next[2] < next[axis] ? 2 : axis;
+		enter = next[axis];
+		next[axis] += delta[axis];
+		c[axis] += step[axis];
+	}
+
+	t = best;
+	return hit;
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#define POINT_GRID_MAX_REACH 2
+#define POINT_GRID_MAX_BUCKETS 125 // (2 * POINT_GRID_MAX_REACH + 1)^3
+
+/**
+* Uniform grid over a point set for fixed radius neighbour queries. Cells are
+* hashed into a table of about one bucket per point, and the points are
+* sorted by bucket so every bucket is a contiguous range. Walking the entries
+* in order visits space tile by tile, which keeps neighbour queries cache
+* friendly. Memory stays linear in the point count no matter how sparse the
+* cloud is.
+*/
+struct PointGrid {
+	float cellSize = 0;
+	float origin[3] = { 0, 0, 0 }; // Minimum corner of the points
+	float upper[3] = { 0, 0, 0 }; // Maximum corner of the points
+	uint32_t mask = 0; // Bucket count - 1
+	std::vector<uint32_t> starts; // First entry of every bucket, plus the end
+	std::vector<uint32_t> order; // Point index of every entry
+	std::vector<float> points; // Positions in entry order
+
+	/**
+	* Sorts the points into cells of "cellSize" with the parallel radix sort.
+	*/
+	void build(const float *positions, size_t count, float cellSize);
+
+	size_t size() const { return order.size(); }
+	const float *point(size_t entry) const { return &points[entry * 3]; }
+
+	void cellOf(const float *p, int *cell) const
+	{
+		const float inv = 1.f / cellSize;
+		for (int a = 0; a < 3; a++)
+			cell[a] = (int)floorf((p[a] - origin[a]) * inv);
+	}
+
+	/**
+	* Cells are grouped into tiles of 4x4x4 that are hashed as a whole, and
+	* stored in Morton order inside their tile, so the neighbours of a cell
+	* are mostly close by in memory.
+	*/
+	uint32_t bucketOf(int x, int y, int z) const
+	{
+		const uint32_t tile = (uint32_t)(x >> 2) * 73856093u ^ (uint32_t)(y >> 2) * 19349663u ^ (uint32_t)(z >> 2) * 83492791u;
+		const uint32_t local = (x & 1) | (y & 1) << 1 | (z & 1) << 2 | (x & 2) << 2 | (y & 2) << 3 | (z & 2) << 4;
+		return ((tile << 6) | local) & mask;
+	}
+
+	/**
+	* Calls fn(entry, distanceSquared) for every entry within "radius" of "p".
+	* Stops early when fn returns false.
+	*/
+	template <typename Fn>
+	void forEachInRadius(const float *p, float radius, Fn fn) const
+	{
+		if (order.empty())
+			return;
+
+		const int reach = (int)ceilf(radius / cellSize);
+		int c[3];
+		cellOf(p, c);
+
+		// Colliding cells share a bucket, visit each bucket once. Any point
+		// within the radius lies in one of the cells, whatever bucket it is in.
+		uint32_t buckets[POINT_GRID_MAX_BUCKETS];
+		size_t bucketCount = 0;
+		if (reach > POINT_GRID_MAX_REACH) {
+			forEachInRadiusChecked(p, radius, reach, c, fn);
+			return;
+		}
+		for (int z = c[2] - reach; z <= c[2] + reach; z++) {
+			for (int y = c[1] - reach; y <= c[1] + reach; y++) {
+				for (int x = c[0] - reach; x <= c[0] + reach; x++) {
+					const uint32_t bucket = bucketOf(x, y, z);
+					if (starts[bucket] == starts[bucket + 1])
+						continue;
+					bool seen = false;
+					for (size_t b = 0; b < bucketCount && !seen; b++)
+						seen = buckets[b] == bucket;
+					if (!seen)
+						buckets[bucketCount++] = bucket;
+				}
+			}
+		}
+
+		const float radiusSq = radius * radius;
+		for (size_t b = 0; b < bucketCount; b++) {
+			for (uint32_t e = starts[buckets[b]]; e < starts[buckets[b] + 1]; e++) {
+				const float *q = point(e);
+				const float dx = q[0] - p[0], dy = q[1] - p[1], dz = q[2] - p[2];
+				const float distSq = dx * dx + dy * dy + dz * dz;
+				if (distSq <= radiusSq && !fn(e, distSq))
+					return;
+			}
+		}
+	}
+
+	/**
+	* Appends every entry within "radius" of "p" and its squared distance.
+	*/
+	void inRadius(const float *p, float radius, std::vector<uint32_t> &entries, std::vector<float> &distSq) const;
+
+	/**
+	* Appends every entry inside the box from "lo" to "hi", bounds included.
+	*/
+	void inBox(const float *lo, const float *hi, std::vector<uint32_t> &entries) const;
+
+	/**
+	* First entry within "radius" of the ray from "origin" along "dir", found
+	* by stepping through the cells along the ray. Works like
+	* KdTree::raycast.
+	*/
+	bool raycast(const float *origin, const float *dir, float radius, float maxT, uint32_t &entry, float &t) const;
+
+private:
+	/**
+	* Calls fn(entry) for the entries of cell (x, y, z), skipping the entries
+	* of other cells that share its bucket.
+	*/
+	template <typename Fn>
+	void forEachInCell(int x, int y, int z, Fn fn) const
+	{
+		const uint32_t bucket = bucketOf(x, y, z);
+		for (uint32_t e = starts[bucket]; e < starts[bucket + 1]; e++) {
+			int c[3];
+			cellOf(point(e), c);
+			if (c[0] == x && c[1] == y && c[2] == z)
+				fn(e);
+		}
+	}
+
+	/**
+	* Slow path for radii spanning many cells, tests the cell of every
+	* candidate instead of tracking visited buckets.
+	*/
+	template <typename Fn>
+	void forEachInRadiusChecked(const float *p, float radius, int reach, const int *c, Fn &fn) const
+	{
+		const float radiusSq = radius * radius;
+		for (int z = c[2] - reach; z <= c[2] + reach; z++) {
+			for (int y = c[1] - reach; y <= c[1] + reach; y++) {
+				for (int x = c[0] - reach; x <= c[0] + reach; x++) {
+					const uint32_t bucket = bucketOf(x, y, z);
+					for (uint32_t e = starts[bucket]; e < starts[bucket + 1]; e++) {
+						const float *q = point(e);
+						int qc[3];
+						cellOf(q, qc);
+						if (qc[0] != x || qc[1] != y || qc[2] != z)
+							continue;
+
+						const float dx = q[0] - p[0], dy = q[1] - p[1], dz = q[2] - p[2];
+						const float distSq = dx * dx + dy * dy + dz * dz;
+						if (distSq <= radiusSq && !fn(e, distSq))
+							return;
+					}
+				}
+			}
+		}
+	}
+};
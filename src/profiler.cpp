@@ -0,0 +1,113 @@
+#include "profiler.h"
+
+#include <imgui.h>
+
+void Profiler::init()
+{
+	sections.clear();
+	current = -1;
+	frame = 0;
+}
+
+void Profiler::shutdown()
+{
+	for (auto &s : sections) {
+		if (s.queries[0] != 0)
+			glDeleteQueries(2, s.queries);
+	}
+	sections.clear();
+}
+
+size_t Profiler::section(const char *name)
+{
+	for (size_t i = 0; i < sections.size(); i++) {
+		if (sections[i].name == name)
+			return i;
+	}
+	sections.emplace_back();
+	sections.back().name = name;
+	return sections.size() - 1;
+}
+
+void Profiler::begin(const char *name)
+{
+	current = (int)section(name);
+	Section &s = sections[current];
+	if (s.queries[0] == 0)
+		glGenQueries(2, s.queries);
+
+	s.gpu = true;
+	s.issued[frame] = true;
+	glBeginQuery(GL_TIME_ELAPSED, s.queries[frame]);
+	cpuStart = std::chrono::high_resolution_clock::now();
+}
+
+void Profiler::end(size_t points)
+{
+	if (current < 0)
+		return;
+
+	Section &s = sections[current];
+	glEndQuery(GL_TIME_ELAPSED);
+	s.cpuMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - cpuStart).count();
+	s.points = points;
+	current = -1;
+}
+
+void Profiler::record(const char *name, double cpuMs, size_t points)
+{
+	Section &s = sections[section(name)];
+	s.cpuMs = cpuMs;
+	s.points = points;
+}
+
+void Profiler::counter(const char *name, double value)
+{
+	Section &s = sections[section(name)];
+	s.counter = true;
+	s.value = value;
+}
+
+void Profiler::newFrame(float delta)
+{
+	frameMs = delta * 1000.f;
+	frame = 1 - frame;
+
+	// This slot was issued an earlier frame, only read it if ready
+	for (auto &s : sections) {
+		if (!s.issued[frame])
+			continue;
+
+		GLint available = 0;
+		glGetQueryObjectiv(s.queries[frame], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) {
+			GLuint64 ns = 0;
+			glGetQueryObjectui64v(s.queries[frame], GL_QUERY_RESULT, &ns);
+			s.gpuMs = ns / 1000000.0;
+			s.issued[frame] = false;
+		}
+	}
+}
+
+void Profiler::draw()
+{
+	ImGui::Begin("- Profiler -");
+	ImGui::Text("Frame: %.2f ms (%.0f fps)", frameMs, frameMs > 0 ? 1000.f / frameMs : 0.f);
+	ImGui::Separator();
+	for (auto &s : sections) {
+		if (s.counter) {
+			ImGui::Text("%s: %g", s.name.c_str(), s.value);
+			continue;
+		}
+
+		if (s.gpu)
+			ImGui::Text("%s: cpu %.2f ms, gpu %.2f ms", s.name.c_str(), s.cpuMs, s.gpuMs);
+		else
+			ImGui::Text("%s: %.2f ms", s.name.c_str(), s.cpuMs);
+		if (s.points > 0) {
+			ImGui::SameLine();
+			ImGui::Text("[%zu pts]", s.points);
+		}
+	}
+	ImGui::End();
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+/**
+* Measures CPU and GPU time of named frame sections.
+* GPU times use double buffered timer queries so reading them never stalls,
+* which means they lag a couple of frames behind.
+*/
+class Profiler {
+public:
+	void init();
+	void shutdown();
+
+	/**
+	* Starts timing a section, sections must not be nested.
+	*/
+	void begin(const char *name);
+
+	/**
+	* Ends the current section, "points" is the amount of points it processed.
+	*/
+	void end(size_t points = 0);
+
+	/**
+	* Records a CPU only measurement for work done outside of a begin/end pair.
+	*/
+	void record(const char *name, double cpuMs, size_t points = 0);
+
+	/**
+	* Shows a named value that is not a time, e.g. a cache hit count.
+	*/
+	void counter(const char *name, double value);
+
+	/**
+	* Swaps the query buffers and collects last frame's results.
+	*/
+	void newFrame(float delta);
+
+	/**
+	* Draws the profiler ImGui window.
+	*/
+	void draw();
+
+private:
+	struct Section {
+		std::string name;
+		GLuint queries[2] = { 0, 0 };
+		bool issued[2] = { false, false };
+		double cpuMs = 0;
+		double gpuMs = 0;
+		size_t points = 0;
+		double value = 0;
+		bool gpu = false;
+		bool counter = false;
+	};
+
+	size_t section(const char *name);
+
+	std::vector<Section> sections;
+	int current = -1;
+	std::chrono::high_resolution_clock::time_point cpuStart;
+	int frame = 0;
+	float frameMs = 0;
+};
@@ -0,0 +1,97 @@
+#include "radix_sort.h"
+
+#include <algorithm>
+
+#include "parallel.h"
+
+#define RADIX_BITS 8
+#define RADIX_SIZE (1 << RADIX_BITS)
+#define RADIX_MIN_PER_WORKER (1 << 14)
+
+void radixSort(std::vector<uint32_t> &keys, std::vector<uint32_t> &values, int keyBits)
+{
+	const size_t count = keys.size();
+	if (count < 2)
+		return;
+
+	std::vector<uint32_t> tmpKeys(count);
+	std::vector<uint32_t> tmpValues(count);
+
+	// One histogram per worker, parallelFor splits the same way every pass
+	const size_t workers = parallelWorkers(count, RADIX_MIN_PER_WORKER);
+	std::vector<size_t> histograms(workers * RADIX_SIZE);
+
+	for (int shift = 0; shift < keyBits; shift += RADIX_BITS) {
+		// The last pass only looks at the bits left below keyBits
+		const uint32_t digitMask = keyBits - shift < RADIX_BITS ? (1u << (keyBits - shift)) - 1 : RADIX_SIZE - 1;
+		std::fill(histograms.begin(), histograms.end(), 0);
+
+		parallelFor(count, [&](size_t w, size_t begin, size_t end) {
+			size_t *h = &histograms[w * RADIX_SIZE];
+			for (size_t i = begin; i < end; i++)
+				h[(keys[i] >> shift) & digitMask]++;
+		}, RADIX_MIN_PER_WORKER);
+
+		// Exclusive prefix sum, digit major so each worker's output stays stable
+		size_t sum = 0;
+		bool skip = false;
+		for (size_t d = 0; d < RADIX_SIZE; d++) {
+			size_t digitCount = 0;
+			for (size_t w = 0; w < workers; w++) {
+				const size_t c = histograms[w * RADIX_SIZE + d];
+				histograms[w * RADIX_SIZE + d] = sum;
+				sum += c;
+				digitCount += c;
+			}
+			// Every key has the same digit so this pass would not move anything
+			if (digitCount == count)
+				skip = true;
+		}
+		if (skip)
+			continue;
+
+		parallelFor(count, [&](size_t w, size_t begin, size_t end) {
+			size_t *h = &histograms[w * RADIX_SIZE];
+			for (size_t i = begin; i < end; i++) {
+				const size_t dst = h[(keys[i] >> shift) & digitMask]++;
+				tmpKeys[dst] = keys[i];
+				tmpValues[dst] = values[i];
+			}
+		}, RADIX_MIN_PER_WORKER);
+
+		keys.swap(tmpKeys);
+		values.swap(tmpValues);
+	}
+}
+
+bool sortNearlySorted(std::vector<uint32_t> &keys, std::vector<uint32_t> &values, int keyBits)
+{
+	const uint32_t mask = keyBits >= 32 ? 0xffffffffu : ((1u << keyBits) - 1);
+	const size_t count = keys.size();
+
+	// Insertion sort is linear in the number of moves, give up once it would
+	// cost more than a radix sort
+	size_t budget = count / 2 + 64;
+	for (size_t i = 1; i < count; i++) {
+		const uint32_t key = keys[i];
+		if ((keys[i - 1] & mask) <= (key & mask))
+			continue;
+
+		const uint32_t value = values[i];
+		size_t j = i;
+		while (j > 0 && (keys[j - 1] & mask) > (key & mask) && budget > 0) {
+			keys[j] = keys[j - 1];
+			values[j] = values[j - 1];
+			j--;
+			budget--;
+		}
+		keys[j] = key;
+		values[j] = value;
+
+		if (budget == 0) {
+			radixSort(keys, values, keyBits);
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+/**
+* Sorts "values" by ascending "keys" with a stable parallel LSD radix sort.
+* Only the lowest "keyBits" bits of each key are considered, keys equal in
+* those keep their order whatever their higher bits.
+*/
+void radixSort(std::vector<uint32_t> &keys, std::vector<uint32_t> &values, int keyBits = 32);
+
+/**
+* Sorts a sequence which is expected to be almost in order already (e.g.
+* last frame's draw order) with a bounded insertion sort, falling back to
+* radixSort when too many moves are needed.
+* Returns true if the insertion sort was enough.
+*/
+bool sortNearlySorted(std::vector<uint32_t> &keys, std::vector<uint32_t> &values, int keyBits = 32);
@@ -0,0 +1,299 @@
+#include "ransac.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <random>
+
+#include <glm/glm.hpp>
+
+#include "morton.h"
+#include "parallel.h"
+#include "radix_sort.h"
+
+#define RANSAC_MAX_LEVEL 8
+#define RANSAC_SAMPLE_ATTEMPTS 32
+
+namespace {
+
+/**
+* Points sorted by Morton code, every octree cell is a contiguous range.
+*/
+struct ImplicitOctree {
+	std::vector<uint32_t> codes;
+	std::vector<uint32_t> order;
+
+	void build(const float *positions, size_t count)
+	{
+		glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+		for (size_t i = 0; i < count; i++) {
+			const glm::vec3 p(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2]);
+			min = glm::min(min, p);
+			max = glm::max(max, p);
+		}
+		const glm::vec3 extent = glm::max(max - min, glm::vec3(FLT_MIN));
+		const glm::vec3 invExtent = 1.f / extent;
+
+		codes.resize(count);
+		order.resize(count);
+		parallelFor(count, [&](size_t, size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				codes[i] = mortonCode(positions + i * 3, &min[0], &invExtent[0]);
+				order[i] = (uint32_t)i;
+			}
+		});
+		radixSort(codes, order, 30);
+	}
+
+	/**
+	* Range of sorted entries in the same cell as entry "i" at "level".
+	*/
+	void cell(size_t i, int level, size_t &first, size_t &last) const
+	{
+		const uint32_t mask = level <= 0 ? 0 : (0x3fffffffu << (30 - 3 * level)) & 0x3fffffffu;
+		const uint32_t lo = codes[i] & mask;
+		const uint32_t hi = lo | (~mask & 0x3fffffffu);
+		first = std::lower_bound(codes.begin(), codes.end(), lo) - codes.begin();
+		last = std::upper_bound(codes.begin() + first, codes.end(), hi) - codes.begin();
+	}
+};
+
+struct Candidate {
+	PrimitiveType type;
+	glm::vec3 a; // Plane normal or cylinder axis point
+	glm::vec3 b; // Cylinder axis
+	float d; // Plane offset or cylinder radius
+};
+
+inline glm::vec3 load(const float *data, size_t i)
+{
+	return glm::vec3(data[i * 3], data[i * 3 + 1], data[i * 3 + 2]);
+}
+
+/**
+* Tests if a point and its normal fit a candidate shape.
+*/
+inline bool compatible(const Candidate &c, const glm::vec3 &p, const float *normal, float epsilon, float minCos)
+{
+	if (c.type == PRIMITIVE_PLANE) {
+		if (fabsf(glm::dot(c.a, p) + c.d) > epsilon)
+			return false;
+		return normal == NULL || fabsf(glm::dot(c.a, glm::vec3(normal[0], normal[1], normal[2]))) >= minCos;
+	}
+
+	const glm::vec3 v = p - c.a;
+	const glm::vec3 radial = v - glm::dot(v, c.b) * c.b;
+	const float dist = glm::length(radial);
+	if (fabsf(dist - c.d) > epsilon || dist <= 0)
+		return false;
+	return fabsf(glm::dot(radial / dist, glm::vec3(normal[0], normal[1], normal[2]))) >= minCos;
+}
+
+bool planeFromSamples(const float *positions, const float *normals, const uint32_t *idx, float minCos, Candidate &c)
+{
+	const glm::vec3 p0 = load(positions, idx[0]);
+	const glm::vec3 n = glm::cross(load(positions, idx[1]) - p0, load(positions, idx[2]) - p0);
+	const float len = glm::length(n);
+	if (len <= FLT_EPSILON)
+		return false;
+
+	c.type = PRIMITIVE_PLANE;
+	c.a = n / len;
+	c.d = -glm::dot(c.a, p0);
+	if (normals == NULL)
+		return true;
+
+	for (int i = 0; i < 3; i++) {
+		if (fabsf(glm::dot(c.a, load(normals, idx[i]))) < minCos)
+			return false;
+	}
+	return true;
+}
+
+bool cylinderFromSamples(const float *positions, const float *normals, const uint32_t *idx, float epsilon, float maxRadius, Candidate &c)
+{
+	const glm::vec3 n0 = glm::normalize(load(normals, idx[0]));
+	const glm::vec3 n1 = glm::normalize(load(normals, idx[1]));
+	glm::vec3 axis = glm::cross(n0, n1);
+	const float len = glm::length(axis);
+	if (len < 0.05f)
+		return false;
+	axis /= len;
+
+	// Intersect the normal lines projected onto the plane across the axis
+	const glm::vec3 p0 = load(positions, idx[0]);
+	const glm::vec3 p1 = load(positions, idx[1]);
+	const glm::vec3 q0 = p0 - glm::dot(p0, axis) * axis;
+	const glm::vec3 q1 = p1 - glm::dot(p1, axis) * axis;
+	const glm::vec3 m0 = glm::normalize(n0 - glm::dot(n0, axis) * axis);
+	const glm::vec3 m1 = glm::normalize(n1 - glm::dot(n1, axis) * axis);
+
+	const glm::vec3 w = q0 - q1;
+	const float b = glm::dot(m0, m1);
+	const float denom = 1.f - b * b;
+	if (denom <= FLT_EPSILON)
+		return false;
+	const float t = (b * glm::dot(m1, w) - glm::dot(m0, w)) / denom;
+	const glm::vec3 center = q0 + t * m0;
+
+	const float r0 = glm::length(q0 - center);
+	const float r1 = glm::length(q1 - center);
+	if (fabsf(r0 - r1) > epsilon || r0 <= epsilon || r0 > maxRadius)
+		return false;
+
+	c.type = PRIMITIVE_CYLINDER;
+	c.a = center;
+	c.b = axis;
+	c.d = (r0 + r1) * 0.5f;
+	return true;
+}
+
+}
+
+void detectPrimitives(const float *positions, const float *normals, size_t count, const RansacOptions &options,
+	std::vector<Primitive> &primitives, std::vector<uint32_t> &labels)
+{
+	primitives.clear();
+	labels.assign(count, 0);
+	if (count < 3)
+		return;
+
+	ImplicitOctree octree;
+	octree.build(positions, count);
+
+	glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+	for (size_t i = 0; i < count; i++) {
+		min = glm::min(min, load(positions, i));
+		max = glm::max(max, load(positions, i));
+	}
+	const float maxRadius = glm::length(max - min) * 0.5f;
+
+	const float minCos = cosf(options.normalAngle * 3.14159265f / 180.f);
+	const bool cylinders = options.cylinders && normals != NULL;
+	std::mt19937 rng(options.seed);
+
+	size_t remaining = count;
+	int failures = 0;
+	std::vector<Candidate> candidates;
+	std::vector<size_t> scores;
+
+	while ((int)primitives.size() < options.maxPrimitives && failures < options.maxFailures && remaining >= options.minSupport) {
+		// Draw minimal sets from random octree cells so the samples are local
+		candidates.clear();
+		for (int c = 0; c < options.candidates; c++) {
+			for (int attempt = 0; attempt < RANSAC_SAMPLE_ATTEMPTS; attempt++) {
+				const size_t s = rng() % count;
+				if (labels[octree.order[s]] != 0)
+					continue;
+
+				size_t first, last;
+				octree.cell(s, 1 + (int)(rng() % RANSAC_MAX_LEVEL), first, last);
+				if (last - first < 3)
+					continue;
+
+				uint32_t idx[3] = { octree.order[s], 0, 0 };
+				bool valid = true;
+				for (int k = 1; k < 3 && valid; k++) {
+					idx[k] = octree.order[first + rng() % (last - first)];
+					valid = labels[idx[k]] == 0 && idx[k] != idx[0] && idx[k] != idx[k - 1];
+				}
+				if (!valid)
+					continue;
+
+				Candidate candidate;
+				const bool tryCylinder = cylinders && (!options.planes || rng() % 2 == 0);
+				if (tryCylinder ? cylinderFromSamples(positions, normals, idx, options.epsilon, maxRadius, candidate)
+					: (options.planes && planeFromSamples(positions, normals, idx, minCos, candidate))) {
+					candidates.push_back(candidate);
+					break;
+				}
+			}
+		}
+		if (candidates.empty()) {
+			failures++;
+			continue;
+		}
+
+		// Score every hypothesis against the unassigned points in parallel
+		const size_t workers = parallelWorkers(count);
+		scores.assign(workers * candidates.size(), 0);
+		parallelFor(count, [&](size_t w, size_t begin, size_t end) {
+			size_t *score = &scores[w * candidates.size()];
+			for (size_t i = begin; i < end; i++) {
+				if (labels[i] != 0)
+					continue;
+				const glm::vec3 p = load(positions, i);
+				const float *n = normals ? normals + i * 3 : NULL;
+				for (size_t c = 0; c < candidates.size(); c++)
+					score[c] += compatible(candidates[c], p, n, options.epsilon, minCos) ? 1 : 0;
+			}
+		});
+
+		size_t best = 0, bestScore = 0;
+		for (size_t c = 0; c < candidates.size(); c++) {
+			size_t score = 0;
+			for (size_t w = 0; w < workers; w++)
+				score += scores[w * candidates.size() + c];
+			if (score > bestScore) {
+				best = c;
+				bestScore = score;
+			}
+		}
+		if (bestScore < options.minSupport) {
+			failures++;
+			continue;
+		}
+		failures = 0;
+
+		// Assign the supporting points to the new primitive
+		const Candidate &c = candidates[best];
+		const uint32_t label = (uint32_t)primitives.size() + 1;
+		parallelFor(count, [&](size_t, size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				if (labels[i] == 0 && compatible(c, load(positions, i), normals ? normals + i * 3 : NULL, options.epsilon, minCos))
+					labels[i] = label;
+			}
+		});
+
+		Primitive primitive;
+		primitive.type = c.type;
+		primitive.support = bestScore;
+		if (c.type == PRIMITIVE_PLANE) {
+			primitive.params[0] = c.a.x;
+			primitive.params[1] = c.a.y;
+			primitive.params[2] = c.a.z;
+			primitive.params[3] = c.d;
+			primitive.params[4] = primitive.params[5] = primitive.params[6] = 0;
+		}
+		else {
+			for (int k = 0; k < 3; k++) {
+				primitive.params[k] = c.a[k];
+				primitive.params[3 + k] = c.b[k];
+			}
+			primitive.params[6] = c.d;
+		}
+		primitives.push_back(primitive);
+		remaining -= bestScore;
+	}
+}
+
+bool writePrimitives(const std::vector<Primitive> &primitives, const std::string &filename)
+{
+	FILE *file = fopen(filename.c_str(), "w");
+	if (file == NULL)
+		return false;
+
+	fprintf(file, "# plane nx ny nz d support\n# cylinder px py pz ax ay az radius support\n");
+	for (auto &p : primitives) {
+		if (p.type == PRIMITIVE_PLANE)
+			fprintf(file, "plane %f %f %f %f %zu\n", p.params[0], p.params[1], p.params[2], p.params[3], p.support);
+		else
+			fprintf(file, "cylinder %f %f %f %f %f %f %f %zu\n", p.params[0], p.params[1], p.params[2],
+				p.params[3], p.params[4], p.params[5], p.params[6], p.support);
+	}
+
+	bool ok = ferror(file) == 0;
+	fclose(file);
+	return ok;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+enum PrimitiveType {
+	PRIMITIVE_PLANE = 0,
+	PRIMITIVE_CYLINDER
+};
+
+/**
+* A detected shape. Planes store their normal and offset (n . p + d = 0),
+* cylinders a point on the axis, the axis direction and the radius.
+*/
+struct Primitive {
+	PrimitiveType type;
+	float params[7];
+	size_t support; // Points assigned to it
+};
+
+struct RansacOptions {
+	float epsilon = 0.01f; // Max distance of a point to the shape
+	float normalAngle = 20.f; // Max normal deviation in degrees
+	size_t minSupport = 500; // Smallest shape worth keeping
+	int candidates = 64; // Hypotheses scored per round
+	int maxPrimitives = 32;
+	int maxFailures = 8; // Rounds without a good shape before giving up
+	bool planes = true;
+	bool cylinders = true;
+	unsigned seed = 1;
+};
+
+/**
+* Detects planes and cylinders efficient RANSAC style. Minimal sample sets
+* are drawn from cells of an octree so they stay local, and every round's
+* hypotheses are scored in parallel against the unassigned points.
+* labels[i] is set to the 1 based primitive index of point i, or 0.
+*/
+void detectPrimitives(const float *positions, const float *normals, size_t count, const RansacOptions &options,
+	std::vector<Primitive> &primitives, std::vector<uint32_t> &labels);
+
+/**
+* Writes primitives as text, one per line.
+*/
+bool writePrimitives(const std::vector<Primitive> &primitives, const std::string &filename);
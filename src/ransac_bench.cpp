@@ -0,0 +1,159 @@
+///////////////////////////////////////////////////////////
+// pcv-ransac-bench: Primitive detection benchmarks      //
+///////////////////////////////////////////////////////////
+
+#include <iostream>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "parallel.h"
+#include "point_cloud.h"
+#include "ransac.h"
+
+/**
+* Command line options.
+*/
+struct BenchOptions {
+	std::vector<std::string> inputs;
+	RansacOptions ransac;
+	int runs = 3; // Best of this many runs per thread count
+	std::vector<unsigned> threads; // Empty runs 1, 2, 4, ... up to all hardware threads
+};
+
+static void usage()
+{
+	std::cerr << "Usage: pcv-ransac-bench <input.obj>... [options]\n"
+		"  --epsilon <size>    Max distance of a point to a shape (default: 0.01)\n"
+		"  --min-support <n>   Smallest shape worth keeping (default: 500)\n"
+		"  --planes-only       Skip cylinders\n"
+		"  --runs <count>      Runs per thread count, the fastest is reported (default: 3)\n"
+		"  --threads <count>   Run with this many worker threads, repeat for several (default: 1 up to all)\n";
+}
+
+static bool parseArgs(int argc, char **args, BenchOptions &options)
+{
+	for (int i = 1; i < argc; i++) {
+		const char *arg = args[i];
+		const bool hasValue = i + 1 < argc;
+		if (strcmp(arg, "--epsilon") == 0 && hasValue) {
+			options.ransac.epsilon = (float)atof(args[++i]);
+		}
+		else if (strcmp(arg, "--min-support") == 0 && hasValue) {
+			options.ransac.minSupport = (size_t)std::max(1, atoi(args[++i]));
+		}
+		else if (strcmp(arg, "--planes-only") == 0) {
+			options.ransac.cylinders = false;
+		}
+		else if (strcmp(arg, "--runs") == 0 && hasValue) {
+			options.runs = std::max(1, atoi(args[++i]));
+		}
+		else if (strcmp(arg, "--threads") == 0 && hasValue) {
+			options.threads.push_back((unsigned)std::max(1, atoi(args[++i])));
+		}
+		else if (arg[0] == '-') {
+			return false;
+		}
+		else {
+			options.inputs.push_back(arg);
+		}
+	}
+	return !options.inputs.empty();
+}
+
+/**
+* Detects the primitives of every cloud like the viewer does, labels are
+* numbered across the clouds. Returns the time it took in ms.
+*/
+static double detect(const std::vector<PointCloud> &clouds, const RansacOptions &options,
+	std::vector<Primitive> &primitives, std::vector<uint32_t> &labels)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	primitives.clear();
+	labels.clear();
+	std::vector<Primitive> found;
+	std::vector<uint32_t> cloudLabels;
+	for (auto &cloud : clouds) {
+		detectPrimitives(cloud.positions.data(), cloud.hasNormals() ? cloud.normals.data() : NULL, cloud.size(),
+			options, found, cloudLabels);
+		const uint32_t offset = (uint32_t)primitives.size();
+		for (auto label : cloudLabels)
+			labels.push_back(label != 0 ? label + offset : 0);
+		primitives.insert(primitives.end(), found.begin(), found.end());
+	}
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+/**
+* Times the detection across thread counts. Returns false if some thread
+* count found different primitives, the seed is fixed so it must not.
+*/
+static bool benchmark(const std::vector<PointCloud> &clouds, size_t points, const BenchOptions &options)
+{
+	std::vector<unsigned> threadCounts = options.threads;
+	const unsigned maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	for (unsigned threads = 1; options.threads.empty(); threads = std::min(threads * 2, maxThreads)) {
+		threadCounts.push_back(threads);
+		if (threads == maxThreads)
+			break;
+	}
+
+	bool same = true;
+	double baseMs = 0;
+	std::vector<Primitive> primitives;
+	std::vector<uint32_t> labels, firstLabels;
+	for (unsigned threads : threadCounts) {
+		workerLimit() = threads;
+		double ms = 0;
+		for (int run = 0; run < options.runs; run++) {
+			const double runMs = detect(clouds, options.ransac, primitives, labels);
+			ms = run == 0 ? runMs : std::min(ms, runMs);
+		}
+		if (baseMs == 0) {
+			baseMs = ms;
+			firstLabels = labels;
+		}
+		same = same && labels == firstLabels;
+
+		size_t planes = 0, assigned = 0;
+		for (auto &p : primitives) {
+			planes += p.type == PRIMITIVE_PLANE ? 1 : 0;
+			assigned += p.support;
+		}
+		printf("  %2u threads  %9.1f ms  %5.2fx  %8.2f M points/s  %3zu planes  %3zu cylinders  %5.1f%% assigned%s\n",
+			threads, ms, ms > 0 ? baseMs / ms : 0.0, ms > 0 ? points / (ms * 1000.0) : 0.0, planes, primitives.size() - planes,
+			points > 0 ? 100.0 * assigned / points : 0.0, labels == firstLabels ? "" : "  (differs from the first thread count)");
+	}
+	return same;
+}
+
+int main(int argc, char **args)
+{
+	BenchOptions options;
+	if (!parseArgs(argc, args, options)) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	bool same = true;
+	for (auto &input : options.inputs) {
+		std::vector<PointCloud> clouds;
+		std::string error;
+		if (!loadPointClouds(input, clouds, error)) {
+			std::cerr << error << "Cannot open " << input << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		size_t points = 0;
+		for (auto &cloud : clouds)
+			points += cloud.size();
+		std::cout << input << ": " << points << " points in " << clouds.size() << " shapes" << std::endl;
+		same = benchmark(clouds, points, options) && same;
+	}
+	return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
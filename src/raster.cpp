@@ -0,0 +1,259 @@
+#include "raster.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+
+#include "parallel.h"
+
+#define RASTER_NODATA -9999
+
+void Raster::init(float minU, float minV, float maxU, float maxV, float size, int up)
+{
+	cellSize = size > 0 ? size : 1;
+	upAxis = up;
+	originU = minU;
+	originV = minV;
+	firstRow = 0;
+	width = std::max(1, (int)floorf((maxU - minU) / cellSize) + 1);
+	height = std::max(1, (int)floorf((maxV - minV) / cellSize) + 1);
+	clear();
+}
+
+void Raster::resize(int columns, int rows, float minU, float minV, float size, int up, int first)
+{
+	cellSize = size > 0 ? size : 1;
+	upAxis = up;
+	originU = minU;
+	originV = minV;
+	firstRow = first;
+	width = std::max(1, columns);
+	height = std::max(1, rows);
+	clear();
+}
+
+void Raster::clear()
+{
+	counts.assign(cells(), 0);
+	minH.assign(cells(), FLT_MAX);
+	maxH.assign(cells(), -FLT_MAX);
+	sumH.assign(cells(), 0);
+}
+
+float Raster::value(RasterLayer layer, size_t cell) const
+{
+	if (layer == RASTER_COUNT)
+		return (float)counts[cell];
+	if (counts[cell] == 0)
+		return NAN;
+
+	switch (layer) {
+	case RASTER_MIN: return minH[cell];
+	case RASTER_MAX: return maxH[cell];
+	default: return sumH[cell] / counts[cell];
+	}
+}
+
+void rasterAxes(int upAxis, int &u, int &v)
+{
+	u = upAxis == 0 ? 1 : 0;
+	v = upAxis == 2 ? 1 : 2;
+}
+
+/**
+* Adds a range of points into the given cell arrays.
+*/
+static void binRange(const Raster &raster, const float *positions, size_t begin, size_t end,
+	uint32_t *counts, float *minH, float *maxH, float *sumH)
+{
+	int u, v;
+	rasterAxes(raster.upAxis, u, v);
+	for (size_t i = begin; i < end; i++) {
+		const float *p = positions + i * 3;
+		const float fx = (p[u] - raster.originU) / raster.cellSize;
+		const float fy = (p[v] - raster.originV) / raster.cellSize;
+		if (fx < 0 || fy < 0)
+			continue;
+
+		// Divided like the grid size was, so the points at the max corner land in the last cell
+		const int x = (int)fx;
+		const int y = (int)fy - raster.firstRow;
+		if (x >= raster.width || y < 0 || y >= raster.height)
+			continue;
+
+		const size_t cell = (size_t)y * raster.width + x;
+		const float h = p[raster.upAxis];
+		counts[cell]++;
+		minH[cell] = h < minH[cell] ? h : minH[cell];
+		maxH[cell] = h > maxH[cell] ? h : maxH[cell];
+		sumH[cell] += h;
+	}
+}
+
+void rasterizePoints(Raster &raster, const float *positions, size_t count)
+{
+	const size_t cells = raster.cells();
+	const size_t workers = parallelWorkers(count, 1 << 16);
+	if (workers == 1) {
+		binRange(raster, positions, 0, count, raster.counts.data(), raster.minH.data(), raster.maxH.data(), raster.sumH.data());
+		return;
+	}
+
+	// Private grids per worker, worker 0 writes straight into the raster
+	std::vector<std::vector<uint32_t>> counts(workers);
+	std::vector<std::vector<float>> minH(workers), maxH(workers), sumH(workers);
+	parallelFor(count, [&](size_t w, size_t begin, size_t end) {
+		if (w == 0) {
+			binRange(raster, positions, begin, end, raster.counts.data(), raster.minH.data(), raster.maxH.data(), raster.sumH.data());
+			return;
+		}
+		counts[w].assign(cells, 0);
+		minH[w].assign(cells, FLT_MAX);
+		maxH[w].assign(cells, -FLT_MAX);
+		sumH[w].assign(cells, 0);
+		binRange(raster, positions, begin, end, counts[w].data(), minH[w].data(), maxH[w].data(), sumH[w].data());
+	}, 1 << 16);
+
+	// Merge the private grids, split over cells
+	parallelFor(cells, [&](size_t, size_t begin, size_t end) {
+		for (size_t w = 1; w < workers; w++) {
+			if (counts[w].empty())
+				continue;
+			for (size_t c = begin; c < end; c++) {
+				if (counts[w][c] == 0)
+					continue;
+				raster.counts[c] += counts[w][c];
+				raster.minH[c] = std::min(raster.minH[c], minH[w][c]);
+				raster.maxH[c] = std::max(raster.maxH[c], maxH[w][c]);
+				raster.sumH[c] += sumH[w][c];
+			}
+		}
+	}, 1 << 14);
+}
+
+size_t fillRasterGaps(Raster &raster, int radius)
+{
+	if (radius <= 0)
+		return 0;
+
+	// Read from a copy so filled cells do not spread further
+	const Raster source = raster;
+	std::vector<size_t> filled(parallelWorkers(raster.height, 16), 0);
+
+	parallelFor(raster.height, [&](size_t w, size_t begin, size_t end) {
+		for (int y = (int)begin; y < (int)end; y++) {
+			for (int x = 0; x < raster.width; x++) {
+				const size_t cell = (size_t)y * raster.width + x;
+				if (source.counts[cell] > 0)
+					continue;
+
+				float minSum = 0, maxSum = 0, meanSum = 0;
+				int n = 0;
+				for (int ny = std::max(0, y - radius); ny <= std::min(raster.height - 1, y + radius); ny++) {
+					for (int nx = std::max(0, x - radius); nx <= std::min(raster.width - 1, x + radius); nx++) {
+						const size_t other = (size_t)ny * raster.width + nx;
+						if (source.counts[other] == 0)
+							continue;
+						minSum += source.minH[other];
+						maxSum += source.maxH[other];
+						meanSum += source.sumH[other] / source.counts[other];
+						n++;
+					}
+				}
+				if (n == 0)
+					continue;
+
+				raster.counts[cell] = 1;
+				raster.minH[cell] = minSum / n;
+				raster.maxH[cell] = maxSum / n;
+				raster.sumH[cell] = meanSum / n;
+				filled[w]++;
+			}
+		}
+	}, 16);
+
+	size_t total = 0;
+	for (size_t f : filled)
+		total += f;
+	return total;
+}
+
+/**
+* Blue to red ramp for t in [0, 1].
+*/
+static void heatColor(float t, uint8_t *rgb)
+{
+	t = std::min(std::max(t, 0.f), 1.f);
+	const float r = std::min(std::max(1.5f - fabsf(4.f * t - 3.f), 0.f), 1.f);
+	const float g = std::min(std::max(1.5f - fabsf(4.f * t - 2.f), 0.f), 1.f);
+	const float b = std::min(std::max(1.5f - fabsf(4.f * t - 1.f), 0.f), 1.f);
+	rgb[0] = (uint8_t)(r * 255);
+	rgb[1] = (uint8_t)(g * 255);
+	rgb[2] = (uint8_t)(b * 255);
+}
+
+void colorizeRaster(const Raster &raster, RasterLayer layer, std::vector<uint8_t> &rgba)
+{
+	const size_t cells = raster.cells();
+	rgba.assign(cells * 4, 0);
+
+	float lo = FLT_MAX, hi = -FLT_MAX;
+	for (size_t c = 0; c < cells; c++) {
+		if (raster.counts[c] == 0)
+			continue;
+		float value = raster.value(layer, c);
+		if (layer == RASTER_COUNT)
+			value = logf(value);
+		lo = std::min(lo, value);
+		hi = std::max(hi, value);
+	}
+	const float scale = hi > lo ? 1.f / (hi - lo) : 0.f;
+
+	parallelFor(cells, [&](size_t, size_t begin, size_t end) {
+		for (size_t c = begin; c < end; c++) {
+			if (raster.counts[c] == 0)
+				continue;
+			float value = raster.value(layer, c);
+			if (layer == RASTER_COUNT)
+				value = logf(value);
+			heatColor((value - lo) * scale, &rgba[c * 4]);
+			rgba[c * 4 + 3] = 255;
+		}
+	}, 1 << 14);
+}
+
+void writeAsciiGridHeader(FILE *file, int width, int height, float originU, float originV, float cellSize)
+{
+	fprintf(file, "ncols %d\nnrows %d\n", width, height);
+	fprintf(file, "xllcorner %f\nyllcorner %f\n", originU, originV);
+	fprintf(file, "cellsize %.9g\nNODATA_value %d\n", cellSize, RASTER_NODATA);
+}
+
+void writeAsciiGridRows(FILE *file, const Raster &raster, RasterLayer layer, int first, int last)
+{
+	for (int y = last - 1; y >= first; y--) {
+		for (int x = 0; x < raster.width; x++) {
+			const float value = raster.value(layer, (size_t)y * raster.width + x);
+			if (isnan(value))
+				fprintf(file, x > 0 ? " %d" : "%d", RASTER_NODATA);
+			else
+				fprintf(file, x > 0 ? " %.9g" : "%.9g", value); // Enough digits to read back the same float
+		}
+		fputc('\n', file);
+	}
+}
+
+bool writeAsciiGrid(const Raster &raster, RasterLayer layer, const std::string &filename)
+{
+	FILE *file = fopen(filename.c_str(), "w");
+	if (file == NULL)
+		return false;
+
+	writeAsciiGridHeader(file, raster.width, raster.height, raster.originU, raster.originV, raster.cellSize);
+	writeAsciiGridRows(file, raster, layer, 0, raster.height);
+
+	bool ok = ferror(file) == 0;
+	fclose(file);
+	return ok;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/**
+* Which per cell statistic of a raster to read.
+*/
+enum RasterLayer {
+	RASTER_COUNT = 0,
+	RASTER_MIN,
+	RASTER_MAX,
+	RASTER_MEAN
+};
+
+/**
+* A 2D grid of per cell point statistics, projected along the up axis.
+* Columns run along the first horizontal axis and rows along the second
+* one, e.g. X and Z when Y is up.
+*/
+struct Raster {
+	int width = 0;
+	int height = 0;
+	int upAxis = 1;
+	float originU = 0; // Min corner along the horizontal axes
+	float originV = 0;
+	float cellSize = 1;
+	int firstRow = 0; // Row of the whole grid at originV that this band starts at
+
+	std::vector<uint32_t> counts;
+	std::vector<float> minH;
+	std::vector<float> maxH;
+	std::vector<float> sumH;
+
+	/**
+	* Sizes the grid to cover the given horizontal extent and clears it.
+	*/
+	void init(float minU, float minV, float maxU, float maxV, float size, int up = 1);
+
+	/**
+	* Sets an exact grid layout and clears it. A band of a grid too big to
+	* keep whole starts at row "first" of the grid at (minU, minV), rows are
+	* found from that origin so every band bins points the same.
+	*/
+	void resize(int columns, int rows, float minU, float minV, float size, int up = 1, int first = 0);
+
+	/**
+	* Resets all cells to empty without changing the layout.
+	*/
+	void clear();
+
+	size_t cells() const { return (size_t)width * height; }
+
+	/**
+	* Value of a cell, NAN for empty cells unless reading the count.
+	*/
+	float value(RasterLayer layer, size_t cell) const;
+};
+
+/**
+* Horizontal axes for the given up axis.
+*/
+void rasterAxes(int upAxis, int &u, int &v);
+
+/**
+* Bins points into the raster in parallel. Every worker fills a private copy
+* of the grid and the copies are merged at the end. Can be called repeatedly
+* to add more points, points outside the grid are ignored.
+*/
+void rasterizePoints(Raster &raster, const float *positions, size_t count);
+
+/**
+* Fills empty cells with the average of the non empty cells within "radius"
+* cells around them, using the values from before the call. Filled cells get
+* a count of one. Returns the number of filled cells.
+*/
+size_t fillRasterGaps(Raster &raster, int radius);
+
+/**
+* Maps a layer to RGBA8 colors for display, empty cells are transparent.
+* Counts use a log scale so sparse areas stay visible.
+*/
+void colorizeRaster(const Raster &raster, RasterLayer layer, std::vector<uint8_t> &rgba);
+
+/**
+* Writes a layer as an ESRI ASCII grid, the first row written is the one
+* with the highest V coordinate as the format expects.
+*/
+bool writeAsciiGrid(const Raster &raster, RasterLayer layer, const std::string &filename);
+
+/**
+* Writes the header of an ESRI ASCII grid, for writing big grids in bands.
+*/
+void writeAsciiGridHeader(FILE *file, int width, int height, float originU, float originV, float cellSize);
+
+/**
+* Writes rows [first, last) of a layer from the top one down, with every
+* value written precisely enough to read back the same float.
+*/
+void writeAsciiGridRows(FILE *file, const Raster &raster, RasterLayer layer, int first, int last);
@@ -0,0 +1,258 @@
+//////////////////////////////////////////////////////////////
+// pcv-shm-producer: Point frames into a shared memory ring //
+//////////////////////////////////////////////////////////////
+
+#include <iostream>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <signal.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "obj_stream.h"
+#include "shm_ring.h"
+
+#define PRODUCER_READ_POINTS (1 << 22)
+
+/**
+* Set by SIGINT and SIGTERM, the frame loops stop so the ring is unlinked
+* on the way out instead of being left in /dev/shm.
+*/
+static volatile sig_atomic_t interrupted = 0;
+
+static void interrupt(int)
+{
+	interrupted = 1;
+}
+
+/**
+* Command line options.
+*/
+struct ProducerOptions {
+	std::string name;
+	std::string input; // Empty generates a waving grid
+	uint32_t points = 1000000;
+	uint32_t slots = 4;
+	double rate = 30; // Frames per second, 0 as fast as possible
+	uint64_t frames = 0; // 0 runs until interrupted
+	double benchSeconds = 0; // Runs the in process benchmark instead
+};
+
+static void usage()
+{
+	std::cerr << "Usage: pcv-shm-producer <name> [options]\n"
+		"  --input <file.obj>  Replay this cloud, rotating it every frame (default: a waving grid)\n"
+		"  --points <count>    Points per generated frame (default: 1000000)\n"
+		"  --slots <count>     Frames the ring holds (default: 4)\n"
+		"  --rate <fps>        Frames per second, 0 for as fast as possible (default: 30)\n"
+		"  --frames <count>    Stop after this many frames (default: run until interrupted)\n"
+		"  --bench <seconds>   Measure throughput and latency against a reader thread\n"
+		"Connect the viewer through View > Ingest using the same name, e.g. /pcv-frames.\n";
+}
+
+static bool parseArgs(int argc, char **args, ProducerOptions &options)
+{
+	int positional = 0;
+	for (int i = 1; i < argc; i++) {
+		const char *arg = args[i];
+		const bool hasValue = i + 1 < argc;
+		if (strcmp(arg, "--input") == 0 && hasValue) {
+			options.input = args[++i];
+		}
+		else if (strcmp(arg, "--points") == 0 && hasValue) {
+			options.points = (uint32_t)std::max(1, atoi(args[++i]));
+		}
+		else if (strcmp(arg, "--slots") == 0 && hasValue) {
+			options.slots = (uint32_t)std::max(2, atoi(args[++i]));
+		}
+		else if (strcmp(arg, "--rate") == 0 && hasValue) {
+			options.rate = std::max(0.0, atof(args[++i]));
+		}
+		else if (strcmp(arg, "--frames") == 0 && hasValue) {
+			options.frames = (uint64_t)std::max(0, atoi(args[++i]));
+		}
+		else if (strcmp(arg, "--bench") == 0 && hasValue) {
+			options.benchSeconds = std::max(0.1, atof(args[++i]));
+		}
+		else if (arg[0] == '-') {
+			return false;
+		}
+		else if (positional == 0) {
+			options.name = arg[0] == '/' ? arg : std::string("/") + arg;
+			positional++;
+		}
+		else {
+			return false;
+		}
+	}
+	return positional == 1;
+}
+
+/**
+* Writes frame "frame" of the source into the slot arrays, returns its size.
+*/
+static uint32_t fillFrame(const std::vector<float> &source, uint32_t points, uint64_t frame, float *positions, float *normals)
+{
+	const float angle = frame * 0.02f;
+	const float c = cosf(angle), s = sinf(angle);
+	if (!source.empty()) {
+		const size_t count = std::min<size_t>(source.size() / 3, points);
+		for (size_t i = 0; i < count; i++) {
+			const float *p = &source[i * 3];
+			positions[i * 3 + 0] = c * p[0] + s * p[2];
+			positions[i * 3 + 1] = p[1];
+			positions[i * 3 + 2] = -s * p[0] + c * p[2];
+		}
+		return (uint32_t)count;
+	}
+
+	// Waving square grid with analytic normals
+	const uint32_t side = std::max<uint32_t>((uint32_t)sqrtf((float)points), 1);
+	const float step = 2.f / side;
+	for (uint32_t z = 0, i = 0; z < side; z++) {
+		for (uint32_t x = 0; x < side; x++, i++) {
+			const float px = x * step - 1, pz = z * step - 1;
+			const float phase = px * 6 + angle * 5;
+			positions[i * 3 + 0] = px;
+			positions[i * 3 + 1] = 0.1f * sinf(phase);
+			positions[i * 3 + 2] = pz;
+			const float slope = 0.6f * cosf(phase);
+			const float length = sqrtf(slope * slope + 1);
+			normals[i * 3 + 0] = -slope / length;
+			normals[i * 3 + 1] = 1 / length;
+			normals[i * 3 + 2] = 0;
+		}
+	}
+	return side * side;
+}
+
+static double percentile(std::vector<double> &values, double p)
+{
+	if (values.empty())
+		return 0;
+	const size_t k = std::min(values.size() - 1, (size_t)(p * (values.size() - 1) + 0.5));
+	std::nth_element(values.begin(), values.begin() + k, values.end());
+	return values[k];
+}
+
+/**
+* Producer and a reader thread on the same ring. The reader copies every
+* frame it gets out of the mapping like an upload would, and measures the
+* time from commit until the copy is done.
+*/
+static int benchmark(ShmRingWriter &writer, const ProducerOptions &options, const std::vector<float> &source)
+{
+	ShmRingReader reader;
+	if (!reader.open(options.name)) {
+		std::cerr << "Cannot map " << options.name << " for reading" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::atomic<bool> running(true);
+	std::vector<double> latencies;
+	uint64_t consumed = 0, torn = 0, consumedPoints = 0;
+	std::thread consumer([&]() {
+		std::vector<float> upload((size_t)writer.maxPoints() * 6);
+		uint64_t next = 0;
+		ShmFrame frame;
+		while (running.load(std::memory_order_relaxed)) {
+			if (!reader.latest(next, frame)) {
+				std::this_thread::yield();
+				continue;
+			}
+			memcpy(upload.data(), frame.positions, frame.count * 3 * sizeof(float));
+			if (frame.normals)
+				memcpy(upload.data() + frame.count * 3, frame.normals, frame.count * 3 * sizeof(float));
+			if (!reader.valid(frame)) {
+				torn++;
+				continue;
+			}
+			latencies.push_back((shmTimestampNs() - frame.timestampNs) / 1e6);
+			consumedPoints += frame.count;
+			consumed++;
+			next = frame.number + 1;
+		}
+	});
+
+	auto start = std::chrono::steady_clock::now();
+	const auto end = start + std::chrono::duration<double>(options.benchSeconds);
+	uint64_t produced = 0, producedPoints = 0;
+	while (std::chrono::steady_clock::now() < end && !interrupted) {
+		float *positions, *normals;
+		writer.beginFrame(positions, normals);
+		const uint32_t count = fillFrame(source, options.points, produced, positions, normals);
+		writer.commitFrame(count, source.empty());
+		producedPoints += count;
+		produced++;
+		if (options.rate > 0)
+			std::this_thread::sleep_until(start + std::chrono::duration<double>(produced / options.rate));
+	}
+	running = false;
+	consumer.join();
+
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("produced %llu frames, %.2f M points/s\n", (unsigned long long)produced, producedPoints / seconds / 1e6);
+	printf("consumed %llu frames, %.2f M points/s, %llu skipped, %llu torn\n", (unsigned long long)consumed,
+		consumedPoints / seconds / 1e6, (unsigned long long)(produced - std::min(produced, consumed)), (unsigned long long)torn);
+	printf("latency ms: p50 %.3f  p90 %.3f  p99 %.3f  max %.3f\n", percentile(latencies, 0.5), percentile(latencies, 0.9),
+		percentile(latencies, 0.99), percentile(latencies, 1.0));
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char **args)
+{
+	ProducerOptions options;
+	if (!parseArgs(argc, args, options)) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	std::vector<float> source;
+	if (!options.input.empty()) {
+		ObjPointStream stream;
+		if (!stream.open(options.input)) {
+			std::cerr << "Cannot open " << options.input << std::endl;
+			return EXIT_FAILURE;
+		}
+		std::vector<float> batch;
+		while (stream.read(batch, PRODUCER_READ_POINTS))
+			source.insert(source.end(), batch.begin(), batch.end());
+		if (stream.failed()) {
+			std::cerr << stream.error() << std::endl;
+			return EXIT_FAILURE;
+		}
+		options.points = (uint32_t)std::max<size_t>(source.size() / 3, 1);
+	}
+
+	ShmRingWriter writer;
+	if (!writer.create(options.name, options.slots, options.points)) {
+		std::cerr << "Cannot create shared memory " << options.name << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::cout << options.name << ": " << options.slots << " slots of " << options.points << " points" << std::endl;
+
+	signal(SIGINT, interrupt);
+	signal(SIGTERM, interrupt);
+	if (options.benchSeconds > 0)
+		return benchmark(writer, options, source);
+
+	auto start = std::chrono::steady_clock::now();
+	for (uint64_t frame = 0; (options.frames == 0 || frame < options.frames) && !interrupted; frame++) {
+		float *positions, *normals;
+		writer.beginFrame(positions, normals);
+		writer.commitFrame(fillFrame(source, options.points, frame, positions, normals), source.empty());
+		if (options.rate > 0)
+			std::this_thread::sleep_until(start + std::chrono::duration<double>((frame + 1) / options.rate));
+		if (frame % 100 == 99)
+			std::cout << "\r" << frame + 1 << " frames" << std::flush;
+	}
+	std::cout << std::endl;
+	writer.close();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,192 @@
+#include "shm_ring.h"
+
+#include <chrono>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define SHM_SLOT_ALIGN 64
+
+namespace {
+
+size_t slotBytes(uint32_t maxPoints)
+{
+	const size_t bytes = SHM_SLOT_ALIGN + (size_t)maxPoints * 6 * sizeof(float);
+	return (bytes + SHM_SLOT_ALIGN - 1) / SHM_SLOT_ALIGN * SHM_SLOT_ALIGN;
+}
+
+}
+
+uint64_t shmTimestampNs()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ShmRingWriter::~ShmRingWriter()
+{
+	close();
+}
+
+#ifndef _WIN32
+
+bool ShmRingWriter::create(const std::string &ringName, uint32_t slots, uint32_t maxPoints)
+{
+	close();
+	if (slots == 0 || maxPoints == 0)
+		return false;
+
+	// A fresh object rather than truncating the old one, which would fault
+	// readers that still map it
+	shm_unlink(ringName.c_str());
+	const int fd = shm_open(ringName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0)
+		return false;
+	bytes = SHM_SLOT_ALIGN + slots * slotBytes(maxPoints);
+	void *memory = ftruncate(fd, (off_t)bytes) == 0 ? mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	::close(fd);
+	if (memory == MAP_FAILED) {
+		shm_unlink(ringName.c_str());
+		return false;
+	}
+
+	// Slots are zero filled by ftruncate, so every sequence starts out empty
+	name = ringName;
+	header = static_cast<ShmRingHeader *>(memory);
+	header->slots = slots;
+	header->maxPoints = maxPoints;
+	header->slotBytes = slotBytes(maxPoints);
+	header->version = SHM_RING_VERSION;
+	header->published.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	header->magic = SHM_RING_MAGIC;
+	frame = 0;
+	return true;
+}
+
+void ShmRingWriter::close()
+{
+	if (header == NULL)
+		return;
+	munmap(header, bytes);
+	shm_unlink(name.c_str());
+	header = NULL;
+}
+
+bool ShmRingReader::open(const std::string &name)
+{
+	close();
+	const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	void *memory = MAP_FAILED;
+	if (fstat(fd, &info) == 0 && (size_t)info.st_size >= SHM_SLOT_ALIGN) {
+		bytes = (size_t)info.st_size;
+		memory = mmap(NULL, bytes, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	::close(fd);
+	if (memory == MAP_FAILED)
+		return false;
+
+	// Reject objects that are not rings or do not fit their own layout
+	const ShmRingHeader *mapped = static_cast<const ShmRingHeader *>(memory);
+	if (mapped->magic != SHM_RING_MAGIC || mapped->version != SHM_RING_VERSION || mapped->slots == 0 ||
+		mapped->slotBytes < slotBytes(mapped->maxPoints) || SHM_SLOT_ALIGN + mapped->slots * mapped->slotBytes > bytes) {
+		munmap(memory, bytes);
+		return false;
+	}
+	header = mapped;
+	return true;
+}
+
+void ShmRingReader::close()
+{
+	if (header == NULL)
+		return;
+	munmap(const_cast<ShmRingHeader *>(header), bytes);
+	header = NULL;
+}
+
+#else
+
+bool ShmRingWriter::create(const std::string &, uint32_t, uint32_t) { return false; }
+void ShmRingWriter::close() {}
+bool ShmRingReader::open(const std::string &) { return false; }
+void ShmRingReader::close() {}
+
+#endif
+
+void ShmRingWriter::beginFrame(float *&positions, float *&normals)
+{
+	char *base = reinterpret_cast<char *>(header) + SHM_SLOT_ALIGN + (frame % header->slots) * header->slotBytes;
+	ShmSlotHeader *slot = reinterpret_cast<ShmSlotHeader *>(base);
+	slot->sequence.store(2 * frame + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	positions = reinterpret_cast<float *>(base + SHM_SLOT_ALIGN);
+	normals = positions + (size_t)header->maxPoints * 3;
+}
+
+void ShmRingWriter::commitFrame(uint32_t count, bool withNormals)
+{
+	char *base = reinterpret_cast<char *>(header) + SHM_SLOT_ALIGN + (frame % header->slots) * header->slotBytes;
+	ShmSlotHeader *slot = reinterpret_cast<ShmSlotHeader *>(base);
+	slot->count = count < header->maxPoints ? count : header->maxPoints;
+	slot->flags = withNormals ? SHM_FRAME_NORMALS : 0;
+	slot->timestampNs = shmTimestampNs();
+	slot->sequence.store(2 * frame + 2, std::memory_order_release);
+	header->published.store(frame + 1, std::memory_order_release);
+	frame++;
+}
+
+ShmRingReader::~ShmRingReader()
+{
+	close();
+}
+
+const ShmSlotHeader *ShmRingReader::slot(uint64_t frame) const
+{
+	const char *base = reinterpret_cast<const char *>(header) + SHM_SLOT_ALIGN + (frame % header->slots) * header->slotBytes;
+	return reinterpret_cast<const ShmSlotHeader *>(base);
+}
+
+uint64_t ShmRingReader::published() const
+{
+	return header ? header->published.load(std::memory_order_acquire) : 0;
+}
+
+bool ShmRingReader::latest(uint64_t first, ShmFrame &frame) const
+{
+	// The newest frame can be overwritten right away by a fast producer,
+	// then the one after it is complete too
+	for (int attempt = 0; attempt < 4; attempt++) {
+		const uint64_t published = this->published();
+		if (published == 0 || published <= first)
+			return false;
+
+		const uint64_t number = published - 1;
+		const ShmSlotHeader *s = slot(number);
+		if (s->sequence.load(std::memory_order_acquire) != 2 * number + 2)
+			continue;
+
+		frame.number = number;
+		frame.timestampNs = s->timestampNs;
+		frame.count = s->count < header->maxPoints ? s->count : header->maxPoints;
+		frame.positions = reinterpret_cast<const float *>(reinterpret_cast<const char *>(s) + SHM_SLOT_ALIGN);
+		frame.normals = s->flags & SHM_FRAME_NORMALS ? frame.positions + (size_t)header->maxPoints * 3 : NULL;
+		if (valid(frame))
+			return true;
+	}
+	return false;
+}
+
+bool ShmRingReader::valid(const ShmFrame &frame) const
+{
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return slot(frame.number)->sequence.load(std::memory_order_relaxed) == 2 * frame.number + 2;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+#define SHM_RING_MAGIC 0x52564350u // "PCVR"
+#define SHM_RING_VERSION 1
+#define SHM_FRAME_NORMALS 1u
+
+/**
+* Start of the shared memory object, followed by "slots" slots of
+* "slotBytes" each.
+*/
+struct ShmRingHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slots;
+	uint32_t maxPoints; // Capacity of every slot
+	uint64_t slotBytes;
+	std::atomic<uint64_t> published; // Frames completed so far
+};
+
+/**
+* Start of every slot, followed by the positions and then the normals, each
+* sized for "maxPoints". Frame "n" goes to slot n % slots. The sequence is
+* 2n + 1 while the producer writes frame n and 2n + 2 once it is complete, so
+* readers can tell a frame was overwritten while they used it.
+*/
+struct ShmSlotHeader {
+	std::atomic<uint64_t> sequence;
+	uint64_t timestampNs; // steady_clock time the frame was committed
+	uint32_t count;
+	uint32_t flags;
+};
+
+/**
+* A complete frame as seen by a reader, the arrays point into the mapping.
+*/
+struct ShmFrame {
+	uint64_t number = 0;
+	uint64_t timestampNs = 0;
+	uint32_t count = 0;
+	const float *positions = NULL;
+	const float *normals = NULL; // NULL if the frame has none
+};
+
+/**
+* Current steady_clock time in ns, the clock frame timestamps use.
+*/
+uint64_t shmTimestampNs();
+
+/**
+* Producer side of a point frame ring in POSIX shared memory. The producer
+* never waits for readers: when they fall behind the oldest frames are
+* overwritten, readers always go for the newest frame.
+*/
+class ShmRingWriter {
+public:
+	ShmRingWriter() {}
+	~ShmRingWriter();
+
+	/**
+	* Creates (or replaces) the shared memory object "name", e.g. "/pcv-frames".
+	*/
+	bool create(const std::string &name, uint32_t slots, uint32_t maxPoints);
+
+	/**
+	* Unmaps and unlinks the object, mapped readers keep their mapping.
+	*/
+	void close();
+
+	uint32_t maxPoints() const { return header ? header->maxPoints : 0; }
+
+	/**
+	* Arrays of the next frame's slot for the producer to fill in place.
+	*/
+	void beginFrame(float *&positions, float *&normals);
+
+	/**
+	* Publishes the frame started by beginFrame.
+	*/
+	void commitFrame(uint32_t count, bool withNormals);
+
+private:
+	ShmRingWriter(const ShmRingWriter &);
+	ShmRingWriter &operator=(const ShmRingWriter &);
+
+	std::string name;
+	ShmRingHeader *header = NULL;
+	size_t bytes = 0;
+	uint64_t frame = 0; // Frame being written
+};
+
+/**
+* Read only consumer side of a ring created by ShmRingWriter.
+*/
+class ShmRingReader {
+public:
+	ShmRingReader() {}
+	~ShmRingReader();
+
+	bool open(const std::string &name);
+	void close();
+	bool isOpen() const { return header != NULL; }
+
+	/**
+	* Newest complete frame if its number is "first" or later, false if
+	* there is none yet.
+	*/
+	bool latest(uint64_t first, ShmFrame &frame) const;
+
+	/**
+	* True if "frame" was not overwritten since latest returned it, checked
+	* after using its arrays.
+	*/
+	bool valid(const ShmFrame &frame) const;
+
+	/**
+	* Frames the producer has completed.
+	*/
+	uint64_t published() const;
+
+private:
+	ShmRingReader(const ShmRingReader &);
+	ShmRingReader &operator=(const ShmRingReader &);
+
+	const ShmSlotHeader *slot(uint64_t frame) const;
+
+	const ShmRingHeader *header = NULL;
+	size_t bytes = 0;
+};
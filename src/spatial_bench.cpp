@@ -0,0 +1,199 @@
+///////////////////////////////////////////////////////////
+// pcv-spatial-bench: Spatial index query benchmarks     //
+///////////////////////////////////////////////////////////
+
+#include <iostream>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "obj_stream.h"
+#include "spatial_query.h"
+
+#define BENCH_READ_POINTS (1 << 22)
+
+/**
+* Command line options.
+*/
+struct BenchOptions {
+	std::vector<std::string> inputs;
+	size_t queries = 100000;
+	size_t k = 16;
+	float radius = 0; // 0 picks twice the mean nearest neighbour distance
+	unsigned threads = 0; // 0 runs 1, 2, 4, ... up to all hardware threads
+};
+
+static void usage()
+{
+	std::cerr << "Usage: pcv-spatial-bench <input.obj>... [options]\n"
+		"  --queries <count>   Queries per benchmark (default: 100000)\n"
+		"  --k <count>         Neighbours per kNN query (default: 16)\n"
+		"  --radius <size>     Radius of radius and ray queries (default: from point spacing)\n"
+		"  --threads <count>   Only run with this many worker threads (default: 1 up to all)\n";
+}
+
+static bool parseArgs(int argc, char **args, BenchOptions &options)
+{
+	for (int i = 1; i < argc; i++) {
+		const char *arg = args[i];
+		const bool hasValue = i + 1 < argc;
+		if (strcmp(arg, "--queries") == 0 && hasValue) {
+			options.queries = (size_t)std::max(1, atoi(args[++i]));
+		}
+		else if (strcmp(arg, "--k") == 0 && hasValue) {
+			options.k = (size_t)std::max(1, atoi(args[++i]));
+		}
+		else if (strcmp(arg, "--radius") == 0 && hasValue) {
+			options.radius = (float)atof(args[++i]);
+		}
+		else if (strcmp(arg, "--threads") == 0 && hasValue) {
+			options.threads = (unsigned)std::max(0, atoi(args[++i]));
+		}
+		else if (arg[0] == '-') {
+			return false;
+		}
+		else {
+			options.inputs.push_back(arg);
+		}
+	}
+	return !options.inputs.empty();
+}
+
+/**
+* Runs "fn" and returns the time it took in ms.
+*/
+template <typename Fn>
+static double timeMs(Fn fn)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	fn();
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+static void report(const char *name, unsigned threads, size_t queries, size_t results, double ms)
+{
+	printf("  %-16s %2u threads  %9.1f ms  %8.2f M queries/s  %10zu results\n", name, threads, ms,
+		ms > 0 ? queries / (ms * 1000.0) : 0.0, results);
+}
+
+static void benchmark(const std::vector<float> &positions, const BenchOptions &options)
+{
+	const size_t count = positions.size() / 3;
+	float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (size_t i = 0; i < count; i++) {
+		for (int a = 0; a < 3; a++) {
+			lo[a] = std::min(lo[a], positions[i * 3 + a]);
+			hi[a] = std::max(hi[a], positions[i * 3 + a]);
+		}
+	}
+
+	workerLimit() = options.threads;
+	KdTree tree;
+	const double treeMs = timeMs([&]() { tree.build(positions.data(), count); });
+
+	// Queries at evenly strided points of the cloud, same set for every run
+	const size_t queries = options.queries;
+	std::vector<float> points(queries * 3), boxes(queries * 6), rays(queries * 6);
+	const size_t stride = std::max<size_t>(count / queries, 1);
+	for (size_t i = 0; i < queries; i++) {
+		for (int a = 0; a < 3; a++)
+			points[i * 3 + a] = positions[(i * stride % count) * 3 + a];
+	}
+
+	float radius = options.radius;
+	if (radius <= 0) {
+		QueryResults nearest;
+		batchNearestK(tree, points.data(), std::min<size_t>(queries, 1000), 2, FLT_MAX, nearest);
+		double sum = 0;
+		for (size_t i = 0; i < nearest.queries(); i++)
+			sum += nearest.count(i) > 1 ? sqrt(nearest.distSq[nearest.offsets[i] + 1]) : 0.0;
+		radius = std::max((float)(2 * sum / std::max<size_t>(nearest.queries(), 1)), FLT_MIN);
+	}
+
+	// Boxes of about k points, rays from outside the bounds towards the queries
+	const float half = radius * sqrtf((float)options.k) * 0.5f;
+	const float center[3] = { (lo[0] + hi[0]) / 2, (lo[1] + hi[1]) / 2, (lo[2] + hi[2]) / 2 };
+	const float extent = sqrtf((hi[0] - lo[0]) * (hi[0] - lo[0]) + (hi[1] - lo[1]) * (hi[1] - lo[1]) + (hi[2] - lo[2]) * (hi[2] - lo[2]));
+	for (size_t i = 0; i < queries; i++) {
+		const float *p = &points[i * 3];
+		float d[3] = { p[0] - center[0], p[1] - center[1], p[2] - center[2] };
+		const float length = std::max(sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]), FLT_MIN);
+		for (int a = 0; a < 3; a++) {
+			boxes[i * 6 + a] = p[a] - half;
+			boxes[i * 6 + 3 + a] = p[a] + half;
+			rays[i * 6 + a] = center[a] + d[a] / length * extent;
+			rays[i * 6 + 3 + a] = -d[a] / length;
+		}
+	}
+
+	PointGrid grid;
+	const double gridMs = timeMs([&]() { grid.build(positions.data(), count, radius); });
+	printf("  build            KD-tree %.1f ms, grid %.1f ms, radius %g\n", treeMs, gridMs, radius);
+
+	std::vector<unsigned> threadCounts;
+	const unsigned maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	if (options.threads > 0)
+		threadCounts.push_back(options.threads);
+	for (unsigned threads = 1; options.threads == 0; threads = std::min(threads * 2, maxThreads)) {
+		threadCounts.push_back(threads);
+		if (threads == maxThreads)
+			break;
+	}
+
+	QueryResults results;
+	std::vector<uint32_t> hits;
+	std::vector<float> t;
+	for (unsigned threads : threadCounts) {
+		workerLimit() = threads;
+		double ms = timeMs([&]() { batchNearestK(tree, points.data(), queries, options.k, FLT_MAX, results); });
+		report("kNN tree", threads, queries, results.entries.size(), ms);
+		ms = timeMs([&]() { batchRadius(tree, points.data(), queries, radius, results); });
+		report("radius tree", threads, queries, results.entries.size(), ms);
+		ms = timeMs([&]() { batchRadius(grid, points.data(), queries, radius, results); });
+		report("radius grid", threads, queries, results.entries.size(), ms);
+		ms = timeMs([&]() { batchBox(tree, boxes.data(), queries, results); });
+		report("box tree", threads, queries, results.entries.size(), ms);
+		ms = timeMs([&]() { batchBox(grid, boxes.data(), queries, results); });
+		report("box grid", threads, queries, results.entries.size(), ms);
+		ms = timeMs([&]() { batchRaycast(tree, rays.data(), queries, radius, FLT_MAX, hits, t); });
+		report("ray tree", threads, queries, queries - std::count(hits.begin(), hits.end(), SPATIAL_NO_HIT), ms);
+		ms = timeMs([&]() { batchRaycast(grid, rays.data(), queries, radius, FLT_MAX, hits, t); });
+		report("ray grid", threads, queries, queries - std::count(hits.begin(), hits.end(), SPATIAL_NO_HIT), ms);
+	}
+}
+
+int main(int argc, char **args)
+{
+	BenchOptions options;
+	if (!parseArgs(argc, args, options)) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	for (auto &input : options.inputs) {
+		ObjPointStream stream;
+		if (!stream.open(input)) {
+			std::cerr << "Cannot open " << input << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		std::vector<float> positions, batch;
+		while (stream.read(batch, BENCH_READ_POINTS))
+			positions.insert(positions.end(), batch.begin(), batch.end());
+		if (positions.empty()) {
+			std::cerr << "No points in " << input << std::endl;
+			continue;
+		}
+
+		std::cout << input << ": " << positions.size() / 3 << " points" << std::endl;
+		benchmark(positions, options);
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,41 @@
+#include "spatial_query.h"
+
+#include <algorithm>
+
+void joinQueryResults(std::vector<QueryResults> &parts, QueryResults &results)
+{
+	std::vector<size_t> queryStarts(parts.size() + 1, 0), entryStarts(parts.size() + 1, 0);
+	bool withDistances = true;
+	for (size_t w = 0; w < parts.size(); w++) {
+		queryStarts[w + 1] = queryStarts[w] + parts[w].queries();
+		entryStarts[w + 1] = entryStarts[w] + parts[w].entries.size();
+		withDistances = withDistances && parts[w].distSq.size() == parts[w].entries.size();
+	}
+
+	results.offsets.resize(queryStarts.back() + 1);
+	results.entries.resize(entryStarts.back());
+	results.distSq.resize(withDistances ? entryStarts.back() : 0);
+	results.offsets[0] = 0;
+	parallelFor(parts.size(), [&](size_t, size_t begin, size_t end) {
+		for (size_t w = begin; w < end; w++) {
+			const QueryResults &part = parts[w];
+			for (size_t i = 0; i < part.queries(); i++)
+				results.offsets[queryStarts[w] + i + 1] = entryStarts[w] + part.offsets[i + 1];
+			std::copy(part.entries.begin(), part.entries.end(), results.entries.begin() + entryStarts[w]);
+			if (withDistances)
+				std::copy(part.distSq.begin(), part.distSq.end(), results.distSq.begin() + entryStarts[w]);
+		}
+	}, 1);
+}
+
+void batchNearestK(const KdTree &tree, const float *points, size_t count, size_t k, float maxDistSq, QueryResults &results)
+{
+	batchQueries(count, results, [&](size_t i, std::vector<uint32_t> &entries, std::vector<float> &distSq) {
+		const size_t first = entries.size();
+		entries.resize(first + k);
+		distSq.resize(first + k);
+		const size_t found = tree.nearestK(points + i * 3, k, maxDistSq, &entries[first], &distSq[first]);
+		entries.resize(first + found);
+		distSq.resize(first + found);
+	});
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "kd_tree.h"
+#include "parallel.h"
+#include "point_grid.h"
+
+#define SPATIAL_QUERY_MIN_PER_WORKER 256
+#define SPATIAL_NO_HIT 0xffffffffu
+
+/**
+* Results of a batch of queries. The entries of query "i" are
+* entries[offsets[i]] up to entries[offsets[i + 1]], entries being indices
+* into the index's own order like the single queries return.
+*/
+struct QueryResults {
+	std::vector<size_t> offsets;
+	std::vector<uint32_t> entries;
+	std::vector<float> distSq; // Squared distances, kNN and radius queries only
+
+	size_t queries() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+	size_t count(size_t query) const { return offsets[query + 1] - offsets[query]; }
+};
+
+/**
+* Concatenates the results of consecutive query ranges in order.
+*/
+void joinQueryResults(std::vector<QueryResults> &parts, QueryResults &results);
+
+/**
+* Runs "count" queries across the workers. fn(i, entries, distSq) appends the
+* results of query "i". Every worker fills its own part and the parts are
+* joined in query order, so the results do not depend on the thread count.
+*/
+template <typename Fn>
+void batchQueries(size_t count, QueryResults &results, Fn fn)
+{
+	std::vector<QueryResults> parts(parallelWorkers(count, SPATIAL_QUERY_MIN_PER_WORKER));
+	parallelFor(count, [&](size_t w, size_t begin, size_t end) {
+		QueryResults &part = parts[w];
+		part.offsets.assign(1, 0);
+		for (size_t i = begin; i < end; i++) {
+			fn(i, part.entries, part.distSq);
+			part.offsets.push_back(part.entries.size());
+		}
+	}, SPATIAL_QUERY_MIN_PER_WORKER);
+	joinQueryResults(parts, results);
+}
+
+/**
+* Up to "k" nearest entries of every point in "points", ordered by distance.
+*/
+void batchNearestK(const KdTree &tree, const float *points, size_t count, size_t k, float maxDistSq, QueryResults &results);
+
+/**
+* Entries within "radius" of every point in "points".
+*/
+template <typename Index>
+void batchRadius(const Index &index, const float *points, size_t count, float radius, QueryResults &results)
+{
+	batchQueries(count, results, [&](size_t i, std::vector<uint32_t> &entries, std::vector<float> &distSq) {
+		index.inRadius(points + i * 3, radius, entries, distSq);
+	});
+}
+
+/**
+* Entries inside every box, "boxes" holds the min and max corner of each box.
+*/
+template <typename Index>
+void batchBox(const Index &index, const float *boxes, size_t count, QueryResults &results)
+{
+	batchQueries(count, results, [&](size_t i, std::vector<uint32_t> &entries, std::vector<float> &) {
+		index.inBox(boxes + i * 6, boxes + i * 6 + 3, entries);
+	});
+}
+
+/**
+* First hit of every ray, "rays" holds the origin and direction of each ray.
+* Misses get the entry SPATIAL_NO_HIT.
+*/
+template <typename Index>
+void batchRaycast(const Index &index, const float *rays, size_t count, float radius, float maxT,
+	std::vector<uint32_t> &hits, std::vector<float> &t)
+{
+	hits.resize(count);
+	t.resize(count);
+	parallelFor(count, [&](size_t, size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			if (!index.raycast(rays + i * 6, rays + i * 6 + 3, radius, maxT, hits[i], t[i])) {
+				hits[i] = SPATIAL_NO_HIT;
+				t[i] = maxT;
+			}
+		}
+	}, SPATIAL_QUERY_MIN_PER_WORKER);
+}
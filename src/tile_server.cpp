@@ -0,0 +1,283 @@
+///////////////////////////////////////////////////////////
+// pcv-tile-server: Point files over HTTP range requests //
+///////////////////////////////////////////////////////////
+
+#include <iostream>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define SERVER_MAX_HEADER (16 << 10)
+#define SERVER_SEND_CHUNK (1 << 20)
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/**
+* Command line options.
+*/
+struct ServerOptions {
+	std::string directory;
+	std::string bind = "127.0.0.1";
+	int port = 8080;
+	int latencyMs = 0; // Added before every response to emulate a remote server
+	bool verbose = false;
+};
+
+static void usage()
+{
+	std::cerr << "Usage: pcv-tile-server <directory> [options]\n"
+		"  --port <port>       Port to listen on, 0 picks a free one (default: 8080)\n"
+		"  --bind <address>    Address to listen on, 0.0.0.0 for every interface (default: 127.0.0.1)\n"
+		"  --latency <ms>      Delay every response, to try the fetch pipeline as if remote (default: 0)\n"
+		"  --verbose           Log every request\n"
+		"Serves the files of the directory, e.g. pcv-convert output, with HTTP/1.1 range\n"
+		"requests and persistent connections. Open them in the viewer with File > Open URL.\n";
+}
+
+static bool parseArgs(int argc, char **args, ServerOptions &options)
+{
+	int positional = 0;
+	for (int i = 1; i < argc; i++) {
+		const char *arg = args[i];
+		const bool hasValue = i + 1 < argc;
+		if (strcmp(arg, "--port") == 0 && hasValue) {
+			options.port = atoi(args[++i]);
+		}
+		else if (strcmp(arg, "--bind") == 0 && hasValue) {
+			options.bind = args[++i];
+		}
+		else if (strcmp(arg, "--latency") == 0 && hasValue) {
+			options.latencyMs = std::max(0, atoi(args[++i]));
+		}
+		else if (strcmp(arg, "--verbose") == 0) {
+			options.verbose = true;
+		}
+		else if (arg[0] == '-') {
+			return false;
+		}
+		else if (positional == 0) {
+			options.directory = arg;
+			positional++;
+		}
+		else {
+			return false;
+		}
+	}
+	return positional == 1 && options.port >= 0 && options.port < 65536;
+}
+
+#ifndef _WIN32
+
+static bool sendAll(int fd, const char *data, size_t bytes)
+{
+	while (bytes > 0) {
+		const ssize_t sent = send(fd, data, bytes, MSG_NOSIGNAL);
+		if (sent <= 0)
+			return false;
+		data += sent;
+		bytes -= (size_t)sent;
+	}
+	return true;
+}
+
+static bool sendStatus(int fd, const char *status, const std::string &headers = "")
+{
+	const std::string response = std::string("HTTP/1.1 ") + status + "\r\nContent-Length: 0\r\n" + headers + "\r\n";
+	return sendAll(fd, response.data(), response.size());
+}
+
+/**
+* Parses "bytes=first-last", "bytes=first-" and "bytes=-suffix" into an
+* inclusive range, false if it is not satisfiable.
+*/
+static bool parseRange(const std::string &value, uint64_t size, uint64_t &first, uint64_t &last)
+{
+	const size_t dash = value.find('-');
+	if (value.compare(0, 6, "bytes=") != 0 || dash == std::string::npos || value.find(',') != std::string::npos)
+		return false;
+	const std::string from = value.substr(6, dash - 6), to = value.substr(dash + 1);
+	if (from.empty()) {
+		const uint64_t suffix = strtoull(to.c_str(), NULL, 10);
+		if (suffix == 0 || size == 0)
+			return false;
+		first = suffix < size ? size - suffix : 0;
+		last = size - 1;
+		return true;
+	}
+	first = strtoull(from.c_str(), NULL, 10);
+	last = to.empty() ? size - 1 : std::min<uint64_t>(strtoull(to.c_str(), NULL, 10), size - 1);
+	return first < size && first <= last;
+}
+
+/**
+* Answers one request, false once the connection should close.
+*/
+static bool serveRequest(int fd, const ServerOptions &options, const std::string &request)
+{
+	const size_t methodEnd = request.find(' ');
+	const size_t pathEnd = request.find(' ', methodEnd + 1);
+	if (methodEnd == std::string::npos || pathEnd == std::string::npos) {
+		sendStatus(fd, "400 Bad Request", "Connection: close\r\n");
+		return false;
+	}
+	const std::string method = request.substr(0, methodEnd);
+	std::string path = request.substr(methodEnd + 1, pathEnd - methodEnd - 1);
+	path = path.substr(0, path.find('?'));
+
+	std::string range;
+	bool keepAlive = request.compare(pathEnd + 1, 8, "HTTP/1.0") != 0;
+	for (size_t line = request.find("\r\n"); line != std::string::npos; line = request.find("\r\n", line + 2)) {
+		const size_t end = request.find("\r\n", line + 2);
+		std::string header = request.substr(line + 2, end == std::string::npos ? std::string::npos : end - line - 2);
+		for (size_t i = 0; i < header.size() && header[i] != ':'; i++)
+			header[i] = (char)tolower((unsigned char)header[i]);
+		if (header.compare(0, 6, "range:") == 0)
+			range = header.substr(header.find_first_not_of(' ', 6));
+		else if (header.compare(0, 11, "connection:") == 0)
+			keepAlive = header.find("close") == std::string::npos && (keepAlive || header.find("eep-alive") != std::string::npos);
+	}
+	const std::string connection = keepAlive ? "" : "Connection: close\r\n";
+	if (options.latencyMs > 0)
+		std::this_thread::sleep_for(std::chrono::milliseconds(options.latencyMs));
+
+	if (method != "GET" && method != "HEAD")
+		return sendStatus(fd, "405 Method Not Allowed", "Allow: GET, HEAD\r\n" + connection) && keepAlive;
+
+	// Only plain files below the served directory
+	struct stat info;
+	const std::string file = options.directory + path;
+	const int input = path.empty() || path[0] != '/' || path.find("..") != std::string::npos ? -1 : open(file.c_str(), O_RDONLY);
+	if (input < 0 || fstat(input, &info) != 0 || !S_ISREG(info.st_mode)) {
+		if (input >= 0)
+			close(input);
+		return sendStatus(fd, "404 Not Found", connection) && keepAlive;
+	}
+
+	const uint64_t size = (uint64_t)info.st_size;
+	uint64_t first = 0, last = size - 1;
+	std::string headers = "Accept-Ranges: bytes\r\nContent-Type: application/octet-stream\r\n" + connection;
+	const char *status = "200 OK";
+	if (!range.empty()) {
+		if (!parseRange(range, size, first, last)) {
+			close(input);
+			return sendStatus(fd, "416 Range Not Satisfiable", "Content-Range: bytes */" + std::to_string(size) + "\r\n" + connection) && keepAlive;
+		}
+		status = "206 Partial Content";
+		headers += "Content-Range: bytes " + std::to_string(first) + "-" + std::to_string(last) + "/" + std::to_string(size) + "\r\n";
+	}
+	const uint64_t length = size > 0 ? last - first + 1 : 0;
+	const std::string head = std::string("HTTP/1.1 ") + status + "\r\nContent-Length: " + std::to_string(length) + "\r\n" + headers + "\r\n";
+	bool ok = sendAll(fd, head.data(), head.size());
+
+	std::vector<char> chunk(SERVER_SEND_CHUNK);
+	for (uint64_t offset = first; ok && method == "GET" && offset < first + length;) {
+		const size_t want = (size_t)std::min<uint64_t>(chunk.size(), first + length - offset);
+		const ssize_t read = pread(input, chunk.data(), want, (off_t)offset);
+		ok = read > 0 && sendAll(fd, chunk.data(), (size_t)read);
+		offset += read > 0 ? (uint64_t)read : 0;
+	}
+	close(input);
+
+	if (options.verbose)
+		std::cout << method << " " << path << " " << status << " " << first << "+" << length << std::endl;
+	return ok && keepAlive;
+}
+
+/**
+* Serves requests of one persistent connection until the client closes it.
+*/
+static void serveConnection(int fd, const ServerOptions &options)
+{
+	std::string pending;
+	std::vector<char> buffer(SERVER_MAX_HEADER);
+	for (;;) {
+		const size_t end = pending.find("\r\n\r\n");
+		if (end != std::string::npos) {
+			const std::string request = pending.substr(0, end);
+			pending.erase(0, end + 4);
+			if (!serveRequest(fd, options, request))
+				break;
+			continue;
+		}
+		if (pending.size() > SERVER_MAX_HEADER) {
+			sendStatus(fd, "431 Request Header Fields Too Large", "Connection: close\r\n");
+			break;
+		}
+		const ssize_t received = recv(fd, buffer.data(), buffer.size(), 0);
+		if (received <= 0)
+			break;
+		pending.append(buffer.data(), (size_t)received);
+	}
+	close(fd);
+}
+
+int main(int argc, char **args)
+{
+	ServerOptions options;
+	if (!parseArgs(argc, args, options)) {
+		usage();
+		return EXIT_FAILURE;
+	}
+	while (options.directory.size() > 1 && options.directory.back() == '/')
+		options.directory.pop_back();
+	signal(SIGPIPE, SIG_IGN);
+
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons((uint16_t)options.port);
+	const int listener = socket(AF_INET, SOCK_STREAM, 0);
+	const int one = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (listener < 0 || inet_pton(AF_INET, options.bind.c_str(), &address.sin_addr) != 1 ||
+		bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listener, 64) != 0) {
+		std::cerr << "Cannot listen on " << options.bind << ":" << options.port << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// Port 0 leaves the choice to the system, report the one it made
+	socklen_t addressLength = sizeof(address);
+	getsockname(listener, (struct sockaddr *)&address, &addressLength);
+	options.port = ntohs(address.sin_port);
+	std::cout << "Serving " << options.directory << " on http://" << options.bind << ":" << options.port << "/" << std::endl;
+
+	// A thread per connection, clients keep a few persistent ones each
+	for (;;) {
+		const int client = accept(listener, NULL, NULL);
+		if (client < 0)
+			continue;
+		setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		std::thread(serveConnection, client, options).detach();
+	}
+}
+
+#else
+
+int main(int argc, char **args)
+{
+	ServerOptions options;
+	if (!parseArgs(argc, args, options))
+		usage();
+	std::cerr << "pcv-tile-server needs POSIX sockets" << std::endl;
+	return EXIT_FAILURE;
+}
+
+#endif
@@ -0,0 +1,102 @@
+#include "voxel_grid.h"
+
+#include <math.h>
+#include <unordered_map>
+
+#include "parallel.h"
+
+#define VOXEL_SHARDS 64
+#define VOXEL_AXIS_BITS 21
+#define VOXEL_AXIS_OFFSET (1 << (VOXEL_AXIS_BITS - 1))
+
+namespace {
+
+struct Cell {
+	float normal[3];
+	uint32_t count;
+};
+
+typedef std::unordered_map<uint64_t, Cell> CellMap;
+
+inline uint64_t cellKey(const float *p, float invSize)
+{
+	const uint64_t mask = (1ull << VOXEL_AXIS_BITS) - 1;
+	const uint64_t x = (uint64_t)((int64_t)floorf(p[0] * invSize) + VOXEL_AXIS_OFFSET) & mask;
+	const uint64_t y = (uint64_t)((int64_t)floorf(p[1] * invSize) + VOXEL_AXIS_OFFSET) & mask;
+	const uint64_t z = (uint64_t)((int64_t)floorf(p[2] * invSize) + VOXEL_AXIS_OFFSET) & mask;
+	return x | (y << VOXEL_AXIS_BITS) | (z << (VOXEL_AXIS_BITS * 2));
+}
+
+inline float cellCenter(uint64_t key, int axis, float size)
+{
+	const int64_t i = (int64_t)((key >> (VOXEL_AXIS_BITS * axis)) & ((1ull << VOXEL_AXIS_BITS) - 1)) - VOXEL_AXIS_OFFSET;
+	return (i + 0.5f) * size;
+}
+
+inline size_t shardOf(uint64_t key)
+{
+	return (size_t)((key * 0x9E3779B97F4A7C15ull) >> 58) % VOXEL_SHARDS;
+}
+
+}
+
+void buildVoxelGrid(const float *positions, const float *normals, size_t count, float size, std::vector<Voxel> &voxels)
+{
+	voxels.clear();
+	if (count == 0 || size <= 0)
+		return;
+
+	const float invSize = 1.f / size;
+	const size_t workers = parallelWorkers(count);
+
+	// Each worker bins its range into a private map, split by shard so the
+	// merge can run in parallel over shards
+	std::vector<std::vector<std::pair<uint64_t, Cell>>> shards(workers * VOXEL_SHARDS);
+	parallelFor(count, [&](size_t w, size_t begin, size_t end) {
+		CellMap local;
+		for (size_t i = begin; i < end; i++) {
+			Cell &cell = local[cellKey(positions + i * 3, invSize)];
+			if (normals) {
+				cell.normal[0] += normals[i * 3 + 0];
+				cell.normal[1] += normals[i * 3 + 1];
+				cell.normal[2] += normals[i * 3 + 2];
+			}
+			cell.count++;
+		}
+		for (auto &c : local)
+			shards[w * VOXEL_SHARDS + shardOf(c.first)].push_back(c);
+	});
+
+	std::vector<std::vector<Voxel>> merged(VOXEL_SHARDS);
+	parallelFor(VOXEL_SHARDS, [&](size_t, size_t begin, size_t end) {
+		for (size_t s = begin; s < end; s++) {
+			CellMap cells;
+			for (size_t w = 0; w < workers; w++) {
+				for (auto &c : shards[w * VOXEL_SHARDS + s]) {
+					Cell &cell = cells[c.first];
+					cell.normal[0] += c.second.normal[0];
+					cell.normal[1] += c.second.normal[1];
+					cell.normal[2] += c.second.normal[2];
+					cell.count += c.second.count;
+				}
+			}
+
+			merged[s].reserve(cells.size());
+			for (auto &c : cells) {
+				Voxel v;
+				const float *n = c.second.normal;
+				const float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+				const float inv = len > 0 ? 1.f / len : 0.f;
+				for (int a = 0; a < 3; a++) {
+					v.center[a] = cellCenter(c.first, a, size);
+					v.normal[a] = n[a] * inv;
+				}
+				v.count = c.second.count;
+				merged[s].push_back(v);
+			}
+		}
+	}, 1);
+
+	for (auto &m : merged)
+		voxels.insert(voxels.end(), m.begin(), m.end());
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+* An occupied cell of a voxel grid.
+*/
+struct Voxel {
+	float center[3]; // Cell center
+	float normal[3]; // Average normal of the points inside
+	uint32_t count;
+};
+
+/**
+* Aggregates points into an occupancy grid with cells of the given size,
+* hashing quantized coordinates in parallel and averaging point normals per
+* cell. "normals" may be null. The output order is unspecified.
+*/
+void buildVoxelGrid(const float *positions, const float *normals, size_t count, float size, std::vector<Voxel> &voxels);